@@ -0,0 +1,36 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include <wil/result.h>
+
+#include "Globals.hpp"
+#include "Logging.hpp"
+#include "AsymmetryCalibration.hpp"
+#include "StatKernels.hpp"
+
+// Minimum spread between the shortest and longest window for the fit to mean anything
+#define CALIBRATION_MIN_SPREAD TIME_US(2)
+
+HRESULT FitAsymmetry(
+    _In_reads_(count) const int64_t *delays,
+    _In_reads_(count) const int64_t *readings,
+    size_t count,
+    _Out_ int64_t &asymmetryPpm) {
+    asymmetryPpm = ASYMMETRY_MIDPOINT_PPM;
+    if (!count)
+        return S_FALSE;
+
+    auto [shortest, longest] = std::minmax_element(delays, delays + count);
+    if (*longest - *shortest < CALIBRATION_MIN_SPREAD) {
+        DebugLog("Calibration delay spread %lld too small", *longest - *shortest);
+        return S_FALSE;
+    }
+
+    double slope;
+    if (!StatLeastSquaresSlope(delays, readings, count, slope))
+        return S_FALSE;
+    asymmetryPpm = std::clamp<int64_t>(std::llround(slope * 1000000), 0, 1000000);
+    DebugLog("Calibrated read point at %lld ppm of the window", asymmetryPpm);
+    return S_OK;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include <wil/result.h>
+
+#include "TimeMeasurement.hpp"
+
+// Read point assumed for an uncalibrated device: the middle of the measurement window
+#define ASYMMETRY_MIDPOINT_PPM 500000
+#define ASYMMETRY_CALIBRATION_BURST_LENGTH 64
+
+// Fit the read point to a burst of measurement delays and the Xen readings' distance from the start of the window
+HRESULT FitAsymmetry(
+    _In_reads_(count) const int64_t *delays,
+    _In_reads_(count) const int64_t *readings,
+    size_t count,
+    _Out_ int64_t &asymmetryPpm);
+
+// Estimate how far into the measurement window, in parts per million of its delay, the Xen reading is taken. Over a
+// short burst the true offset is constant, so XenTime - Begin grows with the delay at exactly that rate. Returns
+// S_FALSE with the midpoint if the burst's delays are too alike to fit. measure is any callable
+// HRESULT(_Out_ TimeMeasurement &).
+template <typename MeasureFn>
+HRESULT CalibrateAsymmetry(MeasureFn &&measure, _Out_ int64_t &asymmetryPpm) {
+    std::array<int64_t, ASYMMETRY_CALIBRATION_BURST_LENGTH> delays;
+    std::array<int64_t, ASYMMETRY_CALIBRATION_BURST_LENGTH> readings;
+
+    asymmetryPpm = ASYMMETRY_MIDPOINT_PPM;
+    for (size_t i = 0; i < delays.size(); i++) {
+        TimeMeasurement m;
+        RETURN_IF_FAILED(measure(m));
+        delays[i] = m.Delay();
+        readings[i] = static_cast<int64_t>(m.XenTime - m.Begin);
+    }
+    return FitAsymmetry(delays.data(), readings.data(), delays.size(), asymmetryPpm);
+}
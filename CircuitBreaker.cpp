@@ -0,0 +1,61 @@
+#include <algorithm>
+
+#include "CircuitBreaker.hpp"
+#include "PerfCounter.hpp"
+
+// Consecutive failures that open the circuit
+#define CIRCUIT_FAILURE_THRESHOLD 3
+#define CIRCUIT_BACKOFF_MIN_US 1000000ULL
+#define CIRCUIT_BACKOFF_MAX_US 300000000ULL
+
+bool CircuitBreaker::Allow() {
+    switch (_state) {
+    case CircuitBreakerOpen:
+        if (PerfCounterToUs(PerfCounterNow() - _openedAt) < _backoffUs) {
+            _refused++;
+            return false;
+        }
+        _state = CircuitBreakerHalfOpen;
+        return true;
+    default:
+        return true;
+    }
+}
+
+bool CircuitBreaker::RecordSuccess() {
+    auto changed = _state != CircuitBreakerClosed;
+
+    _state = CircuitBreakerClosed;
+    _failures = _refused = _failedProbes = 0;
+    _lastError = S_OK;
+    _backoffUs = 0;
+    return changed;
+}
+
+bool CircuitBreaker::RecordFailure(HRESULT hr) {
+    _failures++;
+    _lastError = hr;
+
+    switch (_state) {
+    case CircuitBreakerClosed:
+        if (_failures < CIRCUIT_FAILURE_THRESHOLD)
+            return false;
+        _backoffUs = CIRCUIT_BACKOFF_MIN_US;
+        break;
+    case CircuitBreakerHalfOpen:
+        _failedProbes++;
+        _backoffUs = std::min(_backoffUs * 2, CIRCUIT_BACKOFF_MAX_US);
+        break;
+    default:
+        return false;
+    }
+
+    _state = CircuitBreakerOpen;
+    _openedAt = PerfCounterNow();
+    return true;
+}
+
+void CircuitBreaker::ProbeNow() {
+    if (_state == CircuitBreakerOpen)
+        _state = CircuitBreakerHalfOpen;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+enum CircuitBreakerState {
+    CircuitBreakerClosed,
+    CircuitBreakerOpen,
+    CircuitBreakerHalfOpen,
+};
+
+// Stops repeating an operation that keeps failing. After enough consecutive failures the circuit opens and attempts
+// are refused until a backoff has elapsed. The next attempt is a probe, which either closes the circuit or reopens
+// it with the backoff doubled.
+class CircuitBreaker {
+public:
+    // Whether an attempt should be made now
+    bool Allow();
+    // Both return true if the state changed
+    bool RecordSuccess();
+    bool RecordFailure(HRESULT hr);
+    // Let the next attempt through as a probe, e.g. when conditions are known to have changed
+    void ProbeNow();
+
+    CircuitBreakerState GetState() const {
+        return _state;
+    }
+    ULONG64 GetFailures() const {
+        return _failures;
+    }
+    ULONG64 GetFailedProbes() const {
+        return _failedProbes;
+    }
+    ULONG64 GetRefused() const {
+        return _refused;
+    }
+    HRESULT GetLastError() const {
+        return _lastError;
+    }
+    ULONG64 GetBackoffUs() const {
+        return _backoffUs;
+    }
+
+private:
+    CircuitBreakerState _state = CircuitBreakerClosed;
+    // Consecutive failures, refused attempts and failed probes since the last success
+    ULONG64 _failures = 0;
+    ULONG64 _refused = 0;
+    ULONG64 _failedProbes = 0;
+    HRESULT _lastError = S_OK;
+    ULONG64 _openedAt = 0;
+    ULONG64 _backoffUs = 0;
+};
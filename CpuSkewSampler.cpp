@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <optional>
+#include <string>
+
+#include <wil/result.h>
+
+#include "Logging.hpp"
+#include "CpuSkewSampler.hpp"
+#include "StatKernels.hpp"
+
+// Weight of the newest observation in the per-vCPU jitter average
+#define CPU_JITTER_WEIGHT 8
+
+void CpuSkewSampler::EnumerateCpus() {
+    std::vector<CpuClock> cpus;
+    for (WORD group = 0; group < GetActiveProcessorGroupCount(); group++) {
+        auto count = GetActiveProcessorCount(group);
+        for (DWORD number = 0; number < count; number++) {
+            auto known = std::find_if(_cpus.begin(), _cpus.end(), [&](const CpuClock &cpu) {
+                return cpu.Cpu.Group == group && cpu.Cpu.Number == number;
+            });
+            if (known != _cpus.end()) {
+                cpus.push_back(*known);
+                continue;
+            }
+            cpus.emplace_back(CpuClock{
+                .Cpu = {.Group = group, .Number = static_cast<BYTE>(number), .Reserved = 0},
+            });
+        }
+    }
+    _cpus = std::move(cpus);
+    _skew.assign(_cpus.size() * _cpus.size(), 0);
+    _preferred = 0;
+}
+
+HRESULT CpuSkewSampler::BeginBurst() {
+    EnumerateCpus();
+    RETURN_IF_WIN32_BOOL_FALSE(GetThreadGroupAffinity(GetCurrentThread(), &_savedAffinity));
+    return S_OK;
+}
+
+void CpuSkewSampler::EndBurst() {
+    SetThreadGroupAffinity(GetCurrentThread(), &_savedAffinity, nullptr);
+}
+
+bool CpuSkewSampler::PinTo(_In_ const CpuClock &cpu) {
+    GROUP_AFFINITY affinity{
+        .Mask = static_cast<KAFFINITY>(1) << cpu.Cpu.Number,
+        .Group = cpu.Cpu.Group,
+        .Reserved = {},
+    };
+    return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr);
+}
+
+HRESULT CpuSkewSampler::EndSample(
+    signed __int64 asymmetryPpm,
+    std::optional<size_t> first,
+    _In_ const std::optional<TimeMeasurement> &closing,
+    _Out_ TimeMeasurement &best) {
+    if (!first)
+        return E_UNEXPECTED;
+
+    // The vCPUs are measured one after another, so the local clock's drift against Xen time over the sweep would
+    // show up as skew between the first and last. The first vCPU's two readings give that drift, which is taken out
+    // to give every offset as of the first reading.
+    auto start = _cpus[*first].Last.ReadTime(asymmetryPpm);
+    double drift = 0;
+    if (closing) {
+        auto elapsed = closing->ReadTime(asymmetryPpm) - start;
+        if (elapsed > 0)
+            drift = static_cast<double>(closing->Offset(asymmetryPpm) - _cpus[*first].Last.Offset(asymmetryPpm)) /
+                static_cast<double>(elapsed);
+    }
+
+    std::vector<signed __int64> offsets;
+    std::vector<signed __int64> sorted;
+    for (const auto &cpu : _cpus) {
+        auto elapsed = cpu.Valid ? cpu.Last.ReadTime(asymmetryPpm) - start : 0;
+        offsets.push_back(
+            cpu.Valid ? cpu.Last.Offset(asymmetryPpm) - static_cast<signed __int64>(drift * elapsed) : 0);
+        if (cpu.Valid)
+            sorted.push_back(offsets.back());
+    }
+    std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+    auto median = sorted[sorted.size() / 2];
+
+    // Jitter tracks how far each vCPU's offset moves relative to the group, so a local clock step or a host-wide
+    // change in Xen time does not count against any one vCPU. A vCPU that is steady but far from the others is
+    // steadily wrong, so the distance from the median counts against it too.
+    std::optional<size_t> preferred;
+    signed __int64 preferredScore = 0;
+    for (size_t i = 0; i < _cpus.size(); i++) {
+        auto &cpu = _cpus[i];
+        if (!cpu.Valid)
+            continue;
+        auto offset = offsets[i];
+        if (cpu.HasHistory) {
+            auto wander = (offset - cpu.Offset) - (median - _lastMedian);
+            if (wander < 0)
+                wander = -wander;
+            cpu.Jitter += (wander - cpu.Jitter) / CPU_JITTER_WEIGHT;
+        }
+        cpu.Offset = offset;
+        cpu.HasHistory = true;
+
+        auto distance = offset > median ? offset - median : median - offset;
+        auto score = cpu.Jitter + distance + cpu.Last.Delay() / 2;
+        if (!preferred || score < preferredScore) {
+            preferred = i;
+            preferredScore = score;
+        }
+    }
+    _lastMedian = median;
+    _preferred = *preferred;
+
+    _maxSkew = 0;
+    auto count = _cpus.size();
+    for (size_t i = 0; i < count; i++) {
+        for (size_t j = 0; j < count; j++) {
+            auto &skew = _skew[i * count + j];
+            skew = (_cpus[i].Valid && _cpus[j].Valid) ? _cpus[i].Offset - _cpus[j].Offset : 0;
+            _maxSkew = std::max(_maxSkew, skew);
+        }
+    }
+
+    best = _cpus[_preferred].Last;
+    return S_OK;
+}
+
+void CpuSkewSampler::Reset() {
+    _cpus.clear();
+    _skew.clear();
+    _maxSkew = 0;
+    _lastMedian = 0;
+    _preferred = 0;
+}
+
+void CpuSkewSampler::DebugLogSkew() const {
+    auto count = _cpus.size();
+    for (size_t i = 0; i < count; i++) {
+        std::string row;
+        for (size_t j = 0; j < count; j++) {
+            row += ' ';
+            row += std::to_string(_skew[i * count + j]);
+        }
+        DebugLog("CPU %u:%u skew:%s", _cpus[i].Cpu.Group, _cpus[i].Cpu.Number, row.c_str());
+    }
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <array>
+#include <optional>
+#include <vector>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include <wil/resource.h>
+#include <wil/result.h>
+
+#include "StatKernels.hpp"
+#include "TimeMeasurement.hpp"
+
+// Takes a short burst of measurements pinned to each vCPU in turn, tracks how each vCPU's view of Xen time wanders
+// relative to the others, and hands back the measurement from the most stable vCPU.
+class CpuSkewSampler {
+public:
+    // Measurements taken on each vCPU per sample; the lowest-delay one is kept
+    static constexpr size_t BurstLength = 4;
+
+    // measure is any callable HRESULT(_Out_ TimeMeasurement &). Offsets are taken at the read point that
+    // asymmetryPpm gives.
+    template <typename MeasureFn>
+    HRESULT Sample(MeasureFn &&measure, signed __int64 asymmetryPpm, _Out_ TimeMeasurement &best) {
+        RETURN_IF_FAILED(BeginBurst());
+        auto restore = wil::scope_exit([&] { EndBurst(); });
+
+        std::optional<size_t> first;
+        for (size_t i = 0; i < _cpus.size(); i++) {
+            auto &cpu = _cpus[i];
+            cpu.Valid = false;
+            if (!PinTo(cpu))
+                continue;
+            RETURN_IF_FAILED(MeasureBurst(measure, cpu.Last));
+            cpu.Valid = true;
+            if (!first)
+                first = i;
+        }
+
+        // The first vCPU is measured again at the end, so that the offsets can be brought to one point in time
+        std::optional<TimeMeasurement> closing;
+        if (first && _cpus.size() > 1 && PinTo(_cpus[*first])) {
+            TimeMeasurement m;
+            RETURN_IF_FAILED(MeasureBurst(measure, m));
+            closing = m;
+        }
+        restore.reset();
+        return EndSample(asymmetryPpm, first, closing, best);
+    }
+    void Reset();
+
+    size_t GetCpuCount() const {
+        return _cpus.size();
+    }
+    // Row-major: GetSkewMatrix()[i * GetCpuCount() + j] is the offset of CPU i minus the offset of CPU j
+    const std::vector<signed __int64> &GetSkewMatrix() const {
+        return _skew;
+    }
+    signed __int64 GetMaxSkew() const {
+        return _maxSkew;
+    }
+    PROCESSOR_NUMBER GetPreferredCpu() const {
+        return _cpus.empty() ? PROCESSOR_NUMBER{} : _cpus[_preferred].Cpu;
+    }
+    void DebugLogSkew() const;
+
+private:
+    struct CpuClock {
+        PROCESSOR_NUMBER Cpu;
+        TimeMeasurement Last;
+        // Xen minus local time at the read point, as of the sweep's first reading
+        signed __int64 Offset;
+        signed __int64 Jitter;
+        bool Valid;
+        bool HasHistory;
+    };
+
+    // Keeps the history of vCPUs that are still present, so that hot-added ones join the next sweep
+    void EnumerateCpus();
+    // Saves the thread's affinity, which EndBurst restores
+    HRESULT BeginBurst();
+    void EndBurst();
+    bool PinTo(_In_ const CpuClock &cpu);
+    // Updates the per-vCPU statistics from the sweep and picks the measurement to use
+    HRESULT EndSample(
+        signed __int64 asymmetryPpm,
+        std::optional<size_t> first,
+        _In_ const std::optional<TimeMeasurement> &closing,
+        _Out_ TimeMeasurement &best);
+
+    template <typename MeasureFn>
+    static HRESULT MeasureBurst(MeasureFn &measure, _Out_ TimeMeasurement &best) {
+        std::array<TimeMeasurement, BurstLength> burst;
+        std::array<int64_t, BurstLength> delays;
+        for (size_t i = 0; i < BurstLength; i++) {
+            RETURN_IF_FAILED(measure(burst[i]));
+            delays[i] = burst[i].Delay();
+        }
+        best = burst[StatMinIndex(delays.data(), delays.size())];
+        return S_OK;
+    }
+
+    std::vector<CpuClock> _cpus;
+    GROUP_AFFINITY _savedAffinity{};
+    std::vector<signed __int64> _skew;
+    signed __int64 _maxSkew = 0;
+    signed __int64 _lastMedian = 0;
+    size_t _preferred = 0;
+};
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cassert>
+#include <string>
+#include <utility>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <winioctl.h>
+
+#include <wil/resource.h>
+
+#include "xeniface_ioctls.h"
+#include "Borrowed.hpp"
+
+// XenStore key, relative to the domain's home path, where the bound port is published for the host agent
+#define EVENT_CHANNEL_STORE_KEY "data/xentimeprovider/event-channel"
+
+// Binds an unbound event channel that a host agent signals when the VM's wallclock or time offset changes, and
+// publishes its port in XenStore.
+class EventChannelNotifier {
+public:
+    EventChannelNotifier() = default;
+    EventChannelNotifier(HANDLE borrowed, USHORT remoteDomain, wistd::function<void()> &&callback)
+        : _borrowed(borrowed) {
+        wil::unique_event event(wil::EventOptions::ManualReset);
+
+        XENIFACE_EVTCHN_BIND_UNBOUND_IN in{
+            .RemoteDomain = remoteDomain,
+            .Mask = FALSE,
+            .Event = event.get(),
+        };
+        XENIFACE_EVTCHN_BIND_UNBOUND_OUT out{};
+
+        DWORD dummy;
+        THROW_IF_WIN32_BOOL_FALSE(DeviceIoControl(
+            _borrowed.Get(),
+            IOCTL_XENIFACE_EVTCHN_BIND_UNBOUND,
+            &in,
+            sizeof(in),
+            &out,
+            sizeof(out),
+            &dummy,
+            nullptr));
+        _port = out.LocalPort;
+
+        auto port = std::to_string(_port);
+        std::string payload = EVENT_CHANNEL_STORE_KEY;
+        payload += '\0';
+        payload += port;
+        payload += '\0';
+        payload += '\0';
+        if (!DeviceIoControl(
+                _borrowed.Get(),
+                IOCTL_XENIFACE_STORE_WRITE,
+                payload.data(),
+                static_cast<DWORD>(payload.size()),
+                nullptr,
+                0,
+                &dummy,
+                nullptr)) {
+            auto err = GetLastError();
+            Dispose();
+            THROW_WIN32(err);
+        }
+
+        // The channel is re-armed only after the callback has run, so that a burst of signals results in one resample
+        _watcher.create(
+            std::move(event),
+            [handle = _borrowed.Get(), localPort = _port, callback = std::move(callback)] {
+                if (callback)
+                    callback();
+                Unmask(handle, localPort);
+            });
+    }
+
+    EventChannelNotifier(const EventChannelNotifier &) = delete;
+    EventChannelNotifier &operator=(const EventChannelNotifier &) = delete;
+    EventChannelNotifier(EventChannelNotifier &&other) noexcept {
+        swap(*this, other);
+    }
+    EventChannelNotifier &operator=(EventChannelNotifier &&other) noexcept {
+        if (this != std::addressof(other)) {
+            Dispose();
+            swap(*this, other);
+        }
+        return *this;
+    }
+    ~EventChannelNotifier() {
+        Dispose();
+    }
+    void Reset() noexcept {
+        Dispose();
+    }
+    // Closes the port but leaves its XenStore key, which a binding on another device may already have replaced
+    void Abandon() noexcept {
+        Dispose(false);
+    }
+    explicit operator bool() const noexcept {
+        return static_cast<bool>(_borrowed);
+    }
+
+    friend void swap(EventChannelNotifier &self, EventChannelNotifier &other) noexcept {
+        using std::swap;
+        swap(self._borrowed, other._borrowed);
+        swap(self._watcher, other._watcher);
+        swap(self._port, other._port);
+    }
+
+private:
+    static void Unmask(HANDLE handle, ULONG port) noexcept {
+        XENIFACE_EVTCHN_UNMASK_IN in{.LocalPort = port};
+        DWORD dummy;
+        DeviceIoControl(handle, IOCTL_XENIFACE_EVTCHN_UNMASK, &in, sizeof(in), nullptr, 0, &dummy, nullptr);
+    }
+
+    void Dispose(bool removeKey = true) noexcept {
+        // Stop the watcher first so that no callback races with closing the port
+        _watcher.reset();
+        if (_borrowed) {
+            DWORD dummy;
+            if (removeKey)
+                DeviceIoControl(
+                    _borrowed.Get(),
+                    IOCTL_XENIFACE_STORE_REMOVE,
+                    const_cast<LPVOID>(static_cast<LPCVOID>(EVENT_CHANNEL_STORE_KEY)),
+                    sizeof(EVENT_CHANNEL_STORE_KEY),
+                    nullptr,
+                    0,
+                    &dummy,
+                    nullptr);
+
+            XENIFACE_EVTCHN_CLOSE_IN in{.LocalPort = _port};
+            DeviceIoControl(_borrowed.Get(), IOCTL_XENIFACE_EVTCHN_CLOSE, &in, sizeof(in), nullptr, 0, &dummy, nullptr);
+        }
+        _port = 0;
+        _borrowed.Reset();
+    }
+
+    Borrowed<HANDLE> _borrowed;
+    wil::unique_event_watcher _watcher;
+    ULONG _port = 0;
+};
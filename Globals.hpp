@@ -1,3 +1,9 @@
 #pragma once
 
 #define XenTimeProviderName L"XenTimeProvider"
+#define XenTimeProvidersKey L"SYSTEM\\CurrentControlSet\\Services\\W32Time\\TimeProviders\\"
+#define XenTimeProviderConfigKey XenTimeProvidersKey XenTimeProviderName
+
+#define TIME_US(_us) ((_us) * 10)
+#define TIME_MS(_ms) (TIME_US((_ms) * 1000))
+#define TIME_S(_s) (TIME_MS((_s) * 1000))
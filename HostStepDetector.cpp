@@ -0,0 +1,67 @@
+#include <algorithm>
+
+#include "HostStepDetector.hpp"
+#include "Globals.hpp"
+#include "PerfCounter.hpp"
+
+// Intervals observed before anything is classified as a step
+#define HOST_STEP_WARMUP 4
+// A step is a discrepancy of more than this many times the noise, and never less than the floor
+#define HOST_STEP_NOISE_MULTIPLE 8
+#define HOST_STEP_FLOOR TIME_MS(5)
+// Weight of a new interval in the drift and noise averages, as 1/n
+#define HOST_STEP_AVERAGE_WEIGHT 8
+// Largest gain of Xen time over an interval that is used to learn drift
+#define HOST_STEP_LEARN_MAX TIME_S(60)
+
+_Success_(return) bool HostStepDetector::Observe(int64_t xenTime, ULONG64 perfCounter, _Out_ int64_t &step) {
+    step = 0;
+    if (!_havePrevious || perfCounter <= _previousPerfCounter) {
+        _havePrevious = true;
+        _previousXenTime = xenTime;
+        _previousPerfCounter = perfCounter;
+        return false;
+    }
+
+    auto localElapsed = static_cast<int64_t>(TIME_US(PerfCounterToUs(perfCounter - _previousPerfCounter)));
+    auto xenElapsed = xenTime - _previousXenTime;
+    _previousXenTime = xenTime;
+    _previousPerfCounter = perfCounter;
+    if (!localElapsed)
+        return false;
+
+    // Intervals are at most a few poll periods long, so the products stay well within range
+    auto expected = localElapsed + localElapsed * _driftPpb / 1000000000;
+    auto residual = xenElapsed - expected;
+    auto magnitude = residual < 0 ? -residual : residual;
+
+    if (_intervals >= HOST_STEP_WARMUP && magnitude > GetStepBound()) {
+        // Measure the next interval from the new timeline, keeping what was learned about drift and noise
+        step = residual;
+        return true;
+    }
+
+    // Too far off to learn from without overflowing; only possible during warmup
+    auto gained = xenElapsed - localElapsed;
+    if (gained > HOST_STEP_LEARN_MAX || gained < -HOST_STEP_LEARN_MAX)
+        return false;
+
+    _intervals++;
+    auto ppb = gained * 1000000000 / localElapsed;
+    if (_intervals == 1) {
+        _driftPpb = ppb;
+        _noise = magnitude;
+    } else {
+        _driftPpb += (ppb - _driftPpb) / HOST_STEP_AVERAGE_WEIGHT;
+        _noise += (magnitude - _noise) / HOST_STEP_AVERAGE_WEIGHT;
+    }
+    return false;
+}
+
+void HostStepDetector::Reset() {
+    *this = HostStepDetector();
+}
+
+int64_t HostStepDetector::GetStepBound() const {
+    return std::max<int64_t>(_noise * HOST_STEP_NOISE_MULTIPLE, HOST_STEP_FLOOR);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+// Detects steps in the host's wallclock by comparing how far Xen time advanced between consecutive samples with how
+// far the local performance counter advanced. The difference normally follows a slow drift plus some noise; a
+// difference well outside the noise learned so far is classified as a step.
+class HostStepDetector {
+public:
+    // xenTime is in 100ns units. Returns true if the host stepped since the previous observation, with the size of
+    // the step in step.
+    _Success_(return) bool Observe(int64_t xenTime, ULONG64 perfCounter, _Out_ int64_t &step);
+    void Reset();
+
+    // Smallest discrepancy that currently counts as a step, in 100ns units
+    int64_t GetStepBound() const;
+
+private:
+    bool _havePrevious = false;
+    int64_t _previousXenTime = 0;
+    ULONG64 _previousPerfCounter = 0;
+    ULONG64 _intervals = 0;
+    // Xen time gained on the performance counter, in parts per billion
+    int64_t _driftPpb = 0;
+    // Moving average of how far intervals stray from the drift, in 100ns units
+    int64_t _noise = 0;
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include "InstrumentedMutex.hpp"
+
+struct XenTimeProviderStats {
+    ULONG64 Samples;
+    ULONG64 SamplesRejected;
+    ULONG64 SamplesDownweighted;
+    ULONG64 PerCpuBursts;
+    LONG64 MaxCpuSkew;
+    ULONG64 StartupLatencyUs;
+    ULONG64 TimeChangeEvents;
+    // Every sampling attempt, including failed ones
+    ULONG64 SampleAttempts;
+    ULONG64 SampleCostUsTotal;
+    ULONG64 SampleCostUsMax;
+    // Resumes, time jumps, failed updates and rejected samples, and how long until a sample got through again
+    ULONG64 Disruptions;
+    ULONG64 Recoveries;
+    ULONG64 RecoveryUsTotal;
+    ULONG64 RecoveryUsMax;
+    ULONG64 CircuitOpens;
+    ULONG64 CircuitProbes;
+    ULONG64 CircuitCloses;
+    // Polls answered without sampling because the circuit was open
+    ULONG64 SamplesSkipped;
+    ULONG64 AsymmetryCalibrations;
+    // Read point from the latest calibration, in parts per million of the measurement window
+    LONG64 AsymmetryPpm;
+    ULONG64 StoreReads;
+    ULONG64 StoreReadUsTotal;
+    ULONG64 StoreReadUsMax;
+    // Time change samples that were delayed further because XenStore looked congested
+    ULONG64 CongestedDelays;
+    ULONG64 HostSteps;
+    // Largest host step seen, in 100ns units
+    ULONG64 HostStepMax;
+    // Samples started again on a new device after failover took the one they were on
+    ULONG64 DeviceChangedRetries;
+};
+
+struct MeasurementWindowStats {
+    ULONG64 Windows;
+    ULONG64 Retries;
+    ULONG64 Contaminated;
+    // Windows where every attempt looked preempted and the lowest-delay one was used anyway
+    ULONG64 Exhausted;
+};
+
+struct XenIfaceWorkerStats {
+    LockStats Lock;
+    ULONG64 Arrivals;
+    ULONG64 Removals;
+    ULONG64 InterfaceRemovals;
+    // Full interface enumerations, and how many of them were forced by the registry being out of date
+    ULONG64 Enumerations;
+    ULONG64 Resyncs;
+    ULONG64 QueryRemoves;
+    ULONG64 QueryRemoveFailures;
+    ULONG64 Resumes;
+    ULONG64 TimeChanges;
+    ULONG64 DevicesOpened;
+    ULONG64 DevicesClosed;
+    // Device notifications for a device that was no longer active when the worker got to them
+    ULONG64 StaleRequests;
+    ULONG64 StandbysOpened;
+    // Standby devices promoted to active on query-remove, and the time from the notification to the promotion
+    ULONG64 Failovers;
+    ULONG64 FailoverUsTotal;
+    ULONG64 FailoverUsMax;
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <mutex>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include "PerfCounter.hpp"
+
+struct LockStats {
+    static constexpr size_t HistogramBuckets = 20;
+
+    ULONG64 Acquisitions;
+    ULONG64 Contended;
+    ULONG64 WaitUsTotal;
+    ULONG64 WaitUsMax;
+    ULONG64 HoldUsTotal;
+    ULONG64 HoldUsMax;
+    // Bucket i counts durations in [2^(i-1), 2^i) microseconds; bucket 0 counts durations under 1 us
+    std::array<ULONG64, HistogramBuckets> WaitHistogram;
+    std::array<ULONG64, HistogramBuckets> HoldHistogram;
+};
+
+// A std::mutex that records how long callers wait to acquire it and how long they hold it. Usable with
+// std::unique_lock and std::condition_variable_any.
+class InstrumentedMutex {
+public:
+    void lock() {
+        if (_mutex.try_lock()) {
+            _acquiredAt = PerfCounterNow();
+            _stats.Acquisitions++;
+            Record(0, _stats.WaitHistogram);
+            return;
+        }
+
+        auto start = PerfCounterNow();
+        _mutex.lock();
+        _acquiredAt = PerfCounterNow();
+        auto waitUs = PerfCounterToUs(_acquiredAt - start);
+        _stats.Acquisitions++;
+        _stats.Contended++;
+        _stats.WaitUsTotal += waitUs;
+        _stats.WaitUsMax = std::max(_stats.WaitUsMax, waitUs);
+        Record(waitUs, _stats.WaitHistogram);
+    }
+
+    bool try_lock() {
+        if (!_mutex.try_lock())
+            return false;
+        _acquiredAt = PerfCounterNow();
+        _stats.Acquisitions++;
+        Record(0, _stats.WaitHistogram);
+        return true;
+    }
+
+    void unlock() {
+        auto holdUs = PerfCounterToUs(PerfCounterNow() - _acquiredAt);
+        _stats.HoldUsTotal += holdUs;
+        _stats.HoldUsMax = std::max(_stats.HoldUsMax, holdUs);
+        Record(holdUs, _stats.HoldHistogram);
+        _mutex.unlock();
+    }
+
+    // Snapshot the statistics without counting as an acquisition
+    LockStats GetStats() {
+        std::lock_guard lock(_mutex);
+        return _stats;
+    }
+
+private:
+    static void Record(ULONG64 us, std::array<ULONG64, LockStats::HistogramBuckets> &histogram) {
+        auto bucket = std::min<size_t>(std::bit_width(us), LockStats::HistogramBuckets - 1);
+        histogram[bucket]++;
+    }
+
+    std::mutex _mutex;
+    _Guarded_by_(_mutex) ULONG64 _acquiredAt = 0;
+    _Guarded_by_(_mutex) LockStats _stats{};
+};
@@ -1,21 +1,25 @@
 #include <cstdio>
 #include <cstdarg>
 
-#include "Globals.hpp"
 #include "Logging.hpp"
 
-void TimeProvVLog(LogTimeProvEventFunc *logger, LogTimeProvEventType level, PCWSTR format, va_list args) {
+void TimeProvVLog(
+    LogTimeProvEventFunc *logger,
+    PCWSTR provider,
+    LogTimeProvEventType level,
+    PCWSTR format,
+    va_list args) {
     WCHAR buf[512];
 
     vswprintf_s(buf, format, args);
-    logger(level, const_cast<PWSTR>(XenTimeProviderName), buf);
+    logger(level, const_cast<PWSTR>(provider), buf);
 }
 
-void TimeProvLog(LogTimeProvEventFunc *logger, LogTimeProvEventType level, PCWSTR format, ...) {
+void TimeProvLog(LogTimeProvEventFunc *logger, PCWSTR provider, LogTimeProvEventType level, PCWSTR format, ...) {
     va_list args;
 
     va_start(args, format);
-    TimeProvVLog(logger, level, format, args);
+    TimeProvVLog(logger, provider, level, format, args);
     va_end(args);
 }
 
@@ -10,8 +10,13 @@ enum LogTimeProvEventType : WORD {
     LogTimeProvEventTypeInformation = 3,
 };
 
-void TimeProvVLog(LogTimeProvEventFunc *logger, LogTimeProvEventType level, PCWSTR format, va_list args);
-void TimeProvLog(LogTimeProvEventFunc *logger, LogTimeProvEventType level, PCWSTR format, ...);
+void TimeProvVLog(
+    LogTimeProvEventFunc *logger,
+    PCWSTR provider,
+    LogTimeProvEventType level,
+    PCWSTR format,
+    va_list args);
+void TimeProvLog(LogTimeProvEventFunc *logger, PCWSTR provider, LogTimeProvEventType level, PCWSTR format, ...);
 
 void VDebugLog(PCSTR format, va_list args);
 void DebugLog(PCSTR format, ...);
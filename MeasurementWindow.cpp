@@ -0,0 +1,67 @@
+#include <algorithm>
+
+#include "Globals.hpp"
+#include "Logging.hpp"
+#include "MeasurementWindow.hpp"
+#include "StatKernels.hpp"
+
+// Windows needed before the baseline is trusted
+#define WINDOW_MIN_HISTORY 8
+// A window is contaminated when its delay or tick gap exceeds FACTOR * baseline + floor
+#define WINDOW_BASELINE_FACTOR 3
+#define WINDOW_DELAY_FLOOR TIME_US(25)
+#define WINDOW_TICKS_FLOOR_US 25
+
+MeasurementBoost::MeasurementBoost(bool enable) {
+    if (!enable)
+        return;
+
+    auto priority = GetThreadPriority(GetCurrentThread());
+    if (priority != THREAD_PRIORITY_ERROR_RETURN &&
+        SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL))
+        _oldPriority = priority;
+
+    PROCESSOR_NUMBER cpu;
+    GetCurrentProcessorNumberEx(&cpu);
+    GROUP_AFFINITY affinity{
+        .Mask = static_cast<KAFFINITY>(1) << cpu.Number,
+        .Group = cpu.Group,
+        .Reserved = {},
+    };
+    GROUP_AFFINITY previous;
+    if (SetThreadGroupAffinity(GetCurrentThread(), &affinity, &previous))
+        _oldAffinity = previous;
+}
+
+MeasurementBoost::~MeasurementBoost() {
+    if (_oldAffinity)
+        SetThreadGroupAffinity(GetCurrentThread(), &*_oldAffinity, nullptr);
+    if (_oldPriority)
+        SetThreadPriority(GetCurrentThread(), *_oldPriority);
+}
+
+bool MeasurementWindow::IsContaminated(int64_t delay, int64_t ticksUs) const {
+    if (_count < WINDOW_MIN_HISTORY)
+        return false;
+
+    auto baselineDelay = _delays[StatMinIndex(_delays.data(), _count)];
+    auto baselineTicksUs = _ticksUs[StatMinIndex(_ticksUs.data(), _count)];
+    return delay > WINDOW_BASELINE_FACTOR * baselineDelay + WINDOW_DELAY_FLOOR ||
+        ticksUs > WINDOW_BASELINE_FACTOR * baselineTicksUs + WINDOW_TICKS_FLOOR_US;
+}
+
+void MeasurementWindow::RecordContaminated(int64_t delay, int64_t ticksUs) {
+    _stats.Contaminated++;
+    DebugLog("Measurement window contaminated: delay %lld, ticks %lld us", delay, ticksUs);
+}
+
+void MeasurementWindow::Record(int64_t delay, int64_t ticksUs) {
+    _delays[_next] = delay;
+    _ticksUs[_next] = ticksUs;
+    _next = (_next + 1) % HistorySize;
+    _count = std::min(_count + 1, HistorySize);
+}
+
+void MeasurementWindow::Reset() {
+    _next = _count = 0;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include <wil/result.h>
+
+#include "Instrumentation.hpp"
+#include "PerfCounter.hpp"
+#include "TimeMeasurement.hpp"
+
+// Raises the thread's priority and pins it to its current CPU for as long as it exists
+class MeasurementBoost {
+public:
+    explicit MeasurementBoost(bool enable);
+    ~MeasurementBoost();
+    MeasurementBoost(const MeasurementBoost &) = delete;
+    MeasurementBoost &operator=(const MeasurementBoost &) = delete;
+
+private:
+    std::optional<int> _oldPriority;
+    std::optional<GROUP_AFFINITY> _oldAffinity;
+};
+
+// Takes a measurement and, within a small budget, retries it if the window looks like the thread was preempted:
+// either its delay or the performance counter ticks it spanned are far above the lowest seen recently.
+class MeasurementWindow {
+public:
+    static constexpr size_t HistorySize = 32;
+    // Extra attempts allowed per measurement when the window looks preempted
+    static constexpr int RetryBudget = 3;
+
+    // measure is any callable HRESULT(_Out_ TimeMeasurement &), e.g. SamplePipeline::Measure. boost raises the
+    // thread's priority and pins it to its current CPU for each attempt.
+    template <typename MeasureFn>
+    HRESULT Measure(MeasureFn &&measure, bool boost, _Out_ TimeMeasurement &best) {
+        int64_t bestTicksUs = 0;
+        bool clean = false;
+
+        _stats.Windows++;
+        for (int attempt = 0; attempt <= RetryBudget; attempt++) {
+            TimeMeasurement m;
+
+            if (attempt > 0)
+                _stats.Retries++;
+            {
+                MeasurementBoost boosted(boost);
+                m.PerfCounterBegin = PerfCounterNow();
+                RETURN_IF_FAILED(measure(m));
+                m.PerfCounterEnd = PerfCounterNow();
+            }
+            auto ticksUs = static_cast<int64_t>(PerfCounterToUs(m.PerfCounterEnd - m.PerfCounterBegin));
+            if (attempt == 0 || m.Delay() < best.Delay()) {
+                best = m;
+                bestTicksUs = ticksUs;
+            }
+
+            if (!IsContaminated(m.Delay(), ticksUs)) {
+                clean = true;
+                break;
+            }
+            RecordContaminated(m.Delay(), ticksUs);
+        }
+        if (!clean)
+            _stats.Exhausted++;
+
+        // Even a contaminated best goes into the history, so a lasting rise in delay eventually becomes the baseline
+        Record(best.Delay(), bestTicksUs);
+        return S_OK;
+    }
+    void Reset();
+
+    const MeasurementWindowStats &GetStats() const {
+        return _stats;
+    }
+
+private:
+    bool IsContaminated(int64_t delay, int64_t ticksUs) const;
+    void RecordContaminated(int64_t delay, int64_t ticksUs);
+    void Record(int64_t delay, int64_t ticksUs);
+
+    std::array<int64_t, HistorySize> _delays{};
+    std::array<int64_t, HistorySize> _ticksUs{};
+    size_t _next = 0, _count = 0;
+    MeasurementWindowStats _stats{};
+};
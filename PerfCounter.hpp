@@ -0,0 +1,29 @@
+#pragma once
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+inline ULONG64 PerfCounterNow() {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return static_cast<ULONG64>(now.QuadPart);
+}
+
+inline ULONG64 PerfCounterFrequency() {
+    static const ULONG64 frequency = [] {
+        LARGE_INTEGER freq;
+        QueryPerformanceFrequency(&freq);
+        return static_cast<ULONG64>(freq.QuadPart);
+    }();
+    return frequency;
+}
+
+inline ULONG64 PerfCounterToUs(ULONG64 ticks) {
+    auto frequency = PerfCounterFrequency();
+    return ticks / frequency * 1000000 + ticks % frequency * 1000000 / frequency;
+}
+
+inline ULONG64 PerfCounterTo100ns(ULONG64 ticks) {
+    auto frequency = PerfCounterFrequency();
+    return ticks / frequency * 10000000 + ticks % frequency * 10000000 / frequency;
+}
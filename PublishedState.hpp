@@ -0,0 +1,39 @@
+#pragma once
+
+#include <atomic>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include "xentimeapi.h"
+
+// Shared memory and events through which the provider publishes its samples to xentimeapi.h consumers
+#define PUBLISHED_STATE_NAME L"Global\\XenTimeProviderState"
+#define PUBLISHED_EVENT_NAME_0 L"Global\\XenTimeProviderEvent0"
+#define PUBLISHED_EVENT_NAME_1 L"Global\\XenTimeProviderEvent1"
+
+#define PUBLISHED_STATE_MAGIC 'XTPS'
+#define PUBLISHED_STATE_VERSION 1
+
+struct PublishedData {
+    ULONG SampleCount;
+    // Slot the next sample goes into; the newest is the one before it
+    ULONG SampleNext;
+    // Rate of Xen time against the performance counter, less one, in parts per billion
+    LONG64 DriftPpb;
+    ULONG64 ResumeCount;
+    ULONG64 OffsetChangeCount;
+    XENTIME_SAMPLE Samples[XENTIME_MAX_SAMPLES];
+};
+
+struct PublishedState {
+    ULONG Magic;
+    ULONG Version;
+    // Odd while the provider is updating Data
+    std::atomic<ULONG> Sequence;
+    PublishedData Data;
+    // Incremented for each notification. Waiters for generation g wait on event g % 2, which the provider sets when
+    // moving on from g, after resetting the event for g + 1.
+    std::atomic<ULONG64> Generation;
+};
+static_assert(std::atomic<ULONG>::is_always_lock_free && std::atomic<ULONG64>::is_always_lock_free);
@@ -0,0 +1,140 @@
+#include <cstring>
+
+#include <wil/result.h>
+#include <wil/resource.h>
+
+#include "PerfCounter.hpp"
+#include "SampleArchive.hpp"
+
+#define SAMPLE_ARCHIVE_MAX_BYTES (64ULL * 1024 * 1024)
+// The block being filled is written once this many samples are pending, or the oldest has waited this long; a killed
+// service loses at most that much of its archive
+#define SAMPLE_ARCHIVE_BATCH_SAMPLES 16
+#define SAMPLE_ARCHIVE_BATCH_MAX_US 60000000
+
+HRESULT SampleArchiveWriter::Open(_In_ const std::filesystem::path &path) {
+    std::error_code ec;
+
+    Flush();
+    _file.close();
+    _file.clear();
+    auto size = std::filesystem::exists(path, ec) ? std::filesystem::file_size(path, ec) : 0;
+    if (ec)
+        return HRESULT_FROM_WIN32(ec.value());
+
+    if (!size) {
+        _file.open(path, std::ios::binary | std::ios::out | std::ios::trunc);
+        if (!_file)
+            return E_ACCESSDENIED;
+        SampleArchiveHeader header{
+            .Magic = SAMPLE_ARCHIVE_MAGIC,
+            .Version = SAMPLE_ARCHIVE_VERSION,
+            .Reserved = 0,
+            .BlockSize = SAMPLE_ARCHIVE_BLOCK_SIZE,
+            .Reserved2 = 0,
+        };
+        if (!_file.write(reinterpret_cast<const char *>(&header), sizeof(header)) || !_file.flush())
+            return E_FAIL;
+        size = sizeof(header);
+    } else {
+        _file.open(path, std::ios::binary | std::ios::in | std::ios::out);
+        if (!_file)
+            return E_ACCESSDENIED;
+        SampleArchiveHeader header;
+        if (!_file.read(reinterpret_cast<char *>(&header), sizeof(header)))
+            return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        RETURN_HR_IF(HRESULT_FROM_WIN32(ERROR_INVALID_DATA), header.Magic != SAMPLE_ARCHIVE_MAGIC);
+        RETURN_HR_IF(
+            HRESULT_FROM_WIN32(ERROR_REVISION_MISMATCH),
+            header.Version != SAMPLE_ARCHIVE_VERSION || header.BlockSize != SAMPLE_ARCHIVE_BLOCK_SIZE);
+    }
+
+    // Start a fresh block after any existing ones, including one left partly written
+    auto blocks = (size - sizeof(SampleArchiveHeader) + SAMPLE_ARCHIVE_BLOCK_SIZE - 1) / SAMPLE_ARCHIVE_BLOCK_SIZE;
+    _blockOffset = sizeof(SampleArchiveHeader) + blocks * SAMPLE_ARCHIVE_BLOCK_SIZE;
+    _block.fill(0);
+    _codec.Reset();
+    return S_OK;
+}
+
+HRESULT SampleArchiveWriter::Append(_In_ const ArchivedSample &sample) {
+    RETURN_HR_IF(E_NOT_VALID_STATE, !_file.is_open());
+
+    SampleArchiveBlockHeader header;
+    memcpy(&header, _block.data(), sizeof(header));
+
+    if (header.Count && header.Used + SampleArchiveCodec::MaxRecordSize > SAMPLE_ARCHIVE_BLOCK_DATA) {
+        RETURN_IF_FAILED(Flush());
+        _blockOffset += SAMPLE_ARCHIVE_BLOCK_SIZE;
+        _block.fill(0);
+        _codec.Reset();
+        header = {};
+    }
+    RETURN_HR_IF(
+        HRESULT_FROM_WIN32(ERROR_FILE_TOO_LARGE),
+        _blockOffset + SAMPLE_ARCHIVE_BLOCK_SIZE > SAMPLE_ARCHIVE_MAX_BYTES);
+
+    header.Used += static_cast<ULONG>(_codec.Encode(sample, _block.data() + sizeof(header) + header.Used));
+    if (!header.Count || sample.Time < header.MinTime)
+        header.MinTime = sample.Time;
+    if (!header.Count || sample.Time > header.MaxTime)
+        header.MaxTime = sample.Time;
+    header.Count++;
+    memcpy(_block.data(), &header, sizeof(header));
+
+    if (!_pending++)
+        _pendingSince = PerfCounterNow();
+    // A block that cannot take another sample will not change again
+    if (_pending < SAMPLE_ARCHIVE_BATCH_SAMPLES &&
+        header.Used + SampleArchiveCodec::MaxRecordSize <= SAMPLE_ARCHIVE_BLOCK_DATA &&
+        PerfCounterToUs(PerfCounterNow() - _pendingSince) < SAMPLE_ARCHIVE_BATCH_MAX_US)
+        return S_OK;
+    return Flush();
+}
+
+HRESULT SampleArchiveWriter::Flush() {
+    if (!_pending || !_file.is_open())
+        return S_OK;
+
+    // The whole block is rewritten, so that a reader never sees a header that disagrees with its samples
+    _pending = 0;
+    _file.seekp(static_cast<std::streamoff>(_blockOffset));
+    if (!_file.write(reinterpret_cast<const char *>(_block.data()), _block.size()) || !_file.flush())
+        return E_FAIL;
+    return S_OK;
+}
+
+HRESULT QuerySampleArchive(
+    _In_ const std::filesystem::path &path,
+    LONG64 from,
+    LONG64 to,
+    _In_ const SampleArchiveCallback &callback) {
+    wil::unique_hfile file(CreateFileW(
+        path.wstring().c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_WRITE,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        nullptr));
+    RETURN_LAST_ERROR_IF(!file.is_valid());
+
+    LARGE_INTEGER size;
+    RETURN_IF_WIN32_BOOL_FALSE(GetFileSizeEx(file.get(), &size));
+    RETURN_HR_IF(HRESULT_FROM_WIN32(ERROR_INVALID_DATA), !size.QuadPart);
+
+    wil::unique_handle mapping(CreateFileMappingW(file.get(), nullptr, PAGE_READONLY, 0, 0, nullptr));
+    RETURN_LAST_ERROR_IF_NULL(mapping.get());
+
+    wil::unique_mapview_ptr<BYTE> view(static_cast<BYTE *>(MapViewOfFile(mapping.get(), FILE_MAP_READ, 0, 0, 0)));
+    RETURN_LAST_ERROR_IF_NULL(view.get());
+
+    switch (DecodeSampleArchive(view.get(), static_cast<size_t>(size.QuadPart), from, to, callback)) {
+    case SampleArchiveDecoded:
+        return S_OK;
+    case SampleArchiveVersionMismatch:
+        return HRESULT_FROM_WIN32(ERROR_REVISION_MISMATCH);
+    default:
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+}
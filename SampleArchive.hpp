@@ -0,0 +1,45 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include "SampleArchiveFormat.hpp"
+
+// Appends samples to an archive made of fixed-size blocks. Each block starts with a header holding its sample count
+// and time range, which readers use as an index to skip blocks outside the range they want. The block being filled
+// is written in batches, so that most samples do no file I/O.
+class SampleArchiveWriter {
+public:
+    SampleArchiveWriter() = default;
+    SampleArchiveWriter(const SampleArchiveWriter &) = delete;
+    SampleArchiveWriter &operator=(const SampleArchiveWriter &) = delete;
+    ~SampleArchiveWriter() {
+        Flush();
+    }
+
+    HRESULT Open(_In_ const std::filesystem::path &path);
+    HRESULT Append(_In_ const ArchivedSample &sample);
+    HRESULT Flush();
+
+private:
+    std::fstream _file;
+    ULONG64 _blockOffset = 0;
+    std::array<BYTE, SAMPLE_ARCHIVE_BLOCK_SIZE> _block{};
+    SampleArchiveCodec _codec;
+    // Samples appended to the block since it was last written
+    ULONG _pending = 0;
+    // Performance counter of the oldest pending sample
+    ULONG64 _pendingSince = 0;
+};
+
+// Memory-map an archive file and decode the samples whose Time lies in [from, to]
+HRESULT QuerySampleArchive(
+    _In_ const std::filesystem::path &path,
+    LONG64 from,
+    LONG64 to,
+    _In_ const SampleArchiveCallback &callback);
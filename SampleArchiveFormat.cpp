@@ -0,0 +1,152 @@
+#include <cstring>
+
+#include "SampleArchiveFormat.hpp"
+
+static uint64_t ZigZag(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+static int64_t UnZigZag(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+static size_t PutVarint(int64_t value, _Out_writes_(10) uint8_t *out) {
+    auto v = ZigZag(value);
+    size_t n = 0;
+    while (v >= 0x80) {
+        out[n++] = static_cast<uint8_t>(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = static_cast<uint8_t>(v);
+    return n;
+}
+
+_Success_(return != 0) static size_t GetVarint(
+    _In_reads_(size) const uint8_t *data,
+    size_t size,
+    _Out_ int64_t &value) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < size && i < 10; i++) {
+        v |= static_cast<uint64_t>(data[i] & 0x7f) << (7 * i);
+        if (!(data[i] & 0x80)) {
+            value = UnZigZag(v);
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+// Unsigned arithmetic so that wrapping deltas of extreme values round-trip
+static int64_t Sub(int64_t a, int64_t b) {
+    return static_cast<int64_t>(static_cast<uint64_t>(a) - static_cast<uint64_t>(b));
+}
+
+static int64_t Add(int64_t a, int64_t b) {
+    return static_cast<int64_t>(static_cast<uint64_t>(a) + static_cast<uint64_t>(b));
+}
+
+size_t SampleArchiveCodec::Encode(_In_ const ArchivedSample &sample, _Out_writes_(MaxRecordSize) uint8_t *out) {
+    auto tick = static_cast<int64_t>(sample.TickCount);
+    auto prevTick = static_cast<int64_t>(_prev.TickCount);
+    size_t n = 0;
+
+    if (!_count) {
+        n += PutVarint(sample.Time, out + n);
+        n += PutVarint(tick, out + n);
+        n += PutVarint(sample.Offset, out + n);
+        n += PutVarint(sample.Delay, out + n);
+        n += PutVarint(sample.Dispersion, out + n);
+        _timeDelta = _tickDelta = 0;
+    } else {
+        auto timeDelta = Sub(sample.Time, _prev.Time);
+        auto tickDelta = Sub(tick, prevTick);
+        n += PutVarint(Sub(timeDelta, _timeDelta), out + n);
+        n += PutVarint(Sub(tickDelta, _tickDelta), out + n);
+        n += PutVarint(Sub(sample.Offset, _prev.Offset), out + n);
+        n += PutVarint(Sub(sample.Delay, _prev.Delay), out + n);
+        n += PutVarint(Sub(sample.Dispersion, _prev.Dispersion), out + n);
+        _timeDelta = timeDelta;
+        _tickDelta = tickDelta;
+    }
+    _prev = sample;
+    _count++;
+    return n;
+}
+
+size_t SampleArchiveCodec::Decode(_In_reads_(size) const uint8_t *data, size_t size, _Out_ ArchivedSample &sample) {
+    std::array<int64_t, 5> fields;
+    size_t n = 0;
+
+    for (auto &field : fields) {
+        auto used = GetVarint(data + n, size - n, field);
+        if (!used)
+            return 0;
+        n += used;
+    }
+
+    if (!_count) {
+        sample = ArchivedSample{
+            .Time = fields[0],
+            .TickCount = static_cast<uint64_t>(fields[1]),
+            .Offset = fields[2],
+            .Delay = fields[3],
+            .Dispersion = fields[4],
+        };
+        _timeDelta = _tickDelta = 0;
+    } else {
+        _timeDelta = Add(_timeDelta, fields[0]);
+        _tickDelta = Add(_tickDelta, fields[1]);
+        sample = ArchivedSample{
+            .Time = Add(_prev.Time, _timeDelta),
+            .TickCount = static_cast<uint64_t>(Add(static_cast<int64_t>(_prev.TickCount), _tickDelta)),
+            .Offset = Add(_prev.Offset, fields[2]),
+            .Delay = Add(_prev.Delay, fields[3]),
+            .Dispersion = Add(_prev.Dispersion, fields[4]),
+        };
+    }
+    _prev = sample;
+    _count++;
+    return n;
+}
+
+SampleArchiveDecodeResult DecodeSampleArchive(
+    _In_reads_bytes_(size) const uint8_t *data,
+    size_t size,
+    int64_t from,
+    int64_t to,
+    _In_ const SampleArchiveCallback &callback) {
+    SampleArchiveHeader header;
+
+    if (size < sizeof(header))
+        return SampleArchiveInvalid;
+    memcpy(&header, data, sizeof(header));
+    if (header.Magic != SAMPLE_ARCHIVE_MAGIC)
+        return SampleArchiveInvalid;
+    if (header.Version != SAMPLE_ARCHIVE_VERSION || header.BlockSize != SAMPLE_ARCHIVE_BLOCK_SIZE)
+        return SampleArchiveVersionMismatch;
+
+    // A partial block at the end is from a writer that was killed mid-write
+    for (size_t offset = sizeof(header); offset + SAMPLE_ARCHIVE_BLOCK_SIZE <= size;
+         offset += SAMPLE_ARCHIVE_BLOCK_SIZE) {
+        SampleArchiveBlockHeader block;
+        memcpy(&block, data + offset, sizeof(block));
+        if (!block.Count || block.Used > SAMPLE_ARCHIVE_BLOCK_DATA)
+            continue;
+        if (block.MaxTime < from || block.MinTime > to)
+            continue;
+
+        SampleArchiveCodec codec;
+        auto encoded = data + offset + sizeof(block);
+        size_t used = 0;
+        for (uint32_t i = 0; i < block.Count; i++) {
+            ArchivedSample sample;
+            auto n = codec.Decode(encoded + used, block.Used - used, sample);
+            if (!n)
+                break;
+            used += n;
+            if (sample.Time >= from && sample.Time <= to)
+                callback(sample);
+        }
+    }
+    return SampleArchiveDecoded;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#include <sal.h>
+
+// On-disk format of sample archives. Uses no OS services, so archives copied off a VM can be read anywhere.
+
+#define SAMPLE_ARCHIVE_MAGIC 'XTAR'
+#define SAMPLE_ARCHIVE_VERSION 2
+#define SAMPLE_ARCHIVE_BLOCK_SIZE 4096
+
+struct SampleArchiveHeader {
+    uint32_t Magic;
+    uint16_t Version;
+    uint16_t Reserved;
+    uint32_t BlockSize;
+    uint32_t Reserved2;
+};
+static_assert(sizeof(SampleArchiveHeader) == 16);
+
+struct SampleArchiveBlockHeader {
+    uint32_t Count;
+    // Bytes of encoded samples following the header
+    uint32_t Used;
+    // Earliest and latest sample time in the block. Time can step backwards, so these are not the first and last.
+    int64_t MinTime;
+    int64_t MaxTime;
+};
+static_assert(sizeof(SampleArchiveBlockHeader) == 24);
+
+#define SAMPLE_ARCHIVE_BLOCK_DATA (SAMPLE_ARCHIVE_BLOCK_SIZE - sizeof(SampleArchiveBlockHeader))
+
+// One accepted sample as kept in the archive
+struct ArchivedSample {
+    // Local time the offset refers to, in 100ns units since 1601-01-01 UTC
+    int64_t Time;
+    uint64_t TickCount;
+    int64_t Offset;
+    int64_t Delay;
+    int64_t Dispersion;
+};
+
+// Delta encoding state for one archive block. Time and tick count, which advance at a near constant rate, are stored
+// as zig-zag varints of their delta-of-delta; the rest as zig-zag varints of their delta. A steady poll costs a few
+// bytes per sample.
+class SampleArchiveCodec {
+public:
+    // Enough for every field being a full 10-byte varint
+    static constexpr size_t MaxRecordSize = 50;
+
+    void Reset() {
+        _count = 0;
+    }
+    // Returns the number of bytes written to out, which must hold MaxRecordSize
+    size_t Encode(_In_ const ArchivedSample &sample, _Out_writes_(MaxRecordSize) uint8_t *out);
+    // Returns the number of bytes consumed, or 0 if data is truncated
+    size_t Decode(_In_reads_(size) const uint8_t *data, size_t size, _Out_ ArchivedSample &sample);
+
+private:
+    uint64_t _count = 0;
+    ArchivedSample _prev{};
+    int64_t _timeDelta = 0;
+    int64_t _tickDelta = 0;
+};
+
+enum SampleArchiveDecodeResult {
+    SampleArchiveDecoded,
+    SampleArchiveInvalid,
+    SampleArchiveVersionMismatch,
+};
+
+using SampleArchiveCallback = std::function<void(_In_ const ArchivedSample &sample)>;
+
+// Decode the samples of an archive image whose Time lies in [from, to]
+SampleArchiveDecodeResult DecodeSampleArchive(
+    _In_reads_bytes_(size) const uint8_t *data,
+    size_t size,
+    int64_t from,
+    int64_t to,
+    _In_ const SampleArchiveCallback &callback);
@@ -0,0 +1,101 @@
+#include <algorithm>
+
+#include "Globals.hpp"
+#include "SampleFilter.hpp"
+#include "StatKernels.hpp"
+
+// Minimum number of samples before the filter starts judging new ones
+#define FILTER_MIN_HISTORY 8
+// Delays above this percentile of the window (plus slack) are rejected
+#define FILTER_DELAY_PERCENTILE 75
+#define FILTER_DELAY_MAD_FACTOR 4
+#define FILTER_DELAY_FLOOR TIME_US(50)
+// Offsets further than this many MADs from the median are down-weighted
+#define FILTER_OFFSET_MAD_FACTOR 4
+#define FILTER_OFFSET_FLOOR TIME_US(100)
+
+template <size_t N>
+static int64_t Percentile(const std::array<int64_t, N> &values, size_t count, size_t percentile) {
+    std::array<int64_t, N> tmp;
+    std::copy_n(values.begin(), count, tmp.begin());
+    auto nth = tmp.begin() + (count - 1) * percentile / 100;
+    std::nth_element(tmp.begin(), nth, tmp.begin() + count);
+    return *nth;
+}
+
+template <size_t N>
+static int64_t MedianAbsDeviation(const std::array<int64_t, N> &values, size_t count, int64_t median) {
+    std::array<int64_t, N> tmp;
+    StatAbsDeviation(values.data(), count, median, tmp.data());
+    auto nth = tmp.begin() + count / 2;
+    std::nth_element(tmp.begin(), nth, tmp.begin() + count);
+    return *nth;
+}
+
+SampleFilterResult SampleFilter::Filter(_Inout_ TimeSample &sample) {
+    auto result = SampleFilterAccepted;
+
+    if (_delayCount >= FILTER_MIN_HISTORY) {
+        auto delayMedian = Percentile(_delays, _delayCount, 50);
+        auto delayMad = MedianAbsDeviation(_delays, _delayCount, delayMedian);
+        auto delayThreshold = Percentile(_delays, _delayCount, FILTER_DELAY_PERCENTILE) +
+            std::max<int64_t>(FILTER_DELAY_MAD_FACTOR * delayMad, FILTER_DELAY_FLOOR);
+        if (sample.toDelay > delayThreshold)
+            result = SampleFilterRejected;
+    }
+
+    // Rejected delays still enter the history so that a sustained rise in delay becomes the new baseline
+    _delays[_delayNext] = sample.toDelay;
+    _delayNext = (_delayNext + 1) % WindowSize;
+    _delayCount = std::min(_delayCount + 1, WindowSize);
+
+    if (result == SampleFilterRejected)
+        return result;
+
+    if (_offsetCount >= FILTER_MIN_HISTORY) {
+        auto offsetMedian = Percentile(_offsets, _offsetCount, 50);
+        auto offsetMad = MedianAbsDeviation(_offsets, _offsetCount, offsetMedian);
+        auto deviation = sample.toOffset > offsetMedian ? sample.toOffset - offsetMedian : offsetMedian - sample.toOffset;
+        if (deviation > std::max<int64_t>(FILTER_OFFSET_MAD_FACTOR * offsetMad, FILTER_OFFSET_FLOOR)) {
+            sample.tpDispersion += static_cast<unsigned __int64>(deviation);
+            result = SampleFilterDownweighted;
+        }
+    }
+
+    _offsets[_offsetNext] = sample.toOffset;
+    _offsetNext = (_offsetNext + 1) % WindowSize;
+    _offsetCount = std::min(_offsetCount + 1, WindowSize);
+
+    return result;
+}
+
+void SampleFilter::ResetOffsets() {
+    _offsetNext = _offsetCount = 0;
+}
+
+void SampleFilter::Reset() {
+    ResetOffsets();
+    _delayNext = _delayCount = 0;
+}
+
+_Success_(return) bool SampleFilter::GetState(_Out_ SampleFilterState &state) const {
+    if (_delayCount < FILTER_MIN_HISTORY)
+        return false;
+    state.DelayMedian = Percentile(_delays, _delayCount, 50);
+    state.DelayMad = MedianAbsDeviation(_delays, _delayCount, state.DelayMedian);
+    return true;
+}
+
+void SampleFilter::Seed(_In_ const SampleFilterState &state) {
+    Reset();
+    // Synthesize a delay history with the saved median and MAD
+    for (size_t i = 0; i < FILTER_MIN_HISTORY; i++) {
+        if (i < FILTER_MIN_HISTORY * 3 / 8)
+            _delays[i] = state.DelayMedian - state.DelayMad;
+        else if (i < FILTER_MIN_HISTORY * 5 / 8)
+            _delays[i] = state.DelayMedian;
+        else
+            _delays[i] = state.DelayMedian + state.DelayMad;
+    }
+    _delayNext = _delayCount = FILTER_MIN_HISTORY;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <TimeProv.h>
+
+// Learned filter state that can be carried over to a later run
+struct SampleFilterState {
+    int64_t DelayMedian;
+    int64_t DelayMad;
+};
+
+enum SampleFilterResult {
+    SampleFilterAccepted,
+    SampleFilterDownweighted,
+    SampleFilterRejected,
+};
+
+// Rolling median/MAD filter over recent sample offsets and delays. Samples whose delay is far above the recent
+// delay distribution are rejected; samples whose offset is far from the recent offset median are passed on with
+// their dispersion inflated, so that a genuine clock change still gets through.
+class SampleFilter {
+public:
+    static constexpr size_t WindowSize = 32;
+
+    SampleFilterResult Filter(_Inout_ TimeSample &sample);
+    // Forget offset history, e.g. after the local clock was stepped.
+    void ResetOffsets();
+    void Reset();
+
+    _Success_(return) bool GetState(_Out_ SampleFilterState &state) const;
+    // Prime an empty filter with state from an earlier run so that it can judge samples immediately
+    void Seed(_In_ const SampleFilterState &state);
+
+private:
+    std::array<int64_t, WindowSize> _offsets{};
+    std::array<int64_t, WindowSize> _delays{};
+    size_t _offsetNext = 0, _offsetCount = 0;
+    size_t _delayNext = 0, _delayCount = 0;
+};
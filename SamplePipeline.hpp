@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include <wil/result.h>
+
+#include "SampleFilter.hpp"
+#include "TimeMeasurement.hpp"
+#include "xentimeapi.h"
+
+// The sources a sample is built from, composed at compile time so the production combination involves no virtual
+// calls or runtime branches. Each policy is a small value type:
+//
+//   Clock:        HRESULT Now(_Out_ unsigned __int64 *time)   local system time, in 100ns units
+//   TimeSource:   HRESULT Read(_Out_ unsigned __int64 *time, _Out_ unsigned __int64 *dispersion)
+//   OffsetSource: HRESULT Read(_Out_ int64_t &offset)         the host's time offset for the VM
+//   Filter:       SampleFilterResult Filter(_Inout_ TimeSample &sample)
+//   Publisher:    void Publish(_In_ const XENTIME_SAMPLE &sample)
+//
+// Alternative policies, e.g. simulated sources replaying a trace or a publisher that records what it is given, only
+// need to provide the same members.
+template <typename Clock, typename TimeSource, typename OffsetSource, typename Filter, typename Publisher>
+class SamplePipeline {
+public:
+    SamplePipeline(Clock clock, TimeSource time, OffsetSource offset, Filter filter, Publisher publisher)
+        : _clock(std::move(clock)), _time(std::move(time)), _offset(std::move(offset)), _filter(std::move(filter)),
+          _publisher(std::move(publisher)) {}
+
+    // Reads the time source bracketed by two reads of the clock
+    HRESULT Measure(_Out_ TimeMeasurement &m) {
+        RETURN_IF_FAILED(_clock.Now(&m.Begin));
+        RETURN_IF_FAILED(_time.Read(&m.XenTime, &m.Dispersion));
+        RETURN_IF_FAILED(_clock.Now(&m.End));
+        return S_OK;
+    }
+
+    HRESULT ReadOffset(_Out_ int64_t &offset) {
+        return _offset.Read(offset);
+    }
+
+    SampleFilterResult FilterSample(_Inout_ TimeSample &sample) {
+        return _filter.Filter(sample);
+    }
+
+    void Publish(_In_ const XENTIME_SAMPLE &sample) {
+        _publisher.Publish(sample);
+    }
+
+    const TimeSource &GetTimeSource() const {
+        return _time;
+    }
+
+private:
+    Clock _clock;
+    TimeSource _time;
+    OffsetSource _offset;
+    Filter _filter;
+    Publisher _publisher;
+};
@@ -0,0 +1,157 @@
+#include <utility>
+
+#include <wil/result.h>
+
+#include "Globals.hpp"
+#include "HostStepDetector.hpp"
+#include "PerfCounter.hpp"
+#include "SampleTrace.hpp"
+#include "TimeMeasurement.hpp"
+
+#define SAMPLE_TRACE_MAGIC 'XTTR'
+#define SAMPLE_TRACE_VERSION 1
+#define SAMPLE_TRACE_MAX_BYTES (64ULL * 1024 * 1024)
+// Pending records are written once there are this many, or the oldest has waited this long; a killed service loses at
+// most that much of its trace
+#define SAMPLE_TRACE_BATCH_RECORDS 16
+#define SAMPLE_TRACE_BATCH_MAX_US 60000000
+
+struct SampleTraceHeader {
+    ULONG Magic;
+    USHORT Version;
+    USHORT RecordSize;
+};
+static_assert(sizeof(SampleTraceHeader) == 8);
+
+_Success_(return) bool MakeTimeSample(
+    _In_ const SampleInputs &inputs,
+    _In_ PCWSTR name,
+    _Out_ TimeSample &sample,
+    _Out_ int64_t &sampleTime) {
+    if (inputs.TimeOffsetPre != inputs.TimeOffsetPost)
+        return false;
+
+    TimeMeasurement measurement{
+        .Begin = inputs.Begin,
+        .XenTime = inputs.XenTime,
+        .Dispersion = inputs.Dispersion,
+        .End = inputs.End,
+    };
+    auto xenTime = static_cast<signed __int64>(measurement.XenTime - TIME_S(inputs.TimeOffsetPost));
+    auto readTime = measurement.ReadTime(inputs.AsymmetryPpm);
+
+    sample = TimeSample{
+        .dwSize = sizeof(TimeSample),
+        .dwRefid = ' NEX',
+        .toOffset = xenTime - readTime,
+        .toDelay = measurement.Delay(),
+        .tpDispersion = measurement.Dispersion,
+        .nSysTickCount = inputs.TickCount,
+        .nSysPhaseOffset = inputs.PhaseOffset,
+        .nLeapFlags = 3,
+        .nStratum = 0,
+        .dwTSFlags = TSF_Hardware,
+    };
+    wcsncpy_s(sample.wszUniqueName, name, _TRUNCATE);
+    sampleTime = readTime;
+    return true;
+}
+
+HRESULT SampleTraceWriter::Open(_In_ const std::filesystem::path &path) {
+    std::error_code ec;
+
+    Flush();
+    _file.close();
+    _file.clear();
+    _size = std::filesystem::exists(path, ec) ? std::filesystem::file_size(path, ec) : 0;
+    if (ec)
+        return HRESULT_FROM_WIN32(ec.value());
+
+    _file.open(path, std::ios::binary | std::ios::app);
+    if (!_file)
+        return E_ACCESSDENIED;
+
+    if (!_size) {
+        SampleTraceHeader header{
+            .Magic = SAMPLE_TRACE_MAGIC,
+            .Version = SAMPLE_TRACE_VERSION,
+            .RecordSize = sizeof(SampleInputs),
+        };
+        if (!_file.write(reinterpret_cast<const char *>(&header), sizeof(header)))
+            return E_FAIL;
+        _size = sizeof(header);
+    }
+    return S_OK;
+}
+
+HRESULT SampleTraceWriter::Write(_In_ const SampleInputs &inputs) {
+    RETURN_HR_IF(E_NOT_VALID_STATE, !_file.is_open());
+    RETURN_HR_IF(HRESULT_FROM_WIN32(ERROR_FILE_TOO_LARGE), _size + sizeof(inputs) > SAMPLE_TRACE_MAX_BYTES);
+
+    if (_pending.empty())
+        _pendingSince = PerfCounterNow();
+    _pending.push_back(inputs);
+    _size += sizeof(inputs);
+    if (_pending.size() < SAMPLE_TRACE_BATCH_RECORDS &&
+        PerfCounterToUs(PerfCounterNow() - _pendingSince) < SAMPLE_TRACE_BATCH_MAX_US)
+        return S_OK;
+    return Flush();
+}
+
+HRESULT SampleTraceWriter::Flush() {
+    if (_pending.empty() || !_file.is_open())
+        return S_OK;
+
+    auto pending = std::exchange(_pending, {});
+    if (!_file.write(reinterpret_cast<const char *>(pending.data()), pending.size() * sizeof(SampleInputs)) ||
+        !_file.flush())
+        return E_FAIL;
+    return S_OK;
+}
+
+HRESULT ReplaySampleTrace(
+    _In_ const std::filesystem::path &path,
+    _Inout_ SampleFilter &filter,
+    _In_ const SampleTraceCallback &callback) {
+    SampleTraceHeader header;
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+    if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)))
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    RETURN_HR_IF(HRESULT_FROM_WIN32(ERROR_INVALID_DATA), header.Magic != SAMPLE_TRACE_MAGIC);
+    RETURN_HR_IF(
+        HRESULT_FROM_WIN32(ERROR_REVISION_MISMATCH),
+        header.Version != SAMPLE_TRACE_VERSION || header.RecordSize != sizeof(SampleInputs));
+
+    filter.Reset();
+    HostStepDetector stepDetector;
+    SampleInputs inputs;
+    while (file.read(reinterpret_cast<char *>(&inputs), sizeof(inputs))) {
+        TimeSample sample;
+        int64_t sampleTime;
+
+        if (inputs.Flags & SampleTraceResumed) {
+            filter.Reset();
+            stepDetector.Reset();
+        }
+        if (inputs.Flags & SampleTraceTimeJumped)
+            filter.ResetOffsets();
+
+        if (!MakeTimeSample(inputs, L"replay", sample, sampleTime)) {
+            callback(inputs, nullptr, SampleFilterAccepted);
+            continue;
+        }
+        // As in the provider, a host step restarts the filter on the new timeline
+        int64_t step;
+        if (stepDetector.Observe(sampleTime + sample.toOffset, inputs.PerfCounter, step))
+            filter.Reset();
+        auto result = filter.Filter(sample);
+        callback(inputs, &sample, result);
+    }
+    // A partial record at the end is from a writer that was killed mid-write
+    if (file.bad())
+        return E_FAIL;
+    return S_OK;
+}
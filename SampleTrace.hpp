@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <vector>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <TimeProv.h>
+
+#include "SampleFilter.hpp"
+
+enum SampleTraceFlags : ULONG {
+    // The filter was reset before this sample because the VM resumed
+    SampleTraceResumed = 1,
+    // W32Time stepped the local clock before this sample
+    SampleTraceTimeJumped = 2,
+};
+
+// Every input that goes into one sample, as read from W32Time and the device
+struct SampleInputs {
+    ULONG64 TickCount;
+    LONG64 PhaseOffset;
+    ULONG64 Begin;
+    ULONG64 End;
+    ULONG64 XenTime;
+    ULONG64 Dispersion;
+    // Performance counter at the Xen reading
+    ULONG64 PerfCounter;
+    LONG64 TimeOffsetPre;
+    LONG64 TimeOffsetPost;
+    LONG64 AsymmetryPpm;
+    ULONG SuspendCount;
+    ULONG Flags;
+};
+static_assert(sizeof(SampleInputs) == 88);
+
+// Turn inputs into a sample; fails if the time offset changed while they were being read. sampleTime receives the
+// local time the sample's offset refers to.
+_Success_(return) bool MakeTimeSample(
+    _In_ const SampleInputs &inputs,
+    _In_ PCWSTR name,
+    _Out_ TimeSample &sample,
+    _Out_ int64_t &sampleTime);
+
+// Appends SampleInputs records to a file, stopping once it reaches a size limit. Records are written in batches, so
+// that most samples do no file I/O.
+class SampleTraceWriter {
+public:
+    SampleTraceWriter() = default;
+    SampleTraceWriter(const SampleTraceWriter &) = delete;
+    SampleTraceWriter &operator=(const SampleTraceWriter &) = delete;
+    ~SampleTraceWriter() {
+        Flush();
+    }
+
+    HRESULT Open(_In_ const std::filesystem::path &path);
+    HRESULT Write(_In_ const SampleInputs &inputs);
+    HRESULT Flush();
+
+private:
+    std::ofstream _file;
+    ULONG64 _size = 0;
+    std::vector<SampleInputs> _pending;
+    // Performance counter of the oldest pending record
+    ULONG64 _pendingSince = 0;
+};
+
+using SampleTraceCallback =
+    std::function<void(_In_ const SampleInputs &inputs, _In_opt_ const TimeSample *sample, SampleFilterResult result)>;
+
+// Feed a trace through MakeTimeSample and a filter as fast as it can be read. sample is null for records whose time
+// offset changed mid-read; result is only meaningful when it is not.
+HRESULT ReplaySampleTrace(
+    _In_ const std::filesystem::path &path,
+    _Inout_ SampleFilter &filter,
+    _In_ const SampleTraceCallback &callback);
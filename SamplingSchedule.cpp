@@ -0,0 +1,50 @@
+#include <algorithm>
+
+#include "SamplingSchedule.hpp"
+#include "PerfCounter.hpp"
+
+// Store reads averaging this many times the baseline, and above the floor, count as congestion
+#define SCHEDULE_CONGESTION_RATIO 4
+#define SCHEDULE_CONGESTION_FLOOR_US 2000ULL
+// Weight of a new reading in the moving average, as 1/n
+#define SCHEDULE_AVERAGE_WEIGHT 8
+// The baseline drifts up by 1/n per read so that it recovers from one unusually fast read
+#define SCHEDULE_BASELINE_DECAY 64
+
+SamplingSchedule::SamplingSchedule() : _random(PerfCounterNow()) {}
+
+SamplingSchedule::SamplingSchedule(ULONG64 seed) : _random(seed) {}
+
+void SamplingSchedule::SetIdentity(std::string_view identity) {
+    // FNV-1a
+    ULONG64 hash = 0xcbf29ce484222325ULL;
+    for (auto c : identity) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001b3ULL;
+    }
+    if (hash == _identityHash)
+        return;
+    _identityHash = hash;
+    _phaseUs = hash % PhaseSpreadUs;
+}
+
+void SamplingSchedule::RecordStoreRead(ULONG64 latencyUs) {
+    if (!_reads++) {
+        _baselineUs = _averageUs = latencyUs;
+    } else {
+        _baselineUs = std::min(latencyUs, _baselineUs + _baselineUs / SCHEDULE_BASELINE_DECAY + 1);
+        _averageUs = _averageUs + latencyUs / SCHEDULE_AVERAGE_WEIGHT - _averageUs / SCHEDULE_AVERAGE_WEIGHT;
+    }
+
+    auto congested = _averageUs > SCHEDULE_CONGESTION_FLOOR_US &&
+        _averageUs > _baselineUs * SCHEDULE_CONGESTION_RATIO;
+    if (congested)
+        _backoff = std::min(_backoff + 1, MaxBackoff);
+    else if (_backoff)
+        _backoff--;
+}
+
+ULONG64 SamplingSchedule::NextDelayUs() {
+    auto jitterUs = std::uniform_int_distribution<ULONG64>(0, JitterUs)(_random);
+    return (_phaseUs + jitterUs) << _backoff;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <random>
+#include <string_view>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+// Decides when a sample that is not driven by a W32Time poll is taken. VMs that hear about the same host time change
+// would otherwise all read XenStore at once, so each VM waits for a phase derived from its identity plus some random
+// jitter. The wait is stretched while XenStore reads are slow, which means xenstored is congested.
+class SamplingSchedule {
+public:
+    // Background samples are spread over this window by phase, then jittered by up to JitterUs more
+    static constexpr ULONG64 PhaseSpreadUs = 1000000;
+    static constexpr ULONG64 JitterUs = 250000;
+    static constexpr unsigned MaxBackoff = 3;
+
+    SamplingSchedule();
+    // A fixed seed makes the jitter reproducible, e.g. for simulating many VMs at once
+    explicit SamplingSchedule(ULONG64 seed);
+
+    // Derive the phase from a string identifying the VM; does nothing if the identity is unchanged
+    void SetIdentity(std::string_view identity);
+    void RecordStoreRead(ULONG64 latencyUs);
+    // How long to wait before the next background sample: the phase plus jitter, times 2^backoff
+    ULONG64 NextDelayUs();
+
+    bool IsCongested() const {
+        return _backoff > 0;
+    }
+    unsigned GetBackoff() const {
+        return _backoff;
+    }
+    ULONG64 GetPhaseUs() const {
+        return _phaseUs;
+    }
+    ULONG64 GetStoreReadBaselineUs() const {
+        return _baselineUs;
+    }
+    ULONG64 GetStoreReadAverageUs() const {
+        return _averageUs;
+    }
+
+private:
+    ULONG64 _identityHash = 0;
+    ULONG64 _phaseUs = 0;
+    // Lowest recent store read latency, and an exponential moving average of it
+    ULONG64 _baselineUs = 0;
+    ULONG64 _averageUs = 0;
+    ULONG64 _reads = 0;
+    unsigned _backoff = 0;
+    std::mt19937_64 _random;
+};
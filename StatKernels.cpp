@@ -0,0 +1,285 @@
+#include <algorithm>
+#include <atomic>
+
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#include <immintrin.h>
+#define STAT_KERNELS_X86
+#endif
+
+// MSVC compiles intrinsics for any instruction set. GCC and Clang need each function that uses them marked with its
+// instruction set, which keeps the rest of the unit, dispatch and scalar kernels included, to the baseline.
+#if defined(__GNUC__)
+#define STAT_TARGET(_isa) __attribute__((target(_isa)))
+#else
+#define STAT_TARGET(_isa)
+#endif
+
+#include "StatKernels.hpp"
+
+struct StatSums {
+    double X, Y, XX, XY;
+};
+
+static size_t MinIndexScalar(const int64_t *values, size_t begin, size_t count, size_t best) {
+    for (size_t i = begin; i < count; i++)
+        if (values[i] < values[best])
+            best = i;
+    return best;
+}
+
+static void AbsDeviationScalar(const int64_t *values, size_t begin, size_t count, int64_t center, int64_t *out) {
+    for (size_t i = begin; i < count; i++)
+        out[i] = values[i] > center ? values[i] - center : center - values[i];
+}
+
+static void LinearSumsScalar(
+    const int64_t *x,
+    const int64_t *y,
+    size_t begin,
+    size_t count,
+    int64_t x0,
+    int64_t y0,
+    StatSums &sums) {
+    for (size_t i = begin; i < count; i++) {
+        auto dx = static_cast<double>(x[i] - x0);
+        auto dy = static_cast<double>(y[i] - y0);
+        sums.X += dx;
+        sums.Y += dy;
+        sums.XX += dx * dx;
+        sums.XY += dx * dy;
+    }
+}
+
+#ifdef STAT_KERNELS_X86
+
+STAT_TARGET("xsave")
+static StatIsa DetectIsa() {
+    int info[4];
+
+    __cpuid(info, 0);
+    auto maxLeaf = info[0];
+    __cpuid(info, 1);
+    bool sse42 = info[2] & (1 << 20);
+    bool osxsave = info[2] & (1 << 27);
+    bool avx = info[2] & (1 << 28);
+    // AVX state must also be enabled by the OS
+    if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6) {
+        __cpuidex(info, 7, 0);
+        if (info[1] & (1 << 5))
+            return StatIsaAvx2;
+    }
+    return sse42 ? StatIsaSse42 : StatIsaScalar;
+}
+
+// Exact for |v| < 2^51: adding the integer into the mantissa of 2^52 + 2^51 and subtracting it again as a double
+#define STAT_DOUBLE_MAGIC 0x4338000000000000LL
+
+STAT_TARGET("sse4.2")
+static size_t MinIndexSse42(const int64_t *values, size_t count) {
+    auto best = _mm_set1_epi64x(values[0]);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(values + i));
+        best = _mm_blendv_epi8(best, v, _mm_cmpgt_epi64(best, v));
+    }
+    alignas(16) int64_t lanes[2];
+    _mm_store_si128(reinterpret_cast<__m128i *>(lanes), best);
+    auto minimum = std::min(lanes[0], lanes[1]);
+    // Find the first index holding the minimum, then check the tail
+    size_t index = 0;
+    while (values[index] != minimum)
+        index++;
+    return MinIndexScalar(values, i, count, index);
+}
+
+STAT_TARGET("avx2")
+static size_t MinIndexAvx2(const int64_t *values, size_t count) {
+    auto best = _mm256_set1_epi64x(values[0]);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + i));
+        best = _mm256_blendv_epi8(best, v, _mm256_cmpgt_epi64(best, v));
+    }
+    alignas(32) int64_t lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), best);
+    auto minimum = *std::min_element(lanes, lanes + 4);
+    size_t index = 0;
+    while (values[index] != minimum)
+        index++;
+    return MinIndexScalar(values, i, count, index);
+}
+
+STAT_TARGET("sse4.2")
+static void AbsDeviationSse42(const int64_t *values, size_t count, int64_t center, int64_t *out) {
+    auto c = _mm_set1_epi64x(center);
+    auto zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        auto d = _mm_sub_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i *>(values + i)), c);
+        auto negative = _mm_cmpgt_epi64(zero, d);
+        d = _mm_sub_epi64(_mm_xor_si128(d, negative), negative);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), d);
+    }
+    AbsDeviationScalar(values, i, count, center, out);
+}
+
+STAT_TARGET("avx2")
+static void AbsDeviationAvx2(const int64_t *values, size_t count, int64_t center, int64_t *out) {
+    auto c = _mm256_set1_epi64x(center);
+    auto zero = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        auto d = _mm256_sub_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + i)), c);
+        auto negative = _mm256_cmpgt_epi64(zero, d);
+        d = _mm256_sub_epi64(_mm256_xor_si256(d, negative), negative);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), d);
+    }
+    AbsDeviationScalar(values, i, count, center, out);
+}
+
+STAT_TARGET("sse4.2")
+static void LinearSumsSse42(const int64_t *x, const int64_t *y, size_t count, int64_t x0, int64_t y0, StatSums &sums) {
+    auto magicInt = _mm_set1_epi64x(STAT_DOUBLE_MAGIC);
+    auto magic = _mm_castsi128_pd(magicInt);
+    auto vx0 = _mm_set1_epi64x(x0);
+    auto vy0 = _mm_set1_epi64x(y0);
+    auto sx = _mm_setzero_pd(), sy = _mm_setzero_pd(), sxx = _mm_setzero_pd(), sxy = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        auto ix = _mm_sub_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i *>(x + i)), vx0);
+        auto iy = _mm_sub_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i *>(y + i)), vy0);
+        auto dx = _mm_sub_pd(_mm_castsi128_pd(_mm_add_epi64(ix, magicInt)), magic);
+        auto dy = _mm_sub_pd(_mm_castsi128_pd(_mm_add_epi64(iy, magicInt)), magic);
+        sx = _mm_add_pd(sx, dx);
+        sy = _mm_add_pd(sy, dy);
+        sxx = _mm_add_pd(sxx, _mm_mul_pd(dx, dx));
+        sxy = _mm_add_pd(sxy, _mm_mul_pd(dx, dy));
+    }
+    alignas(16) double lanes[2];
+    _mm_store_pd(lanes, sx);
+    sums.X += lanes[0] + lanes[1];
+    _mm_store_pd(lanes, sy);
+    sums.Y += lanes[0] + lanes[1];
+    _mm_store_pd(lanes, sxx);
+    sums.XX += lanes[0] + lanes[1];
+    _mm_store_pd(lanes, sxy);
+    sums.XY += lanes[0] + lanes[1];
+    LinearSumsScalar(x, y, i, count, x0, y0, sums);
+}
+
+STAT_TARGET("avx2")
+static void LinearSumsAvx2(const int64_t *x, const int64_t *y, size_t count, int64_t x0, int64_t y0, StatSums &sums) {
+    auto magicInt = _mm256_set1_epi64x(STAT_DOUBLE_MAGIC);
+    auto magic = _mm256_castsi256_pd(magicInt);
+    auto vx0 = _mm256_set1_epi64x(x0);
+    auto vy0 = _mm256_set1_epi64x(y0);
+    auto sx = _mm256_setzero_pd(), sy = _mm256_setzero_pd(), sxx = _mm256_setzero_pd(), sxy = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        auto ix = _mm256_sub_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(x + i)), vx0);
+        auto iy = _mm256_sub_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(y + i)), vy0);
+        auto dx = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_add_epi64(ix, magicInt)), magic);
+        auto dy = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_add_epi64(iy, magicInt)), magic);
+        sx = _mm256_add_pd(sx, dx);
+        sy = _mm256_add_pd(sy, dy);
+        sxx = _mm256_add_pd(sxx, _mm256_mul_pd(dx, dx));
+        sxy = _mm256_add_pd(sxy, _mm256_mul_pd(dx, dy));
+    }
+    alignas(32) double lanes[4];
+    _mm256_store_pd(lanes, sx);
+    sums.X += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    _mm256_store_pd(lanes, sy);
+    sums.Y += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    _mm256_store_pd(lanes, sxx);
+    sums.XX += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    _mm256_store_pd(lanes, sxy);
+    sums.XY += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    LinearSumsScalar(x, y, i, count, x0, y0, sums);
+}
+
+#else
+
+static StatIsa DetectIsa() {
+    return StatIsaScalar;
+}
+
+#endif
+
+static std::atomic<StatIsa> g_isaLimit = StatIsaAvx2;
+
+StatIsa StatDetectIsa() {
+    static const auto isa = DetectIsa();
+    return isa;
+}
+
+static StatIsa GetIsa() {
+    return std::min(StatDetectIsa(), g_isaLimit.load(std::memory_order_relaxed));
+}
+
+StatIsa StatLimitIsa(StatIsa isa) {
+    g_isaLimit.store(isa, std::memory_order_relaxed);
+    return GetIsa();
+}
+
+size_t StatMinIndex(_In_reads_(count) const int64_t *values, size_t count) {
+    switch (GetIsa()) {
+#ifdef STAT_KERNELS_X86
+    case StatIsaAvx2:
+        return MinIndexAvx2(values, count);
+    case StatIsaSse42:
+        return MinIndexSse42(values, count);
+#endif
+    default:
+        return MinIndexScalar(values, 0, count, 0);
+    }
+}
+
+void StatAbsDeviation(
+    _In_reads_(count) const int64_t *values,
+    size_t count,
+    int64_t center,
+    _Out_writes_(count) int64_t *out) {
+    switch (GetIsa()) {
+#ifdef STAT_KERNELS_X86
+    case StatIsaAvx2:
+        return AbsDeviationAvx2(values, count, center, out);
+    case StatIsaSse42:
+        return AbsDeviationSse42(values, count, center, out);
+#endif
+    default:
+        return AbsDeviationScalar(values, 0, count, center, out);
+    }
+}
+
+_Success_(return) bool StatLeastSquaresSlope(
+    _In_reads_(count) const int64_t *x,
+    _In_reads_(count) const int64_t *y,
+    size_t count,
+    _Out_ double &slope) {
+    StatSums sums{};
+
+    if (count < 2)
+        return false;
+
+    switch (GetIsa()) {
+#ifdef STAT_KERNELS_X86
+    case StatIsaAvx2:
+        LinearSumsAvx2(x, y, count, x[0], y[0], sums);
+        break;
+    case StatIsaSse42:
+        LinearSumsSse42(x, y, count, x[0], y[0], sums);
+        break;
+#endif
+    default:
+        LinearSumsScalar(x, y, 0, count, x[0], y[0], sums);
+        break;
+    }
+
+    auto n = static_cast<double>(count);
+    auto denominator = n * sums.XX - sums.X * sums.X;
+    if (denominator <= 0)
+        return false;
+    slope = (n * sums.XY - sums.X * sums.Y) / denominator;
+    return true;
+}
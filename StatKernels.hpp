@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+// Reductions over sample history kept as separate offset, delay and time arrays. Each kernel picks an AVX2 or
+// SSE4.2 implementation at runtime when the CPU supports it and falls back to scalar code otherwise.
+
+// Instruction sets the kernels can use, from least to most capable
+enum StatIsa {
+    StatIsaScalar,
+    StatIsaSse42,
+    StatIsaAvx2,
+};
+
+// The most capable instruction set that the CPU and OS support
+StatIsa StatDetectIsa();
+
+// Caps the kernels at the given instruction set, so that tests and benchmarks can compare the implementations on one
+// machine. Returns the instruction set that is now in use, which is lower if the CPU lacks the requested one.
+StatIsa StatLimitIsa(StatIsa isa);
+
+// Index of the smallest value; count must be non-zero
+size_t StatMinIndex(_In_reads_(count) const int64_t *values, size_t count);
+
+// out[i] = |values[i] - center|, e.g. to take the median absolute deviation
+void StatAbsDeviation(
+    _In_reads_(count) const int64_t *values,
+    size_t count,
+    int64_t center,
+    _Out_writes_(count) int64_t *out);
+
+// Least-squares slope of y against x. Both are taken relative to their first entry, and those differences must
+// be within +/-2^51.
+_Success_(return) bool StatLeastSquaresSlope(
+    _In_reads_(count) const int64_t *x,
+    _In_reads_(count) const int64_t *y,
+    size_t count,
+    _Out_ double &slope);
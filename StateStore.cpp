@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include <wil/result.h>
+
+#include "StateStore.hpp"
+
+#define SNAPSHOT_MAGIC 'SPTX'
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_STRING_MAX 1024
+
+#define SNAPSHOT_FLAG_DRIFT 0x0001
+
+struct SnapshotHeader {
+    ULONG Magic;
+    USHORT Version;
+    USHORT Flags;
+    ULONG SuspendCount;
+    USHORT DevicePathLength;
+    USHORT TimeOffsetPathLength;
+    LONG64 DelayMedian;
+    LONG64 DelayMad;
+    LONG64 DriftPpb;
+};
+static_assert(sizeof(SnapshotHeader) == 40);
+
+std::vector<BYTE> ProviderSnapshot::Serialize() const {
+    SnapshotHeader header{
+        .Magic = SNAPSHOT_MAGIC,
+        .Version = SNAPSHOT_VERSION,
+        .Flags = static_cast<USHORT>(DriftPpb ? SNAPSHOT_FLAG_DRIFT : 0),
+        .SuspendCount = SuspendCount,
+        .DevicePathLength = static_cast<USHORT>(std::min<size_t>(DevicePath.size(), SNAPSHOT_STRING_MAX)),
+        .TimeOffsetPathLength = static_cast<USHORT>(std::min<size_t>(TimeOffsetPath.size(), SNAPSHOT_STRING_MAX)),
+        .DelayMedian = Filter.DelayMedian,
+        .DelayMad = Filter.DelayMad,
+        .DriftPpb = DriftPpb.value_or(0),
+    };
+    auto devicePathBytes = header.DevicePathLength * sizeof(WCHAR);
+    auto timeOffsetPathBytes = header.TimeOffsetPathLength * sizeof(CHAR);
+
+    std::vector<BYTE> data(sizeof(header) + devicePathBytes + timeOffsetPathBytes);
+    auto p = data.data();
+    memcpy(p, &header, sizeof(header));
+    p += sizeof(header);
+    memcpy(p, DevicePath.data(), devicePathBytes);
+    p += devicePathBytes;
+    memcpy(p, TimeOffsetPath.data(), timeOffsetPathBytes);
+    return data;
+}
+
+HRESULT ProviderSnapshot::Deserialize(_In_ const std::vector<BYTE> &data, _Out_ ProviderSnapshot &snapshot) {
+    SnapshotHeader header;
+
+    RETURN_HR_IF(HRESULT_FROM_WIN32(ERROR_INVALID_DATA), data.size() < sizeof(header));
+    memcpy(&header, data.data(), sizeof(header));
+    RETURN_HR_IF(HRESULT_FROM_WIN32(ERROR_INVALID_DATA), header.Magic != SNAPSHOT_MAGIC);
+    RETURN_HR_IF(HRESULT_FROM_WIN32(ERROR_REVISION_MISMATCH), header.Version != SNAPSHOT_VERSION);
+    RETURN_HR_IF(
+        HRESULT_FROM_WIN32(ERROR_INVALID_DATA),
+        header.DevicePathLength > SNAPSHOT_STRING_MAX || header.TimeOffsetPathLength > SNAPSHOT_STRING_MAX);
+
+    auto devicePathBytes = header.DevicePathLength * sizeof(WCHAR);
+    auto timeOffsetPathBytes = header.TimeOffsetPathLength * sizeof(CHAR);
+    RETURN_HR_IF(
+        HRESULT_FROM_WIN32(ERROR_INVALID_DATA),
+        data.size() != sizeof(header) + devicePathBytes + timeOffsetPathBytes);
+    RETURN_HR_IF(HRESULT_FROM_WIN32(ERROR_INVALID_DATA), header.DelayMedian < 0 || header.DelayMad < 0);
+
+    auto p = data.data() + sizeof(header);
+    snapshot.SuspendCount = header.SuspendCount;
+    snapshot.DevicePath.assign(reinterpret_cast<const WCHAR *>(p), header.DevicePathLength);
+    p += devicePathBytes;
+    snapshot.TimeOffsetPath.assign(reinterpret_cast<const CHAR *>(p), header.TimeOffsetPathLength);
+    snapshot.Filter = SampleFilterState{
+        .DelayMedian = header.DelayMedian,
+        .DelayMad = header.DelayMad,
+    };
+    if (header.Flags & SNAPSHOT_FLAG_DRIFT)
+        snapshot.DriftPpb = header.DriftPpb;
+    else
+        snapshot.DriftPpb = std::nullopt;
+    return S_OK;
+}
+
+HRESULT RegistryStateStore::Load(_Out_ std::vector<BYTE> &data) {
+    DWORD size = 0;
+
+    data.clear();
+    RETURN_IF_WIN32_ERROR(
+        RegGetValueW(HKEY_LOCAL_MACHINE, _subkey.c_str(), _valueName.c_str(), RRF_RT_REG_BINARY, nullptr, nullptr, &size));
+    data.resize(size);
+    RETURN_IF_WIN32_ERROR(RegGetValueW(
+        HKEY_LOCAL_MACHINE,
+        _subkey.c_str(),
+        _valueName.c_str(),
+        RRF_RT_REG_BINARY,
+        nullptr,
+        data.data(),
+        &size));
+    data.resize(size);
+    return S_OK;
+}
+
+HRESULT RegistryStateStore::Save(_In_ const std::vector<BYTE> &data) {
+    RETURN_IF_WIN32_ERROR(RegSetKeyValueW(
+        HKEY_LOCAL_MACHINE,
+        _subkey.c_str(),
+        _valueName.c_str(),
+        REG_BINARY,
+        data.data(),
+        static_cast<DWORD>(data.size())));
+    return S_OK;
+}
+
+HRESULT FileStateStore::Load(_Out_ std::vector<BYTE> &data) {
+    data.clear();
+
+    std::ifstream file(_path, std::ios::binary);
+    if (!file)
+        return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    if (file.bad())
+        return E_FAIL;
+    return S_OK;
+}
+
+HRESULT FileStateStore::Save(_In_ const std::vector<BYTE> &data) {
+    auto tempPath = _path;
+    tempPath += L".tmp";
+
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file)
+            return E_ACCESSDENIED;
+        file.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size()));
+        if (!file.flush())
+            return E_FAIL;
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tempPath, _path, ec);
+    if (ec)
+        return HRESULT_FROM_WIN32(ec.value());
+    return S_OK;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <optional>
+#include <vector>
+#include <string>
+#include <filesystem>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include "SampleFilter.hpp"
+
+// Learned provider state carried across service restarts. It is only trusted if the VM has not been suspended or
+// migrated since it was taken, which SuspendCount is used to check.
+struct ProviderSnapshot {
+    ULONG SuspendCount;
+    std::wstring DevicePath;
+    std::string TimeOffsetPath;
+    SampleFilterState Filter;
+    // Published drift of Xen time against the performance counter, if enough samples had been fitted
+    std::optional<LONG64> DriftPpb;
+
+    std::vector<BYTE> Serialize() const;
+    static HRESULT Deserialize(_In_ const std::vector<BYTE> &data, _Out_ ProviderSnapshot &snapshot);
+};
+
+class StateStore {
+public:
+    virtual ~StateStore() = default;
+
+    virtual HRESULT Load(_Out_ std::vector<BYTE> &data) = 0;
+    virtual HRESULT Save(_In_ const std::vector<BYTE> &data) = 0;
+};
+
+// Stores state as a REG_BINARY value under HKEY_LOCAL_MACHINE
+class RegistryStateStore : public StateStore {
+public:
+    RegistryStateStore(_In_ PCWSTR subkey, _In_ PCWSTR valueName) : _subkey(subkey), _valueName(valueName) {}
+
+    HRESULT Load(_Out_ std::vector<BYTE> &data) override;
+    HRESULT Save(_In_ const std::vector<BYTE> &data) override;
+
+private:
+    std::wstring _subkey;
+    std::wstring _valueName;
+};
+
+// Stores state in a plain file, replaced atomically on save
+class FileStateStore : public StateStore {
+public:
+    explicit FileStateStore(_In_ const std::filesystem::path &path) : _path(path) {}
+
+    HRESULT Load(_Out_ std::vector<BYTE> &data) override;
+    HRESULT Save(_In_ const std::vector<BYTE> &data) override;
+
+private:
+    std::filesystem::path _path;
+};
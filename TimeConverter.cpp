@@ -1,5 +1,12 @@
+#include <algorithm>
+#include <iterator>
+
+#include "Globals.hpp"
 #include "TimeConverter.hpp"
 
+#define FILETIME_PER_DAY (TIME_S(86400LL))
+#define FILETIME_PER_MINUTE (TIME_S(60LL))
+
 _Success_(return) BOOL TimeConvertFileTime(
     _In_ CONST FILETIME *inputFileTime,
     _Out_ LPFILETIME outputFileTime,
@@ -29,3 +36,168 @@ _Success_(return) BOOL TimeConvertFileTime(
 
     return TRUE;
 }
+
+static LONG64 FileTimeToInt64(_In_ const FILETIME &fileTime) {
+    return static_cast<LONG64>(static_cast<ULONG64>(fileTime.dwHighDateTime) << 32 | fileTime.dwLowDateTime);
+}
+
+static FILETIME Int64ToFileTime(LONG64 value) {
+    return FILETIME{
+        .dwLowDateTime = static_cast<DWORD>(value),
+        .dwHighDateTime = static_cast<DWORD>(static_cast<ULONG64>(value) >> 32),
+    };
+}
+
+// SYSTEMTIME stops at milliseconds; the 100ns ticks below them are carried over, as the table keeps them for the
+// times it covers
+static BOOL ConvertKeepingTicks(
+    _In_ CONST FILETIME *inputFileTime,
+    _Out_ LPFILETIME outputFileTime,
+    _In_ TIME_CONVERT_FILE_TIME_DIRECTION direction,
+    _In_opt_ PDYNAMIC_TIME_ZONE_INFORMATION dynamicTimeZone) {
+    if (!TimeConvertFileTime(inputFileTime, outputFileTime, direction, dynamicTimeZone))
+        return FALSE;
+    *outputFileTime = Int64ToFileTime(FileTimeToInt64(*outputFileTime) + FileTimeToInt64(*inputFileTime) % TIME_MS(1));
+    return TRUE;
+}
+
+// Days since 1601-01-01 in the proleptic Gregorian calendar
+static LONG64 DaysFromCivil(int year, unsigned month, unsigned day) {
+    year -= month <= 2;
+    auto era = (year >= 0 ? year : year - 399) / 400;
+    auto yearOfEra = static_cast<unsigned>(year - era * 400);
+    auto dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    auto dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    // 584694 days from 0000-03-01 to 1601-01-01
+    return era * 146097LL + static_cast<LONG64>(dayOfEra) - 584694;
+}
+
+static unsigned DaysInMonth(int year, unsigned month) {
+    return static_cast<unsigned>(DaysFromCivil(year + (month == 12), month % 12 + 1, 1) - DaysFromCivil(year, month, 1));
+}
+
+// Local time of a TIME_ZONE_INFORMATION transition date in the given year
+static LONG64 TransitionLocalTime(_In_ const SYSTEMTIME &date, int year) {
+    unsigned day = date.wDay;
+
+    // wYear == 0 means day-in-month format: wDay is the week (5 for the last) of weekday wDayOfWeek
+    if (!date.wYear) {
+        // 1601-01-01 was a Monday
+        auto firstDayOfWeek = static_cast<unsigned>((DaysFromCivil(year, date.wMonth, 1) + 1) % 7);
+        day = 1 + (date.wDayOfWeek + 7 - firstDayOfWeek) % 7 + (date.wDay - 1) * 7;
+        while (day > DaysInMonth(year, date.wMonth))
+            day -= 7;
+    }
+
+    return DaysFromCivil(year, date.wMonth, day) * FILETIME_PER_DAY + TIME_S(date.wHour * 3600LL) +
+        TIME_S(date.wMinute * 60LL) + TIME_S(static_cast<LONG64>(date.wSecond)) +
+        TIME_MS(static_cast<LONG64>(date.wMilliseconds));
+}
+
+void TimeConvertTable::Add(LONG64 universal, LONG64 bias) {
+    if (!_transitions.empty() && _transitions.back().Bias == bias)
+        return;
+    _transitions.push_back(Transition{.Universal = universal, .Local = universal + bias, .Bias = bias});
+}
+
+_Success_(return) BOOL TimeConvertTable::Build(
+    _In_opt_ PDYNAMIC_TIME_ZONE_INFORMATION dynamicTimeZone,
+    _In_ USHORT firstYear,
+    _In_ USHORT lastYear) {
+    if (firstYear < 1602 || lastYear < firstYear || lastYear > 30826) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    _transitions.clear();
+    _hasZone = dynamicTimeZone != nullptr;
+    if (_hasZone)
+        _zone = *dynamicTimeZone;
+
+    LONG64 bias = 0;
+    for (int year = firstYear; year <= lastYear; year++) {
+        TIME_ZONE_INFORMATION tzi;
+        if (!GetTimeZoneInformationForYear(static_cast<USHORT>(year), dynamicTimeZone, &tzi)) {
+            _transitions.clear();
+            return FALSE;
+        }
+
+        // Windows biases are universal minus local, in minutes
+        auto standard = -(tzi.Bias + tzi.StandardBias) * FILETIME_PER_MINUTE;
+        auto daylight = -(tzi.Bias + tzi.DaylightBias) * FILETIME_PER_MINUTE;
+        auto yearStart = DaysFromCivil(year, 1, 1) * FILETIME_PER_DAY;
+
+        if (!tzi.StandardDate.wMonth || !tzi.DaylightDate.wMonth) {
+            Add(yearStart - standard, standard);
+            bias = standard;
+            continue;
+        }
+
+        // DaylightDate is given in standard time and StandardDate in daylight time
+        auto daylightStart = TransitionLocalTime(tzi.DaylightDate, year) - standard;
+        auto daylightEnd = TransitionLocalTime(tzi.StandardDate, year) - daylight;
+        if (daylightStart < daylightEnd) {
+            Add(yearStart - standard, standard);
+            Add(daylightStart, daylight);
+            Add(daylightEnd, standard);
+            bias = standard;
+        } else {
+            // Southern hemisphere: the year starts and ends in daylight time
+            Add(yearStart - daylight, daylight);
+            Add(daylightEnd, standard);
+            Add(daylightStart, daylight);
+            bias = daylight;
+        }
+    }
+
+    _endLocal = DaysFromCivil(lastYear + 1, 1, 1) * FILETIME_PER_DAY;
+    _endUniversal = _endLocal - bias;
+    return TRUE;
+}
+
+_Success_(return) BOOL TimeConvertTable::Convert(
+    _In_reads_(count) CONST FILETIME *input,
+    _Out_writes_(count) LPFILETIME output,
+    _In_ size_t count,
+    _In_ TIME_CONVERT_FILE_TIME_DIRECTION direction) const {
+    if (_transitions.empty()) {
+        SetLastError(ERROR_INVALID_STATE);
+        return FALSE;
+    }
+
+    bool toLocal;
+    switch (direction) {
+    case TimeConvertUniversalToLocal:
+        toLocal = true;
+        break;
+    case TimeConvertLocalToUniversal:
+        toLocal = false;
+        break;
+    default:
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    auto first = toLocal ? _transitions.front().Universal : _transitions.front().Local;
+    auto end = toLocal ? _endUniversal : _endLocal;
+    for (size_t i = 0; i < count; i++) {
+        auto value = FileTimeToInt64(input[i]);
+
+        if (value < first || value >= end) {
+            auto zone = _zone;
+            if (!ConvertKeepingTicks(&input[i], &output[i], direction, _hasZone ? &zone : nullptr))
+                return FALSE;
+            continue;
+        }
+
+        // Last transition at or before value
+        auto next = std::upper_bound(
+            _transitions.begin(),
+            _transitions.end(),
+            value,
+            [toLocal](LONG64 v, const Transition &t) { return v < (toLocal ? t.Universal : t.Local); });
+        auto bias = std::prev(next)->Bias;
+        output[i] = Int64ToFileTime(toLocal ? value + bias : value - bias);
+    }
+    return TRUE;
+}
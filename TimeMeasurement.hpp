@@ -0,0 +1,32 @@
+#pragma once
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+// One reading of Xen time bracketed by two reads of the local clock.
+struct TimeMeasurement {
+    unsigned __int64 Begin;
+    unsigned __int64 XenTime;
+    unsigned __int64 Dispersion;
+    unsigned __int64 End;
+    // Performance counter read just outside Begin and End
+    unsigned __int64 PerfCounterBegin;
+    unsigned __int64 PerfCounterEnd;
+
+    signed __int64 Delay() const {
+        return End > Begin ? static_cast<signed __int64>(End - Begin) : 0;
+    }
+    // Local time of the Xen reading, taken to be asymmetryPpm of the way through the window
+    signed __int64 ReadTime(signed __int64 asymmetryPpm) const {
+        return static_cast<signed __int64>(Begin) + Delay() * asymmetryPpm / 1000000;
+    }
+    // Performance counter at the same point of the window as ReadTime
+    unsigned __int64 ReadPerfCounter(signed __int64 asymmetryPpm) const {
+        auto ticks = PerfCounterEnd > PerfCounterBegin ? PerfCounterEnd - PerfCounterBegin : 0;
+        return PerfCounterBegin + ticks * static_cast<unsigned __int64>(asymmetryPpm) / 1000000;
+    }
+    // Xen time minus local time at ReadTime
+    signed __int64 Offset(signed __int64 asymmetryPpm) const {
+        return static_cast<signed __int64>(XenTime) - ReadTime(asymmetryPpm);
+    }
+};
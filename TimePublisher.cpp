@@ -0,0 +1,181 @@
+#include <algorithm>
+#include <array>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <sddl.h>
+
+#include <wil/result.h>
+
+#include "Logging.hpp"
+#include "PerfCounter.hpp"
+#include "StatKernels.hpp"
+#include "TimePublisher.hpp"
+
+// Full access for the system and the W32Time service account, read access for authenticated users
+#define PUBLISHED_STATE_SDDL L"D:P(A;;GA;;;SY)(A;;GA;;;LS)(A;;GA;;;BA)(A;;GR;;;AU)"
+// Authenticated users may only wait on the events
+#define PUBLISHED_EVENT_SDDL L"D:P(A;;GA;;;SY)(A;;GA;;;LS)(A;;GA;;;BA)(A;;0x00100000;;;AU)"
+// Samples the drift must be fitted over before the fit replaces a seeded drift or is worth saving
+#define PUBLISHER_MIN_DRIFT_SAMPLES 8
+
+static HRESULT MakeSecurityAttributes(
+    _In_ PCWSTR sddl,
+    _Out_ wil::unique_hlocal_security_descriptor &descriptor,
+    _Out_ SECURITY_ATTRIBUTES &attributes) {
+    RETURN_IF_WIN32_BOOL_FALSE(ConvertStringSecurityDescriptorToSecurityDescriptorW(
+        sddl,
+        SDDL_REVISION_1,
+        &descriptor,
+        nullptr));
+    attributes = SECURITY_ATTRIBUTES{
+        .nLength = sizeof(SECURITY_ATTRIBUTES),
+        .lpSecurityDescriptor = descriptor.get(),
+        .bInheritHandle = FALSE,
+    };
+    return S_OK;
+}
+
+TimePublisher::TimePublisher(Private pvt) {
+    UNREFERENCED_PARAMETER(pvt);
+}
+
+HRESULT TimePublisher::Acquire(_Out_ std::shared_ptr<TimePublisher> &publisher) {
+    static std::mutex instanceMutex;
+    static std::weak_ptr<TimePublisher> instance;
+
+    std::lock_guard lock(instanceMutex);
+    publisher = instance.lock();
+    if (!publisher) {
+        auto created = std::make_shared<TimePublisher>(Private());
+        RETURN_IF_FAILED(created->Create());
+        instance = created;
+        publisher = std::move(created);
+    }
+    return S_OK;
+}
+
+HRESULT TimePublisher::Create() {
+    std::lock_guard lock(_mutex);
+    wil::unique_hlocal_security_descriptor descriptor;
+    SECURITY_ATTRIBUTES attributes;
+
+    RETURN_IF_FAILED(MakeSecurityAttributes(PUBLISHED_STATE_SDDL, descriptor, attributes));
+    _mapping.reset(CreateFileMappingW(
+        INVALID_HANDLE_VALUE,
+        &attributes,
+        PAGE_READWRITE,
+        0,
+        sizeof(PublishedState),
+        PUBLISHED_STATE_NAME));
+    RETURN_LAST_ERROR_IF(!_mapping);
+    // Consumers may still hold the section from an earlier run, in which case its contents carry on
+    auto existed = GetLastError() == ERROR_ALREADY_EXISTS;
+
+    _state.reset(static_cast<PublishedState *>(
+        MapViewOfFile(_mapping.get(), FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, sizeof(PublishedState))));
+    RETURN_LAST_ERROR_IF(!_state);
+
+    RETURN_IF_FAILED(MakeSecurityAttributes(PUBLISHED_EVENT_SDDL, descriptor, attributes));
+    PCWSTR eventNames[] = {PUBLISHED_EVENT_NAME_0, PUBLISHED_EVENT_NAME_1};
+    for (size_t i = 0; i < ARRAYSIZE(eventNames); i++) {
+        _events[i].reset(CreateEventW(&attributes, TRUE, FALSE, eventNames[i]));
+        RETURN_LAST_ERROR_IF(!_events[i]);
+    }
+
+    if (!existed || _state.get()->Magic != PUBLISHED_STATE_MAGIC || _state.get()->Version != PUBLISHED_STATE_VERSION) {
+        DebugLog("Initializing published state");
+        auto state = _state.get();
+        state->Sequence.store(0);
+        state->Data = {};
+        state->Generation.store(0);
+        state->Version = PUBLISHED_STATE_VERSION;
+        // Consumers check the magic before anything else
+        std::atomic_thread_fence(std::memory_order_release);
+        state->Magic = PUBLISHED_STATE_MAGIC;
+    }
+    return S_OK;
+}
+
+template <typename F>
+void TimePublisher::Write(F &&update) {
+    auto state = _state.get();
+    auto sequence = state->Sequence.load(std::memory_order_relaxed);
+
+    state->Sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    update(state->Data);
+    state->Sequence.store(sequence + 2, std::memory_order_release);
+}
+
+// Consumers extrapolate from the performance counter, so the drift is fitted as Xen time less performance counter time
+// against performance counter time, rather than against system time
+static LONG64 FitPerfCounterDrift(_In_ const PublishedData &data, ULONG count) {
+    std::array<int64_t, XENTIME_MAX_SAMPLES> x, y;
+
+    for (ULONG i = 0; i < count; i++) {
+        const auto &sample = data.Samples[(data.SampleNext + XENTIME_MAX_SAMPLES - 1 - i) % XENTIME_MAX_SAMPLES];
+        x[i] = static_cast<int64_t>(PerfCounterTo100ns(sample.PerfCounter));
+        y[i] = static_cast<int64_t>(sample.LocalTime) + sample.Offset - x[i];
+    }
+    double slope;
+    if (!StatLeastSquaresSlope(x.data(), y.data(), count, slope))
+        return 0;
+    return static_cast<LONG64>(slope * 1e9);
+}
+
+void TimePublisher::Publish(_In_ const XENTIME_SAMPLE &sample) {
+    std::lock_guard lock(_mutex);
+
+    _driftSamples = std::min<ULONG>(_driftSamples + 1, XENTIME_MAX_SAMPLES);
+    Write([&](PublishedData &data) {
+        data.Samples[data.SampleNext] = sample;
+        data.SampleNext = (data.SampleNext + 1) % XENTIME_MAX_SAMPLES;
+        data.SampleCount = std::min<ULONG>(data.SampleCount + 1, XENTIME_MAX_SAMPLES);
+        if (_seedDriftPpb && _driftSamples < PUBLISHER_MIN_DRIFT_SAMPLES)
+            data.DriftPpb = *_seedDriftPpb;
+        else
+            data.DriftPpb = FitPerfCounterDrift(data, _driftSamples);
+    });
+}
+
+void TimePublisher::Notify(XENTIME_EVENT event) {
+    std::lock_guard lock(_mutex);
+
+    // The VM may be on another host, whose clock runs at another rate
+    if (event == XenTimeEventResume) {
+        _driftSamples = 0;
+        _seedDriftPpb = std::nullopt;
+    }
+    Write([&](PublishedData &data) {
+        if (event == XenTimeEventResume) {
+            data.ResumeCount++;
+            data.DriftPpb = 0;
+        } else {
+            data.OffsetChangeCount++;
+        }
+    });
+
+    auto state = _state.get();
+    auto generation = state->Generation.load();
+    _events[(generation + 1) % 2].ResetEvent();
+    state->Generation.store(generation + 1);
+    _events[generation % 2].SetEvent();
+}
+
+_Success_(return) bool TimePublisher::GetFittedDrift(_Out_ LONG64 &driftPpb) {
+    std::lock_guard lock(_mutex);
+
+    if (_driftSamples < PUBLISHER_MIN_DRIFT_SAMPLES)
+        return false;
+    driftPpb = _state.get()->Data.DriftPpb;
+    return true;
+}
+
+void TimePublisher::SeedDrift(LONG64 driftPpb) {
+    std::lock_guard lock(_mutex);
+
+    _seedDriftPpb = driftPpb;
+    if (_driftSamples < PUBLISHER_MIN_DRIFT_SAMPLES)
+        Write([&](PublishedData &data) { data.DriftPpb = driftPpb; });
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <optional>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include <wil/resource.h>
+
+#include "PublishedState.hpp"
+
+// Publishes samples and notifications to shared memory for xentimeapi.h consumers. There is one per process, shared by
+// all provider instances.
+class TimePublisher {
+    struct Private {
+        explicit Private() = default;
+    };
+
+public:
+    TimePublisher(Private pvt);
+    TimePublisher(const TimePublisher &) = delete;
+    TimePublisher &operator=(const TimePublisher &) = delete;
+    TimePublisher(TimePublisher &&) = delete;
+    TimePublisher &operator=(TimePublisher &&) = delete;
+
+    static HRESULT Acquire(_Out_ std::shared_ptr<TimePublisher> &publisher);
+
+    // Also refits the published drift over the samples since the last resume
+    void Publish(_In_ const XENTIME_SAMPLE &sample);
+    void Notify(XENTIME_EVENT event);
+    // Drift fitted over the samples since the last resume, once there are enough of them to carry over to a later run
+    _Success_(return) bool GetFittedDrift(_Out_ LONG64 &driftPpb);
+    // Drift to publish until enough samples have been fitted, e.g. one saved by an earlier run. Cleared on resume.
+    void SeedDrift(LONG64 driftPpb);
+
+private:
+    HRESULT Create();
+    template <typename F>
+    void Write(F &&update);
+
+    std::mutex _mutex;
+    _Guarded_by_(_mutex) wil::unique_handle _mapping;
+    _Guarded_by_(_mutex) wil::unique_mapview_ptr<PublishedState> _state;
+    _Guarded_by_(_mutex) wil::unique_event _events[2];
+    // Newest published samples that the drift is fitted over; samples from before a resume are left out
+    _Guarded_by_(_mutex) ULONG _driftSamples = 0;
+    _Guarded_by_(_mutex) std::optional<LONG64> _seedDriftPpb;
+};
@@ -0,0 +1,78 @@
+#include <algorithm>
+
+#include "TimeSourceArbiter.hpp"
+
+// Weight of a new read in the latency and jitter averages, as 1/n
+#define ARBITER_AVERAGE_WEIGHT 8
+// Availability drops by 1/n on each failure and recovers by 1/n of the shortfall on each success, so that a failing
+// source loses its rank quickly and regains it gradually
+#define ARBITER_FAILURE_WEIGHT 4
+#define ARBITER_RECOVERY_WEIGHT 16
+// Jitter counts this many times as much as latency
+#define ARBITER_JITTER_FACTOR 4
+
+std::array<size_t, TimeSourceArbiter::MaxSources> TimeSourceArbiter::Rank(size_t count) const {
+    std::array<size_t, MaxSources> ranking;
+    for (size_t i = 0; i < ranking.size(); i++)
+        ranking[i] = i;
+    count = std::min(count, MaxSources);
+    std::stable_sort(ranking.begin(), ranking.begin() + count, [this](size_t a, size_t b) { return Cost(a) < Cost(b); });
+
+    if (_probeInterval && count > 1 && _reads % _probeInterval == _probeInterval - 1) {
+        auto stalest = std::min_element(ranking.begin(), ranking.begin() + count, [this](size_t a, size_t b) {
+            return _scores[a].LastRead < _scores[b].LastRead;
+        });
+        std::rotate(ranking.begin(), stalest, stalest + 1);
+    }
+    return ranking;
+}
+
+// Moves a fixed point average 1/ARBITER_AVERAGE_WEIGHT of the way towards a fixed point value
+static ULONG64 UpdateAverage(ULONG64 average, ULONG64 value) {
+    return static_cast<ULONG64>(
+        static_cast<LONG64>(average) +
+        (static_cast<LONG64>(value) - static_cast<LONG64>(average)) / ARBITER_AVERAGE_WEIGHT);
+}
+
+void TimeSourceArbiter::Record(size_t source, HRESULT hr, ULONG64 latency) {
+    if (source >= MaxSources)
+        return;
+    auto &score = _scores[source];
+
+    score.Reads++;
+    score.LastRead = ++_reads;
+    if (FAILED(hr)) {
+        score.Failures++;
+        score.AvailabilityPermille -= score.AvailabilityPermille / ARBITER_FAILURE_WEIGHT;
+        return;
+    }
+
+    score.AvailabilityPermille += (1000 - score.AvailabilityPermille) / ARBITER_RECOVERY_WEIGHT;
+    if (score.Reads - score.Failures == 1) {
+        score.Latency = latency << TimeSourceScore::FractionBits;
+        score.Jitter = 0;
+    } else {
+        auto scaled = latency << TimeSourceScore::FractionBits;
+        auto deviation = scaled > score.Latency ? scaled - score.Latency : score.Latency - scaled;
+        score.Latency = UpdateAverage(score.Latency, scaled);
+        score.Jitter = UpdateAverage(score.Jitter, deviation);
+    }
+
+    if (source != _selected) {
+        _selected = source;
+        _switches++;
+    }
+}
+
+void TimeSourceArbiter::Reset() {
+    for (auto &score : _scores)
+        score = TimeSourceScore{.AvailabilityPermille = 1000};
+    _selected = 0;
+}
+
+ULONG64 TimeSourceArbiter::Cost(size_t source) const {
+    const auto &score = _scores[source];
+    // Plus one so that an unmeasured source is still ranked by availability
+    auto cost = score.Latency + score.Jitter * ARBITER_JITTER_FACTOR + 1;
+    return cost * 1000 / std::max<ULONG64>(score.AvailabilityPermille, 1);
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <tuple>
+#include <utility>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include "PerfCounter.hpp"
+
+struct TimeSourceScore {
+    // Fractional bits of Latency and Jitter, so that reads much shorter than 100 ns still move the averages
+    static constexpr unsigned FractionBits = 8;
+
+    ULONG64 Reads;
+    ULONG64 Failures;
+    // Moving averages: share of recent reads that succeeded, and how long reads take and how much that varies, in
+    // 100 ns units with FractionBits fractional bits
+    ULONG64 AvailabilityPermille;
+    ULONG64 Latency;
+    ULONG64 Jitter;
+    // Value of the arbiter's read count when this source was last read
+    ULONG64 LastRead;
+};
+
+// Scores time sources by availability, read latency and latency jitter, and ranks them for the next read
+class TimeSourceArbiter {
+public:
+    static constexpr size_t MaxSources = 4;
+
+    // With a probe interval, every that many reads the source read longest ago goes first, so that a recovered source
+    // can regain its rank. Only useful with more than one source.
+    explicit TimeSourceArbiter(ULONG64 probeInterval = 0) : _probeInterval(probeInterval) {
+        Reset();
+    }
+
+    // Indexes of the first count sources, best first
+    std::array<size_t, MaxSources> Rank(size_t count) const;
+    // Latency is in 100 ns units
+    void Record(size_t source, HRESULT hr, ULONG64 latency);
+    // Forget the scores, e.g. after moving to another host; the switch count is kept
+    void Reset();
+
+    // The source of the latest successful read
+    size_t GetSelected() const {
+        return _selected;
+    }
+    ULONG64 GetSwitches() const {
+        return _switches;
+    }
+    const TimeSourceScore &GetScore(size_t source) const {
+        return _scores[source];
+    }
+
+private:
+    ULONG64 Cost(size_t source) const;
+
+    std::array<TimeSourceScore, MaxSources> _scores{};
+    size_t _selected = 0;
+    ULONG64 _switches = 0;
+    ULONG64 _reads = 0;
+    ULONG64 _probeInterval;
+};
+
+// SamplePipeline time source policy that reads the best ranked of several sources, falling back to the next one
+// within the same read when a source fails. Each source is itself a time source policy with a static Name.
+template <typename... Sources>
+class ArbitratedTimeSource {
+    static_assert(sizeof...(Sources) > 0 && sizeof...(Sources) <= TimeSourceArbiter::MaxSources);
+
+public:
+    ArbitratedTimeSource(TimeSourceArbiter &arbiter, Sources... sources)
+        : _arbiter(&arbiter), _sources(std::move(sources)...) {}
+
+    HRESULT Read(_Out_ unsigned __int64 *time, _Out_ unsigned __int64 *dispersion) {
+        auto ranking = _arbiter->Rank(sizeof...(Sources));
+        HRESULT hr = E_FAIL;
+        for (size_t i = 0; i < sizeof...(Sources); i++) {
+            hr = ReadSource(ranking[i], time, dispersion, std::index_sequence_for<Sources...>());
+            if (SUCCEEDED(hr))
+                break;
+        }
+        return hr;
+    }
+
+    PCWSTR GetSelectedName() const {
+        static constexpr std::array<PCWSTR, sizeof...(Sources)> names{Sources::Name...};
+        return names[_arbiter->GetSelected() % names.size()];
+    }
+
+private:
+    template <size_t... I>
+    HRESULT ReadSource(
+        size_t index,
+        _Out_ unsigned __int64 *time,
+        _Out_ unsigned __int64 *dispersion,
+        std::index_sequence<I...>) {
+        HRESULT hr = E_INVALIDARG;
+        ((I == index && (hr = ReadTimed<I>(time, dispersion), true)) || ...);
+        return hr;
+    }
+
+    template <size_t I>
+    HRESULT ReadTimed(_Out_ unsigned __int64 *time, _Out_ unsigned __int64 *dispersion) {
+        auto start = PerfCounterNow();
+        auto hr = std::get<I>(_sources).Read(time, dispersion);
+        _arbiter->Record(I, hr, PerfCounterTo100ns(PerfCounterNow() - start));
+        return hr;
+    }
+
+    TimeSourceArbiter *_arbiter;
+    std::tuple<Sources...> _sources;
+};
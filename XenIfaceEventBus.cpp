@@ -0,0 +1,66 @@
+#include <algorithm>
+
+#include <wil/resource.h>
+
+#include "XenIfaceEventBus.hpp"
+
+void XenIfaceSubscription::Reset() {
+    if (auto bus = _bus.lock(); bus && _cookie)
+        bus->Unsubscribe(_cookie);
+    _bus.reset();
+    _cookie = 0;
+}
+
+XenIfaceSubscription XenIfaceEventBus::Subscribe(XenIfaceEvent event, std::function<void()> &&callback) {
+    std::lock_guard lock(_mutex);
+    auto cookie = _nextCookie++;
+
+    auto subscriber = std::make_shared<Subscriber>();
+    subscriber->Cookie = cookie;
+    subscriber->Event = event;
+    subscriber->Callback = std::move(callback);
+
+    auto subscribers = std::make_shared<SubscriberList>(*_subscribers.load());
+    subscribers->push_back(std::move(subscriber));
+    _subscribers.store(std::move(subscribers));
+
+    return XenIfaceSubscription(weak_from_this(), cookie);
+}
+
+void XenIfaceEventBus::Publish(XenIfaceEvent event) const {
+    auto subscribers = _subscribers.load();
+    for (const auto &subscriber : *subscribers) {
+        if (subscriber->Event != event)
+            continue;
+        // Announce the call before checking Removed, so that Unsubscribe either sees it running or we see it removed
+        subscriber->Running++;
+        // Unsubscribe would wait forever if a throwing callback left the count raised
+        auto done = wil::scope_exit([&] {
+            if (--subscriber->Running == 0)
+                subscriber->Running.notify_all();
+        });
+        if (!subscriber->Removed)
+            subscriber->Callback();
+    }
+}
+
+void XenIfaceEventBus::Unsubscribe(ULONG64 cookie) {
+    std::shared_ptr<Subscriber> removed;
+    {
+        std::lock_guard lock(_mutex);
+        auto subscribers = std::make_shared<SubscriberList>(*_subscribers.load());
+        auto it = std::find_if(subscribers->begin(), subscribers->end(), [cookie](const auto &subscriber) {
+            return subscriber->Cookie == cookie;
+        });
+        if (it == subscribers->end())
+            return;
+        removed = std::move(*it);
+        subscribers->erase(it);
+        _subscribers.store(std::move(subscribers));
+    }
+
+    // Publishers may still hold the old snapshot; wait out any call already in progress
+    removed->Removed = true;
+    for (auto running = removed->Running.load(); running; running = removed->Running.load())
+        removed->Running.wait(running);
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+enum XenIfaceEvent {
+    // A device was opened and became the active device
+    XenIfaceEventArrival,
+    // The active device was closed because it is being removed
+    XenIfaceEventRemoval,
+    // The active device's handle was closed so that it can be removed
+    XenIfaceEventQueryRemove,
+    XenIfaceEventResume,
+    // Signalled by the host over an event channel when the VM's wallclock or time offset changes
+    XenIfaceEventTimeChange,
+};
+
+class XenIfaceEventBus;
+
+// Unsubscribes when destroyed. Destruction waits for a running callback to return, so it must not be destroyed from
+// within its own callback.
+class XenIfaceSubscription {
+public:
+    XenIfaceSubscription() = default;
+    ~XenIfaceSubscription() {
+        Reset();
+    }
+    XenIfaceSubscription(const XenIfaceSubscription &) = delete;
+    XenIfaceSubscription &operator=(const XenIfaceSubscription &) = delete;
+    XenIfaceSubscription(XenIfaceSubscription &&other) noexcept
+        : _bus(std::move(other._bus)), _cookie(std::exchange(other._cookie, 0)) {}
+    XenIfaceSubscription &operator=(XenIfaceSubscription &&other) noexcept {
+        if (this != &other) {
+            Reset();
+            _bus = std::move(other._bus);
+            _cookie = std::exchange(other._cookie, 0);
+        }
+        return *this;
+    }
+
+    void Reset();
+
+private:
+    friend class XenIfaceEventBus;
+    XenIfaceSubscription(std::weak_ptr<XenIfaceEventBus> bus, ULONG64 cookie) : _bus(std::move(bus)), _cookie(cookie) {}
+
+    std::weak_ptr<XenIfaceEventBus> _bus;
+    ULONG64 _cookie = 0;
+};
+
+// Delivers device lifecycle events to subscribers. Publishing reads an immutable snapshot of the subscriber list without
+// taking _mutex, so it never waits for a subscribe or unsubscribe; subscribing and unsubscribing replace the snapshot.
+// Loading the snapshot is not lock-free: std::atomic<std::shared_ptr> guards the pointer with a brief internal lock.
+class XenIfaceEventBus : public std::enable_shared_from_this<XenIfaceEventBus> {
+public:
+    XenIfaceSubscription Subscribe(XenIfaceEvent event, std::function<void()> &&callback);
+    void Publish(XenIfaceEvent event) const;
+
+private:
+    friend class XenIfaceSubscription;
+
+    struct Subscriber {
+        ULONG64 Cookie;
+        XenIfaceEvent Event;
+        std::function<void()> Callback;
+        // Publishers currently inside Callback
+        mutable std::atomic<ULONG> Running = 0;
+        std::atomic<bool> Removed = false;
+    };
+    using SubscriberList = std::vector<std::shared_ptr<Subscriber>>;
+
+    void Unsubscribe(ULONG64 cookie);
+
+    std::atomic<std::shared_ptr<const SubscriberList>> _subscribers{std::make_shared<const SubscriberList>()};
+    // Serializes writers of _subscribers
+    std::mutex _mutex;
+    _Guarded_by_(_mutex) ULONG64 _nextCookie = 1;
+};
@@ -1,9 +1,11 @@
+#include <algorithm>
 #include <vector>
 
 #include <wil/result.h>
 #include <wil/filesystem.h>
 
 #include "Logging.hpp"
+#include "PerfCounter.hpp"
 #include "XenIfaceWorker.hpp"
 #include "xeniface_ioctls.h"
 
@@ -23,8 +25,9 @@
         } \
     } while (0)
 
-static std::vector<std::wstring> ParseMultiStrings(_In_reads_(count) const WCHAR *buf, size_t count) {
-    std::vector<std::wstring> strings;
+// The returned views point into buf
+static std::vector<std::wstring_view> ParseMultiStrings(_In_reads_(count) const WCHAR *buf, size_t count) {
+    std::vector<std::wstring_view> strings;
     if (!buf || !count)
         return strings;
     for (size_t i = 0; i < count; i++) {
@@ -77,22 +80,39 @@ _Pre_satisfies_(eventDataSize >= sizeof(CM_NOTIFY_EVENT_DATA)) DWORD CALLBACK
         _In_ CM_NOTIFY_ACTION action,
         _In_reads_bytes_(eventDataSize) PCM_NOTIFY_EVENT_DATA eventData,
         _In_ DWORD eventDataSize) {
-    auto self = static_cast<XenIfaceDevice *>(context)->shared_from_this();
-
     UNREFERENCED_PARAMETER(notifyHandle);
     UNREFERENCED_PARAMETER(eventData);
     UNREFERENCED_PARAMETER(eventDataSize);
 
+    // The device may already be on its way out, its destructor waiting in CM_Unregister_Notification for this callback
+    auto self = static_cast<XenIfaceDevice *>(context)->weak_from_this().lock();
+    if (!self)
+        return ERROR_SUCCESS;
+
     switch (action) {
     case CM_NOTIFY_ACTION_DEVICEQUERYREMOVE:
-    case CM_NOTIFY_ACTION_DEVICEQUERYREMOVEFAILED:
+    case CM_NOTIFY_ACTION_DEVICEQUERYREMOVEFAILED: {
         // Must close immediately to avoid failing DEVICEQUERYREMOVE
         DebugLog("CM_NOTIFY_ACTION_DEVICEQUERYREMOVE/FAILED");
-        self->Close();
+        auto start = PerfCounterNow();
+        XenIfaceDevice::Detached detached;
+        {
+            std::lock_guard lock(self->_worker->_mutex);
+            // Swap in the standby first, so that users never find the active device without a handle
+            if (action == CM_NOTIFY_ACTION_DEVICEQUERYREMOVE && self == self->_worker->_active)
+                self->_worker->FailOver(start);
+            detached = self->Detach();
+        }
+        // The worker may already have bound the channel on another device under the same key
+        detached.TimeChange.Abandon();
         break;
     }
+    }
 
-    self->_worker->QueueRequest(std::unique_lock(self->_worker->_mutex), self, action);
+    // The request takes this callback's reference, so that the last one is never dropped here: the destructor
+    // unregisters this callback and would wait for itself
+    auto worker = self->_worker;
+    worker->QueueRequest(std::unique_lock(worker->_mutex), std::move(self), action);
 
     return ERROR_SUCCESS;
 }
@@ -117,7 +137,22 @@ XenIfaceWorker::XenIfaceDevice::XenIfaceDevice(
         DebugLog("CM_Register_Notification failed %x", cr);
     THROW_IF_CR_FAILED(cr);
 
-    _suspend = ResumeNotifier(_handle.get(), [this] { _worker->OnResume(this); });
+    _suspend = ResumeNotifier(_handle.get(), [this] { _worker->OnEvent(this, XenIfaceEventResume); });
+}
+
+void XenIfaceWorker::XenIfaceDevice::BindTimeChange(USHORT remoteDomain) {
+    if (_timeChange || !_handle.is_valid())
+        return;
+    try {
+        _timeChange = EventChannelNotifier(
+            _handle.get(),
+            remoteDomain,
+            [this] { _worker->OnEvent(this, XenIfaceEventTimeChange); });
+        _timeChangeDomain = remoteDomain;
+    } catch (...) {
+        // Older drivers or a missing host agent should not stop the device from being used for polling
+        DebugLog("Failed to bind time change event channel: %x", wil::ResultFromCaughtException());
+    }
 }
 
 HRESULT XenIfaceWorker::XenIfaceDevice::make(
@@ -140,45 +175,129 @@ XenIfaceWorker::~XenIfaceWorker() {
     _signal.notify_one();
 }
 
-std::tuple<std::unique_lock<std::mutex>, HANDLE, PCWSTR> XenIfaceWorker::GetDevice() {
+std::shared_ptr<XenIfaceWorker> XenIfaceWorker::Acquire() {
+    static std::mutex instanceMutex;
+    static std::weak_ptr<XenIfaceWorker> instance;
+
+    std::lock_guard lock(instanceMutex);
+    auto worker = instance.lock();
+    if (!worker) {
+        worker = std::make_shared<XenIfaceWorker>();
+        instance = worker;
+    }
+    return worker;
+}
+
+bool XenIfaceWorker::WaitReady(std::chrono::milliseconds timeout) {
+    std::unique_lock lock(_mutex);
+    return _readySignal.wait_for(lock, timeout, [this] { return _ready; });
+}
+
+XenIfaceWorkerStats XenIfaceWorker::GetStats() {
+    XenIfaceWorkerStats stats;
+    {
+        std::lock_guard lock(_mutex);
+        stats = _stats;
+    }
+    stats.Lock = _mutex.GetStats();
+    return stats;
+}
+
+std::tuple<std::unique_lock<InstrumentedMutex>, HANDLE, PCWSTR, XenIfaceDeviceCache *> XenIfaceWorker::GetDevice() {
     std::unique_lock lock(_mutex);
     if (_active)
-        return {std::move(lock), _active->GetHandle().get(), _active->GetPath().c_str()};
-    return {std::move(lock), nullptr, L""};
+        return {std::move(lock), _active->GetHandle().get(), _active->GetPath().c_str(), &_active->GetCache()};
+    return {std::move(lock), nullptr, L"", nullptr};
 }
 
-void XenIfaceWorker::RegisterResume(std::function<void()> &&callback) {
+XenIfaceWorker::DeviceLease XenIfaceWorker::LeaseDevice() {
     std::lock_guard lock(_mutex);
-    _callbacks.push_back(std::forward<std::function<void()>>(callback));
+    if (!_active || !_active->GetHandle().is_valid())
+        return {};
+    return DeviceLease(this, _active, _active->GetPath());
+}
+
+std::unique_lock<InstrumentedMutex> XenIfaceWorker::DeviceLease::Lock(
+    _Out_ HANDLE &handle,
+    _Out_ XenIfaceDeviceCache *&cache) {
+    handle = nullptr;
+    cache = nullptr;
+    if (!_worker)
+        return {};
+
+    std::unique_lock lock(_worker->_mutex);
+    // Compared by owner: promoting the weak reference could leave this thread holding the last one
+    auto &active = _worker->_active;
+    if (active && !_device.owner_before(active) && !active.owner_before(_device) && active->GetHandle().is_valid()) {
+        handle = active->GetHandle().get();
+        cache = &active->GetCache();
+    }
+    return lock;
+}
+
+HRESULT XenIfaceWorker::EnableTimeChangeNotifications(const void *owner, USHORT remoteDomain) {
+    {
+        std::lock_guard lock(_mutex);
+        for (const auto &[other, domain] : _timeChangeOwners) {
+            if (other != owner && domain != remoteDomain) {
+                DebugLog("Time change notifications already requested for domain %u", domain);
+                return HRESULT_FROM_WIN32(ERROR_BUSY);
+            }
+        }
+        auto [it, inserted] = _timeChangeOwners.try_emplace(owner, remoteDomain);
+        if (!inserted && it->second == remoteDomain)
+            return S_OK;
+        it->second = remoteDomain;
+        _timeChangeUpdated = true;
+    }
+    _signal.notify_one();
+    return S_OK;
+}
+
+void XenIfaceWorker::DisableTimeChangeNotifications(const void *owner) {
+    {
+        std::lock_guard lock(_mutex);
+        if (!_timeChangeOwners.erase(owner))
+            return;
+        _timeChangeUpdated = true;
+    }
+    _signal.notify_one();
+}
+
+std::optional<USHORT> XenIfaceWorker::GetTimeChangeDomain() {
+    if (_timeChangeOwners.empty())
+        return std::nullopt;
+    return _timeChangeOwners.begin()->second;
 }
 
 void XenIfaceWorker::QueueRequest(
-    std::unique_lock<std::mutex> &&lock,
+    std::unique_lock<InstrumentedMutex> &&lock,
     std::shared_ptr<XenIfaceDevice> target,
     CM_NOTIFY_ACTION action) {
     _Analysis_assume_lock_held_(_mutex);
     {
         auto _lock = std::move(lock);
-        _requests.emplace_back(XenIfaceWorkerRequest{.Target = std::move(target), .Action = action});
+        _requests.emplace_back(
+            XenIfaceWorkerRequest{.Target = std::move(target), .Action = action});
     }
     _signal.notify_one();
 }
 
-void XenIfaceWorker::OnResume(XenIfaceDevice *device) {
-    std::vector<std::function<void()>> callbacks;
-
+void XenIfaceWorker::OnEvent(XenIfaceDevice *device, XenIfaceEvent event) {
     {
         std::lock_guard lock(_mutex);
-        if (_active.get() == device) {
-            callbacks = _callbacks;
+        if (_active.get() != device)
+            return;
+        if (event == XenIfaceEventResume) {
+            _stats.Resumes++;
+            // The VM may have been migrated, which can change its XenStore paths
+            device->GetCache() = {};
+        } else {
+            _stats.TimeChanges++;
         }
     }
 
-    for (const auto &callback : callbacks) {
-        if (callback) {
-            callback();
-        }
-    }
+    _events->Publish(event);
 }
 
 _Pre_satisfies_(eventDataSize >= sizeof(CM_NOTIFY_EVENT_DATA)) DWORD CALLBACK XenIfaceWorker::CmListenerCallback(
@@ -191,27 +310,26 @@ _Pre_satisfies_(eventDataSize >= sizeof(CM_NOTIFY_EVENT_DATA)) DWORD CALLBACK Xe
     auto self = static_cast<XenIfaceWorker *>(context);
 
     UNREFERENCED_PARAMETER(notifyHandle);
-    UNREFERENCED_PARAMETER(eventData);
-    UNREFERENCED_PARAMETER(eventDataSize);
+
+    XenIfaceWorkerRequest request{.Action = action};
+    constexpr auto linkOffset = offsetof(CM_NOTIFY_EVENT_DATA, u.DeviceInterface.SymbolicLink);
+    if (eventData && eventDataSize > linkOffset) {
+        auto link = eventData->u.DeviceInterface.SymbolicLink;
+        auto maxChars = (eventDataSize - linkOffset) / sizeof(WCHAR);
+        request.Interface.assign(link, wcsnlen(link, maxChars));
+    }
 
     {
         std::lock_guard lock(self->_mutex);
-        self->_requests.emplace_back(XenIfaceWorkerRequest{.Action = action});
+        self->_requests.emplace_back(std::move(request));
     }
     self->_signal.notify_one();
 
     return ERROR_SUCCESS;
 }
 
-HRESULT XenIfaceWorker::RefreshDevices(std::list<std::shared_ptr<XenIfaceDevice>> &tombstones) {
-    DebugLog("XenIfaceWorker::RefreshDevices");
-
-    if (_active && _active->GetHandle().is_valid()) {
-        DebugLog("Device valid, skipping refresh");
-        return S_FALSE;
-    } else if (_active) {
-        tombstones.emplace_back(std::move(_active));
-    }
+HRESULT XenIfaceWorker::EnumerateInterfaces() {
+    DebugLog("XenIfaceWorker::EnumerateInterfaces");
 
     std::vector<WCHAR> buffer;
     auto hr = GetDeviceInterfaceList(buffer, &GUID_INTERFACE_XENIFACE, nullptr, CM_GET_DEVICE_INTERFACE_LIST_PRESENT);
@@ -219,25 +337,136 @@ HRESULT XenIfaceWorker::RefreshDevices(std::list<std::shared_ptr<XenIfaceDevice>
         DebugLog("GetDeviceInterfaceList failed %x", hr);
     RETURN_IF_FAILED(hr);
 
-    auto interfaces = ParseMultiStrings(buffer.data(), buffer.size());
-    if (interfaces.empty()) {
-        DebugLog("Interface list empty");
-        return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+    _stats.Enumerations++;
+    _interfaces.clear();
+    for (auto iface : ParseMultiStrings(buffer.data(), buffer.size())) {
+        DebugLog("Interface: %.*S", static_cast<int>(iface.size()), iface.data());
+        _interfaces.emplace(iface);
     }
+    _enumerated = true;
+    return S_OK;
+}
 
-    for (const auto &iface : interfaces)
-        DebugLog("Interface: %S", iface.c_str());
-
-    auto [newHandle, err] = wil::try_open_file(interfaces[0].c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE);
+HRESULT XenIfaceWorker::OpenDevice(const std::wstring &path, std::shared_ptr<XenIfaceDevice> &device) {
+    auto [newHandle, err] = wil::try_open_file(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE);
     if (!newHandle.is_valid())
-        DebugLog("open(%S) failed %x", interfaces[0].c_str(), err);
+        DebugLog("open(%S) failed %x", path.c_str(), err);
     RETURN_HR_IF(HRESULT_FROM_WIN32(err), !newHandle.is_valid());
 
-    RETURN_IF_FAILED(XenIfaceDevice::make(_active, std::move(newHandle), interfaces[0], this));
+    RETURN_IF_FAILED(XenIfaceDevice::make(device, std::move(newHandle), path, this));
+    _stats.DevicesOpened++;
+    return S_OK;
+}
 
+HRESULT XenIfaceWorker::OpenInterface(const std::wstring &path) {
+    RETURN_IF_FAILED(OpenDevice(path, _active));
+    Activated();
     return S_OK;
 }
 
+void XenIfaceWorker::Activated() {
+    _pendingEvents.push_back(XenIfaceEventArrival);
+    _timeChangeUpdated = true;
+}
+
+bool XenIfaceWorker::PromoteStandby(std::list<std::shared_ptr<XenIfaceDevice>> &retired) {
+    if (!_standby || !_standby->GetHandle().is_valid())
+        return false;
+
+    DebugLog("Failing over to %S", _standby->GetPath().c_str());
+    if (_active) {
+        _stats.DevicesClosed++;
+        retired.emplace_back(std::move(_active));
+    }
+    _active = std::move(_standby);
+    _standbyWanted = true;
+    Activated();
+    return true;
+}
+
+void XenIfaceWorker::FailOver(ULONG64 start) {
+    _pendingEvents.push_back(XenIfaceEventQueryRemove);
+    // Keep the old device registered so that its removal or removal failure still arrives
+    if (PromoteStandby(_retired)) {
+        _stats.Failovers++;
+        auto failoverUs = PerfCounterToUs(PerfCounterNow() - start);
+        _stats.FailoverUsTotal += failoverUs;
+        _stats.FailoverUsMax = std::max(_stats.FailoverUsMax, failoverUs);
+    }
+}
+
+void XenIfaceWorker::EnsureStandby(std::list<std::shared_ptr<XenIfaceDevice>> &tombstones) {
+    if (_standby && _standby->GetHandle().is_valid())
+        return;
+    if (_standby)
+        tombstones.emplace_back(std::move(_standby));
+    if (!_active)
+        return;
+
+    for (const auto &iface : _interfaces) {
+        if (InterfacePathEqual(iface, _active->GetPath()) || _removing.contains(iface))
+            continue;
+        if (SUCCEEDED(OpenDevice(iface, _standby))) {
+            DebugLog("Standby: %S", iface.c_str());
+            _stats.StandbysOpened++;
+            return;
+        }
+    }
+}
+
+HRESULT XenIfaceWorker::OpenRegistered(std::wstring_view preferred) {
+    std::vector<std::wstring> candidates;
+    if (auto it = _interfaces.find(preferred); it != _interfaces.end())
+        candidates.push_back(*it);
+    for (const auto &iface : _interfaces)
+        if (candidates.empty() || candidates[0] != iface)
+            candidates.push_back(iface);
+
+    auto hr = HRESULT_FROM_WIN32(ERROR_NO_MORE_ITEMS);
+    for (const auto &iface : candidates) {
+        // Opening a device that is being removed would hold up its removal
+        if (_removing.contains(iface))
+            continue;
+        hr = OpenInterface(iface);
+        if (SUCCEEDED(hr))
+            return hr;
+    }
+    return hr;
+}
+
+HRESULT XenIfaceWorker::RefreshDevices(
+    std::list<std::shared_ptr<XenIfaceDevice>> &tombstones,
+    std::wstring_view preferred) {
+    DebugLog("XenIfaceWorker::RefreshDevices");
+
+    if (_active && _active->GetHandle().is_valid()) {
+        DebugLog("Device valid, skipping refresh");
+        return S_FALSE;
+    } else if (_active) {
+        _stats.DevicesClosed++;
+        tombstones.emplace_back(std::move(_active));
+    }
+
+    if (PromoteStandby(tombstones))
+        return S_OK;
+
+    // Try the registry first; an interface that cannot be opened means it is out of date
+    auto hr = _enumerated ? OpenRegistered(preferred) : E_PENDING;
+    if (SUCCEEDED(hr))
+        return hr;
+    if (hr != HRESULT_FROM_WIN32(ERROR_NO_MORE_ITEMS)) {
+        if (_stats.Enumerations)
+            _stats.Resyncs++;
+        RETURN_IF_FAILED(EnumerateInterfaces());
+        hr = OpenRegistered(preferred);
+    }
+    if (hr == HRESULT_FROM_WIN32(ERROR_NO_MORE_ITEMS)) {
+        DebugLog("No interfaces registered that are not being removed");
+        return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+    }
+    return hr;
+}
+
 void XenIfaceWorker::WorkerFunc(std::stop_token stop) {
     HRESULT hr;
     std::list<std::shared_ptr<XenIfaceDevice>> tombstones;
@@ -252,47 +481,172 @@ void XenIfaceWorker::WorkerFunc(std::stop_token stop) {
 
     wil::unique_hcmnotification cmListener;
     auto cr = CM_Register_Notification(&filter, this, &CmListenerCallback, &cmListener);
-    if (cr != CR_SUCCESS)
+    if (cr != CR_SUCCESS) {
+        DebugLog("CM_Register_Notification failed %x", cr);
+        {
+            std::lock_guard lock(_mutex);
+            _ready = true;
+        }
+        _readySignal.notify_all();
         return;
+    }
 
+    std::vector<XenIfaceEvent> events;
+    EventChannelNotifier unbound;
+    bool rebind;
     {
         std::lock_guard lock(_mutex);
         hr = RefreshDevices(tombstones);
         if (FAILED(hr))
             DebugLog("RefreshDevices failed %x", hr);
+        EnsureStandby(tombstones);
+        _standbyWanted = false;
+        _ready = true;
+        events.swap(_pendingEvents);
     }
+    _readySignal.notify_all();
+    for (auto event : events)
+        _events->Publish(event);
 
     while (1) {
         {
             std::unique_lock lock(_mutex);
-            _signal.wait(lock);
+            // Requests queued while the lock was dropped must not be waited past
+            _signal.wait(lock, [&] { return !_requests.empty() || _timeChangeUpdated || stop.stop_requested(); });
             if (stop.stop_requested())
                 break;
 
             while (!_requests.empty()) {
-                auto request = _requests.front();
+                auto request = std::move(_requests.front());
                 _requests.pop_front();
                 switch (request.Action) {
                 case CM_NOTIFY_ACTION_DEVICEINTERFACEARRIVAL:
-                    DebugLog("CM_NOTIFY_ACTION_DEVICEINTERFACEARRIVAL");
-                    hr = RefreshDevices(tombstones);
+                    DebugLog("CM_NOTIFY_ACTION_DEVICEINTERFACEARRIVAL %S", request.Interface.c_str());
+                    _stats.Arrivals++;
+                    _standbyWanted = true;
+                    if (request.Interface.empty()) {
+                        // Cannot apply a delta without the interface path
+                        _enumerated = false;
+                    } else {
+                        _interfaces.emplace(request.Interface);
+                    }
+                    hr = RefreshDevices(tombstones, request.Interface);
+                    if (FAILED(hr))
+                        DebugLog("RefreshDevices failed %x", hr);
+                    break;
+
+                case CM_NOTIFY_ACTION_DEVICEINTERFACEREMOVAL:
+                    DebugLog("CM_NOTIFY_ACTION_DEVICEINTERFACEREMOVAL %S", request.Interface.c_str());
+                    _stats.InterfaceRemovals++;
+                    _standbyWanted = true;
+                    // Removing an interface the registry never saw means an arrival was missed
+                    if (!_interfaces.erase(request.Interface))
+                        _enumerated = false;
+                    _removing.erase(request.Interface);
+                    if (_active && InterfacePathEqual(_active->GetPath(), request.Interface)) {
+                        _stats.DevicesClosed++;
+                        _pendingEvents.push_back(XenIfaceEventRemoval);
+                        tombstones.emplace_back(std::move(_active));
+                    }
+                    if (_standby && InterfacePathEqual(_standby->GetPath(), request.Interface))
+                        tombstones.emplace_back(std::move(_standby));
+                    if (!_enumerated || !_active) {
+                        hr = RefreshDevices(tombstones);
+                        if (FAILED(hr))
+                            DebugLog("RefreshDevices failed %x", hr);
+                    }
+                    break;
+
+                case CM_NOTIFY_ACTION_DEVICEQUERYREMOVE:
+                    _stats.QueryRemoves++;
+                    _removing.emplace(request.Target->GetPath());
+                    // The notification callback already failed over from the active device, if it could
+                    if (request.Target == _standby) {
+                        _retired.emplace_back(std::move(_standby));
+                        _standbyWanted = true;
+                    } else if (request.Target != _active &&
+                               std::find(_retired.begin(), _retired.end(), request.Target) == _retired.end()) {
+                        _stats.StaleRequests++;
+                    }
+                    break;
+
+                case CM_NOTIFY_ACTION_DEVICEQUERYREMOVEFAILED:
+                    // The device stays, but its handle was closed on query-remove; reopen it
+                    DebugLog("CM_NOTIFY_ACTION_DEVICEQUERYREMOVEFAILED");
+                    _stats.QueryRemoveFailures++;
+                    _removing.erase(request.Target->GetPath());
+                    if (std::erase(_retired, request.Target)) {
+                        // Already failed over; the interface can serve as the standby again
+                        tombstones.emplace_back(std::move(request.Target));
+                        _standbyWanted = true;
+                        break;
+                    }
+                    if (request.Target != _active) {
+                        _stats.StaleRequests++;
+                        break;
+                    }
+                    hr = RefreshDevices(tombstones, _active->GetPath());
                     if (FAILED(hr))
                         DebugLog("RefreshDevices failed %x", hr);
                     break;
 
                 case CM_NOTIFY_ACTION_DEVICEREMOVEPENDING:
                 case CM_NOTIFY_ACTION_DEVICEREMOVECOMPLETE:
-                    DebugLog("CM_NOTIFY_ACTION_DEVICEREMOVEPENDING");
-                    if (request.Target == _active)
+                    DebugLog("CM_NOTIFY_ACTION_DEVICEREMOVEPENDING/COMPLETE");
+                    if (request.Target->IsRemoved()) {
+                        tombstones.emplace_back(std::move(request.Target));
+                        break;
+                    }
+                    request.Target->SetRemoved();
+                    _stats.Removals++;
+                    // The registry is left to the interface removal that follows; until then, keep the interface from
+                    // being reopened
+                    _removing.emplace(request.Target->GetPath());
+                    if (request.Target == _active) {
+                        _stats.DevicesClosed++;
+                        _pendingEvents.push_back(XenIfaceEventRemoval);
                         _active.reset();
+                        // Fail over to another registered interface, if there is one
+                        hr = RefreshDevices(tombstones);
+                        if (FAILED(hr))
+                            DebugLog("RefreshDevices failed %x", hr);
+                    } else if (request.Target == _standby) {
+                        _standby.reset();
+                        _standbyWanted = true;
+                    } else if (!std::erase(_retired, request.Target)) {
+                        _stats.StaleRequests++;
+                    }
                     tombstones.emplace_back(std::move(request.Target));
                     break;
                 }
             }
+            // Opening a standby can take a while, so it is only retried when the set of interfaces changes
+            if (std::exchange(_standbyWanted, false))
+                EnsureStandby(tombstones);
+            events.swap(_pendingEvents);
+
+            rebind = std::exchange(_timeChangeUpdated, false);
+            if (rebind && _active && _active->GetTimeChangeDomain() &&
+                _active->GetTimeChangeDomain() != GetTimeChangeDomain())
+                unbound = _active->UnbindTimeChange();
         }
 
         // Closing old listeners must be done outside of the lock, since CM_Unregister_Notification will wait for
-        // callbacks to finish
+        // callbacks to finish. The same goes for notifiers.
+        unbound.Reset();
         tombstones.clear();
+
+        // Binding comes after every old channel is gone, so that none of them removes the new port's XenStore key
+        if (rebind) {
+            std::lock_guard lock(_mutex);
+            auto domain = GetTimeChangeDomain();
+            if (domain && _active)
+                _active->BindTimeChange(*domain);
+        }
+
+        // Subscribers may call back into the worker
+        for (auto event : events)
+            _events->Publish(event);
+        events.clear();
     }
 }
@@ -1,13 +1,18 @@
 #pragma once
 
 #include <memory>
+#include <optional>
+#include <chrono>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 #include <list>
+#include <map>
+#include <set>
 #include <string>
+#include <string_view>
+#include <vector>
 #include <tuple>
-#include <functional>
 
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
@@ -15,17 +20,101 @@
 
 #include <wil/resource.h>
 
+#include "Instrumentation.hpp"
+#include "XenIfaceEventBus.hpp"
+#include "InstrumentedMutex.hpp"
 #include "ResumeNotifier.hpp"
+#include "EventChannelNotifier.hpp"
+
+// State derived from the active device, shared by every user of the worker. Cleared whenever the active device
+// changes or the VM resumes, since either can invalidate it. Each user decides from its own configuration whether to
+// use an entry.
+struct XenIfaceDeviceCache {
+    std::string TimeOffsetPath;
+    // Calibrated read point within the measurement window, in parts per million
+    std::optional<int64_t> AsymmetryPpm;
+};
+
+// Device interface paths are case-insensitive
+struct InterfacePathLess {
+    using is_transparent = void;
+    bool operator()(std::wstring_view a, std::wstring_view b) const {
+        return CompareStringOrdinal(
+                   a.data(),
+                   static_cast<int>(a.size()),
+                   b.data(),
+                   static_cast<int>(b.size()),
+                   TRUE) == CSTR_LESS_THAN;
+    }
+};
+
+inline bool InterfacePathEqual(std::wstring_view a, std::wstring_view b) {
+    return CompareStringOrdinal(a.data(), static_cast<int>(a.size()), b.data(), static_cast<int>(b.size()), TRUE) ==
+        CSTR_EQUAL;
+}
 
 class XenIfaceWorker {
+    class XenIfaceDevice;
+
 public:
+    // The active device as it was when leased, for a user that makes several calls on it without holding the worker
+    // lock in between, so that failover is never held up for longer than one call.
+    class DeviceLease {
+    public:
+        DeviceLease() = default;
+
+        explicit operator bool() const {
+            return !_device.expired();
+        }
+        const std::wstring &GetPath() const {
+            return _path;
+        }
+        // Takes the worker lock for one use of the device. handle and cache are null if the leased device is no
+        // longer the active one, e.g. after a failover; they stay the same for as long as it is.
+        std::unique_lock<InstrumentedMutex> Lock(_Out_ HANDLE &handle, _Out_ XenIfaceDeviceCache *&cache);
+        bool IsActive() {
+            HANDLE handle;
+            XenIfaceDeviceCache *cache;
+            auto lock = Lock(handle, cache);
+            return handle != nullptr;
+        }
+
+    private:
+        friend class XenIfaceWorker;
+
+        DeviceLease(XenIfaceWorker *worker, std::weak_ptr<XenIfaceDevice> device, std::wstring path)
+            : _worker(worker), _device(std::move(device)), _path(std::move(path)) {}
+
+        XenIfaceWorker *_worker = nullptr;
+        // Weak, so that a lease never ends up releasing a device, which must not happen with the locks its users hold
+        std::weak_ptr<XenIfaceDevice> _device;
+        std::wstring _path;
+    };
+
     XenIfaceWorker();
     ~XenIfaceWorker();
     XenIfaceWorker(const XenIfaceWorker &) = delete;
     XenIfaceWorker &operator=(const XenIfaceWorker &) = delete;
 
-    std::tuple<std::unique_lock<std::mutex>, HANDLE, PCWSTR> GetDevice();
-    void RegisterResume(std::function<void()> &&callback);
+    // Returns the process-wide worker, creating it if no other user currently holds one.
+    static std::shared_ptr<XenIfaceWorker> Acquire();
+
+    // Waits until the worker has finished its first device enumeration. Returns false on timeout.
+    bool WaitReady(std::chrono::milliseconds timeout);
+
+    std::tuple<std::unique_lock<InstrumentedMutex>, HANDLE, PCWSTR, XenIfaceDeviceCache *> GetDevice();
+    DeviceLease LeaseDevice();
+    XenIfaceWorkerStats GetStats();
+    // Callbacks run on worker and notification threads without the worker lock held
+    XenIfaceSubscription Subscribe(XenIfaceEvent event, std::function<void()> &&callback) {
+        return _events->Subscribe(event, std::move(callback));
+    }
+    // Bind a time change event channel for remoteDomain on the active device and on any device opened later, on behalf
+    // of owner. The port is published under a single XenStore key, so every owner has to ask for the same domain; a
+    // conflicting request fails with ERROR_BUSY.
+    HRESULT EnableTimeChangeNotifications(const void *owner, USHORT remoteDomain);
+    // Withdraw owner's request. The channel is unbound and its XenStore key removed once no owner needs it.
+    void DisableTimeChangeNotifications(const void *owner);
 
 private:
     class XenIfaceDevice : public std::enable_shared_from_this<XenIfaceDevice> {
@@ -58,9 +147,34 @@ private:
         const std::wstring &GetPath() const {
             return _path;
         }
-        void Close() {
-            _suspend.Reset();
-            _handle.reset();
+        XenIfaceDeviceCache &GetCache() {
+            return _cache;
+        }
+        // Set by the worker on the first removal notification, since remove-pending is followed by remove-complete
+        bool IsRemoved() const {
+            return _removed;
+        }
+        void SetRemoved() {
+            _removed = true;
+        }
+        // Resources taken from a closed device. They are released in reverse order of declaration, so the notifiers
+        // stop before the handle they borrow is closed.
+        struct Detached {
+            wil::unique_hfile Handle;
+            ResumeNotifier Suspend;
+            EventChannelNotifier TimeChange;
+        };
+        // Called with the worker lock held. Stopping the notifiers waits for their callbacks, which take the worker
+        // lock, so the caller releases what is returned after dropping it.
+        Detached Detach() {
+            return {std::move(_handle), std::move(_suspend), std::move(_timeChange)};
+        }
+        void BindTimeChange(USHORT remoteDomain);
+        EventChannelNotifier UnbindTimeChange() {
+            return std::move(_timeChange);
+        }
+        std::optional<USHORT> GetTimeChangeDomain() const {
+            return _timeChange ? std::optional(_timeChangeDomain) : std::nullopt;
         }
 
         _Pre_satisfies_(eventDataSize >= sizeof(CM_NOTIFY_EVENT_DATA)) static DWORD CALLBACK DeviceHandleCallback(
@@ -74,20 +188,47 @@ private:
         wil::unique_hcmnotification _listener;
         wil::unique_hfile _handle;
         std::wstring _path;
+        XenIfaceDeviceCache _cache;
         XenIfaceWorker *_worker;
+        bool _removed = false;
         ResumeNotifier _suspend;
+        EventChannelNotifier _timeChange;
+        USHORT _timeChangeDomain = 0;
     };
 
     struct XenIfaceWorkerRequest {
         std::shared_ptr<XenIfaceDevice> Target;
         CM_NOTIFY_ACTION Action;
+        // Symbolic link of the interface, for interface arrival and removal
+        std::wstring Interface;
     };
 
     void WorkerFunc(std::stop_token stop);
-    HRESULT RefreshDevices(std::list<std::shared_ptr<XenIfaceDevice>> &tombstones);
-    void
-    QueueRequest(std::unique_lock<std::mutex> &&lock, std::shared_ptr<XenIfaceDevice> target, CM_NOTIFY_ACTION action);
-    void OnResume(XenIfaceDevice *device);
+    HRESULT EnumerateInterfaces();
+    HRESULT OpenDevice(const std::wstring &path, std::shared_ptr<XenIfaceDevice> &device);
+    HRESULT OpenInterface(const std::wstring &path);
+    // Opens the first registered interface that will open, preferred one first, skipping any being removed. Returns
+    // ERROR_NO_MORE_ITEMS if none is eligible, or the last open failure.
+    HRESULT OpenRegistered(std::wstring_view preferred);
+    // Announces a newly active device and schedules binding it to host time change notifications
+    void Activated();
+    // The remote domain every time change owner agreed on, if any
+    std::optional<USHORT> GetTimeChangeDomain();
+    // Swap the standby device in as the active one, moving the old active device to retired; returns false if there is
+    // no usable standby
+    bool PromoteStandby(std::list<std::shared_ptr<XenIfaceDevice>> &retired);
+    // Called on query-remove of the active device, before its handle is closed
+    void FailOver(ULONG64 start);
+    // Keep a second interface open, if there is one, so that losing the active device does not stop sampling
+    void EnsureStandby(std::list<std::shared_ptr<XenIfaceDevice>> &tombstones);
+    // Opens a device if there is no usable active one, preferring the given interface. Uses the interface registry
+    // and only falls back to a full enumeration when the registry turns out to be out of date.
+    HRESULT RefreshDevices(std::list<std::shared_ptr<XenIfaceDevice>> &tombstones, std::wstring_view preferred = {});
+    void QueueRequest(
+        std::unique_lock<InstrumentedMutex> &&lock,
+        std::shared_ptr<XenIfaceDevice> target,
+        CM_NOTIFY_ACTION action);
+    void OnEvent(XenIfaceDevice *device, XenIfaceEvent event);
 
     _Pre_satisfies_(eventDataSize >= sizeof(CM_NOTIFY_EVENT_DATA)) static DWORD CALLBACK CmListenerCallback(
         _In_ HCMNOTIFICATION notifyHandle,
@@ -96,12 +237,30 @@ private:
         _In_reads_bytes_(eventDataSize) PCM_NOTIFY_EVENT_DATA eventData,
         _In_ DWORD eventDataSize);
 
-    struct {
-        std::mutex _mutex;
-        std::condition_variable _signal;
-        _Guarded_by_(_mutex) std::list<XenIfaceWorkerRequest> _requests;
-        _Guarded_by_(_mutex) std::shared_ptr<XenIfaceDevice> _active;
-        _Guarded_by_(_mutex) std::vector<std::function<void()>> _callbacks;
-    };
+    InstrumentedMutex _mutex;
+    std::condition_variable_any _signal;
+    _Guarded_by_(_mutex) std::list<XenIfaceWorkerRequest> _requests;
+    _Guarded_by_(_mutex) std::shared_ptr<XenIfaceDevice> _active;
+    _Guarded_by_(_mutex) std::shared_ptr<XenIfaceDevice> _standby;
+    // Set when interfaces come or go, or the standby is used up, so that the worker looks for a new standby
+    _Guarded_by_(_mutex) bool _standbyWanted = false;
+    // Interfaces that passed query-remove or were removed, and must not be reopened until the interface goes away
+    // or the removal fails
+    _Guarded_by_(_mutex) std::set<std::wstring, InterfacePathLess> _removing;
+    // Devices failed away from on query-remove, kept registered until the removal completes or fails
+    _Guarded_by_(_mutex) std::list<std::shared_ptr<XenIfaceDevice>> _retired;
+    // Present interfaces, kept up to date from arrival and removal notifications
+    _Guarded_by_(_mutex) std::set<std::wstring, InterfacePathLess> _interfaces;
+    // Cleared when the registry is known to have missed a change and needs a full enumeration
+    _Guarded_by_(_mutex) bool _enumerated = false;
+    std::condition_variable_any _readySignal;
+    _Guarded_by_(_mutex) bool _ready = false;
+    _Guarded_by_(_mutex) std::map<const void *, USHORT> _timeChangeOwners;
+    // Set when the active device or the requested domain changed, so that the worker rebinds the channel
+    _Guarded_by_(_mutex) bool _timeChangeUpdated = false;
+    _Guarded_by_(_mutex) XenIfaceWorkerStats _stats{};
+    // Lifecycle events raised while holding _mutex, published once it is dropped
+    _Guarded_by_(_mutex) std::vector<XenIfaceEvent> _pendingEvents;
+    std::shared_ptr<XenIfaceEventBus> _events = std::make_shared<XenIfaceEventBus>();
     std::jthread _worker;
 };
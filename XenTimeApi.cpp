@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include <wil/resource.h>
+#include <wil/result.h>
+
+#include "Globals.hpp"
+#include "PerfCounter.hpp"
+#include "PublishedState.hpp"
+#include "xentimeapi.h"
+
+// Assumed bound on how far the performance counter and Xen time drift apart between samples
+#define ESTIMATE_TOLERANCE_PPM 10
+// Attempts at a consistent read before giving up on a busy provider
+#define PUBLISHED_READ_RETRIES 100
+
+struct _XENTIME_SUBSCRIPTION {
+    ULONG Events;
+    PXENTIME_CALLBACK Callback;
+    PVOID Context;
+    ULONG64 Generation;
+    ULONG64 ResumeCount;
+    ULONG64 OffsetChangeCount;
+    std::atomic<bool> Closing;
+    wil::unique_threadpool_wait Wait;
+};
+
+// The provider's shared state as mapped into this process, opened on first use and kept for the process lifetime
+static struct {
+    std::mutex Mutex;
+    wil::unique_handle Mapping;
+    wil::unique_mapview_ptr<const PublishedState> State;
+    wil::unique_event Events[2];
+} Published;
+
+static HRESULT OpenPublished(_Out_ const PublishedState *&state) {
+    std::lock_guard lock(Published.Mutex);
+
+    if (!Published.State) {
+        wil::unique_handle mapping(OpenFileMappingW(FILE_MAP_READ, FALSE, PUBLISHED_STATE_NAME));
+        RETURN_LAST_ERROR_IF_EXPECTED(!mapping);
+        wil::unique_mapview_ptr<const PublishedState> view(
+            static_cast<const PublishedState *>(MapViewOfFile(mapping.get(), FILE_MAP_READ, 0, 0, sizeof(PublishedState))));
+        RETURN_LAST_ERROR_IF(!view);
+
+        PCWSTR eventNames[] = {PUBLISHED_EVENT_NAME_0, PUBLISHED_EVENT_NAME_1};
+        wil::unique_event events[2];
+        for (size_t i = 0; i < ARRAYSIZE(eventNames); i++) {
+            events[i].reset(OpenEventW(SYNCHRONIZE, FALSE, eventNames[i]));
+            RETURN_LAST_ERROR_IF(!events[i]);
+        }
+
+        Published.Mapping = std::move(mapping);
+        Published.State = std::move(view);
+        for (size_t i = 0; i < ARRAYSIZE(eventNames); i++)
+            Published.Events[i] = std::move(events[i]);
+    }
+
+    state = Published.State.get();
+    RETURN_HR_IF(
+        HRESULT_FROM_WIN32(ERROR_NOT_READY),
+        state->Magic != PUBLISHED_STATE_MAGIC || state->Version != PUBLISHED_STATE_VERSION);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return S_OK;
+}
+
+static HRESULT ReadPublished(_Out_ PublishedData &data) {
+    const PublishedState *state;
+
+    RETURN_IF_FAILED(OpenPublished(state));
+    for (int i = 0; i < PUBLISHED_READ_RETRIES; i++) {
+        auto sequence = state->Sequence.load(std::memory_order_acquire);
+        if (sequence & 1) {
+            YieldProcessor();
+            continue;
+        }
+        data = state->Data;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (state->Sequence.load(std::memory_order_relaxed) == sequence)
+            return S_OK;
+    }
+    return HRESULT_FROM_WIN32(ERROR_BUSY);
+}
+
+static bool IsSupportedVersion(ULONG version) {
+    return version >= 1 && version <= XENTIME_API_VERSION;
+}
+
+HRESULT WINAPI XenTimeGetTime(_In_ ULONG Version, _Out_ PXENTIME_ESTIMATE Estimate) {
+    PublishedData data;
+
+    RETURN_HR_IF(HRESULT_FROM_WIN32(ERROR_REVISION_MISMATCH), !IsSupportedVersion(Version));
+    RETURN_HR_IF_NULL(E_POINTER, Estimate);
+    RETURN_IF_FAILED(ReadPublished(data));
+    RETURN_HR_IF(HRESULT_FROM_WIN32(ERROR_NOT_READY), data.SampleCount == 0);
+
+    const auto &latest = data.Samples[(data.SampleNext + XENTIME_MAX_SAMPLES - 1) % XENTIME_MAX_SAMPLES];
+    auto elapsed = static_cast<LONG64>(TIME_US(PerfCounterToUs(PerfCounterNow() - latest.PerfCounter)));
+    auto drift = elapsed * data.DriftPpb / 1000000000;
+
+    Estimate->Time = static_cast<ULONG64>(static_cast<LONG64>(latest.LocalTime) + latest.Offset + elapsed + drift);
+    Estimate->Uncertainty =
+        latest.Delay / 2 + latest.Dispersion + static_cast<ULONG64>(elapsed) * ESTIMATE_TOLERANCE_PPM / 1000000;
+    Estimate->Age = static_cast<ULONG64>(elapsed);
+    return S_OK;
+}
+
+HRESULT WINAPI XenTimeGetSamples(
+    _In_ ULONG Version,
+    _Out_writes_to_(Count, *Returned) PXENTIME_SAMPLE Samples,
+    _In_ ULONG Count,
+    _Out_ PULONG Returned) {
+    PublishedData data;
+
+    RETURN_HR_IF(HRESULT_FROM_WIN32(ERROR_REVISION_MISMATCH), !IsSupportedVersion(Version));
+    RETURN_HR_IF_NULL(E_POINTER, Returned);
+    *Returned = 0;
+    RETURN_HR_IF(E_POINTER, Count && !Samples);
+    RETURN_IF_FAILED(ReadPublished(data));
+
+    auto count = std::min(Count, data.SampleCount);
+    for (ULONG i = 0; i < count; i++)
+        Samples[i] = data.Samples[(data.SampleNext + XENTIME_MAX_SAMPLES - 1 - i) % XENTIME_MAX_SAMPLES];
+    *Returned = count;
+    return S_OK;
+}
+
+static VOID CALLBACK SubscriptionCallback(
+    _Inout_ PTP_CALLBACK_INSTANCE instance,
+    _Inout_opt_ PVOID context,
+    _Inout_ PTP_WAIT wait,
+    _In_ TP_WAIT_RESULT waitResult) {
+    auto subscription = static_cast<XENTIME_SUBSCRIPTION>(context);
+
+    UNREFERENCED_PARAMETER(instance);
+    UNREFERENCED_PARAMETER(waitResult);
+
+    auto generation = Published.State.get()->Generation.load();
+    if (generation != subscription->Generation) {
+        PublishedData data;
+        if (SUCCEEDED(ReadPublished(data))) {
+            ULONG events = 0;
+            if (data.ResumeCount != subscription->ResumeCount)
+                events |= XenTimeEventResume;
+            if (data.OffsetChangeCount != subscription->OffsetChangeCount)
+                events |= XenTimeEventOffsetChange;
+            subscription->ResumeCount = data.ResumeCount;
+            subscription->OffsetChangeCount = data.OffsetChangeCount;
+
+            events &= subscription->Events;
+            if (events)
+                subscription->Callback(events, subscription->Context);
+        }
+        subscription->Generation = generation;
+    }
+
+    if (!subscription->Closing)
+        SetThreadpoolWait(wait, Published.Events[subscription->Generation % 2].get(), nullptr);
+}
+
+HRESULT WINAPI XenTimeSubscribe(
+    _In_ ULONG Version,
+    _In_ ULONG Events,
+    _In_ PXENTIME_CALLBACK Callback,
+    _In_opt_ PVOID Context,
+    _Out_ XENTIME_SUBSCRIPTION *Subscription) {
+    const PublishedState *state;
+    PublishedData data;
+
+    RETURN_HR_IF(HRESULT_FROM_WIN32(ERROR_REVISION_MISMATCH), !IsSupportedVersion(Version));
+    RETURN_HR_IF_NULL(E_POINTER, Subscription);
+    *Subscription = nullptr;
+    RETURN_HR_IF(E_INVALIDARG, !Callback || !Events || (Events & ~(XenTimeEventResume | XenTimeEventOffsetChange)));
+    RETURN_IF_FAILED(OpenPublished(state));
+
+    try {
+        auto subscription = std::make_unique<_XENTIME_SUBSCRIPTION>();
+        subscription->Events = Events;
+        subscription->Callback = Callback;
+        subscription->Context = Context;
+        // Read the generation first so that a notification racing with the counters is delivered rather than lost
+        subscription->Generation = state->Generation.load();
+        RETURN_IF_FAILED(ReadPublished(data));
+        subscription->ResumeCount = data.ResumeCount;
+        subscription->OffsetChangeCount = data.OffsetChangeCount;
+
+        subscription->Wait.reset(CreateThreadpoolWait(&SubscriptionCallback, subscription.get(), nullptr));
+        RETURN_LAST_ERROR_IF(!subscription->Wait);
+        SetThreadpoolWait(
+            subscription->Wait.get(),
+            Published.Events[subscription->Generation % 2].get(),
+            nullptr);
+
+        *Subscription = subscription.release();
+    }
+    CATCH_RETURN();
+    return S_OK;
+}
+
+HRESULT WINAPI XenTimeUnsubscribe(_In_ XENTIME_SUBSCRIPTION Subscription) {
+    RETURN_HR_IF_NULL(E_INVALIDARG, Subscription);
+
+    std::unique_ptr<_XENTIME_SUBSCRIPTION> subscription(Subscription);
+    subscription->Closing = true;
+    // A callback that was already running may have re-armed the wait; once it has returned, nothing re-arms it again
+    SetThreadpoolWait(subscription->Wait.get(), nullptr, nullptr);
+    WaitForThreadpoolWaitCallbacks(subscription->Wait.get(), TRUE);
+    subscription->Wait.reset();
+    return S_OK;
+}
@@ -1,6 +1,7 @@
 #include <string>
 #include <vector>
 #include <charconv>
+#include <algorithm>
 
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
@@ -11,34 +12,62 @@
 #include "Globals.hpp"
 #include "XenTimeProvider.hpp"
 #include "TimeConverter.hpp"
+#include "PerfCounter.hpp"
+#include "SamplePipeline.hpp"
 
 #include "xeniface_ioctls.h"
 
-#define TIME_US(_us) ((_us) * 10)
-#define TIME_MS(_ms) (TIME_US((_ms) * 1000))
-#define TIME_S(_s) (TIME_MS((_s) * 1000))
-
 #define XENSTORE_PAYLOAD_MAX 4096
 
-XenTimeProvider::XenTimeProvider(_In_ TimeProvSysCallbacks *callbacks) : _callbacks(*callbacks) {
+// How long the first Update() waits for the worker's initial device enumeration
+#define STARTUP_DEVICE_TIMEOUT std::chrono::milliseconds(1000)
+// How long a sample taken on a host time change notification is handed out instead of resampling
+#define PUSHED_SAMPLE_MAX_AGE_US 2000000
+// While sampling keeps failing, log a summary after this many failed probes
+#define CIRCUIT_SUMMARY_PROBES 8
+// How long to wait before calibrating again when a burst's delays were too alike to fit
+#define CALIBRATION_RETRY_INTERVAL_US 300000000
+
+XenTimeProvider::XenTimeProvider(_In_ TimeProvSysCallbacks *callbacks, _In_ PCWSTR name)
+    : _callbacks(*callbacks), _name(name), _configKey(std::wstring(XenTimeProvidersKey) + name) {
+    _openTimestamp = PerfCounterNow();
+    _worker = XenIfaceWorker::Acquire();
     UpdateConfig();
-    _worker = std::make_unique<XenIfaceWorker>();
-    _worker->RegisterResume([this] { OnResume(); });
+    {
+        std::lock_guard lock(_mutex);
+        LoadSnapshot();
+    }
+    _pushTimer.reset(CreateThreadpoolTimer(&PushTimerCallback, this, nullptr));
+    if (!_pushTimer)
+        DebugLog("CreateThreadpoolTimer failed %x", GetLastError());
+    _workerSubscriptions.push_back(_worker->Subscribe(XenIfaceEventResume, [this] { OnResume(); }));
+    _workerSubscriptions.push_back(_worker->Subscribe(XenIfaceEventTimeChange, [this] { OnTimeChange(); }));
+}
+
+XenTimeProvider::~XenTimeProvider() {
+    ReleaseWorker();
 }
 
 HRESULT XenTimeProvider::TimeJumped(_In_ TpcTimeJumpedArgs *args) {
     UNREFERENCED_PARAMETER(args);
 
+    std::lock_guard lock(_mutex);
     Log(LogTimeProvEventTypeInformation, L"TimeJumped");
     _sample = std::nullopt;
+    _pushedTimestamp = 0;
+    _filter.ResetOffsets();
+    _traceFlags |= SampleTraceTimeJumped;
+    MarkDisrupted();
     return S_OK;
 }
 
 HRESULT XenTimeProvider::GetSamples(_Out_ TpcGetSamplesArgs *args) {
-    HRESULT hr = Update();
+    std::lock_guard lock(_mutex);
 
-    if (FAILED(hr))
-        Log(LogTimeProvEventTypeError, L"Update failed: %x", hr);
+    // A sample just taken in response to a host time change is handed out as is
+    auto pushedTimestamp = std::exchange(_pushedTimestamp, 0);
+    if (!pushedTimestamp || PerfCounterToUs(PerfCounterNow() - pushedTimestamp) > PUSHED_SAMPLE_MAX_AGE_US)
+        Sample();
 
     if (_sample) {
         args->dwSamplesAvailable = 1;
@@ -53,21 +82,438 @@ HRESULT XenTimeProvider::GetSamples(_Out_ TpcGetSamplesArgs *args) {
     return S_OK;
 }
 
+void XenTimeProvider::CheckHostStep() {
+    int64_t step;
+
+    // sampleTime plus the offset is the Xen time of the reading, on the timeline W32Time is given
+    if (_stepDetector.Observe(_sampleTime + _sample->toOffset, _samplePerfCounter, step)) {
+        auto magnitude = static_cast<ULONG64>(step < 0 ? -step : step);
+        _stats.HostSteps++;
+        _stats.HostStepMax = std::max(_stats.HostStepMax, magnitude);
+        Log(LogTimeProvEventTypeWarning, L"Host clock stepped by %lld us", step / 10);
+        // The filter would otherwise reject the new timeline as outliers until its history rolled over
+        _filter.Reset();
+        _stepDispersion = magnitude;
+        MarkDisrupted();
+        // W32Time would otherwise only hear of the new timeline at its next poll
+        SchedulePush(_schedule.NextDelayUs());
+    }
+
+    if (_stepDispersion) {
+        _sample->tpDispersion += _stepDispersion;
+        _stepDispersion /= 2;
+        if (_stepDispersion < static_cast<ULONG64>(_stepDetector.GetStepBound()))
+            _stepDispersion = 0;
+    }
+}
+
+void XenTimeProvider::MarkDisrupted() {
+    _stats.Disruptions++;
+    if (!_disruptedTimestamp)
+        _disruptedTimestamp = PerfCounterNow();
+}
+
+void XenTimeProvider::RecordUpdateResult(HRESULT hr) {
+    if (SUCCEEDED(hr)) {
+        auto failures = _breaker.GetFailures();
+        auto refused = _breaker.GetRefused();
+        if (_breaker.RecordSuccess()) {
+            _stats.CircuitCloses++;
+            Log(LogTimeProvEventTypeInformation,
+                L"Sampling recovered after %llu failures, %llu polls skipped",
+                failures,
+                refused);
+        }
+        return;
+    }
+
+    // Failures are only logged to the event log when the circuit opens and periodically while it stays open
+    DebugLog("Update failed %x", hr);
+    MarkDisrupted();
+    auto wasClosed = _breaker.GetState() == CircuitBreakerClosed;
+    if (!_breaker.RecordFailure(hr))
+        return;
+
+    _stats.CircuitOpens++;
+    if (wasClosed)
+        Log(LogTimeProvEventTypeError,
+            L"Update failed %llu times in a row (last error %x), backing off",
+            _breaker.GetFailures(),
+            hr);
+    else if (_breaker.GetFailedProbes() % CIRCUIT_SUMMARY_PROBES == 0)
+        Log(LogTimeProvEventTypeWarning,
+            L"Update still failing: %llu failures, %llu polls skipped (last error %x), retrying every %llu s",
+            _breaker.GetFailures(),
+            _breaker.GetRefused(),
+            hr,
+            _breaker.GetBackoffUs() / 1000000);
+}
+
+void XenTimeProvider::Sample() {
+    auto start = PerfCounterNow();
+
+    if (_resumed.exchange(false)) {
+        _filter.Reset();
+        _cpuSampler.Reset();
+        _window.Reset();
+        _stepDetector.Reset();
+        _stepDispersion = 0;
+        _arbiter.Reset();
+        _calibrationRetry = 0;
+        _traceFlags |= SampleTraceResumed;
+        MarkDisrupted();
+        // The VM may have moved to a healthy host
+        _breaker.ProbeNow();
+    }
+
+    if (_breaker.Allow()) {
+        if (_breaker.GetState() == CircuitBreakerHalfOpen)
+            _stats.CircuitProbes++;
+        RecordUpdateResult(Update());
+    } else {
+        _sample = std::nullopt;
+        _stats.SamplesSkipped++;
+    }
+
+    if (_sample && _archive) {
+        auto hr = _archive->Append(ArchivedSample{
+            .Time = _sampleTime,
+            .TickCount = _sample->nSysTickCount,
+            .Offset = _sample->toOffset,
+            .Delay = _sample->toDelay,
+            .Dispersion = static_cast<LONG64>(_sample->tpDispersion),
+        });
+        if (FAILED(hr)) {
+            Log(LogTimeProvEventTypeWarning, L"Stopped archiving: %x", hr);
+            _archive.reset();
+        }
+    }
+
+    auto end = PerfCounterNow();
+    auto costUs = PerfCounterToUs(end - start);
+    _stats.SampleAttempts++;
+    _stats.SampleCostUsTotal += costUs;
+    _stats.SampleCostUsMax = std::max(_stats.SampleCostUsMax, costUs);
+
+    if (_sample && _disruptedTimestamp) {
+        auto recoveryUs = PerfCounterToUs(end - _disruptedTimestamp);
+        _stats.Recoveries++;
+        _stats.RecoveryUsTotal += recoveryUs;
+        _stats.RecoveryUsMax = std::max(_stats.RecoveryUsMax, recoveryUs);
+        _disruptedTimestamp = 0;
+    }
+
+    if (_sample && _openTimestamp) {
+        _stats.StartupLatencyUs = PerfCounterToUs(PerfCounterNow() - _openTimestamp);
+        _openTimestamp = 0;
+        Log(LogTimeProvEventTypeInformation, L"First sample %llu us after open", _stats.StartupLatencyUs);
+    }
+}
+
 HRESULT XenTimeProvider::PollIntervalChanged() {
     return S_OK;
 }
 
 HRESULT XenTimeProvider::UpdateConfig() {
+    std::lock_guard lock(_mutex);
+
+    try {
+        _config.PerCpuSampling =
+            wil::reg::try_get_value_dword(HKEY_LOCAL_MACHINE, _configKey.c_str(), L"PerCpuSampling").value_or(0) != 0;
+        _config.BoostMeasurement =
+            wil::reg::try_get_value_dword(HKEY_LOCAL_MACHINE, _configKey.c_str(), L"BoostMeasurement")
+                .value_or(0) != 0;
+        _config.CalibrateAsymmetry =
+            wil::reg::try_get_value_dword(HKEY_LOCAL_MACHINE, _configKey.c_str(), L"CalibrateAsymmetry")
+                .value_or(0) != 0;
+        // Only the primary instance publishes, so xentimeapi.h readers never see an alternate engine's samples
+        _config.PublishTime = _name == XenTimeProviderName &&
+            wil::reg::try_get_value_dword(HKEY_LOCAL_MACHINE, _configKey.c_str(), L"PublishTime").value_or(0) != 0;
+        _config.EventChannel =
+            wil::reg::try_get_value_dword(HKEY_LOCAL_MACHINE, _configKey.c_str(), L"EventChannel").value_or(0) != 0;
+        _config.EventChannelDomain = static_cast<USHORT>(
+            wil::reg::try_get_value_dword(HKEY_LOCAL_MACHINE, _configKey.c_str(), L"EventChannelDomain")
+                .value_or(0));
+
+        // Files are only reopened when their path changes, so that rereading the configuration neither starts a new
+        // archive block nor loses pending trace records
+        auto stateFile =
+            wil::reg::try_get_value_string(HKEY_LOCAL_MACHINE, _configKey.c_str(), L"StateFile").value_or(L"");
+        if (!_stateStore || stateFile != _config.StateFile) {
+            if (!stateFile.empty())
+                _stateStore = std::make_unique<FileStateStore>(stateFile);
+            else
+                _stateStore = std::make_unique<RegistryStateStore>(_configKey.c_str(), L"State");
+            _config.StateFile = std::move(stateFile);
+        }
+
+        if (_worker && _config.EventChannel) {
+            auto hr = _worker->EnableTimeChangeNotifications(this, _config.EventChannelDomain);
+            if (FAILED(hr))
+                Log(LogTimeProvEventTypeWarning,
+                    L"Failed to enable time change notifications from domain %u: %x",
+                    _config.EventChannelDomain,
+                    hr);
+        } else if (_worker) {
+            _worker->DisableTimeChangeNotifications(this);
+        }
+
+        auto traceFile =
+            wil::reg::try_get_value_string(HKEY_LOCAL_MACHINE, _configKey.c_str(), L"TraceFile").value_or(L"");
+        if (traceFile.empty()) {
+            _trace.reset();
+        } else if (traceFile != _config.TraceFile) {
+            _trace = std::make_unique<SampleTraceWriter>();
+            auto hr = _trace->Open(traceFile);
+            if (FAILED(hr)) {
+                Log(LogTimeProvEventTypeWarning, L"Failed to open trace file: %x", hr);
+                _trace.reset();
+            }
+        }
+        _config.TraceFile = std::move(traceFile);
+
+        auto archiveFile =
+            wil::reg::try_get_value_string(HKEY_LOCAL_MACHINE, _configKey.c_str(), L"ArchiveFile").value_or(L"");
+        if (archiveFile.empty()) {
+            _archive.reset();
+        } else if (archiveFile != _config.ArchiveFile) {
+            _archive = std::make_unique<SampleArchiveWriter>();
+            auto hr = _archive->Open(archiveFile);
+            if (FAILED(hr)) {
+                Log(LogTimeProvEventTypeWarning, L"Failed to open archive file: %x", hr);
+                _archive.reset();
+            }
+        }
+        _config.ArchiveFile = std::move(archiveFile);
+
+        if (!_config.PublishTime) {
+            _publisher.reset();
+        } else if (!_publisher) {
+            auto hr = TimePublisher::Acquire(_publisher);
+            if (FAILED(hr))
+                Log(LogTimeProvEventTypeWarning, L"Failed to publish time: %x", hr);
+        }
+    }
+    CATCH_RETURN();
     return S_OK;
 }
 
 HRESULT XenTimeProvider::Shutdown() {
-    _worker.reset();
-    _sample = std::nullopt;
+    {
+        std::lock_guard lock(_mutex);
+
+        Log(LogTimeProvEventTypeInformation,
+            L"Samples: %llu, rejected: %llu, downweighted: %llu",
+            _stats.Samples,
+            _stats.SamplesRejected,
+            _stats.SamplesDownweighted);
+        if (_config.PerCpuSampling)
+            Log(LogTimeProvEventTypeInformation,
+                L"Per-CPU bursts: %llu, max CPU skew: %lld",
+                _stats.PerCpuBursts,
+                _stats.MaxCpuSkew);
+        if (_config.EventChannel)
+            Log(LogTimeProvEventTypeInformation,
+                L"Time change events: %llu, delayed for congestion: %llu, sample phase: %llu us",
+                _stats.TimeChangeEvents,
+                _stats.CongestedDelays,
+                _schedule.GetPhaseUs());
+        if (_stats.HostSteps)
+            Log(LogTimeProvEventTypeInformation,
+                L"Host clock steps: %llu, largest: %llu us",
+                _stats.HostSteps,
+                _stats.HostStepMax / 10);
+        if (_stats.DeviceChangedRetries)
+            Log(LogTimeProvEventTypeInformation,
+                L"Samples retried after failover: %llu",
+                _stats.DeviceChangedRetries);
+        for (size_t i = 0; i < TimeSourceArbiter::MaxSources; i++) {
+            const auto &score = _arbiter.GetScore(i);
+            if (score.Reads)
+                Log(LogTimeProvEventTypeInformation,
+                    L"Time source %zu: %llu reads, %llu failed, latency %llu ns, jitter %llu ns%s",
+                    i,
+                    score.Reads,
+                    score.Failures,
+                    (score.Latency * 100) >> TimeSourceScore::FractionBits,
+                    (score.Jitter * 100) >> TimeSourceScore::FractionBits,
+                    i == _arbiter.GetSelected() ? L" (selected)" : L"");
+        }
+        if (_arbiter.GetSwitches())
+            Log(LogTimeProvEventTypeInformation, L"Time source switches: %llu", _arbiter.GetSwitches());
+        if (_stats.StoreReads)
+            Log(LogTimeProvEventTypeInformation,
+                L"Store reads: %llu, latency: %llu us average, %llu us max, %llu us baseline",
+                _stats.StoreReads,
+                _stats.StoreReadUsTotal / _stats.StoreReads,
+                _stats.StoreReadUsMax,
+                _schedule.GetStoreReadBaselineUs());
+        if (_stats.SampleAttempts)
+            Log(LogTimeProvEventTypeInformation,
+                L"Sample attempts: %llu, cost: %llu us average, %llu us max",
+                _stats.SampleAttempts,
+                _stats.SampleCostUsTotal / _stats.SampleAttempts,
+                _stats.SampleCostUsMax);
+        auto &windowStats = _window.GetStats();
+        if (windowStats.Windows)
+            Log(LogTimeProvEventTypeInformation,
+                L"Measurement windows: %llu, retries: %llu, contaminated: %llu, budget exhausted: %llu",
+                windowStats.Windows,
+                windowStats.Retries,
+                windowStats.Contaminated,
+                windowStats.Exhausted);
+        if (_stats.AsymmetryCalibrations)
+            Log(LogTimeProvEventTypeInformation,
+                L"Read point calibrations: %llu, latest at %lld ppm of the window",
+                _stats.AsymmetryCalibrations,
+                _stats.AsymmetryPpm);
+        if (_stats.CircuitOpens)
+            Log(LogTimeProvEventTypeInformation,
+                L"Circuit opened: %llu, probes: %llu, closed: %llu, polls skipped: %llu",
+                _stats.CircuitOpens,
+                _stats.CircuitProbes,
+                _stats.CircuitCloses,
+                _stats.SamplesSkipped);
+        if (_stats.Recoveries)
+            Log(LogTimeProvEventTypeInformation,
+                L"Disruptions: %llu, recoveries: %llu, time to recover: %llu us average, %llu us max",
+                _stats.Disruptions,
+                _stats.Recoveries,
+                _stats.RecoveryUsTotal / _stats.Recoveries,
+                _stats.RecoveryUsMax);
+
+        if (_worker) {
+            auto workerStats = _worker->GetStats();
+            Log(LogTimeProvEventTypeInformation,
+                L"Worker lock acquisitions: %llu, contended: %llu, max wait: %llu us, max hold: %llu us",
+                workerStats.Lock.Acquisitions,
+                workerStats.Lock.Contended,
+                workerStats.Lock.WaitUsMax,
+                workerStats.Lock.HoldUsMax);
+            Log(LogTimeProvEventTypeInformation,
+                L"Device arrivals: %llu, removals: %llu, query removes: %llu (%llu failed), opened: %llu, closed: %llu, "
+                L"stale: %llu",
+                workerStats.Arrivals,
+                workerStats.Removals,
+                workerStats.QueryRemoves,
+                workerStats.QueryRemoveFailures,
+                workerStats.DevicesOpened,
+                workerStats.DevicesClosed,
+                workerStats.StaleRequests);
+            Log(LogTimeProvEventTypeInformation,
+                L"Interface removals: %llu, enumerations: %llu, resyncs: %llu",
+                workerStats.InterfaceRemovals,
+                workerStats.Enumerations,
+                workerStats.Resyncs);
+            if (workerStats.StandbysOpened)
+                Log(LogTimeProvEventTypeInformation,
+                    L"Standby devices opened: %llu, failovers: %llu, failover mean %llu us, max %llu us",
+                    workerStats.StandbysOpened,
+                    workerStats.Failovers,
+                    workerStats.Failovers ? workerStats.FailoverUsTotal / workerStats.Failovers : 0,
+                    workerStats.FailoverUsMax);
+        }
+
+        auto hr = SaveSnapshot();
+        if (FAILED(hr))
+            Log(LogTimeProvEventTypeWarning, L"Failed to save state: %x", hr);
+
+        _sample = std::nullopt;
+    }
+
+    // Not under _mutex: unregistering waits for running callbacks, which may be waiting for _mutex
+    ReleaseWorker();
     return S_OK;
 }
 
+void XenTimeProvider::ReleaseWorker() {
+    _workerSubscriptions.clear();
+    // Nothing arms the timer once the subscriptions are gone
+    if (_pushTimer) {
+        SetThreadpoolTimer(_pushTimer.get(), nullptr, 0, 0);
+        WaitForThreadpoolTimerCallbacks(_pushTimer.get(), TRUE);
+        _pushTimer.reset();
+    }
+    if (_worker)
+        _worker->DisableTimeChangeNotifications(this);
+    _worker.reset();
+}
+
+void XenTimeProvider::LoadSnapshot() {
+    std::vector<BYTE> data;
+    ProviderSnapshot snapshot;
+
+    if (!_stateStore || FAILED(_stateStore->Load(data)))
+        return;
+    auto hr = ProviderSnapshot::Deserialize(data, snapshot);
+    if (FAILED(hr)) {
+        DebugLog("Ignoring invalid snapshot: %x", hr);
+        return;
+    }
+    _warmStart = std::move(snapshot);
+}
+
 void XenTimeProvider::OnResume() {
+    // Delays and offsets measured before a migration say nothing about the new host
+    _resumed = true;
+    {
+        std::lock_guard lock(_mutex);
+        if (_publisher)
+            _publisher->Notify(XenTimeEventResume);
+    }
+    _callbacks.pfnAlertSamplesAvail();
+}
+
+void XenTimeProvider::OnTimeChange() {
+    ULONG64 delayUs;
+    {
+        std::lock_guard lock(_mutex);
+        // The worker is shared with the other instance, which may have asked for notifications when this one did not
+        if (!_config.EventChannel)
+            return;
+        _stats.TimeChangeEvents++;
+        if (_schedule.IsCongested())
+            _stats.CongestedDelays++;
+        delayUs = _schedule.NextDelayUs();
+    }
+
+    if (!_pushTimer) {
+        PushSample();
+        return;
+    }
+    SchedulePush(delayUs);
+}
+
+void XenTimeProvider::SchedulePush(ULONG64 delayUs) {
+    // Requests that arrive while a sample is already scheduled are covered by it
+    if (!_pushTimer || IsThreadpoolTimerSet(_pushTimer.get()))
+        return;
+    auto due = -static_cast<LONG64>(delayUs * 10);
+    FILETIME dueTime{
+        .dwLowDateTime = static_cast<DWORD>(due),
+        .dwHighDateTime = static_cast<DWORD>(static_cast<ULONG64>(due) >> 32),
+    };
+    SetThreadpoolTimer(_pushTimer.get(), &dueTime, 0, 0);
+}
+
+VOID CALLBACK XenTimeProvider::PushTimerCallback(
+    _Inout_ PTP_CALLBACK_INSTANCE instance,
+    _Inout_opt_ PVOID context,
+    _Inout_ PTP_TIMER timer) {
+    UNREFERENCED_PARAMETER(instance);
+    UNREFERENCED_PARAMETER(timer);
+
+    static_cast<XenTimeProvider *>(context)->PushSample();
+}
+
+void XenTimeProvider::PushSample() {
+    {
+        std::lock_guard lock(_mutex);
+        Sample();
+        _pushedTimestamp = _sample ? PerfCounterNow() : 0;
+        if (_publisher)
+            _publisher->Notify(XenTimeEventOffsetChange);
+    }
     _callbacks.pfnAlertSamplesAvail();
 }
 
@@ -138,18 +584,167 @@ GetXenOffsetTime(_In_ HANDLE handle, _Out_ unsigned __int64 *xenTime, _Out_ unsi
     return S_OK;
 }
 
-HRESULT XenTimeProvider::Update() {
-    std::string timeOffsetPath, tmp;
-    int64_t timeOffsetPre, timeOffsetPost;
+// Production sample pipeline policies, see SamplePipeline.hpp
+
+struct W32TimeClock {
+    const TimeProvSysCallbacks *Callbacks;
 
+    HRESULT Now(_Out_ unsigned __int64 *time) {
+        return Callbacks->pfnGetTimeSysInfo(TSI_CurrentTime, time);
+    }
+};
+
+struct XenIfaceTimeSource {
+    static constexpr PCWSTR Name = L"sharedinfo";
+
+    HANDLE Handle;
+
+    HRESULT Read(_Out_ unsigned __int64 *time, _Out_ unsigned __int64 *dispersion) {
+        return GetXenOffsetTime(Handle, time, dispersion);
+    }
+};
+
+struct XenStoreOffsetSource {
+    HANDLE Handle;
+    const std::string *Path;
+
+    HRESULT Read(_Out_ int64_t &offset) {
+        return GetTimeOffset(Handle, *Path, offset);
+    }
+};
+
+struct RollingSampleFilter {
+    SampleFilter *Target;
+
+    SampleFilterResult Filter(_Inout_ TimeSample &sample) {
+        return Target->Filter(sample);
+    }
+};
+
+// Publishing is optional; Target is null when shared memory could not be set up
+struct SharedMemoryPublisher {
+    TimePublisher *Target;
+
+    void Publish(_In_ const XENTIME_SAMPLE &sample) {
+        if (Target)
+            Target->Publish(sample);
+    }
+};
+
+// Further sources go in the arbitrated list; user mode has no other way to read Xen time through xeniface today
+using XenTimeSource = ArbitratedTimeSource<XenIfaceTimeSource>;
+using XenSamplePipeline =
+    SamplePipeline<W32TimeClock, XenTimeSource, XenStoreOffsetSource, RollingSampleFilter, SharedMemoryPublisher>;
+
+static HRESULT GetSuspendCount(_In_ HANDLE handle, _Out_ ULONG *count) {
+    DWORD dummy;
+
+    RETURN_IF_WIN32_BOOL_FALSE(DeviceIoControl(
+        handle,
+        IOCTL_XENIFACE_SUSPEND_GET_COUNT,
+        nullptr,
+        0,
+        count,
+        sizeof(*count),
+        &dummy,
+        nullptr));
+    return S_OK;
+}
+
+void XenTimeProvider::ApplySnapshot(_In_ XenIfaceWorker::DeviceLease &device) {
+    auto snapshot = std::exchange(_warmStart, std::nullopt);
+
+    {
+        HANDLE handle;
+        XenIfaceDeviceCache *cache;
+        ULONG suspendCount;
+        auto lock = device.Lock(handle, cache);
+        if (!handle || FAILED(GetSuspendCount(handle, &suspendCount)) || suspendCount != snapshot->SuspendCount ||
+            snapshot->DevicePath != device.GetPath()) {
+            DebugLog("Discarding stale snapshot");
+            return;
+        }
+        if (cache->TimeOffsetPath.empty())
+            cache->TimeOffsetPath = snapshot->TimeOffsetPath;
+    }
+    _filter.Seed(snapshot->Filter);
+    // Consumers extrapolate with the saved drift until the publisher has fitted its own
+    if (_publisher && snapshot->DriftPpb)
+        _publisher->SeedDrift(*snapshot->DriftPpb);
+    Log(LogTimeProvEventTypeInformation,
+        L"Restored state: delay %lld, drift %lld ppb",
+        snapshot->Filter.DelayMedian,
+        snapshot->DriftPpb.value_or(0));
+}
+
+HRESULT XenTimeProvider::SaveSnapshot() {
+    ProviderSnapshot snapshot;
+
+    if (!_worker || !_stateStore || !_filter.GetState(snapshot.Filter))
+        return S_FALSE;
+    LONG64 driftPpb;
+    if (_publisher && _publisher->GetFittedDrift(driftPpb))
+        snapshot.DriftPpb = driftPpb;
+
+    try {
+        {
+            auto [lock, handle, path, cache] = _worker->GetDevice();
+            if (!handle || handle == INVALID_HANDLE_VALUE)
+                return S_FALSE;
+            RETURN_IF_FAILED(GetSuspendCount(handle, &snapshot.SuspendCount));
+            snapshot.DevicePath = path;
+            snapshot.TimeOffsetPath = cache->TimeOffsetPath;
+        }
+        RETURN_IF_FAILED(_stateStore->Save(snapshot.Serialize()));
+    }
+    CATCH_RETURN();
+    return S_OK;
+}
+
+HRESULT XenTimeProvider::Update() {
     _sample = std::nullopt;
 
     if (!_worker)
         return E_PENDING;
 
-    auto [lock, handle, path] = _worker->GetDevice();
-    if (!handle || handle == INVALID_HANDLE_VALUE)
+    // The worker enumerates devices asynchronously; give the first sample a chance to wait for it rather than
+    // failing until the next poll.
+    if (!_workerReady) {
+        if (!_worker->WaitReady(STARTUP_DEVICE_TIMEOUT))
+            DebugLog("Timed out waiting for device enumeration");
+        _workerReady = true;
+    }
+
+    auto device = _worker->LeaseDevice();
+    if (!device)
         return E_PENDING;
+    auto hr = UpdateOnDevice(device);
+    // If the device went away part way through, start again on the one the worker failed over to
+    if (FAILED(hr) && !device.IsActive()) {
+        _stats.DeviceChangedRetries++;
+        device = _worker->LeaseDevice();
+        if (device)
+            hr = UpdateOnDevice(device);
+    }
+    return hr;
+}
+
+HRESULT XenTimeProvider::UpdateOnDevice(_In_ XenIfaceWorker::DeviceLease &device) {
+    int64_t timeOffsetPre, timeOffsetPost;
+
+    // The worker lock is taken for each use of the device rather than for the whole sample, so that failing over on
+    // query-remove waits for one ioctl or XenStore read at most
+    auto withDevice = [&](auto &&use) -> HRESULT {
+        HANDLE current;
+        XenIfaceDeviceCache *currentCache;
+        auto lock = device.Lock(current, currentCache);
+        if (!current)
+            return HRESULT_FROM_WIN32(ERROR_DEVICE_NOT_CONNECTED);
+        return use();
+    };
+
+    if (_warmStart)
+        ApplySnapshot(device);
 
     unsigned __int64 tickCount;
     RETURN_IF_FAILED(_callbacks.pfnGetTimeSysInfo(TSI_TickCount, &tickCount));
@@ -157,43 +752,160 @@ HRESULT XenTimeProvider::Update() {
     signed __int64 phaseOffset;
     RETURN_IF_FAILED(_callbacks.pfnGetTimeSysInfo(TSI_PhaseOffset, &phaseOffset));
 
-    RETURN_IF_FAILED(GetTimeOffsetPath(handle, timeOffsetPath));
-    RETURN_IF_FAILED(GetTimeOffset(handle, timeOffsetPath, timeOffsetPre));
+    // Both stay the same for as long as the device is the active one, which withDevice checks on each use
+    HANDLE handle;
+    XenIfaceDeviceCache *cache;
+    std::string timeOffsetPath;
+    {
+        auto lock = device.Lock(handle, cache);
+        if (!handle)
+            return HRESULT_FROM_WIN32(ERROR_DEVICE_NOT_CONNECTED);
+        if (cache->TimeOffsetPath.empty())
+            RETURN_IF_FAILED(GetTimeOffsetPath(handle, cache->TimeOffsetPath));
+        timeOffsetPath = cache->TimeOffsetPath;
+    }
+    XenSamplePipeline pipeline(
+        W32TimeClock{&_callbacks},
+        XenTimeSource(_arbiter, XenIfaceTimeSource{handle}),
+        XenStoreOffsetSource{handle, &timeOffsetPath},
+        RollingSampleFilter{&_filter},
+        SharedMemoryPublisher{_publisher.get()});
+    _schedule.SetIdentity(timeOffsetPath);
+
+    // Store read latency is how the schedule tells that xenstored is congested
+    auto readOffset = [&](_Out_ int64_t &offset) -> HRESULT {
+        ULONG64 latencyUs = 0;
+        RETURN_IF_FAILED(withDevice([&] {
+            auto start = PerfCounterNow();
+            RETURN_IF_FAILED(pipeline.ReadOffset(offset));
+            latencyUs = PerfCounterToUs(PerfCounterNow() - start);
+            return S_OK;
+        }));
+        _schedule.RecordStoreRead(latencyUs);
+        _stats.StoreReads++;
+        _stats.StoreReadUsTotal += latencyUs;
+        _stats.StoreReadUsMax = std::max(_stats.StoreReadUsMax, latencyUs);
+        return S_OK;
+    };
+    RETURN_IF_FAILED(readOffset(timeOffsetPre));
 
-    unsigned __int64 begin;
-    RETURN_IF_FAILED(_callbacks.pfnGetTimeSysInfo(TSI_CurrentTime, &begin));
+    auto measure = [&](_Out_ TimeMeasurement &m) -> HRESULT {
+        return withDevice([&] { return pipeline.Measure(m); });
+    };
+    // Retries measurements where the thread looks to have been preempted mid-window
+    auto windowed = [&](_Out_ TimeMeasurement &m) -> HRESULT {
+        return _window.Measure(measure, _config.BoostMeasurement, m);
+    };
 
-    unsigned __int64 xenTime, dispersion;
-    RETURN_IF_FAILED(GetXenOffsetTime(handle, &xenTime, &dispersion));
+    // Calibrated once per device; the cache is cleared on resume, which may have moved the VM to another host. The
+    // cache is shared with the other instance, so a calibration it made is only used if this one asks for it too.
+    int64_t asymmetryPpm = ASYMMETRY_MIDPOINT_PPM;
+    if (_config.CalibrateAsymmetry) {
+        std::optional<int64_t> cachedPpm;
+        RETURN_IF_FAILED(withDevice([&] {
+            cachedPpm = cache->AsymmetryPpm;
+            return S_OK;
+        }));
+        auto now = PerfCounterNow();
+        if (!cachedPpm && (!_calibrationRetry || now >= _calibrationRetry)) {
+            int64_t calibratedPpm;
+            auto hr = CalibrateAsymmetry(measure, calibratedPpm);
+            RETURN_IF_FAILED(hr);
+            _stats.AsymmetryCalibrations++;
+            if (hr == S_OK) {
+                RETURN_IF_FAILED(withDevice([&] {
+                    cache->AsymmetryPpm = calibratedPpm;
+                    return S_OK;
+                }));
+                cachedPpm = calibratedPpm;
+                _stats.AsymmetryPpm = calibratedPpm;
+                _calibrationRetry = 0;
+            } else {
+                // An inconclusive burst says nothing about the device; try again later rather than every sample
+                _calibrationRetry = now + CALIBRATION_RETRY_INTERVAL_US * PerfCounterFrequency() / 1000000;
+            }
+        }
+        asymmetryPpm = cachedPpm.value_or(ASYMMETRY_MIDPOINT_PPM);
+    }
 
-    unsigned __int64 end;
-    RETURN_IF_FAILED(_callbacks.pfnGetTimeSysInfo(TSI_CurrentTime, &end));
+    TimeMeasurement measurement;
+    if (_config.PerCpuSampling) {
+        RETURN_IF_FAILED(_cpuSampler.Sample(windowed, asymmetryPpm, measurement));
+        _cpuSampler.DebugLogSkew();
+        _stats.PerCpuBursts++;
+        _stats.MaxCpuSkew = std::max<LONG64>(_stats.MaxCpuSkew, _cpuSampler.GetMaxSkew());
+    } else {
+        RETURN_IF_FAILED(windowed(measurement));
+    }
 
     // have we changed offset since the start of Update?
-    RETURN_IF_FAILED(GetTimeOffset(handle, timeOffsetPath, timeOffsetPost));
-    if (timeOffsetPre != timeOffsetPost)
-        return E_PENDING;
+    RETURN_IF_FAILED(readOffset(timeOffsetPost));
+    ULONG suspendCount = 0;
+    if (_trace) {
+        ULONG count;
+        if (SUCCEEDED(withDevice([&] { return GetSuspendCount(handle, &count); })))
+            suspendCount = count;
+    }
 
-    xenTime -= TIME_S(timeOffsetPost);
-
-    signed __int64 delay = end - begin;
-    if (delay < 0)
-        delay = 0;
-
-    TimeSample sample{
-        .dwSize = sizeof(TimeSample),
-        .dwRefid = ' NEX',
-        .toOffset = static_cast<signed __int64>(xenTime - begin + delay / 2),
-        .toDelay = delay,
-        .tpDispersion = dispersion,
-        .nSysTickCount = tickCount,
-        .nSysPhaseOffset = phaseOffset,
-        .nLeapFlags = 3,
-        .nStratum = 0,
-        .dwTSFlags = TSF_Hardware,
+    // Everything from here on works on the inputs alone, without the device
+    if (_publisher && _lastTimeOffset && (*_lastTimeOffset != timeOffsetPre || timeOffsetPre != timeOffsetPost))
+        _publisher->Notify(XenTimeEventOffsetChange);
+    _lastTimeOffset = timeOffsetPost;
+
+    SampleInputs inputs{
+        .TickCount = tickCount,
+        .PhaseOffset = phaseOffset,
+        .Begin = measurement.Begin,
+        .End = measurement.End,
+        .XenTime = measurement.XenTime,
+        .Dispersion = measurement.Dispersion,
+        .PerfCounter = measurement.ReadPerfCounter(asymmetryPpm),
+        .TimeOffsetPre = timeOffsetPre,
+        .TimeOffsetPost = timeOffsetPost,
+        .AsymmetryPpm = asymmetryPpm,
+        .SuspendCount = suspendCount,
+        .Flags = 0,
     };
-    wcsncpy_s(sample.wszUniqueName, path, _TRUNCATE);
+    if (_trace) {
+        inputs.Flags = std::exchange(_traceFlags, 0);
+        auto hr = _trace->Write(inputs);
+        if (FAILED(hr)) {
+            Log(LogTimeProvEventTypeWarning, L"Stopped tracing: %x", hr);
+            _trace.reset();
+        }
+    }
+
+    TimeSample sample;
+    int64_t sampleTime;
+    // The unique name records which source the sample came from
+    auto name = device.GetPath() + L" (" + pipeline.GetTimeSource().GetSelectedName() + L")";
+    if (!MakeTimeSample(inputs, name.c_str(), sample, sampleTime))
+        return E_PENDING;
     _sample = sample;
+    _sampleTime = sampleTime;
+    _samplePerfCounter = inputs.PerfCounter;
+
+    _stats.Samples++;
+    CheckHostStep();
+    switch (pipeline.FilterSample(*_sample)) {
+    case SampleFilterDownweighted:
+        _stats.SamplesDownweighted++;
+        break;
+    case SampleFilterRejected:
+        DebugLog("Rejected sample with delay %lld", _sample->toDelay);
+        _stats.SamplesRejected++;
+        _sample = std::nullopt;
+        MarkDisrupted();
+        return S_OK;
+    }
+
+    pipeline.Publish(XENTIME_SAMPLE{
+        .LocalTime = static_cast<ULONG64>(_sampleTime),
+        .PerfCounter = _samplePerfCounter,
+        .Offset = _sample->toOffset,
+        .Delay = static_cast<ULONG64>(_sample->toDelay),
+        .Dispersion = _sample->tpDispersion,
+    });
 
     return S_OK;
 }
@@ -2,17 +2,52 @@
 
 #include <optional>
 #include <memory>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
 
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #include <TimeProv.h>
 
+#include <wil/resource.h>
+
 #include "Logging.hpp"
+#include "Instrumentation.hpp"
+#include "SampleArchive.hpp"
+#include "SampleFilter.hpp"
+#include "SamplingSchedule.hpp"
+#include "SampleTrace.hpp"
+#include "AsymmetryCalibration.hpp"
+#include "CircuitBreaker.hpp"
+#include "CpuSkewSampler.hpp"
+#include "HostStepDetector.hpp"
+#include "MeasurementWindow.hpp"
+#include "StateStore.hpp"
+#include "TimeSourceArbiter.hpp"
+#include "TimePublisher.hpp"
 #include "XenIfaceWorker.hpp"
 
+struct XenTimeProviderConfig {
+    bool PerCpuSampling;
+    bool BoostMeasurement;
+    bool CalibrateAsymmetry;
+    bool PublishTime;
+    bool EventChannel;
+    USHORT EventChannelDomain;
+    // Empty when not configured
+    std::wstring StateFile;
+    std::wstring TraceFile;
+    std::wstring ArchiveFile;
+};
+
 class XenTimeProvider {
 public:
-    XenTimeProvider(_In_ TimeProvSysCallbacks *callbacks);
+    // name is XenTimeProviderName or the configured alternate name; each instance reads its configuration from its
+    // own W32Time provider key
+    XenTimeProvider(_In_ TimeProvSysCallbacks *callbacks, _In_ PCWSTR name);
+    ~XenTimeProvider();
     XenTimeProvider(const XenTimeProvider &) = delete;
     XenTimeProvider &operator=(const XenTimeProvider &) = delete;
     XenTimeProvider(XenTimeProvider &&) = default;
@@ -27,20 +62,80 @@ public:
     const TimeProvSysCallbacks &GetCallbacks() {
         return _callbacks;
     }
+    const XenTimeProviderStats &GetStats() {
+        return _stats;
+    }
 
 private:
     void OnResume();
+    void OnTimeChange();
+    // Takes a sample after delayUs and tells W32Time it is there, unless one is already scheduled
+    void SchedulePush(ULONG64 delayUs);
+    void PushSample();
+    static VOID CALLBACK PushTimerCallback(
+        _Inout_ PTP_CALLBACK_INSTANCE instance,
+        _Inout_opt_ PVOID context,
+        _Inout_ PTP_TIMER timer);
+    void ReleaseWorker();
+    void LoadSnapshot();
+    void ApplySnapshot(_In_ XenIfaceWorker::DeviceLease &device);
+    HRESULT SaveSnapshot();
+    void MarkDisrupted();
+    void CheckHostStep();
+    void RecordUpdateResult(HRESULT hr);
+    void Sample();
     HRESULT Update();
+    HRESULT UpdateOnDevice(_In_ XenIfaceWorker::DeviceLease &device);
 
     void Log(LogTimeProvEventType level, PCWSTR format, ...) {
         va_list args;
 
         va_start(args, format);
-        TimeProvVLog(_callbacks.pfnLogTimeProvEvent, level, format, args);
+        TimeProvVLog(_callbacks.pfnLogTimeProvEvent, _name.c_str(), level, format, args);
         va_end(args);
     }
 
     TimeProvSysCallbacks _callbacks;
-    std::unique_ptr<XenIfaceWorker> _worker;
-    std::optional<TimeSample> _sample;
+    std::wstring _name;
+    std::wstring _configKey;
+    std::shared_ptr<XenIfaceWorker> _worker;
+    std::vector<XenIfaceSubscription> _workerSubscriptions;
+    std::atomic<bool> _resumed = false;
+    // Takes the sample for a host time change once its scheduled delay has passed
+    wil::unique_threadpool_timer _pushTimer;
+
+    // Sampling can be triggered both by W32Time and by time change notifications from the host
+    std::mutex _mutex;
+    _Guarded_by_(_mutex) XenTimeProviderConfig _config{};
+    _Guarded_by_(_mutex) bool _workerReady = false;
+    // Performance counter at open, cleared once the first sample has been returned
+    _Guarded_by_(_mutex) ULONG64 _openTimestamp = 0;
+    _Guarded_by_(_mutex) std::optional<TimeSample> _sample;
+    _Guarded_by_(_mutex) signed __int64 _sampleTime = 0;
+    _Guarded_by_(_mutex) ULONG64 _samplePerfCounter = 0;
+    // Last time offset read from XenStore, to notify xentimeapi.h subscribers of changes
+    _Guarded_by_(_mutex) std::optional<int64_t> _lastTimeOffset;
+    // Performance counter when a pushed sample was taken, cleared once it has been returned
+    _Guarded_by_(_mutex) ULONG64 _pushedTimestamp = 0;
+    // Performance counter when sampling was first disrupted, cleared once a sample gets through again
+    _Guarded_by_(_mutex) ULONG64 _disruptedTimestamp = 0;
+    _Guarded_by_(_mutex) SampleFilter _filter;
+    _Guarded_by_(_mutex) CpuSkewSampler _cpuSampler;
+    _Guarded_by_(_mutex) MeasurementWindow _window;
+    _Guarded_by_(_mutex) HostStepDetector _stepDetector;
+    _Guarded_by_(_mutex) TimeSourceArbiter _arbiter;
+    // Performance counter before which an inconclusive asymmetry calibration is not retried
+    _Guarded_by_(_mutex) ULONG64 _calibrationRetry = 0;
+    // Extra dispersion reported after a host step, halved with each sample until the filter has re-locked
+    _Guarded_by_(_mutex) ULONG64 _stepDispersion = 0;
+    _Guarded_by_(_mutex) CircuitBreaker _breaker;
+    _Guarded_by_(_mutex) SamplingSchedule _schedule;
+    _Guarded_by_(_mutex) XenTimeProviderStats _stats{};
+    _Guarded_by_(_mutex) std::unique_ptr<StateStore> _stateStore;
+    _Guarded_by_(_mutex) std::optional<ProviderSnapshot> _warmStart;
+    _Guarded_by_(_mutex) std::shared_ptr<TimePublisher> _publisher;
+    _Guarded_by_(_mutex) std::unique_ptr<SampleTraceWriter> _trace;
+    _Guarded_by_(_mutex) std::unique_ptr<SampleArchiveWriter> _archive;
+    // SampleTraceFlags for the next traced sample
+    _Guarded_by_(_mutex) ULONG _traceFlags = 0;
 };
@@ -1,21 +1,34 @@
 #include <stdexcept>
 #include <system_error>
 
+#include <wil/registry.h>
+
 #include "Globals.hpp"
 #include "Logging.hpp"
 #include "XenTimeProvider.hpp"
 
+// A second provider name, set by AlternateName in the primary provider's key, runs another instance alongside the
+// primary one with its own configuration so that sampling changes can be compared on the same machine
+static bool IsAlternateName(_In_ PCWSTR name) {
+    auto alternate = wil::reg::try_get_value_string(HKEY_LOCAL_MACHINE, XenTimeProviderConfigKey, L"AlternateName");
+    return alternate && !alternate->empty() &&
+        CompareStringOrdinal(XenTimeProviderName, -1, alternate->c_str(), -1, TRUE) != CSTR_EQUAL &&
+        CompareStringOrdinal(alternate->c_str(), -1, name, -1, TRUE) == CSTR_EQUAL;
+}
+
 HRESULT CALLBACK
 TimeProvOpen(_In_ PWSTR wszName, _In_ TimeProvSysCallbacks *pSysCallbacks, _Out_ TimeProvHandle *phTimeProv) {
-    if (CompareStringOrdinal(XenTimeProviderName, -1, wszName, -1, TRUE) == CSTR_EQUAL) {
-        try {
-            *phTimeProv = new XenTimeProvider(pSysCallbacks);
+    try {
+        if (CompareStringOrdinal(XenTimeProviderName, -1, wszName, -1, TRUE) == CSTR_EQUAL) {
+            *phTimeProv = new XenTimeProvider(pSysCallbacks, XenTimeProviderName);
+            return S_OK;
+        } else if (IsAlternateName(wszName)) {
+            *phTimeProv = new XenTimeProvider(pSysCallbacks, wszName);
             return S_OK;
         }
-        CATCH_RETURN();
-    } else {
-        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
     }
+    CATCH_RETURN();
+    return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
 }
 
 HRESULT CALLBACK TimeProvCommand(_In_ TimeProvHandle hTimeProv, _In_ TimeProvCmd eCmd, _In_ TimeProvArgs pvArgs) {
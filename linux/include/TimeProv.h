@@ -0,0 +1,84 @@
+#pragma once
+
+// W32Time provider interface, as declared by the Windows SDK
+
+#include <windows.h>
+
+typedef enum TimeSysInfo {
+    TSI_LastSyncTime,
+    TSI_ClockTickSize,
+    TSI_ClockPrecision,
+    TSI_CurrentTime,
+    TSI_PhaseOffset,
+    TSI_TickCount,
+    TSI_LeapFlags,
+    TSI_Stratum,
+    TSI_ReferenceIdentifier,
+    TSI_PollInterval,
+    TSI_RootDelay,
+    TSI_RootDispersion,
+    TSI_TSFlags,
+} TimeSysInfo;
+
+typedef enum TimeProvCmd {
+    TPC_TimeJumped,
+    TPC_UpdateConfig,
+    TPC_PollIntervalChanged,
+    TPC_GetSamples,
+    TPC_NetTopoChange,
+    TPC_Query,
+    TPC_Shutdown,
+} TimeProvCmd;
+
+#define TSF_Hardware 0x00000001
+#define TSF_Authenticated 0x00000002
+#define TSF_IPv6 0x00000004
+#define TSF_SignatureAuthenticated 0x00000008
+
+#define TJF_Default 0x0
+#define TJF_UserRequested 0x1
+
+typedef void *TimeProvHandle;
+typedef void *TimeProvArgs;
+
+typedef struct TimeSample {
+    DWORD dwSize;
+    DWORD dwRefid;
+    signed __int64 toOffset;
+    signed __int64 toDelay;
+    unsigned __int64 tpDispersion;
+    unsigned __int64 nSysTickCount;
+    signed __int64 nSysPhaseOffset;
+    BYTE nLeapFlags;
+    BYTE nStratum;
+    DWORD dwTSFlags;
+    WCHAR wszUniqueName[256];
+} TimeSample;
+
+typedef struct TpcGetSamplesArgs {
+    BYTE *pbSampleBuf;
+    DWORD cbSampleBuf;
+    DWORD dwSamplesReturned;
+    DWORD dwSamplesAvailable;
+} TpcGetSamplesArgs;
+
+typedef struct TpcTimeJumpedArgs {
+    DWORD tjfFlags;
+} TpcTimeJumpedArgs;
+
+typedef HRESULT(GetTimeSysInfoFunc)(TimeSysInfo eInfo, void *pvInfo);
+typedef HRESULT(LogTimeProvEventFunc)(WORD wType, WCHAR *wszProvName, WCHAR *wszMessage);
+typedef HRESULT(AlertSamplesAvailFunc)(void);
+typedef HRESULT(SetProviderStatusFunc)(void *pspsi);
+
+typedef struct TimeProvSysCallbacks {
+    DWORD dwSize;
+    GetTimeSysInfoFunc *pfnGetTimeSysInfo;
+    LogTimeProvEventFunc *pfnLogTimeProvEvent;
+    AlertSamplesAvailFunc *pfnAlertSamplesAvail;
+    SetProviderStatusFunc *pfnSetProviderStatus;
+} TimeProvSysCallbacks;
+
+HRESULT CALLBACK TimeProvOpen(PWSTR wszName, TimeProvSysCallbacks *pSysCallbacks, TimeProvHandle *phTimeProv);
+HRESULT CALLBACK TimeProvCommand(TimeProvHandle hTimeProv, TimeProvCmd eCmd, TimeProvArgs pvArgs);
+HRESULT CALLBACK TimeProvClose(TimeProvHandle hTimeProv);
@@ -0,0 +1,108 @@
+#pragma once
+
+// Configuration Manager notifications and interface lists, as declared by the Windows SDK
+
+#include <windows.h>
+
+typedef DWORD CONFIGRET;
+typedef WCHAR *DEVINSTID_W;
+typedef struct HCMNOTIFICATION__ *HCMNOTIFICATION, **PHCMNOTIFICATION;
+
+#define CR_SUCCESS 0x00000000
+#define CR_OUT_OF_MEMORY 0x00000002
+#define CR_INVALID_POINTER 0x00000003
+#define CR_INVALID_FLAG 0x00000004
+#define CR_INVALID_DATA 0x0000001F
+#define CR_FAILURE 0x00000013
+#define CR_BUFFER_SMALL 0x0000001A
+#define CR_NO_SUCH_DEVICE_INTERFACE 0x00000037
+
+#define CM_GET_DEVICE_INTERFACE_LIST_PRESENT 0x00000000
+#define CM_GET_DEVICE_INTERFACE_LIST_ALL_DEVICES 0x00000001
+
+typedef enum _CM_NOTIFY_FILTER_TYPE {
+    CM_NOTIFY_FILTER_TYPE_DEVICEINTERFACE = 0,
+    CM_NOTIFY_FILTER_TYPE_DEVICEHANDLE,
+    CM_NOTIFY_FILTER_TYPE_DEVICEINSTANCE,
+    CM_NOTIFY_FILTER_TYPE_MAX,
+} CM_NOTIFY_FILTER_TYPE;
+
+typedef enum _CM_NOTIFY_ACTION {
+    CM_NOTIFY_ACTION_DEVICEINTERFACEARRIVAL = 0,
+    CM_NOTIFY_ACTION_DEVICEINTERFACEREMOVAL,
+    CM_NOTIFY_ACTION_DEVICEQUERYREMOVE,
+    CM_NOTIFY_ACTION_DEVICEQUERYREMOVEFAILED,
+    CM_NOTIFY_ACTION_DEVICEREMOVEPENDING,
+    CM_NOTIFY_ACTION_DEVICEREMOVECOMPLETE,
+    CM_NOTIFY_ACTION_DEVICECUSTOMEVENT,
+    CM_NOTIFY_ACTION_DEVICEINSTANCEENUMERATED,
+    CM_NOTIFY_ACTION_DEVICEINSTANCESTARTED,
+    CM_NOTIFY_ACTION_DEVICEINSTANCEREMOVED,
+    CM_NOTIFY_ACTION_MAX,
+} CM_NOTIFY_ACTION;
+
+typedef struct _CM_NOTIFY_FILTER {
+    DWORD cbSize;
+    DWORD Flags;
+    CM_NOTIFY_FILTER_TYPE FilterType;
+    DWORD Reserved;
+    union {
+        struct {
+            GUID ClassGuid;
+        } DeviceInterface;
+        struct {
+            HANDLE hTarget;
+        } DeviceHandle;
+        struct {
+            WCHAR InstanceId[200];
+        } DeviceInstance;
+    } u;
+} CM_NOTIFY_FILTER, *PCM_NOTIFY_FILTER;
+
+typedef struct _CM_NOTIFY_EVENT_DATA {
+    CM_NOTIFY_FILTER_TYPE FilterType;
+    DWORD Reserved;
+    union {
+        struct {
+            GUID ClassGuid;
+            WCHAR SymbolicLink[ANYSIZE_ARRAY];
+        } DeviceInterface;
+        struct {
+            GUID EventGuid;
+            LONG NameOffset;
+            DWORD DataSize;
+            BYTE Data[ANYSIZE_ARRAY];
+        } DeviceHandle;
+        struct {
+            WCHAR InstanceId[ANYSIZE_ARRAY];
+        } DeviceInstance;
+    } u;
+} CM_NOTIFY_EVENT_DATA, *PCM_NOTIFY_EVENT_DATA;
+
+typedef DWORD(CALLBACK *PCM_NOTIFY_CALLBACK)(
+    HCMNOTIFICATION hNotify,
+    PVOID Context,
+    CM_NOTIFY_ACTION Action,
+    PCM_NOTIFY_EVENT_DATA EventData,
+    DWORD EventDataSize);
+
+extern "C" {
+CONFIGRET CM_Register_Notification(
+    PCM_NOTIFY_FILTER pFilter,
+    PVOID pContext,
+    PCM_NOTIFY_CALLBACK pCallback,
+    PHCMNOTIFICATION pNotifyContext);
+CONFIGRET CM_Unregister_Notification(HCMNOTIFICATION NotifyContext);
+CONFIGRET CM_Get_Device_Interface_List_Size(
+    PULONG pulLen,
+    LPGUID InterfaceClassGuid,
+    DEVINSTID_W pDeviceID,
+    ULONG ulFlags);
+CONFIGRET CM_Get_Device_Interface_List(
+    LPGUID InterfaceClassGuid,
+    DEVINSTID_W pDeviceID,
+    PWSTR Buffer,
+    ULONG BufferLen,
+    ULONG ulFlags);
+DWORD CM_MapCrToWin32Err(CONFIGRET CmReturnCode, DWORD DefaultErr);
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <windows.h>
+
+// Turns the GUID declarations that follow into definitions
+#undef DEFINE_GUID
+#define DEFINE_GUID(name, l, w1, w2, b1, b2, b3, b4, b5, b6, b7, b8) \
+    extern "C" const GUID name = {l, w1, w2, {b1, b2, b3, b4, b5, b6, b7, b8}}
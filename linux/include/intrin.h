@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+// MSVC's CPUID intrinsics; GCC's cpuid.h provides __cpuidex and a different __cpuid
+#undef __cpuid
+static inline void __cpuid(int info[4], int leaf) {
+    __cpuidex(info, leaf, 0);
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+// SAL annotations have no meaning to GCC
+#ifndef _In_
+#define _In_
+#endif
+#ifndef _In_opt_
+#define _In_opt_
+#endif
+#ifndef _Out_
+#define _Out_
+#endif
+#ifndef _Out_opt_
+#define _Out_opt_
+#endif
+#ifndef _Inout_
+#define _Inout_
+#endif
+#ifndef _Inout_opt_
+#define _Inout_opt_
+#endif
+#ifndef _In_reads_
+#define _In_reads_(x)
+#endif
+#ifndef _In_reads_bytes_
+#define _In_reads_bytes_(x)
+#endif
+#ifndef _Out_writes_
+#define _Out_writes_(x)
+#endif
+#ifndef _Out_writes_to_
+#define _Out_writes_to_(x,y)
+#endif
+#ifndef _Out_writes_bytes_
+#define _Out_writes_bytes_(x)
+#endif
+#ifndef _Out_writes_bytes_to_
+#define _Out_writes_bytes_to_(x,y)
+#endif
+#ifndef _In_reads_opt_
+#define _In_reads_opt_(x)
+#endif
+#ifndef _Success_
+#define _Success_(x)
+#endif
+#ifndef _Pre_satisfies_
+#define _Pre_satisfies_(x)
+#endif
+#ifndef _Guarded_by_
+#define _Guarded_by_(x)
+#endif
+#ifndef _Requires_lock_held_
+#define _Requires_lock_held_(x)
+#endif
+#ifndef _Acquires_lock_
+#define _Acquires_lock_(x)
+#endif
+#ifndef _Releases_lock_
+#define _Releases_lock_(x)
+#endif
+#ifndef _Analysis_assume_lock_held_
+#define _Analysis_assume_lock_held_(x)
+#endif
+#ifndef _Analysis_assume_
+#define _Analysis_assume_(x)
+#endif
+#ifndef _Ret_maybenull_
+#define _Ret_maybenull_
+#endif
+#ifndef _Must_inspect_result_
+#define _Must_inspect_result_
+#endif
+#ifndef _Check_return_
+#define _Check_return_
+#endif
+#ifndef _Printf_format_string_
+#define _Printf_format_string_
+#endif
+#ifndef _In_reads_to_
+#define _In_reads_to_(x, y)
+#endif
+#ifndef _Inout_updates_
+#define _Inout_updates_(x)
+#endif
+#ifndef _Outptr_
+#define _Outptr_
+#endif
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <windows.h>
+
+#define SDDL_REVISION_1 1
+
+// The simulator keeps the descriptor string; objects are not access checked
+extern "C" BOOL ConvertStringSecurityDescriptorToSecurityDescriptorW(
+    LPCWSTR stringSecurityDescriptor,
+    DWORD revision,
+    PSECURITY_DESCRIPTOR *securityDescriptor,
+    PULONG securityDescriptorSize);
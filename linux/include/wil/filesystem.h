@@ -0,0 +1,25 @@
+#pragma once
+
+#include <windows.h>
+
+#include "resource.h"
+
+namespace wil {
+
+struct file_and_error_result {
+    unique_hfile file;
+    DWORD last_error;
+};
+
+inline file_and_error_result try_open_file(
+    PCWSTR path,
+    DWORD access = GENERIC_READ,
+    DWORD shareMode = FILE_SHARE_READ,
+    DWORD flags = FILE_ATTRIBUTE_NORMAL,
+    bool inheritHandle = false) noexcept {
+    UNREFERENCED_PARAMETER(inheritHandle);
+    unique_hfile file(::CreateFileW(path, access, shareMode, nullptr, OPEN_EXISTING, flags, nullptr));
+    return {std::move(file), file ? static_cast<DWORD>(ERROR_SUCCESS) : ::GetLastError()};
+}
+
+} // namespace wil
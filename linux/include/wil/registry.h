@@ -0,0 +1,50 @@
+#pragma once
+
+#include <optional>
+#include <string>
+
+#include <windows.h>
+
+#include "result.h"
+
+namespace wil {
+namespace reg {
+
+// Returns nullopt if the value does not exist and throws on any other failure
+inline std::optional<DWORD> try_get_value_dword(HKEY key, PCWSTR subKey, PCWSTR valueName) {
+    DWORD value = 0;
+    DWORD size = sizeof(value);
+    auto error = ::RegGetValueW(key, subKey, valueName, RRF_RT_REG_DWORD, nullptr, &value, &size);
+    if (error == ERROR_FILE_NOT_FOUND)
+        return std::nullopt;
+    THROW_IF_FAILED(HRESULT_FROM_WIN32(error));
+    return value;
+}
+
+inline std::optional<DWORD> try_get_value_dword(HKEY key, PCWSTR valueName) {
+    return try_get_value_dword(key, nullptr, valueName);
+}
+
+inline std::optional<std::wstring> try_get_value_string(HKEY key, PCWSTR subKey, PCWSTR valueName) {
+    DWORD size = 0;
+    auto error = ::RegGetValueW(key, subKey, valueName, RRF_RT_REG_SZ, nullptr, nullptr, &size);
+    while (error == ERROR_SUCCESS || error == ERROR_MORE_DATA) {
+        std::wstring value(size / sizeof(WCHAR), L'\0');
+        error = ::RegGetValueW(key, subKey, valueName, RRF_RT_REG_SZ, nullptr, value.data(), &size);
+        if (error == ERROR_SUCCESS) {
+            value.resize(wcsnlen(value.c_str(), size / sizeof(WCHAR)));
+            return value;
+        }
+    }
+    if (error == ERROR_FILE_NOT_FOUND)
+        return std::nullopt;
+    THROW_IF_FAILED(HRESULT_FROM_WIN32(error));
+    return std::nullopt;
+}
+
+inline std::optional<std::wstring> try_get_value_string(HKEY key, PCWSTR valueName) {
+    return try_get_value_string(key, nullptr, valueName);
+}
+
+} // namespace reg
+} // namespace wil
@@ -0,0 +1,291 @@
+#pragma once
+
+// The WIL resource wrappers used by the provider, with the same ownership and teardown order as WIL's
+
+#include <functional>
+#include <memory>
+#include <utility>
+
+#include <windows.h>
+#include <cfgmgr32.h>
+
+#include "result.h"
+
+namespace wistd {
+using std::function;
+}
+
+namespace wil {
+
+namespace details {
+
+struct handle_null_traits {
+    using type = HANDLE;
+    static type invalid() noexcept {
+        return nullptr;
+    }
+    static void close(type value) noexcept {
+        ::CloseHandle(value);
+    }
+};
+
+struct handle_invalid_traits {
+    using type = HANDLE;
+    static type invalid() noexcept {
+        return INVALID_HANDLE_VALUE;
+    }
+    static void close(type value) noexcept {
+        ::CloseHandle(value);
+    }
+};
+
+struct hcmnotification_traits {
+    using type = HCMNOTIFICATION;
+    static type invalid() noexcept {
+        return nullptr;
+    }
+    static void close(type value) noexcept {
+        ::CM_Unregister_Notification(value);
+    }
+};
+
+struct hlocal_security_descriptor_traits {
+    using type = PSECURITY_DESCRIPTOR;
+    static type invalid() noexcept {
+        return nullptr;
+    }
+    static void close(type value) noexcept {
+        ::LocalFree(value);
+    }
+};
+
+// Disarm, wait for running callbacks and cancel pending ones, then close
+struct threadpool_wait_traits {
+    using type = PTP_WAIT;
+    static type invalid() noexcept {
+        return nullptr;
+    }
+    static void close(type value) noexcept {
+        ::SetThreadpoolWait(value, nullptr, nullptr);
+        ::WaitForThreadpoolWaitCallbacks(value, TRUE);
+        ::CloseThreadpoolWait(value);
+    }
+};
+
+struct threadpool_timer_traits {
+    using type = PTP_TIMER;
+    static type invalid() noexcept {
+        return nullptr;
+    }
+    static void close(type value) noexcept {
+        ::SetThreadpoolTimer(value, nullptr, 0, 0);
+        ::WaitForThreadpoolTimerCallbacks(value, TRUE);
+        ::CloseThreadpoolTimer(value);
+    }
+};
+
+} // namespace details
+
+template <typename Traits>
+class unique_any_t {
+public:
+    using pointer = typename Traits::type;
+
+    unique_any_t() noexcept = default;
+    explicit unique_any_t(pointer value) noexcept : _value(value) {}
+    unique_any_t(const unique_any_t &) = delete;
+    unique_any_t &operator=(const unique_any_t &) = delete;
+    unique_any_t(unique_any_t &&other) noexcept : _value(other.release()) {}
+    unique_any_t &operator=(unique_any_t &&other) noexcept {
+        if (this != std::addressof(other))
+            reset(other.release());
+        return *this;
+    }
+    ~unique_any_t() {
+        reset();
+    }
+
+    pointer get() const noexcept {
+        return _value;
+    }
+    bool is_valid() const noexcept {
+        return _value != Traits::invalid();
+    }
+    explicit operator bool() const noexcept {
+        return is_valid();
+    }
+    void reset(pointer value = Traits::invalid()) noexcept {
+        auto old = std::exchange(_value, value);
+        if (old != Traits::invalid())
+            Traits::close(old);
+    }
+    pointer release() noexcept {
+        return std::exchange(_value, Traits::invalid());
+    }
+    // Closes the current value, as WIL does, so that the address can be passed to a function that creates a new one
+    pointer *put() noexcept {
+        reset();
+        return &_value;
+    }
+    pointer *operator&() noexcept {
+        return put();
+    }
+    pointer *addressof() noexcept {
+        return &_value;
+    }
+    void swap(unique_any_t &other) noexcept {
+        std::swap(_value, other._value);
+    }
+
+private:
+    pointer _value = Traits::invalid();
+};
+
+using unique_handle = unique_any_t<details::handle_null_traits>;
+using unique_hfile = unique_any_t<details::handle_invalid_traits>;
+using unique_hcmnotification = unique_any_t<details::hcmnotification_traits>;
+using unique_hlocal_security_descriptor = unique_any_t<details::hlocal_security_descriptor_traits>;
+using unique_threadpool_wait = unique_any_t<details::threadpool_wait_traits>;
+using unique_threadpool_timer = unique_any_t<details::threadpool_timer_traits>;
+
+namespace details {
+struct unmapview_deleter {
+    void operator()(const void *view) const noexcept {
+        ::UnmapViewOfFile(view);
+    }
+};
+} // namespace details
+
+template <typename T = void>
+using unique_mapview_ptr = std::unique_ptr<T, details::unmapview_deleter>;
+
+enum class EventOptions {
+    None = 0x0,
+    ManualReset = 0x1,
+    Signaled = 0x2,
+};
+
+class unique_event : public unique_handle {
+public:
+    unique_event() noexcept = default;
+    explicit unique_event(HANDLE value) noexcept : unique_handle(value) {}
+    explicit unique_event(EventOptions options) {
+        create(options);
+    }
+    unique_event(unique_event &&) noexcept = default;
+    unique_event &operator=(unique_event &&) noexcept = default;
+
+    void create(EventOptions options = EventOptions::None) {
+        THROW_IF_WIN32_BOOL_FALSE(try_create(options, nullptr));
+    }
+    bool try_create(EventOptions options, PCWSTR name) noexcept {
+        auto event = ::CreateEventW(
+            nullptr,
+            (static_cast<int>(options) & static_cast<int>(EventOptions::ManualReset)) != 0,
+            (static_cast<int>(options) & static_cast<int>(EventOptions::Signaled)) != 0,
+            name);
+        if (!event)
+            return false;
+        reset(event);
+        return true;
+    }
+    void SetEvent() const noexcept {
+        ::SetEvent(get());
+    }
+    void ResetEvent() const noexcept {
+        ::ResetEvent(get());
+    }
+    bool wait(DWORD milliseconds = INFINITE) const noexcept {
+        return ::WaitForSingleObject(get(), milliseconds) == WAIT_OBJECT_0;
+    }
+    bool is_signaled() const noexcept {
+        return wait(0);
+    }
+};
+
+namespace details {
+struct event_watcher_state {
+    event_watcher_state(unique_event &&event, wistd::function<void()> &&callback)
+        : Event(std::move(event)), Callback(std::move(callback)) {}
+
+    static VOID CALLBACK WaitCallback(PTP_CALLBACK_INSTANCE, PVOID context, PTP_WAIT wait, TP_WAIT_RESULT) {
+        auto self = static_cast<event_watcher_state *>(context);
+        // Manual-reset events are reset first so that a signal during the callback is not lost
+        self->Event.ResetEvent();
+        self->Callback();
+        ::SetThreadpoolWait(wait, self->Event.get(), nullptr);
+    }
+
+    // Destroyed in reverse order: the wait stops before the callback and event go away
+    unique_event Event;
+    wistd::function<void()> Callback;
+    unique_threadpool_wait Wait;
+};
+} // namespace details
+
+class unique_event_watcher {
+public:
+    unique_event_watcher() noexcept = default;
+    unique_event_watcher(unique_event_watcher &&) noexcept = default;
+    unique_event_watcher &operator=(unique_event_watcher &&) noexcept = default;
+
+    void create(unique_event &&event, wistd::function<void()> &&callback) {
+        auto state = std::make_unique<details::event_watcher_state>(std::move(event), std::move(callback));
+        state->Wait.reset(::CreateThreadpoolWait(&details::event_watcher_state::WaitCallback, state.get(), nullptr));
+        THROW_LAST_ERROR_IF(!state->Wait);
+        ::SetThreadpoolWait(state->Wait.get(), state->Event.get(), nullptr);
+        _state = std::move(state);
+    }
+    const unique_event &get_event() const noexcept {
+        return _state->Event;
+    }
+    void SetEvent() const noexcept {
+        _state->Event.SetEvent();
+    }
+    void reset() noexcept {
+        _state.reset();
+    }
+    explicit operator bool() const noexcept {
+        return static_cast<bool>(_state);
+    }
+
+private:
+    std::unique_ptr<details::event_watcher_state> _state;
+};
+
+namespace details {
+template <typename F>
+class lambda_call {
+public:
+    explicit lambda_call(F &&lambda) noexcept : _lambda(std::move(lambda)) {}
+    lambda_call(const lambda_call &) = delete;
+    lambda_call &operator=(const lambda_call &) = delete;
+    lambda_call(lambda_call &&other) noexcept : _lambda(std::move(other._lambda)), _call(other._call) {
+        other._call = false;
+    }
+    ~lambda_call() {
+        reset();
+    }
+    void release() noexcept {
+        _call = false;
+    }
+    // Runs the lambda now rather than at scope exit
+    void reset() noexcept {
+        if (_call) {
+            _call = false;
+            _lambda();
+        }
+    }
+
+private:
+    F _lambda;
+    bool _call = true;
+};
+} // namespace details
+
+template <typename F>
+[[nodiscard]] details::lambda_call<std::decay_t<F>> scope_exit(F &&lambda) noexcept {
+    return details::lambda_call<std::decay_t<F>>(std::decay_t<F>(std::forward<F>(lambda)));
+}
+
+} // namespace wil
@@ -0,0 +1,112 @@
+#pragma once
+
+// The WIL error handling macros used by the provider. Failures are not logged; the macros only return or throw.
+
+#include <exception>
+#include <new>
+
+#include <windows.h>
+
+namespace wil {
+
+class ResultException : public std::exception {
+public:
+    explicit ResultException(HRESULT hr) noexcept : _hr(hr) {}
+    HRESULT GetErrorCode() const noexcept {
+        return _hr;
+    }
+    const char *what() const noexcept override {
+        return "wil::ResultException";
+    }
+
+private:
+    HRESULT _hr;
+};
+
+// Must be called from within a catch block
+inline HRESULT ResultFromCaughtException() noexcept {
+    try {
+        throw;
+    } catch (const ResultException &e) {
+        return e.GetErrorCode();
+    } catch (const std::bad_alloc &) {
+        return E_OUTOFMEMORY;
+    } catch (...) {
+        return E_FAIL;
+    }
+}
+
+namespace details {
+inline HRESULT LastErrorHr() noexcept {
+    auto error = GetLastError();
+    return error ? HRESULT_FROM_WIN32(error) : E_FAIL;
+}
+} // namespace details
+
+} // namespace wil
+
+#define RETURN_HR(hr) return (hr)
+#define RETURN_IF_FAILED(x) \
+    do { \
+        HRESULT __hrRet = (x); \
+        if (FAILED(__hrRet)) \
+            return __hrRet; \
+    } while (0)
+#define RETURN_HR_IF(hr, condition) \
+    do { \
+        if (condition) \
+            return (hr); \
+    } while (0)
+#define RETURN_HR_IF_NULL(hr, ptr) RETURN_HR_IF(hr, (ptr) == nullptr)
+#define RETURN_LAST_ERROR() return wil::details::LastErrorHr()
+#define RETURN_LAST_ERROR_IF(condition) \
+    do { \
+        if (condition) \
+            return wil::details::LastErrorHr(); \
+    } while (0)
+#define RETURN_LAST_ERROR_IF_EXPECTED(condition) RETURN_LAST_ERROR_IF(condition)
+#define RETURN_LAST_ERROR_IF_NULL(ptr) RETURN_LAST_ERROR_IF((ptr) == nullptr)
+#define RETURN_IF_WIN32_BOOL_FALSE(x) RETURN_LAST_ERROR_IF(!(x))
+#define RETURN_IF_WIN32_ERROR(x) \
+    do { \
+        DWORD __errRet = static_cast<DWORD>(x); \
+        if (__errRet != ERROR_SUCCESS) \
+            return HRESULT_FROM_WIN32(__errRet); \
+    } while (0)
+
+#define THROW_HR(hr) throw wil::ResultException(hr)
+#define THROW_IF_FAILED(x) \
+    do { \
+        HRESULT __hrThrow = (x); \
+        if (FAILED(__hrThrow)) \
+            THROW_HR(__hrThrow); \
+    } while (0)
+#define THROW_HR_IF(hr, condition) \
+    do { \
+        if (condition) \
+            THROW_HR(hr); \
+    } while (0)
+#define THROW_WIN32(error) THROW_HR(HRESULT_FROM_WIN32(error))
+#define THROW_LAST_ERROR() THROW_HR(wil::details::LastErrorHr())
+#define THROW_LAST_ERROR_IF(condition) \
+    do { \
+        if (condition) \
+            THROW_LAST_ERROR(); \
+    } while (0)
+#define THROW_IF_WIN32_BOOL_FALSE(x) THROW_LAST_ERROR_IF(!(x))
+
+#define LOG_IF_FAILED(x) (x)
+#define LOG_IF_WIN32_BOOL_FALSE(x) (x)
+#define FAIL_FAST_IF(condition) \
+    do { \
+        if (condition) \
+            std::terminate(); \
+    } while (0)
+
+#define CATCH_RETURN() \
+    catch (...) { \
+        return wil::ResultFromCaughtException(); \
+    }
+#define CATCH_LOG() \
+    catch (...) { \
+    }
@@ -0,0 +1,376 @@
+#pragma once
+
+// The subset of the Win32 API used by the provider, implemented on Linux by the simulator in linux/sim. Types follow
+// the Windows sizes; pointer-sized integers are long, as LP64 requires.
+
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cwchar>
+
+#include <sal.h>
+
+#define __int64 long long
+
+#define WINAPI
+#define CALLBACK
+#define APIENTRY
+#define CONST const
+#define VOID void
+#define TRUE 1
+#define FALSE 0
+#define UNREFERENCED_PARAMETER(x) ((void)(x))
+#define ARRAYSIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define ANYSIZE_ARRAY 1
+#define MAX_PATH 260
+#define YieldProcessor() __builtin_ia32_pause()
+
+typedef void *HANDLE, *PVOID, *LPVOID, *HMODULE, *HINSTANCE, *HKEY, *HLOCAL;
+typedef const void *PCVOID, *LPCVOID;
+typedef int BOOL;
+typedef unsigned char BYTE, *PBYTE, UCHAR, BOOLEAN;
+typedef unsigned short WORD, USHORT;
+typedef short SHORT;
+typedef uint32_t DWORD, ULONG, *PULONG, *LPDWORD, *PDWORD;
+typedef int32_t LONG, HRESULT, LSTATUS;
+typedef unsigned long long ULONGLONG, ULONG64, DWORD64;
+typedef unsigned long DWORD_PTR, ULONG_PTR, KAFFINITY, SIZE_T;
+typedef long long LONGLONG, LONG64;
+typedef long LONG_PTR;
+typedef char CHAR, *PCHAR;
+typedef wchar_t WCHAR;
+typedef CHAR *PSTR, *LPSTR;
+typedef const CHAR *PCSTR, *LPCSTR;
+typedef WCHAR *PWSTR, *LPWSTR;
+typedef const WCHAR *PCWSTR, *LPCWSTR;
+
+typedef struct _GUID {
+    uint32_t Data1;
+    unsigned short Data2;
+    unsigned short Data3;
+    unsigned char Data4[8];
+} GUID, *LPGUID;
+typedef const GUID *LPCGUID;
+
+inline bool operator==(const GUID &a, const GUID &b) {
+    return memcmp(&a, &b, sizeof(GUID)) == 0;
+}
+
+#ifndef DEFINE_GUID
+#define DEFINE_GUID(name, l, w1, w2, b1, b2, b3, b4, b5, b6, b7, b8) extern "C" const GUID name
+#endif
+
+typedef union _LARGE_INTEGER {
+    struct {
+        DWORD LowPart;
+        LONG HighPart;
+    };
+    LONGLONG QuadPart;
+} LARGE_INTEGER, *PLARGE_INTEGER;
+
+typedef struct _FILETIME {
+    DWORD dwLowDateTime;
+    DWORD dwHighDateTime;
+} FILETIME, *PFILETIME, *LPFILETIME;
+
+typedef struct _SYSTEMTIME {
+    WORD wYear;
+    WORD wMonth;
+    WORD wDayOfWeek;
+    WORD wDay;
+    WORD wHour;
+    WORD wMinute;
+    WORD wSecond;
+    WORD wMilliseconds;
+} SYSTEMTIME, *PSYSTEMTIME, *LPSYSTEMTIME;
+
+typedef struct _TIME_ZONE_INFORMATION {
+    LONG Bias;
+    WCHAR StandardName[32];
+    SYSTEMTIME StandardDate;
+    LONG StandardBias;
+    WCHAR DaylightName[32];
+    SYSTEMTIME DaylightDate;
+    LONG DaylightBias;
+} TIME_ZONE_INFORMATION, *PTIME_ZONE_INFORMATION, *LPTIME_ZONE_INFORMATION;
+
+typedef struct _TIME_DYNAMIC_ZONE_INFORMATION {
+    LONG Bias;
+    WCHAR StandardName[32];
+    SYSTEMTIME StandardDate;
+    LONG StandardBias;
+    WCHAR DaylightName[32];
+    SYSTEMTIME DaylightDate;
+    LONG DaylightBias;
+    WCHAR TimeZoneKeyName[128];
+    BOOLEAN DynamicDaylightTimeDisabled;
+} DYNAMIC_TIME_ZONE_INFORMATION, *PDYNAMIC_TIME_ZONE_INFORMATION;
+
+typedef struct _GROUP_AFFINITY {
+    KAFFINITY Mask;
+    WORD Group;
+    WORD Reserved[3];
+} GROUP_AFFINITY, *PGROUP_AFFINITY;
+
+typedef struct _PROCESSOR_NUMBER {
+    WORD Group;
+    BYTE Number;
+    BYTE Reserved;
+} PROCESSOR_NUMBER, *PPROCESSOR_NUMBER;
+
+typedef struct _OVERLAPPED OVERLAPPED, *LPOVERLAPPED;
+
+typedef struct _SECURITY_ATTRIBUTES {
+    DWORD nLength;
+    LPVOID lpSecurityDescriptor;
+    BOOL bInheritHandle;
+} SECURITY_ATTRIBUTES, *LPSECURITY_ATTRIBUTES;
+typedef void *PSECURITY_DESCRIPTOR;
+
+#define INVALID_HANDLE_VALUE ((HANDLE)(LONG_PTR)-1)
+#define HKEY_LOCAL_MACHINE ((HKEY)(ULONG_PTR)0x80000002)
+
+#define S_OK ((HRESULT)0)
+#define S_FALSE ((HRESULT)1)
+#define E_NOTIMPL ((HRESULT)0x80004001)
+#define E_POINTER ((HRESULT)0x80004003)
+#define E_ABORT ((HRESULT)0x80004004)
+#define E_FAIL ((HRESULT)0x80004005)
+#define E_PENDING ((HRESULT)0x8000000A)
+#define E_UNEXPECTED ((HRESULT)0x8000FFFF)
+#define E_ACCESSDENIED ((HRESULT)0x80070005)
+#define E_OUTOFMEMORY ((HRESULT)0x8007000E)
+#define E_INVALIDARG ((HRESULT)0x80070057)
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+#define FACILITY_WIN32 7
+#define HRESULT_FROM_WIN32(x) \
+    ((HRESULT)(x) <= 0 ? ((HRESULT)(x)) : ((HRESULT)(((x) & 0x0000FFFF) | (FACILITY_WIN32 << 16) | 0x80000000)))
+
+#define ERROR_SUCCESS 0L
+#define ERROR_FILE_NOT_FOUND 2L
+#define ERROR_ACCESS_DENIED 5L
+#define ERROR_INVALID_HANDLE 6L
+#define ERROR_NOT_ENOUGH_MEMORY 8L
+#define ERROR_BAD_FORMAT 11L
+#define ERROR_INVALID_DATA 13L
+#define ERROR_NOT_READY 21L
+#define ERROR_GEN_FAILURE 31L
+#define ERROR_HANDLE_EOF 38L
+#define ERROR_NOT_SUPPORTED 50L
+#define ERROR_INVALID_PARAMETER 87L
+#define ERROR_DISK_FULL 112L
+#define ERROR_INSUFFICIENT_BUFFER 122L
+#define ERROR_BUSY 170L
+#define ERROR_ALREADY_EXISTS 183L
+#define ERROR_FILE_TOO_LARGE 223L
+#define ERROR_NO_DATA 232L
+#define ERROR_MORE_DATA 234L
+#define ERROR_NO_MORE_ITEMS 259L
+#define ERROR_SERVICE_NOT_ACTIVE 1062L
+#define ERROR_OLD_WIN_VERSION 1150L
+#define ERROR_DEVICE_NOT_CONNECTED 1167L
+#define ERROR_NOT_FOUND 1168L
+#define ERROR_CANCELLED 1223L
+#define ERROR_RETRY 1237L
+#define ERROR_REVISION_MISMATCH 1306L
+#define ERROR_TIMEOUT 1460L
+#define ERROR_UNSUPPORTED_TYPE 1630L
+#define ERROR_INVALID_STATE 5023L
+#define E_NOT_VALID_STATE HRESULT_FROM_WIN32(ERROR_INVALID_STATE)
+
+#define GENERIC_READ 0x80000000L
+#define GENERIC_WRITE 0x40000000L
+#define SYNCHRONIZE 0x00100000L
+#define FILE_APPEND_DATA 4
+#define FILE_SHARE_READ 1
+#define FILE_SHARE_WRITE 2
+#define FILE_SHARE_DELETE 4
+#define CREATE_ALWAYS 2
+#define OPEN_EXISTING 3
+#define OPEN_ALWAYS 4
+#define FILE_ATTRIBUTE_NORMAL 0x80
+#define FILE_BEGIN 0
+#define FILE_CURRENT 1
+#define FILE_END 2
+#define PAGE_READONLY 2
+#define PAGE_READWRITE 4
+#define FILE_MAP_WRITE 2
+#define FILE_MAP_READ 4
+
+#define INFINITE 0xFFFFFFFF
+#define WAIT_OBJECT_0 0
+#define WAIT_TIMEOUT 258
+#define WAIT_FAILED ((DWORD)0xFFFFFFFF)
+
+#define CSTR_LESS_THAN 1
+#define CSTR_EQUAL 2
+#define CSTR_GREATER_THAN 3
+
+#define ALL_PROCESSOR_GROUPS 0xffff
+#define THREAD_PRIORITY_NORMAL 0
+#define THREAD_PRIORITY_HIGHEST 2
+#define THREAD_PRIORITY_TIME_CRITICAL 15
+#define THREAD_PRIORITY_ERROR_RETURN 0x7fffffff
+
+#define PF_XMMI64_INSTRUCTIONS_AVAILABLE 10
+#define PF_AVX2_INSTRUCTIONS_AVAILABLE 40
+
+#define TIME_ZONE_ID_INVALID ((DWORD)0xFFFFFFFF)
+#define TIME_ZONE_ID_UNKNOWN 0
+#define TIME_ZONE_ID_STANDARD 1
+#define TIME_ZONE_ID_DAYLIGHT 2
+
+#define REG_SZ 1
+#define REG_BINARY 3
+#define REG_DWORD 4
+#define RRF_RT_REG_SZ 0x00000002
+#define RRF_RT_REG_BINARY 0x00000008
+#define RRF_RT_REG_DWORD 0x00000010
+
+typedef struct _TP_CALLBACK_INSTANCE TP_CALLBACK_INSTANCE, *PTP_CALLBACK_INSTANCE;
+typedef struct _TP_CALLBACK_ENVIRON TP_CALLBACK_ENVIRON, *PTP_CALLBACK_ENVIRON;
+typedef struct _TP_WAIT TP_WAIT, *PTP_WAIT;
+typedef struct _TP_TIMER TP_TIMER, *PTP_TIMER;
+typedef DWORD TP_WAIT_RESULT;
+typedef VOID(CALLBACK *PTP_WAIT_CALLBACK)(PTP_CALLBACK_INSTANCE, PVOID, PTP_WAIT, TP_WAIT_RESULT);
+typedef VOID(CALLBACK *PTP_TIMER_CALLBACK)(PTP_CALLBACK_INSTANCE, PVOID, PTP_TIMER);
+
+extern "C" {
+void SetLastError(DWORD error);
+DWORD GetLastError();
+void OutputDebugStringA(LPCSTR message);
+int CompareStringOrdinal(LPCWSTR a, int lengthA, LPCWSTR b, int lengthB, BOOL ignoreCase);
+HLOCAL LocalFree(HLOCAL memory);
+BOOL IsProcessorFeaturePresent(DWORD feature);
+DWORD GetModuleFileNameW(HMODULE module, LPWSTR fileName, DWORD size);
+void Sleep(DWORD milliseconds);
+
+BOOL QueryPerformanceCounter(LARGE_INTEGER *count);
+BOOL QueryPerformanceFrequency(LARGE_INTEGER *frequency);
+ULONGLONG GetTickCount64();
+void GetSystemTimeAsFileTime(LPFILETIME time);
+void GetSystemTimePreciseAsFileTime(LPFILETIME time);
+BOOL FileTimeToSystemTime(const FILETIME *fileTime, LPSYSTEMTIME systemTime);
+BOOL SystemTimeToFileTime(const SYSTEMTIME *systemTime, LPFILETIME fileTime);
+BOOL SystemTimeToTzSpecificLocalTimeEx(
+    const DYNAMIC_TIME_ZONE_INFORMATION *timeZone,
+    const SYSTEMTIME *universalTime,
+    LPSYSTEMTIME localTime);
+BOOL TzSpecificLocalTimeToSystemTimeEx(
+    const DYNAMIC_TIME_ZONE_INFORMATION *timeZone,
+    const SYSTEMTIME *localTime,
+    LPSYSTEMTIME universalTime);
+BOOL GetTimeZoneInformationForYear(USHORT year, PDYNAMIC_TIME_ZONE_INFORMATION dtzi, LPTIME_ZONE_INFORMATION tzi);
+DWORD GetDynamicTimeZoneInformation(PDYNAMIC_TIME_ZONE_INFORMATION timeZone);
+
+HANDLE GetCurrentThread();
+HANDLE GetCurrentProcess();
+DWORD GetCurrentProcessId();
+BOOL SetThreadGroupAffinity(HANDLE thread, const GROUP_AFFINITY *affinity, PGROUP_AFFINITY previous);
+BOOL GetThreadGroupAffinity(HANDLE thread, PGROUP_AFFINITY affinity);
+WORD GetActiveProcessorGroupCount();
+DWORD GetActiveProcessorCount(WORD group);
+void GetCurrentProcessorNumberEx(PPROCESSOR_NUMBER number);
+int GetThreadPriority(HANDLE thread);
+BOOL SetThreadPriority(HANDLE thread, int priority);
+
+BOOL CloseHandle(HANDLE object);
+HANDLE CreateEventW(LPSECURITY_ATTRIBUTES attributes, BOOL manualReset, BOOL initialState, LPCWSTR name);
+HANDLE OpenEventW(DWORD access, BOOL inherit, LPCWSTR name);
+BOOL SetEvent(HANDLE event);
+BOOL ResetEvent(HANDLE event);
+DWORD WaitForSingleObject(HANDLE object, DWORD milliseconds);
+
+HANDLE CreateFileW(
+    LPCWSTR fileName,
+    DWORD access,
+    DWORD shareMode,
+    LPSECURITY_ATTRIBUTES attributes,
+    DWORD disposition,
+    DWORD flags,
+    HANDLE templateFile);
+BOOL GetFileSizeEx(HANDLE file, PLARGE_INTEGER size);
+BOOL ReadFile(HANDLE file, LPVOID buffer, DWORD size, LPDWORD read, LPOVERLAPPED overlapped);
+BOOL WriteFile(HANDLE file, LPCVOID buffer, DWORD size, LPDWORD written, LPOVERLAPPED overlapped);
+BOOL FlushFileBuffers(HANDLE file);
+BOOL SetFilePointerEx(HANDLE file, LARGE_INTEGER distance, PLARGE_INTEGER newPointer, DWORD method);
+HANDLE CreateFileMappingW(
+    HANDLE file,
+    LPSECURITY_ATTRIBUTES attributes,
+    DWORD protect,
+    DWORD maximumSizeHigh,
+    DWORD maximumSizeLow,
+    LPCWSTR name);
+HANDLE OpenFileMappingW(DWORD access, BOOL inherit, LPCWSTR name);
+LPVOID MapViewOfFile(HANDLE mapping, DWORD access, DWORD offsetHigh, DWORD offsetLow, SIZE_T size);
+BOOL UnmapViewOfFile(LPCVOID address);
+BOOL DeviceIoControl(
+    HANDLE device,
+    DWORD ioControlCode,
+    LPVOID inBuffer,
+    DWORD inBufferSize,
+    LPVOID outBuffer,
+    DWORD outBufferSize,
+    LPDWORD bytesReturned,
+    LPOVERLAPPED overlapped);
+
+LSTATUS RegGetValueW(HKEY key, LPCWSTR subKey, LPCWSTR value, DWORD flags, LPDWORD type, PVOID data, LPDWORD size);
+LSTATUS RegSetKeyValueW(HKEY key, LPCWSTR subKey, LPCWSTR value, DWORD type, LPCVOID data, DWORD size);
+
+PTP_WAIT CreateThreadpoolWait(PTP_WAIT_CALLBACK callback, PVOID context, PTP_CALLBACK_ENVIRON environment);
+void SetThreadpoolWait(PTP_WAIT wait, HANDLE object, PFILETIME timeout);
+void WaitForThreadpoolWaitCallbacks(PTP_WAIT wait, BOOL cancelPendingCallbacks);
+void CloseThreadpoolWait(PTP_WAIT wait);
+PTP_TIMER CreateThreadpoolTimer(PTP_TIMER_CALLBACK callback, PVOID context, PTP_CALLBACK_ENVIRON environment);
+void SetThreadpoolTimer(PTP_TIMER timer, PFILETIME dueTime, DWORD period, DWORD windowLength);
+BOOL IsThreadpoolTimerSet(PTP_TIMER timer);
+void WaitForThreadpoolTimerCallbacks(PTP_TIMER timer, BOOL cancelPendingCallbacks);
+void CloseThreadpoolTimer(PTP_TIMER timer);
+}
+
+// Secure CRT functions used by the provider. Wide format strings follow the Windows convention, where %s is a wide
+// string and %S a narrow one.
+#define _TRUNCATE ((size_t)-1)
+
+int SimVswprintf(wchar_t *buffer, size_t count, const wchar_t *format, va_list args);
+
+template <size_t N>
+int vswprintf_s(wchar_t (&buffer)[N], const wchar_t *format, va_list args) {
+    return SimVswprintf(buffer, N, format, args);
+}
+
+template <size_t N>
+int swprintf_s(wchar_t (&buffer)[N], const wchar_t *format, ...) {
+    va_list args;
+    va_start(args, format);
+    auto count = SimVswprintf(buffer, N, format, args);
+    va_end(args);
+    return count;
+}
+
+template <size_t N>
+int vsprintf_s(char (&buffer)[N], const char *format, va_list args) {
+    return vsnprintf(buffer, N, format, args);
+}
+
+template <size_t N>
+int wcsncpy_s(wchar_t (&dest)[N], const wchar_t *source, size_t count) {
+    auto length = wcsnlen(source, count == _TRUNCATE ? N - 1 : count);
+    if (length > N - 1)
+        length = N - 1;
+    wmemcpy(dest, source, length);
+    dest[length] = L'\0';
+    return 0;
+}
+
+template <size_t N>
+int strncpy_s(char (&dest)[N], const char *source, size_t count) {
+    auto length = strnlen(source, count == _TRUNCATE ? N - 1 : count);
+    if (length > N - 1)
+        length = N - 1;
+    memcpy(dest, source, length);
+    dest[length] = '\0';
+    return 0;
+}
@@ -0,0 +1,178 @@
+#pragma once
+
+// Control interface of the simulated Windows and Xen environment the provider runs against on Linux. The provider
+// itself only sees the Win32 API in linux/include; tools and tests drive the simulation through these functions.
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <windows.h>
+#include <cfgmgr32.h>
+
+namespace Sim {
+
+enum class ClockMode {
+    // Time is the host's monotonic clock and simulated work busy-waits; threadpool callbacks run on pool threads
+    Real,
+    // Time only moves when the clock owner spends or advances it; threadpool callbacks run in Pump()
+    Virtual,
+};
+
+// Must be called before anything else touches the simulation
+void Configure(ClockMode mode, uint64_t seed = 1);
+ClockMode GetClockMode();
+
+// Simulated time since Configure, in 100ns units. QueryPerformanceCounter runs at 10 MHz on this clock.
+int64_t Now();
+// Virtual mode: move the clock forward
+void Advance(int64_t ticks);
+// Account for work done on the calling thread
+void Spend(int64_t ticks);
+// Virtual mode: only the calling thread's Spend() moves the clock, so that other threads cannot perturb the timeline
+void SetClockOwner();
+
+// Virtual mode: run the threadpool callbacks that are due on the calling thread; returns how many ran
+size_t Pump();
+// Virtual mode: due time of the earliest armed timer
+std::optional<int64_t> NextTimerDue();
+
+// Counts simulated API calls, so that a driver can tell when other threads have gone quiet
+uint64_t Activity();
+
+void SetProcessorCount(unsigned count);
+unsigned GetProcessorCount();
+
+void SetRegistryDword(const std::wstring &key, const std::wstring &name, DWORD value);
+void SetRegistryString(const std::wstring &key, const std::wstring &name, const std::wstring &value);
+void DeleteRegistryValue(const std::wstring &key, const std::wstring &name);
+
+// Zone used when the provider passes no DYNAMIC_TIME_ZONE_INFORMATION; UTC by default. Simulated zones apply the
+// same transition rule to every year.
+void SetTimeZone(const DYNAMIC_TIME_ZONE_INFORMATION &zone);
+
+// Receives OutputDebugStringA; discarded by default
+void SetDebugOutput(std::function<void(const char *)> &&output);
+
+// Misuse that Windows would turn into a hang, a crash, a vetoed removal or a leak
+struct Defects {
+    // Operations on a handle after it was closed
+    uint64_t UseAfterClose;
+    // Removals vetoed because a handle to the device was still open after query-remove
+    uint64_t Vetoes;
+    // Exceptions escaping a notification or threadpool callback
+    uint64_t CallbackExceptions;
+    // A callback unregistering or waiting for its own registration, which deadlocks on Windows
+    uint64_t SelfWaits;
+};
+Defects GetDefects();
+// Kernel handles currently open, including device handles
+size_t OpenHandleCount();
+size_t OpenDeviceHandleCount();
+
+// Host and hypervisor
+
+struct HostConfig {
+    // Xen wallclock in UTC at time zero, as a FILETIME
+    int64_t UtcStart = 133000000000000000;
+    // Rate error of the host clock
+    int64_t HostDriftPpb = 0;
+    // Guest system clock at time zero and its rate error; W32Time's TSI_CurrentTime reads this clock
+    int64_t GuestStart = 133000000000000000;
+    int64_t GuestDriftPpb = 0;
+    // Where within a shared info ioctl the wallclock is read, in parts per million of its duration
+    int64_t ReadPointPpm = 500000;
+    // Shared info ioctl duration: base plus uniform jitter, plus an occasional preemption spike
+    int64_t IoctlBase = 200;
+    int64_t IoctlJitter = 50;
+    uint32_t SpikePerMillion = 0;
+    int64_t SpikeTicks = 0;
+    // Uniform noise on the wallclock reading
+    int64_t ReadNoise = 0;
+    // Wallclock error of each vCPU's view of the shared info page
+    std::vector<int64_t> CpuSkew;
+    // Service time of one xenstored request, and utilisation by other guests sharing the daemon
+    int64_t StoreCost = 500;
+    uint32_t StoreLoadPermille = 0;
+    // RTC offset of the VM, in seconds, published at <vm>/rtc/timeoffset
+    int64_t TimeOffsetSeconds = 0;
+    USHORT DomainId = 7;
+    std::string VmUuid = "00000000-0000-0000-0000-000000000001";
+};
+
+void ConfigureHost(const HostConfig &config);
+HostConfig GetHostConfig();
+
+int64_t HostUtc();
+int64_t GuestTime();
+// Host UTC minus guest time, the offset a perfect sample would report
+int64_t TruthOffset();
+// Step the host wallclock, as a host administrator or NTP correction on dom0 would
+void StepHost(int64_t ticks);
+// Step the guest clock, as W32Time does before TPC_TimeJumped
+void StepGuest(int64_t ticks);
+void SetGuestDriftPpb(int64_t ppb);
+// Change the VM's RTC offset, as a toolstack would
+void SetTimeOffset(int64_t seconds);
+// Suspend and resume the VM, optionally onto a host with a different configuration. Registered resume events are
+// signalled.
+void Migrate(const std::optional<HostConfig> &config = std::nullopt);
+// Signal the time change event channel whose port the guest published in XenStore, as a host agent would. Returns
+// false if no port is published.
+bool HostNotify();
+
+// XenStore as seen by the host; paths are absolute
+std::optional<std::string> StoreRead(const std::string &path);
+void StoreWrite(const std::string &path, const std::string &value);
+
+struct StoreOp {
+    int64_t Arrival;
+    int64_t Start;
+    int64_t Finish;
+    DWORD Code;
+};
+// Called for every guest XenStore request, after it completes
+void SetStoreObserver(std::function<void(const StoreOp &)> &&observer);
+
+// Device interfaces
+
+enum class Removal {
+    // Query-remove, then remove unless a handle is still open, in which case the removal is vetoed
+    Orderly,
+    // Query-remove that another party vetoes
+    QueryRemoveFailed,
+    // Remove-complete without a query
+    Surprise,
+};
+
+// Adds and announces a XENIFACE interface, returning its symbolic link
+std::wstring AddInterface();
+// Removes the interface with the given symbolic link; returns false if the removal was vetoed
+bool RemoveInterface(const std::wstring &path, Removal removal);
+std::vector<std::wstring> GetInterfaces();
+
+// Notifications delivered to registrations, counted per action
+struct DeliveryStats {
+    uint64_t Actions[CM_NOTIFY_ACTION_MAX];
+    // Device registrations that were told of their device's removal, counted once however many removal actions each
+    // received
+    uint64_t Removals;
+};
+DeliveryStats GetDeliveryStats();
+
+struct HostStats {
+    uint64_t SharedInfoReads;
+    uint64_t StoreOps;
+    uint64_t StoreQueueTicksTotal;
+    uint64_t StoreQueueTicksMax;
+    uint64_t SuspendCount;
+    uint64_t NotificationsSent;
+    uint64_t NotificationsMasked;
+    uint64_t PortsBound;
+    uint64_t PortsClosed;
+};
+HostStats GetHostStats();
+
+} // namespace Sim
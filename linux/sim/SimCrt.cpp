@@ -0,0 +1,104 @@
+// String helpers that differ between the Windows CRT and glibc
+
+#include <algorithm>
+#include <cwctype>
+
+#include <windows.h>
+
+#include "SimInternal.hpp"
+
+// Windows wide format strings take %s as a wide string and %S as a narrow one; glibc uses %ls and %s
+static std::wstring TranslateFormat(const wchar_t *format) {
+    std::wstring out;
+    for (auto p = format; *p; p++) {
+        out += *p;
+        if (*p != L'%')
+            continue;
+        if (p[1] == L'%') {
+            out += *++p;
+            continue;
+        }
+        std::wstring length;
+        while (p[1] && wcschr(L"-+ #0123456789.*", p[1]))
+            out += *++p;
+        while (p[1] && wcschr(L"hlLwjzt", p[1]))
+            length += *++p;
+        auto conversion = p[1] ? *++p : L'\0';
+        if (conversion == L's' || conversion == L'c' || conversion == L'S' || conversion == L'C') {
+            bool wide = conversion == L's' || conversion == L'c';
+            if (length == L"h")
+                wide = false;
+            else if (length == L"l" || length == L"w")
+                wide = true;
+            out += wide ? L"l" : L"";
+            out += static_cast<wchar_t>(towlower(conversion));
+        } else if (conversion) {
+            out += length;
+            out += conversion;
+        }
+    }
+    return out;
+}
+
+int SimVswprintf(wchar_t *buffer, size_t count, const wchar_t *format, va_list args) {
+    auto translated = TranslateFormat(format);
+    auto written = vswprintf(buffer, count, translated.c_str(), args);
+    if (written < 0 && count)
+        buffer[count - 1] = L'\0';
+    return written;
+}
+
+extern "C" int CompareStringOrdinal(LPCWSTR a, int lengthA, LPCWSTR b, int lengthB, BOOL ignoreCase) {
+    size_t sizeA = lengthA < 0 ? wcslen(a) : lengthA;
+    size_t sizeB = lengthB < 0 ? wcslen(b) : lengthB;
+    for (size_t i = 0; i < std::min(sizeA, sizeB); i++) {
+        auto x = ignoreCase ? towupper(a[i]) : a[i];
+        auto y = ignoreCase ? towupper(b[i]) : b[i];
+        if (x != y)
+            return x < y ? CSTR_LESS_THAN : CSTR_GREATER_THAN;
+    }
+    if (sizeA == sizeB)
+        return CSTR_EQUAL;
+    return sizeA < sizeB ? CSTR_LESS_THAN : CSTR_GREATER_THAN;
+}
+
+namespace Sim::Internal {
+
+std::string Narrow(const std::wstring &wide) {
+    std::string out;
+    for (auto c : wide) {
+        auto u = static_cast<uint32_t>(c);
+        if (u < 0x80) {
+            out += static_cast<char>(u);
+        } else if (u < 0x800) {
+            out += static_cast<char>(0xC0 | (u >> 6));
+            out += static_cast<char>(0x80 | (u & 0x3F));
+        } else if (u < 0x10000) {
+            out += static_cast<char>(0xE0 | (u >> 12));
+            out += static_cast<char>(0x80 | ((u >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (u & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (u >> 18));
+            out += static_cast<char>(0x80 | ((u >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((u >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (u & 0x3F));
+        }
+    }
+    return out;
+}
+
+std::wstring Widen(const std::string &narrow) {
+    std::wstring out;
+    for (size_t i = 0; i < narrow.size();) {
+        auto c = static_cast<unsigned char>(narrow[i]);
+        auto extra = c < 0x80 ? 0 : c < 0xE0 ? 1 : c < 0xF0 ? 2 : 3;
+        uint32_t u = extra ? c & (0x3F >> extra) : c;
+        for (int j = 1; j <= extra && i + j < narrow.size(); j++)
+            u = u << 6 | (static_cast<unsigned char>(narrow[i + j]) & 0x3F);
+        out += static_cast<wchar_t>(u);
+        i += extra + 1;
+    }
+    return out;
+}
+
+} // namespace Sim::Internal
@@ -0,0 +1,63 @@
+#pragma once
+
+// Shared between the simulator's translation units; not for tools or tests
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+
+#include <windows.h>
+
+#include "Sim.hpp"
+
+namespace Sim::Internal {
+
+// A kernel object that handles refer to
+struct Object {
+    virtual ~Object() = default;
+    // Called outside the kernel lock once the last handle to the object is closed
+    virtual void OnLastHandleClosed() {}
+
+    // Guarded by the kernel lock
+    size_t Handles = 0;
+};
+
+HANDLE InsertHandle(std::shared_ptr<Object> object);
+// Returns null for handles that were never opened or were already closed, counting the latter as a defect
+std::shared_ptr<Object> LookupHandle(HANDLE handle);
+
+template <typename T>
+std::shared_ptr<T> Lookup(HANDLE handle) {
+    return std::dynamic_pointer_cast<T>(LookupHandle(handle));
+}
+
+// Event objects, referenced directly by the simulated driver as a kernel driver would
+std::shared_ptr<Object> ReferenceEvent(HANDLE handle);
+void SignalEvent(const std::shared_ptr<Object> &event);
+
+void Touch();
+void CountUseAfterClose();
+void CountCallbackException();
+void CountSelfWait();
+void CountVeto();
+
+// Opens a device interface, or returns nullopt if path is not one
+std::optional<HANDLE> OpenDevice(const std::wstring &path, DWORD &error);
+BOOL DeviceControl(
+    HANDLE device,
+    DWORD code,
+    LPVOID in,
+    DWORD inSize,
+    LPVOID out,
+    DWORD outSize,
+    LPDWORD returned);
+bool IsDeviceHandle(const std::shared_ptr<Object> &object);
+
+std::mt19937_64 &Random();
+std::string Narrow(const std::wstring &wide);
+std::wstring Widen(const std::string &narrow);
+
+} // namespace Sim::Internal
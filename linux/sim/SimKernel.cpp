@@ -0,0 +1,1173 @@
+// Kernel objects, the threadpool, the clock, the registry and files of the simulated Windows environment
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <windows.h>
+#include <sddl.h>
+
+#include "SimInternal.hpp"
+
+// Handle values start above the pseudo-handles and small integers that buggy callers might pass
+#define HANDLE_BASE 0x100
+#define HANDLE_STEP 4
+#define POOL_THREADS 4
+// Simulated work longer than this sleeps for most of its duration rather than spinning
+#define SPIN_LIMIT 10000
+#define DEFAULT_PROCESSORS 4
+
+using namespace Sim;
+using namespace Sim::Internal;
+
+namespace {
+
+struct PoolObject {
+    virtual ~PoolObject() = default;
+    virtual void Invoke() = 0;
+
+    PVOID Context = nullptr;
+    size_t Running = 0;
+    bool Queued = false;
+    bool Closed = false;
+};
+
+} // namespace
+
+struct _TP_WAIT : PoolObject {
+    void Invoke() override {
+        Callback(nullptr, Context, this, WAIT_OBJECT_0);
+    }
+
+    PTP_WAIT_CALLBACK Callback = nullptr;
+    std::shared_ptr<Object> Armed;
+};
+
+struct _TP_TIMER : PoolObject {
+    void Invoke() override {
+        Callback(nullptr, Context, this);
+    }
+
+    PTP_TIMER_CALLBACK Callback = nullptr;
+    std::optional<int64_t> Due;
+    int64_t Period = 0;
+};
+
+namespace {
+
+struct EventObject : Object {
+    bool ManualReset = false;
+    bool Signaled = false;
+    std::vector<PTP_WAIT> Waits;
+};
+
+struct FileObject : Object {
+    ~FileObject() override {
+        close(Fd);
+    }
+
+    int Fd = -1;
+};
+
+struct SectionObject : Object {
+    ~SectionObject() override {
+        if (Anonymous)
+            munmap(Anonymous, Size);
+        if (Fd >= 0)
+            close(Fd);
+    }
+
+    // Pagefile-backed sections are one shared allocation that every view points into
+    void *Anonymous = nullptr;
+    int Fd = -1;
+    size_t Size = 0;
+    bool Writable = false;
+};
+
+struct View {
+    std::shared_ptr<SectionObject> Section;
+    void *Base;
+    size_t Length;
+};
+
+struct RegistryValue {
+    DWORD Type;
+    std::vector<BYTE> Data;
+};
+
+struct Kernel {
+    std::mutex Mutex;
+    // Signalled when an event is set or a pool callback finishes
+    std::condition_variable Changed;
+    std::condition_variable PoolWake;
+
+    std::map<uintptr_t, std::shared_ptr<Object>> Handles;
+    uintptr_t NextHandle = HANDLE_BASE;
+    std::map<std::wstring, std::weak_ptr<Object>> Names;
+    std::map<const void *, View> Views;
+    std::map<std::wstring, RegistryValue> Registry;
+
+    std::deque<PoolObject *> Queue;
+    std::vector<PTP_TIMER> Timers;
+    bool PoolStarted = false;
+
+    Sim::Defects Found{};
+    unsigned Processors = DEFAULT_PROCESSORS;
+    std::function<void(const char *)> DebugOutput;
+};
+
+// Never destroyed, so that detached pool threads and late callers at exit do not touch a dead object
+Kernel &K() {
+    static auto kernel = new Kernel;
+    return *kernel;
+}
+
+struct Clock {
+    std::atomic<ClockMode> Mode = ClockMode::Real;
+    std::chrono::steady_clock::time_point Origin = std::chrono::steady_clock::now();
+    std::atomic<int64_t> Virtual = 0;
+    std::atomic<std::thread::id> Owner;
+    std::atomic<uint64_t> Activity = 0;
+    std::mt19937_64 Random;
+};
+
+Clock &C() {
+    static auto clock = new Clock;
+    return *clock;
+}
+
+thread_local DWORD t_lastError;
+thread_local PoolObject *t_currentCallback;
+thread_local KAFFINITY t_affinity;
+thread_local int t_priority = THREAD_PRIORITY_NORMAL;
+
+HANDLE InsertLocked(Kernel &k, std::shared_ptr<Object> object) {
+    auto value = k.NextHandle;
+    k.NextHandle += HANDLE_STEP;
+    object->Handles++;
+    k.Handles.emplace(value, std::move(object));
+    return reinterpret_cast<HANDLE>(value);
+}
+
+std::shared_ptr<Object> LookupLocked(Kernel &k, HANDLE handle) {
+    auto value = reinterpret_cast<uintptr_t>(handle);
+    auto it = k.Handles.find(value);
+    if (it != k.Handles.end())
+        return it->second;
+    if (value >= HANDLE_BASE && value < k.NextHandle)
+        k.Found.UseAfterClose++;
+    return nullptr;
+}
+
+void Enqueue(Kernel &k, PoolObject *object) {
+    if (object->Queued)
+        return;
+    object->Queued = true;
+    k.Queue.push_back(object);
+    k.PoolWake.notify_one();
+}
+
+void Dequeue(Kernel &k, PoolObject *object) {
+    if (!object->Queued)
+        return;
+    object->Queued = false;
+    k.Queue.erase(std::remove(k.Queue.begin(), k.Queue.end(), object), k.Queue.end());
+}
+
+void FreeIfDone(PoolObject *object) {
+    if (object->Closed && !object->Running && !object->Queued)
+        delete object;
+}
+
+// Runs a queued callback with the kernel lock dropped
+void Run(Kernel &k, std::unique_lock<std::mutex> &lock, PoolObject *object) {
+    Dequeue(k, object);
+    object->Running++;
+    auto previous = std::exchange(t_currentCallback, object);
+    lock.unlock();
+    Touch();
+    try {
+        object->Invoke();
+    } catch (...) {
+        CountCallbackException();
+    }
+    lock.lock();
+    t_currentCallback = previous;
+    object->Running--;
+    FreeIfDone(object);
+    k.Changed.notify_all();
+}
+
+void PromoteDueTimers(Kernel &k, int64_t now) {
+    for (auto timer : k.Timers) {
+        if (!timer->Due || *timer->Due > now)
+            continue;
+        if (timer->Period)
+            timer->Due = *timer->Due + timer->Period;
+        else
+            timer->Due.reset();
+        Enqueue(k, timer);
+    }
+}
+
+std::optional<int64_t> NextDueLocked(Kernel &k) {
+    std::optional<int64_t> next;
+    for (auto timer : k.Timers)
+        if (timer->Due && (!next || *timer->Due < *next))
+            next = timer->Due;
+    return next;
+}
+
+void PoolThread() {
+    auto &k = K();
+    std::unique_lock lock(k.Mutex);
+    for (;;) {
+        PromoteDueTimers(k, Now());
+        if (!k.Queue.empty()) {
+            Run(k, lock, k.Queue.front());
+            continue;
+        }
+        auto due = NextDueLocked(k);
+        if (due)
+            k.PoolWake.wait_for(lock, std::chrono::nanoseconds((*due - Now()) * 100));
+        else
+            k.PoolWake.wait(lock);
+    }
+}
+
+void StartPoolLocked(Kernel &k) {
+    if (k.PoolStarted || GetClockMode() != ClockMode::Real)
+        return;
+    k.PoolStarted = true;
+    for (int i = 0; i < POOL_THREADS; i++)
+        std::thread(PoolThread).detach();
+}
+
+void WaitForCallbacks(PoolObject *object, BOOL cancel) {
+    Touch();
+    auto &k = K();
+    std::unique_lock lock(k.Mutex);
+    if (t_currentCallback == object) {
+        k.Found.SelfWaits++;
+        return;
+    }
+    if (cancel)
+        Dequeue(k, object);
+    else if (object->Queued && GetClockMode() == ClockMode::Virtual)
+        Run(k, lock, object);
+    k.Changed.wait(lock, [&] { return !object->Running && !object->Queued; });
+}
+
+void ClosePoolObject(PoolObject *object) {
+    auto &k = K();
+    std::lock_guard lock(k.Mutex);
+    object->Closed = true;
+    FreeIfDone(object);
+}
+
+void DisarmLocked(PTP_WAIT wait) {
+    if (!wait->Armed)
+        return;
+    auto &waits = static_cast<EventObject *>(wait->Armed.get())->Waits;
+    waits.erase(std::remove(waits.begin(), waits.end(), wait), waits.end());
+    wait->Armed.reset();
+}
+
+void SignalLocked(Kernel &k, EventObject &event) {
+    event.Signaled = true;
+    while (!event.Waits.empty() && event.Signaled) {
+        auto wait = event.Waits.front();
+        event.Waits.erase(event.Waits.begin());
+        wait->Armed.reset();
+        Enqueue(k, wait);
+        if (!event.ManualReset)
+            event.Signaled = false;
+    }
+    k.Changed.notify_all();
+}
+
+std::wstring Lower(std::wstring value) {
+    for (auto &c : value)
+        c = towlower(c);
+    return value;
+}
+
+std::wstring RegistryPath(LPCWSTR subKey, LPCWSTR value) {
+    return Lower(std::wstring(subKey ? subKey : L"") + L"\\" + (value ? value : L""));
+}
+
+void SetRegistry(const std::wstring &key, const std::wstring &name, DWORD type, const void *data, size_t size) {
+    auto &k = K();
+    std::lock_guard lock(k.Mutex);
+    auto bytes = static_cast<const BYTE *>(data);
+    k.Registry[RegistryPath(key.c_str(), name.c_str())] = {type, std::vector<BYTE>(bytes, bytes + size)};
+}
+
+KAFFINITY AllProcessors() {
+    auto count = GetProcessorCount();
+    return count >= 64 ? ~KAFFINITY(0) : (KAFFINITY(1) << count) - 1;
+}
+
+} // namespace
+
+// Simulator control
+
+namespace Sim {
+
+void Configure(ClockMode mode, uint64_t seed) {
+    auto &c = C();
+    c.Mode = mode;
+    c.Origin = std::chrono::steady_clock::now();
+    c.Virtual = 0;
+    c.Random.seed(seed);
+}
+
+ClockMode GetClockMode() {
+    return C().Mode;
+}
+
+int64_t Now() {
+    auto &c = C();
+    if (c.Mode == ClockMode::Virtual)
+        return c.Virtual;
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - c.Origin).count() /
+        100;
+}
+
+void Advance(int64_t ticks) {
+    if (ticks > 0)
+        C().Virtual += ticks;
+}
+
+void Spend(int64_t ticks) {
+    auto &c = C();
+    if (ticks <= 0)
+        return;
+    if (c.Mode == ClockMode::Virtual) {
+        auto owner = c.Owner.load();
+        if (owner == std::thread::id() || owner == std::this_thread::get_id())
+            c.Virtual += ticks;
+        return;
+    }
+    auto end = Now() + ticks;
+    if (ticks > SPIN_LIMIT)
+        std::this_thread::sleep_for(std::chrono::nanoseconds((ticks - SPIN_LIMIT / 2) * 100));
+    while (Now() < end)
+        YieldProcessor();
+}
+
+void SetClockOwner() {
+    C().Owner = std::this_thread::get_id();
+}
+
+size_t Pump() {
+    auto &k = K();
+    std::unique_lock lock(k.Mutex);
+    size_t count = 0;
+    for (;;) {
+        PromoteDueTimers(k, Now());
+        if (k.Queue.empty())
+            return count;
+        Run(k, lock, k.Queue.front());
+        count++;
+    }
+}
+
+std::optional<int64_t> NextTimerDue() {
+    auto &k = K();
+    std::lock_guard lock(k.Mutex);
+    return NextDueLocked(k);
+}
+
+uint64_t Activity() {
+    return C().Activity;
+}
+
+void SetProcessorCount(unsigned count) {
+    auto &k = K();
+    std::lock_guard lock(k.Mutex);
+    k.Processors = std::clamp(count, 1u, 64u);
+}
+
+unsigned GetProcessorCount() {
+    auto &k = K();
+    std::lock_guard lock(k.Mutex);
+    return k.Processors;
+}
+
+void SetRegistryDword(const std::wstring &key, const std::wstring &name, DWORD value) {
+    SetRegistry(key, name, REG_DWORD, &value, sizeof(value));
+}
+
+void SetRegistryString(const std::wstring &key, const std::wstring &name, const std::wstring &value) {
+    SetRegistry(key, name, REG_SZ, value.c_str(), (value.size() + 1) * sizeof(WCHAR));
+}
+
+void DeleteRegistryValue(const std::wstring &key, const std::wstring &name) {
+    auto &k = K();
+    std::lock_guard lock(k.Mutex);
+    k.Registry.erase(RegistryPath(key.c_str(), name.c_str()));
+}
+
+void SetDebugOutput(std::function<void(const char *)> &&output) {
+    auto &k = K();
+    std::lock_guard lock(k.Mutex);
+    k.DebugOutput = std::move(output);
+}
+
+Defects GetDefects() {
+    auto &k = K();
+    std::lock_guard lock(k.Mutex);
+    return k.Found;
+}
+
+size_t OpenHandleCount() {
+    auto &k = K();
+    std::lock_guard lock(k.Mutex);
+    return k.Handles.size();
+}
+
+size_t OpenDeviceHandleCount() {
+    auto &k = K();
+    std::lock_guard lock(k.Mutex);
+    return std::count_if(k.Handles.begin(), k.Handles.end(), [](auto &entry) { return IsDeviceHandle(entry.second); });
+}
+
+} // namespace Sim
+
+// Shared with the rest of the simulator
+
+namespace Sim::Internal {
+
+HANDLE InsertHandle(std::shared_ptr<Object> object) {
+    auto &k = K();
+    std::lock_guard lock(k.Mutex);
+    return InsertLocked(k, std::move(object));
+}
+
+std::shared_ptr<Object> LookupHandle(HANDLE handle) {
+    auto &k = K();
+    std::lock_guard lock(k.Mutex);
+    return LookupLocked(k, handle);
+}
+
+std::shared_ptr<Object> ReferenceEvent(HANDLE handle) {
+    auto object = LookupHandle(handle);
+    return dynamic_cast<EventObject *>(object.get()) ? object : nullptr;
+}
+
+void SignalEvent(const std::shared_ptr<Object> &event) {
+    auto &k = K();
+    std::lock_guard lock(k.Mutex);
+    SignalLocked(k, static_cast<EventObject &>(*event));
+}
+
+void Touch() {
+    C().Activity++;
+}
+
+void CountUseAfterClose() {
+    auto &k = K();
+    std::lock_guard lock(k.Mutex);
+    k.Found.UseAfterClose++;
+}
+
+void CountCallbackException() {
+    auto &k = K();
+    std::lock_guard lock(k.Mutex);
+    k.Found.CallbackExceptions++;
+}
+
+void CountSelfWait() {
+    auto &k = K();
+    std::lock_guard lock(k.Mutex);
+    k.Found.SelfWaits++;
+}
+
+void CountVeto() {
+    auto &k = K();
+    std::lock_guard lock(k.Mutex);
+    k.Found.Vetoes++;
+}
+
+std::mt19937_64 &Random() {
+    return C().Random;
+}
+
+} // namespace Sim::Internal
+
+// Win32
+
+extern "C" {
+
+void SetLastError(DWORD error) {
+    t_lastError = error;
+}
+
+DWORD GetLastError() {
+    return t_lastError;
+}
+
+void OutputDebugStringA(LPCSTR message) {
+    auto &k = K();
+    std::function<void(const char *)> output;
+    {
+        std::lock_guard lock(k.Mutex);
+        output = k.DebugOutput;
+    }
+    if (output)
+        output(message);
+}
+
+HLOCAL LocalFree(HLOCAL memory) {
+    free(memory);
+    return nullptr;
+}
+
+BOOL IsProcessorFeaturePresent(DWORD feature) {
+    switch (feature) {
+    case PF_XMMI64_INSTRUCTIONS_AVAILABLE:
+        return __builtin_cpu_supports("sse2");
+    case PF_AVX2_INSTRUCTIONS_AVAILABLE:
+        return __builtin_cpu_supports("avx2");
+    default:
+        return FALSE;
+    }
+}
+
+DWORD GetModuleFileNameW(HMODULE module, LPWSTR fileName, DWORD size) {
+    UNREFERENCED_PARAMETER(module);
+    char path[MAX_PATH];
+    auto length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (length < 0 || size == 0) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return 0;
+    }
+    auto wide = Widen(std::string(path, length));
+    auto copied = std::min<size_t>(wide.size(), size - 1);
+    wmemcpy(fileName, wide.c_str(), copied);
+    fileName[copied] = L'\0';
+    if (copied < wide.size()) {
+        SetLastError(ERROR_INSUFFICIENT_BUFFER);
+        return size;
+    }
+    return static_cast<DWORD>(copied);
+}
+
+void Sleep(DWORD milliseconds) {
+    Touch();
+    std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
+}
+
+BOOL QueryPerformanceCounter(LARGE_INTEGER *count) {
+    Touch();
+    count->QuadPart = Now();
+    return TRUE;
+}
+
+BOOL QueryPerformanceFrequency(LARGE_INTEGER *frequency) {
+    frequency->QuadPart = 10000000;
+    return TRUE;
+}
+
+ULONGLONG GetTickCount64() {
+    Touch();
+    return Now() / 10000;
+}
+
+void GetSystemTimeAsFileTime(LPFILETIME time) {
+    Touch();
+    auto now = static_cast<ULONGLONG>(GuestTime());
+    time->dwLowDateTime = static_cast<DWORD>(now);
+    time->dwHighDateTime = static_cast<DWORD>(now >> 32);
+}
+
+void GetSystemTimePreciseAsFileTime(LPFILETIME time) {
+    GetSystemTimeAsFileTime(time);
+}
+
+HANDLE GetCurrentThread() {
+    return reinterpret_cast<HANDLE>(static_cast<LONG_PTR>(-2));
+}
+
+HANDLE GetCurrentProcess() {
+    return reinterpret_cast<HANDLE>(static_cast<LONG_PTR>(-1));
+}
+
+DWORD GetCurrentProcessId() {
+    return static_cast<DWORD>(getpid());
+}
+
+BOOL GetThreadGroupAffinity(HANDLE thread, PGROUP_AFFINITY affinity) {
+    if (thread != GetCurrentThread()) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+    *affinity = {};
+    affinity->Mask = t_affinity ? t_affinity : AllProcessors();
+    return TRUE;
+}
+
+BOOL SetThreadGroupAffinity(HANDLE thread, const GROUP_AFFINITY *affinity, PGROUP_AFFINITY previous) {
+    Touch();
+    if (thread != GetCurrentThread()) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+    if (affinity->Group != 0 || !affinity->Mask || (affinity->Mask & ~AllProcessors())) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+    if (previous)
+        GetThreadGroupAffinity(thread, previous);
+    t_affinity = affinity->Mask;
+    return TRUE;
+}
+
+WORD GetActiveProcessorGroupCount() {
+    return 1;
+}
+
+DWORD GetActiveProcessorCount(WORD group) {
+    return group == 0 || group == ALL_PROCESSOR_GROUPS ? GetProcessorCount() : 0;
+}
+
+// Threads run on the lowest processor they are allowed on, so that pinning decides which vCPU's view is read
+void GetCurrentProcessorNumberEx(PPROCESSOR_NUMBER number) {
+    *number = {};
+    auto mask = t_affinity ? t_affinity : AllProcessors();
+    number->Number = static_cast<BYTE>(__builtin_ctzl(mask));
+}
+
+int GetThreadPriority(HANDLE thread) {
+    return thread == GetCurrentThread() ? t_priority : THREAD_PRIORITY_ERROR_RETURN;
+}
+
+BOOL SetThreadPriority(HANDLE thread, int priority) {
+    if (thread != GetCurrentThread()) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+    t_priority = priority;
+    return TRUE;
+}
+
+BOOL CloseHandle(HANDLE object) {
+    Touch();
+    if (object == GetCurrentThread() || object == GetCurrentProcess())
+        return TRUE;
+
+    auto &k = K();
+    std::shared_ptr<Object> closed;
+    {
+        std::lock_guard lock(k.Mutex);
+        auto it = k.Handles.find(reinterpret_cast<uintptr_t>(object));
+        if (it == k.Handles.end()) {
+            LookupLocked(k, object);
+            SetLastError(ERROR_INVALID_HANDLE);
+            return FALSE;
+        }
+        closed = std::move(it->second);
+        k.Handles.erase(it);
+        if (--closed->Handles) {
+            return TRUE;
+        }
+        // Windows does not keep an event alive for a threadpool wait; the wait would be left on a dead object
+        if (auto event = dynamic_cast<EventObject *>(closed.get()); event && !event->Waits.empty())
+            k.Found.UseAfterClose++;
+    }
+    closed->OnLastHandleClosed();
+    return TRUE;
+}
+
+HANDLE CreateEventW(LPSECURITY_ATTRIBUTES attributes, BOOL manualReset, BOOL initialState, LPCWSTR name) {
+    UNREFERENCED_PARAMETER(attributes);
+    Touch();
+    auto &k = K();
+    std::lock_guard lock(k.Mutex);
+    if (name) {
+        if (auto existing = k.Names[name].lock()) {
+            if (!dynamic_cast<EventObject *>(existing.get())) {
+                SetLastError(ERROR_INVALID_HANDLE);
+                return nullptr;
+            }
+            SetLastError(ERROR_ALREADY_EXISTS);
+            return InsertLocked(k, existing);
+        }
+    }
+    auto event = std::make_shared<EventObject>();
+    event->ManualReset = manualReset;
+    event->Signaled = initialState;
+    if (name)
+        k.Names[name] = event;
+    SetLastError(ERROR_SUCCESS);
+    return InsertLocked(k, std::move(event));
+}
+
+HANDLE OpenEventW(DWORD access, BOOL inherit, LPCWSTR name) {
+    UNREFERENCED_PARAMETER(access);
+    UNREFERENCED_PARAMETER(inherit);
+    Touch();
+    auto &k = K();
+    std::lock_guard lock(k.Mutex);
+    auto it = k.Names.find(name);
+    auto existing = it != k.Names.end() ? it->second.lock() : nullptr;
+    if (!dynamic_cast<EventObject *>(existing.get())) {
+        SetLastError(ERROR_FILE_NOT_FOUND);
+        return nullptr;
+    }
+    return InsertLocked(k, existing);
+}
+
+BOOL SetEvent(HANDLE event) {
+    Touch();
+    auto &k = K();
+    std::lock_guard lock(k.Mutex);
+    auto object = std::dynamic_pointer_cast<EventObject>(LookupLocked(k, event));
+    if (!object) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+    SignalLocked(k, *object);
+    return TRUE;
+}
+
+BOOL ResetEvent(HANDLE event) {
+    Touch();
+    auto &k = K();
+    std::lock_guard lock(k.Mutex);
+    auto object = std::dynamic_pointer_cast<EventObject>(LookupLocked(k, event));
+    if (!object) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+    object->Signaled = false;
+    return TRUE;
+}
+
+DWORD WaitForSingleObject(HANDLE object, DWORD milliseconds) {
+    Touch();
+    auto &k = K();
+    std::unique_lock lock(k.Mutex);
+    auto event = std::dynamic_pointer_cast<EventObject>(LookupLocked(k, object));
+    if (!event) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return WAIT_FAILED;
+    }
+    auto signaled = [&] { return event->Signaled; };
+    if (milliseconds == INFINITE)
+        k.Changed.wait(lock, signaled);
+    else if (!k.Changed.wait_for(lock, std::chrono::milliseconds(milliseconds), signaled))
+        return WAIT_TIMEOUT;
+    if (!event->ManualReset)
+        event->Signaled = false;
+    return WAIT_OBJECT_0;
+}
+
+HANDLE CreateFileW(
+    LPCWSTR fileName,
+    DWORD access,
+    DWORD shareMode,
+    LPSECURITY_ATTRIBUTES attributes,
+    DWORD disposition,
+    DWORD flags,
+    HANDLE templateFile) {
+    UNREFERENCED_PARAMETER(shareMode);
+    UNREFERENCED_PARAMETER(attributes);
+    UNREFERENCED_PARAMETER(flags);
+    UNREFERENCED_PARAMETER(templateFile);
+    Touch();
+
+    DWORD error = ERROR_SUCCESS;
+    if (auto device = OpenDevice(fileName, error)) {
+        if (!*device) {
+            SetLastError(error);
+            return INVALID_HANDLE_VALUE;
+        }
+        return *device;
+    }
+
+    int mode = 0;
+    if ((access & GENERIC_WRITE) || (access & FILE_APPEND_DATA))
+        mode = (access & GENERIC_READ) ? O_RDWR : O_WRONLY;
+    if (access & FILE_APPEND_DATA)
+        mode |= O_APPEND;
+    if (disposition == CREATE_ALWAYS)
+        mode |= O_CREAT | O_TRUNC;
+    else if (disposition == OPEN_ALWAYS)
+        mode |= O_CREAT;
+
+    auto fd = open(Narrow(fileName).c_str(), mode | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        SetLastError(errno == ENOENT ? ERROR_FILE_NOT_FOUND : ERROR_ACCESS_DENIED);
+        return INVALID_HANDLE_VALUE;
+    }
+    auto file = std::make_shared<FileObject>();
+    file->Fd = fd;
+    return InsertHandle(std::move(file));
+}
+
+BOOL GetFileSizeEx(HANDLE file, PLARGE_INTEGER size) {
+    Touch();
+    auto object = Lookup<FileObject>(file);
+    struct stat st;
+    if (!object || fstat(object->Fd, &st) != 0) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+    size->QuadPart = st.st_size;
+    return TRUE;
+}
+
+BOOL ReadFile(HANDLE file, LPVOID buffer, DWORD size, LPDWORD read, LPOVERLAPPED overlapped) {
+    UNREFERENCED_PARAMETER(overlapped);
+    Touch();
+    auto object = Lookup<FileObject>(file);
+    auto count = object ? ::read(object->Fd, buffer, size) : -1;
+    if (count < 0) {
+        SetLastError(object ? ERROR_GEN_FAILURE : ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+    if (read)
+        *read = static_cast<DWORD>(count);
+    return TRUE;
+}
+
+BOOL WriteFile(HANDLE file, LPCVOID buffer, DWORD size, LPDWORD written, LPOVERLAPPED overlapped) {
+    UNREFERENCED_PARAMETER(overlapped);
+    Touch();
+    auto object = Lookup<FileObject>(file);
+    auto count = object ? ::write(object->Fd, buffer, size) : -1;
+    if (count < 0) {
+        SetLastError(object ? ERROR_DISK_FULL : ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+    if (written)
+        *written = static_cast<DWORD>(count);
+    return TRUE;
+}
+
+BOOL FlushFileBuffers(HANDLE file) {
+    Touch();
+    auto object = Lookup<FileObject>(file);
+    if (!object || fsync(object->Fd) != 0) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+BOOL SetFilePointerEx(HANDLE file, LARGE_INTEGER distance, PLARGE_INTEGER newPointer, DWORD method) {
+    Touch();
+    auto object = Lookup<FileObject>(file);
+    static const int whence[] = {SEEK_SET, SEEK_CUR, SEEK_END};
+    auto position = object && method <= FILE_END ? lseek(object->Fd, distance.QuadPart, whence[method]) : -1;
+    if (position < 0) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+    if (newPointer)
+        newPointer->QuadPart = position;
+    return TRUE;
+}
+
+HANDLE CreateFileMappingW(
+    HANDLE file,
+    LPSECURITY_ATTRIBUTES attributes,
+    DWORD protect,
+    DWORD maximumSizeHigh,
+    DWORD maximumSizeLow,
+    LPCWSTR name) {
+    UNREFERENCED_PARAMETER(attributes);
+    Touch();
+    auto size = static_cast<size_t>(maximumSizeHigh) << 32 | maximumSizeLow;
+    auto section = std::make_shared<SectionObject>();
+    section->Writable = protect == PAGE_READWRITE;
+
+    if (file != INVALID_HANDLE_VALUE) {
+        auto object = Lookup<FileObject>(file);
+        struct stat st;
+        if (!object || fstat(object->Fd, &st) != 0) {
+            SetLastError(ERROR_INVALID_HANDLE);
+            return nullptr;
+        }
+        // Windows cannot map an empty file
+        section->Size = size ? size : st.st_size;
+        if (!section->Size) {
+            SetLastError(ERROR_INVALID_PARAMETER);
+            return nullptr;
+        }
+        section->Fd = dup(object->Fd);
+        SetLastError(ERROR_SUCCESS);
+        return InsertHandle(std::move(section));
+    }
+
+    auto &k = K();
+    std::lock_guard lock(k.Mutex);
+    if (name) {
+        if (auto existing = k.Names[name].lock()) {
+            if (!dynamic_cast<SectionObject *>(existing.get())) {
+                SetLastError(ERROR_INVALID_HANDLE);
+                return nullptr;
+            }
+            SetLastError(ERROR_ALREADY_EXISTS);
+            return InsertLocked(k, existing);
+        }
+    }
+    section->Size = size;
+    section->Anonymous = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (section->Anonymous == MAP_FAILED) {
+        section->Anonymous = nullptr;
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return nullptr;
+    }
+    if (name)
+        k.Names[name] = section;
+    SetLastError(ERROR_SUCCESS);
+    return InsertLocked(k, std::move(section));
+}
+
+HANDLE OpenFileMappingW(DWORD access, BOOL inherit, LPCWSTR name) {
+    UNREFERENCED_PARAMETER(access);
+    UNREFERENCED_PARAMETER(inherit);
+    Touch();
+    auto &k = K();
+    std::lock_guard lock(k.Mutex);
+    auto it = k.Names.find(name);
+    auto existing = it != k.Names.end() ? it->second.lock() : nullptr;
+    if (!dynamic_cast<SectionObject *>(existing.get())) {
+        SetLastError(ERROR_FILE_NOT_FOUND);
+        return nullptr;
+    }
+    return InsertLocked(k, existing);
+}
+
+LPVOID MapViewOfFile(HANDLE mapping, DWORD access, DWORD offsetHigh, DWORD offsetLow, SIZE_T size) {
+    Touch();
+    auto section = Lookup<SectionObject>(mapping);
+    auto offset = static_cast<size_t>(offsetHigh) << 32 | offsetLow;
+    if (!section || offset >= section->Size || ((access & FILE_MAP_WRITE) && !section->Writable)) {
+        SetLastError(section ? ERROR_ACCESS_DENIED : ERROR_INVALID_HANDLE);
+        return nullptr;
+    }
+    auto length = size ? size : section->Size - offset;
+    void *base;
+    if (section->Anonymous) {
+        base = static_cast<BYTE *>(section->Anonymous) + offset;
+    } else {
+        auto protection = PROT_READ | ((access & FILE_MAP_WRITE) ? PROT_WRITE : 0);
+        base = mmap(nullptr, length, protection, MAP_SHARED, section->Fd, static_cast<off_t>(offset));
+        if (base == MAP_FAILED) {
+            SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+            return nullptr;
+        }
+    }
+    auto &k = K();
+    std::lock_guard lock(k.Mutex);
+    k.Views.emplace(base, View{section, base, length});
+    return base;
+}
+
+BOOL UnmapViewOfFile(LPCVOID address) {
+    Touch();
+    auto &k = K();
+    std::unique_lock lock(k.Mutex);
+    auto it = k.Views.find(address);
+    if (it == k.Views.end()) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+    auto view = std::move(it->second);
+    k.Views.erase(it);
+    lock.unlock();
+    if (!view.Section->Anonymous)
+        munmap(view.Base, view.Length);
+    return TRUE;
+}
+
+BOOL DeviceIoControl(
+    HANDLE device,
+    DWORD ioControlCode,
+    LPVOID inBuffer,
+    DWORD inBufferSize,
+    LPVOID outBuffer,
+    DWORD outBufferSize,
+    LPDWORD bytesReturned,
+    LPOVERLAPPED overlapped) {
+    UNREFERENCED_PARAMETER(overlapped);
+    Touch();
+    return DeviceControl(device, ioControlCode, inBuffer, inBufferSize, outBuffer, outBufferSize, bytesReturned);
+}
+
+LSTATUS RegGetValueW(HKEY key, LPCWSTR subKey, LPCWSTR value, DWORD flags, LPDWORD type, PVOID data, LPDWORD size) {
+    Touch();
+    if (key != HKEY_LOCAL_MACHINE)
+        return ERROR_INVALID_HANDLE;
+    auto &k = K();
+    std::lock_guard lock(k.Mutex);
+    auto it = k.Registry.find(RegistryPath(subKey, value));
+    if (it == k.Registry.end())
+        return ERROR_FILE_NOT_FOUND;
+
+    auto &found = it->second;
+    auto allowed = (found.Type == REG_SZ && (flags & RRF_RT_REG_SZ)) ||
+        (found.Type == REG_BINARY && (flags & RRF_RT_REG_BINARY)) ||
+        (found.Type == REG_DWORD && (flags & RRF_RT_REG_DWORD));
+    if (!allowed)
+        return ERROR_UNSUPPORTED_TYPE;
+    if (type)
+        *type = found.Type;
+
+    auto needed = static_cast<DWORD>(found.Data.size());
+    if (!data) {
+        if (size)
+            *size = needed;
+        return ERROR_SUCCESS;
+    }
+    if (!size || *size < needed) {
+        if (size)
+            *size = needed;
+        return ERROR_MORE_DATA;
+    }
+    memcpy(data, found.Data.data(), needed);
+    *size = needed;
+    return ERROR_SUCCESS;
+}
+
+LSTATUS RegSetKeyValueW(HKEY key, LPCWSTR subKey, LPCWSTR value, DWORD type, LPCVOID data, DWORD size) {
+    Touch();
+    if (key != HKEY_LOCAL_MACHINE)
+        return ERROR_INVALID_HANDLE;
+    SetRegistry(subKey ? subKey : L"", value ? value : L"", type, data, size);
+    return ERROR_SUCCESS;
+}
+
+PTP_WAIT CreateThreadpoolWait(PTP_WAIT_CALLBACK callback, PVOID context, PTP_CALLBACK_ENVIRON environment) {
+    UNREFERENCED_PARAMETER(environment);
+    Touch();
+    auto wait = new _TP_WAIT;
+    wait->Callback = callback;
+    wait->Context = context;
+    return wait;
+}
+
+void SetThreadpoolWait(PTP_WAIT wait, HANDLE object, PFILETIME timeout) {
+    UNREFERENCED_PARAMETER(timeout);
+    Touch();
+    auto &k = K();
+    std::lock_guard lock(k.Mutex);
+    DisarmLocked(wait);
+    if (!object)
+        return;
+    auto event = std::dynamic_pointer_cast<EventObject>(LookupLocked(k, object));
+    if (!event)
+        return;
+    StartPoolLocked(k);
+    if (event->Signaled) {
+        if (!event->ManualReset)
+            event->Signaled = false;
+        Enqueue(k, wait);
+        return;
+    }
+    event->Waits.push_back(wait);
+    wait->Armed = std::move(event);
+}
+
+void WaitForThreadpoolWaitCallbacks(PTP_WAIT wait, BOOL cancelPendingCallbacks) {
+    WaitForCallbacks(wait, cancelPendingCallbacks);
+}
+
+void CloseThreadpoolWait(PTP_WAIT wait) {
+    Touch();
+    {
+        auto &k = K();
+        std::lock_guard lock(k.Mutex);
+        DisarmLocked(wait);
+    }
+    ClosePoolObject(wait);
+}
+
+PTP_TIMER CreateThreadpoolTimer(PTP_TIMER_CALLBACK callback, PVOID context, PTP_CALLBACK_ENVIRON environment) {
+    UNREFERENCED_PARAMETER(environment);
+    Touch();
+    auto timer = new _TP_TIMER;
+    timer->Callback = callback;
+    timer->Context = context;
+    auto &k = K();
+    std::lock_guard lock(k.Mutex);
+    k.Timers.push_back(timer);
+    return timer;
+}
+
+void SetThreadpoolTimer(PTP_TIMER timer, PFILETIME dueTime, DWORD period, DWORD windowLength) {
+    UNREFERENCED_PARAMETER(windowLength);
+    Touch();
+    std::optional<int64_t> due;
+    if (dueTime) {
+        auto value = static_cast<int64_t>(static_cast<ULONGLONG>(dueTime->dwHighDateTime) << 32 |
+                                          dueTime->dwLowDateTime);
+        // Negative due times are relative; positive ones are system times
+        due = value < 0 ? Now() - value : Now() + std::max<int64_t>(value - GuestTime(), 0);
+    }
+    auto &k = K();
+    std::lock_guard lock(k.Mutex);
+    timer->Due = due;
+    timer->Period = static_cast<int64_t>(period) * 10000;
+    StartPoolLocked(k);
+    k.PoolWake.notify_all();
+}
+
+BOOL IsThreadpoolTimerSet(PTP_TIMER timer) {
+    Touch();
+    auto &k = K();
+    std::lock_guard lock(k.Mutex);
+    return timer->Due.has_value();
+}
+
+void WaitForThreadpoolTimerCallbacks(PTP_TIMER timer, BOOL cancelPendingCallbacks) {
+    WaitForCallbacks(timer, cancelPendingCallbacks);
+}
+
+void CloseThreadpoolTimer(PTP_TIMER timer) {
+    Touch();
+    {
+        auto &k = K();
+        std::lock_guard lock(k.Mutex);
+        timer->Due.reset();
+        k.Timers.erase(std::remove(k.Timers.begin(), k.Timers.end(), timer), k.Timers.end());
+    }
+    ClosePoolObject(timer);
+}
+
+BOOL ConvertStringSecurityDescriptorToSecurityDescriptorW(
+    LPCWSTR stringSecurityDescriptor,
+    DWORD revision,
+    PSECURITY_DESCRIPTOR *securityDescriptor,
+    PULONG securityDescriptorSize) {
+    if (revision != SDDL_REVISION_1 || !stringSecurityDescriptor) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+    // The descriptor is opaque to the provider; keep the string so that it can be inspected
+    auto bytes = (wcslen(stringSecurityDescriptor) + 1) * sizeof(WCHAR);
+    *securityDescriptor = malloc(bytes);
+    if (!*securityDescriptor) {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return FALSE;
+    }
+    memcpy(*securityDescriptor, stringSecurityDescriptor, bytes);
+    if (securityDescriptorSize)
+        *securityDescriptorSize = static_cast<ULONG>(bytes);
+    return TRUE;
+}
+}
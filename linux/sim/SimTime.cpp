@@ -0,0 +1,210 @@
+// Calendar and time zone conversions, following the Windows rules for TIME_ZONE_INFORMATION transition dates
+
+#include <mutex>
+
+#include <windows.h>
+
+#include "SimInternal.hpp"
+
+#define TICKS_PER_MINUTE 600000000LL
+#define TICKS_PER_DAY (TICKS_PER_MINUTE * 1440)
+
+namespace {
+
+std::mutex g_zoneMutex;
+// UTC with no daylight saving time until a tool sets a zone
+DYNAMIC_TIME_ZONE_INFORMATION g_zone = {.TimeZoneKeyName = L"UTC"};
+
+// Days since 1601-01-01 in the proleptic Gregorian calendar
+int64_t DaysFromCivil(int year, unsigned month, unsigned day) {
+    year -= month <= 2;
+    auto era = (year >= 0 ? year : year - 399) / 400;
+    auto yearOfEra = static_cast<unsigned>(year - era * 400);
+    auto dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    auto dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097LL + static_cast<int64_t>(dayOfEra) - 584694;
+}
+
+void CivilFromDays(int64_t days, int &year, unsigned &month, unsigned &day) {
+    days += 584694;
+    auto era = (days >= 0 ? days : days - 146096) / 146097;
+    auto dayOfEra = static_cast<unsigned>(days - era * 146097);
+    auto yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    auto dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    auto mp = (5 * dayOfYear + 2) / 153;
+    day = dayOfYear - (153 * mp + 2) / 5 + 1;
+    month = mp < 10 ? mp + 3 : mp - 9;
+    year = static_cast<int>(yearOfEra + era * 400 + (month <= 2));
+}
+
+unsigned DaysInMonth(int year, unsigned month) {
+    return static_cast<unsigned>(DaysFromCivil(year + (month == 12), month % 12 + 1, 1) - DaysFromCivil(year, month, 1));
+}
+
+int64_t ToTicks(const SYSTEMTIME &time) {
+    return DaysFromCivil(time.wYear, time.wMonth, time.wDay) * TICKS_PER_DAY +
+        ((time.wHour * 60LL + time.wMinute) * 60 + time.wSecond) * 10000000LL + time.wMilliseconds * 10000LL;
+}
+
+bool ToSystemTime(int64_t ticks, SYSTEMTIME &time) {
+    if (ticks < 0)
+        return false;
+    int year;
+    unsigned month, day;
+    auto days = ticks / TICKS_PER_DAY;
+    auto rest = ticks % TICKS_PER_DAY;
+    CivilFromDays(days, year, month, day);
+    if (year > 30827)
+        return false;
+    time.wYear = static_cast<WORD>(year);
+    time.wMonth = static_cast<WORD>(month);
+    time.wDay = static_cast<WORD>(day);
+    // 1601-01-01 was a Monday
+    time.wDayOfWeek = static_cast<WORD>((days + 1) % 7);
+    time.wHour = static_cast<WORD>(rest / (TICKS_PER_MINUTE * 60));
+    time.wMinute = static_cast<WORD>(rest / TICKS_PER_MINUTE % 60);
+    time.wSecond = static_cast<WORD>(rest / 10000000 % 60);
+    time.wMilliseconds = static_cast<WORD>(rest / 10000 % 1000);
+    return true;
+}
+
+// Local time of a transition date in the given year; wYear == 0 means wDay is the week (5 for the last) of the
+// month in which the transition falls on weekday wDayOfWeek
+int64_t TransitionTime(const SYSTEMTIME &date, int year) {
+    unsigned day = date.wDay;
+    if (!date.wYear) {
+        auto firstDayOfWeek = static_cast<unsigned>((DaysFromCivil(year, date.wMonth, 1) + 1) % 7);
+        day = 1 + (date.wDayOfWeek + 7 - firstDayOfWeek) % 7 + (date.wDay - 1) * 7;
+        while (day > DaysInMonth(year, date.wMonth))
+            day -= 7;
+    }
+    SYSTEMTIME at = date;
+    at.wYear = static_cast<WORD>(year);
+    at.wDay = static_cast<WORD>(day);
+    return ToTicks(at);
+}
+
+DYNAMIC_TIME_ZONE_INFORMATION ZoneOrCurrent(const DYNAMIC_TIME_ZONE_INFORMATION *zone) {
+    if (zone)
+        return *zone;
+    std::lock_guard lock(g_zoneMutex);
+    return g_zone;
+}
+
+bool HasDaylight(const DYNAMIC_TIME_ZONE_INFORMATION &zone) {
+    return zone.StandardDate.wMonth && zone.DaylightDate.wMonth && !zone.DynamicDaylightTimeDisabled;
+}
+
+// Whether daylight time is in effect at a UTC time
+bool IsDaylightUniversal(const DYNAMIC_TIME_ZONE_INFORMATION &zone, int year, int64_t universal) {
+    if (!HasDaylight(zone))
+        return false;
+    auto start = TransitionTime(zone.DaylightDate, year) + (zone.Bias + zone.StandardBias) * TICKS_PER_MINUTE;
+    auto end = TransitionTime(zone.StandardDate, year) + (zone.Bias + zone.DaylightBias) * TICKS_PER_MINUTE;
+    return start < end ? universal >= start && universal < end : universal >= start || universal < end;
+}
+
+// Whether a local time is unambiguously in daylight time; skipped and repeated local times are standard time
+bool IsDaylightLocal(const DYNAMIC_TIME_ZONE_INFORMATION &zone, int year, int64_t local) {
+    if (!HasDaylight(zone))
+        return false;
+    auto shift = (zone.StandardBias - zone.DaylightBias) * TICKS_PER_MINUTE;
+    auto start = TransitionTime(zone.DaylightDate, year) + shift;
+    auto end = TransitionTime(zone.StandardDate, year) - shift;
+    return start < end ? local >= start && local < end : local >= start || local < end;
+}
+
+} // namespace
+
+namespace Sim {
+
+void SetTimeZone(const DYNAMIC_TIME_ZONE_INFORMATION &zone) {
+    std::lock_guard lock(g_zoneMutex);
+    g_zone = zone;
+}
+
+} // namespace Sim
+
+extern "C" {
+
+BOOL FileTimeToSystemTime(const FILETIME *fileTime, LPSYSTEMTIME systemTime) {
+    auto ticks = static_cast<int64_t>(static_cast<ULONGLONG>(fileTime->dwHighDateTime) << 32 | fileTime->dwLowDateTime);
+    if (!ToSystemTime(ticks, *systemTime)) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+BOOL SystemTimeToFileTime(const SYSTEMTIME *systemTime, LPFILETIME fileTime) {
+    auto &t = *systemTime;
+    if (t.wYear < 1601 || t.wYear > 30827 || t.wMonth < 1 || t.wMonth > 12 || t.wDay < 1 ||
+        t.wDay > DaysInMonth(t.wYear, t.wMonth) || t.wHour > 23 || t.wMinute > 59 || t.wSecond > 59 ||
+        t.wMilliseconds > 999) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+    auto ticks = static_cast<ULONGLONG>(ToTicks(t));
+    fileTime->dwLowDateTime = static_cast<DWORD>(ticks);
+    fileTime->dwHighDateTime = static_cast<DWORD>(ticks >> 32);
+    return TRUE;
+}
+
+BOOL SystemTimeToTzSpecificLocalTimeEx(
+    const DYNAMIC_TIME_ZONE_INFORMATION *timeZone,
+    const SYSTEMTIME *universalTime,
+    LPSYSTEMTIME localTime) {
+    auto zone = ZoneOrCurrent(timeZone);
+    auto universal = ToTicks(*universalTime);
+    auto bias = zone.Bias +
+        (IsDaylightUniversal(zone, universalTime->wYear, universal) ? zone.DaylightBias : zone.StandardBias);
+    if (!ToSystemTime(universal - bias * TICKS_PER_MINUTE, *localTime)) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+BOOL TzSpecificLocalTimeToSystemTimeEx(
+    const DYNAMIC_TIME_ZONE_INFORMATION *timeZone,
+    const SYSTEMTIME *localTime,
+    LPSYSTEMTIME universalTime) {
+    auto zone = ZoneOrCurrent(timeZone);
+    auto local = ToTicks(*localTime);
+    auto bias =
+        zone.Bias + (IsDaylightLocal(zone, localTime->wYear, local) ? zone.DaylightBias : zone.StandardBias);
+    if (!ToSystemTime(local + bias * TICKS_PER_MINUTE, *universalTime)) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// Simulated zones have one rule for all years
+BOOL GetTimeZoneInformationForYear(USHORT year, PDYNAMIC_TIME_ZONE_INFORMATION dtzi, LPTIME_ZONE_INFORMATION tzi) {
+    UNREFERENCED_PARAMETER(year);
+    auto zone = ZoneOrCurrent(dtzi);
+    *tzi = {};
+    tzi->Bias = zone.Bias;
+    wmemcpy(tzi->StandardName, zone.StandardName, ARRAYSIZE(tzi->StandardName));
+    tzi->StandardBias = zone.StandardBias;
+    wmemcpy(tzi->DaylightName, zone.DaylightName, ARRAYSIZE(tzi->DaylightName));
+    tzi->DaylightBias = zone.DaylightBias;
+    if (HasDaylight(zone)) {
+        tzi->StandardDate = zone.StandardDate;
+        tzi->DaylightDate = zone.DaylightDate;
+    }
+    return TRUE;
+}
+
+DWORD GetDynamicTimeZoneInformation(PDYNAMIC_TIME_ZONE_INFORMATION timeZone) {
+    auto zone = ZoneOrCurrent(nullptr);
+    *timeZone = zone;
+    if (!HasDaylight(zone))
+        return TIME_ZONE_ID_UNKNOWN;
+    SYSTEMTIME now;
+    auto universal = Sim::GuestTime();
+    ToSystemTime(universal, now);
+    return IsDaylightUniversal(zone, now.wYear, universal) ? TIME_ZONE_ID_DAYLIGHT : TIME_ZONE_ID_STANDARD;
+}
+}
@@ -0,0 +1,869 @@
+// The Xen host, xenstored, the XENIFACE driver and Configuration Manager notifications of the simulated environment
+
+#include <algorithm>
+#include <charconv>
+#include <condition_variable>
+#include <map>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <windows.h>
+#include <winioctl.h>
+#include <cfgmgr32.h>
+
+#include "xeniface_ioctls.h"
+#include "SimInternal.hpp"
+
+#define TICKS_PER_SECOND 10000000LL
+#define FIRST_PORT 10
+#define INTERFACE_PREFIX L"\\\\?\\XENBUS#VEN_XS0001&DEV_IFACE#"
+#define INTERFACE_SUFFIX L"#{b2cfb085-aa5e-47e1-8bf7-9793f3154565}"
+#define EVENT_CHANNEL_KEY "data/xentimeprovider/event-channel"
+
+using namespace Sim;
+using namespace Sim::Internal;
+
+namespace {
+
+const GUID XenIfaceClass = {0xb2cfb085, 0xaa5e, 0x47e1, {0x8b, 0xf7, 0x97, 0x93, 0xf3, 0x15, 0x45, 0x65}};
+
+struct Interface {
+    std::wstring Path;
+    bool Present = true;
+    // Set once the device is going away for good; opens and ioctls fail from then on
+    bool Failed = false;
+    size_t OpenHandles = 0;
+};
+
+struct DeviceObject : Object {
+    void OnLastHandleClosed() override;
+
+    std::shared_ptr<Interface> Iface;
+};
+
+struct Port {
+    std::shared_ptr<Object> Event;
+    const DeviceObject *Owner;
+    bool Masked;
+    bool Pending = false;
+};
+
+struct SuspendRegistration {
+    std::shared_ptr<Object> Event;
+    const DeviceObject *Owner;
+};
+
+struct Registration {
+    PCM_NOTIFY_CALLBACK Callback;
+    PVOID Context;
+    bool ByInterface;
+    GUID ClassGuid;
+    // Device handle registrations follow the device, not the handle, which may be closed before the removal arrives
+    std::shared_ptr<Interface> Device;
+    size_t InFlight = 0;
+    bool Closed = false;
+    bool RemovalSeen = false;
+};
+
+struct Clock {
+    int64_t Base;
+    int64_t Epoch;
+    int64_t DriftPpb;
+
+    int64_t At(int64_t now) const {
+        auto elapsed = now - Epoch;
+        return Base + elapsed + elapsed * DriftPpb / 1000000000;
+    }
+    void Rebase(int64_t now) {
+        Base = At(now);
+        Epoch = now;
+    }
+};
+
+struct Xen {
+    Xen() {
+        Apply(HostConfig{});
+    }
+
+    void Apply(const HostConfig &config);
+    std::string Home() const {
+        return "/local/domain/" + std::to_string(Config.DomainId) + "/";
+    }
+    std::string VmPath() const {
+        return "/vm/" + Config.VmUuid;
+    }
+    std::string Resolve(const std::string &path) const {
+        return path.starts_with('/') ? path : Home() + path;
+    }
+
+    std::mutex Mutex;
+    std::condition_variable Changed;
+    // Serializes device arrival and removal, as the PnP manager does
+    std::mutex Pnp;
+
+    HostConfig Config;
+    Clock Host{};
+    Clock Guest{};
+    std::map<std::string, std::string> Store;
+    int64_t StoreFreeAt = 0;
+    std::function<void(const StoreOp &)> StoreObserver;
+
+    std::vector<std::shared_ptr<Interface>> Interfaces;
+    unsigned NextInterface = 0;
+    std::vector<std::shared_ptr<Registration>> Registrations;
+    std::map<ULONG, Port> Ports;
+    ULONG NextPort = FIRST_PORT;
+    std::map<uintptr_t, SuspendRegistration> Suspends;
+    uintptr_t NextSuspend = 1;
+
+    HostStats Stats{};
+    DeliveryStats Delivery{};
+};
+
+Xen &X() {
+    static auto xen = new Xen;
+    return *xen;
+}
+
+thread_local Registration *t_delivering;
+
+void Xen::Apply(const HostConfig &config) {
+    Config = config;
+    Host = {.Base = config.UtcStart, .Epoch = 0, .DriftPpb = config.HostDriftPpb};
+    Guest = {.Base = config.GuestStart, .Epoch = 0, .DriftPpb = config.GuestDriftPpb};
+    Store[Home() + "domid"] = std::to_string(config.DomainId);
+    Store[Home() + "vm"] = VmPath();
+    Store[VmPath() + "/rtc/timeoffset"] = std::to_string(config.TimeOffsetSeconds);
+}
+
+void DeviceObject::OnLastHandleClosed() {
+    auto &x = X();
+    std::lock_guard lock(x.Mutex);
+    Iface->OpenHandles--;
+    // The driver releases what the handle's owner left behind when the handle is cleaned up
+    std::erase_if(x.Ports, [&](auto &entry) {
+        if (entry.second.Owner != this)
+            return false;
+        x.Stats.PortsClosed++;
+        return true;
+    });
+    std::erase_if(x.Suspends, [&](auto &entry) { return entry.second.Owner == this; });
+    x.Changed.notify_all();
+}
+
+int64_t Uniform(int64_t range) {
+    if (range <= 0)
+        return 0;
+    return std::uniform_int_distribution<int64_t>(0, range)(Random());
+}
+
+// One request to xenstored, which serves guests one at a time. Other guests' load delays the request by the mean
+// M/D/1 queueing delay at that utilisation, drawn from an exponential distribution.
+StoreOp ServeStoreRequest() {
+    auto &x = X();
+    StoreOp op;
+    {
+        std::lock_guard lock(x.Mutex);
+        auto cost = x.Config.StoreCost;
+        op.Arrival = Now();
+        op.Start = std::max(op.Arrival, x.StoreFreeAt);
+        if (auto load = std::min<uint32_t>(x.Config.StoreLoadPermille, 999)) {
+            auto rho = load / 1000.0;
+            std::exponential_distribution<double> wait(2 * (1 - rho) / (rho * cost));
+            op.Start += static_cast<int64_t>(wait(Random()));
+        }
+        op.Finish = op.Start + cost;
+        x.StoreFreeAt = op.Finish;
+        auto queued = static_cast<uint64_t>(op.Start - op.Arrival);
+        x.Stats.StoreOps++;
+        x.Stats.StoreQueueTicksTotal += queued;
+        x.Stats.StoreQueueTicksMax = std::max(x.Stats.StoreQueueTicksMax, queued);
+    }
+    Spend(op.Finish - op.Arrival);
+    return op;
+}
+
+void ObserveStore(StoreOp op, DWORD code) {
+    auto &x = X();
+    std::function<void(const StoreOp &)> observer;
+    {
+        std::lock_guard lock(x.Mutex);
+        observer = x.StoreObserver;
+    }
+    op.Code = code;
+    if (observer)
+        observer(op);
+}
+
+// Fixed-layout input strings; the caller's buffer may not be terminated
+std::string InputString(LPVOID in, DWORD size, DWORD offset = 0) {
+    if (!in || offset >= size)
+        return {};
+    auto start = static_cast<const char *>(in) + offset;
+    return std::string(start, strnlen(start, size - offset));
+}
+
+DWORD StoreIoctl(DWORD code, LPVOID in, DWORD inSize, LPVOID out, DWORD outSize, LPDWORD returned) {
+    auto op = ServeStoreRequest();
+    auto &x = X();
+    DWORD error = ERROR_SUCCESS;
+    {
+        std::lock_guard lock(x.Mutex);
+        auto path = InputString(in, inSize);
+        if (path.empty()) {
+            error = ERROR_INVALID_PARAMETER;
+        } else if (code == IOCTL_XENIFACE_STORE_READ) {
+            auto it = x.Store.find(x.Resolve(path));
+            if (it == x.Store.end()) {
+                error = ERROR_FILE_NOT_FOUND;
+            } else if (outSize < it->second.size() + 1) {
+                error = ERROR_MORE_DATA;
+            } else {
+                memcpy(out, it->second.c_str(), it->second.size() + 1);
+                *returned = static_cast<DWORD>(it->second.size() + 1);
+            }
+        } else if (code == IOCTL_XENIFACE_STORE_WRITE) {
+            x.Store[x.Resolve(path)] = InputString(in, inSize, static_cast<DWORD>(path.size() + 1));
+        } else {
+            auto resolved = x.Resolve(path);
+            std::erase_if(x.Store, [&](auto &entry) {
+                return entry.first == resolved || entry.first.starts_with(resolved + "/");
+            });
+        }
+    }
+    ObserveStore(op, error);
+    return error;
+}
+
+DWORD ReadSharedInfo(LPVOID out, DWORD outSize, LPDWORD returned) {
+    if (outSize < sizeof(XENIFACE_SHAREDINFO_GET_TIME_OUT))
+        return ERROR_INSUFFICIENT_BUFFER;
+
+    auto &x = X();
+    int64_t latency, before;
+    {
+        std::lock_guard lock(x.Mutex);
+        auto &c = x.Config;
+        latency = c.IoctlBase + Uniform(c.IoctlJitter);
+        if (c.SpikePerMillion && Uniform(999999) < c.SpikePerMillion)
+            latency += c.SpikeTicks;
+        before = latency * c.ReadPointPpm / 1000000;
+    }
+    Spend(before);
+
+    PROCESSOR_NUMBER cpu;
+    GetCurrentProcessorNumberEx(&cpu);
+    int64_t value;
+    {
+        std::lock_guard lock(x.Mutex);
+        auto &c = x.Config;
+        value = x.Host.At(Now()) + c.TimeOffsetSeconds * TICKS_PER_SECOND;
+        if (cpu.Number < c.CpuSkew.size())
+            value += c.CpuSkew[cpu.Number];
+        if (c.ReadNoise)
+            value += Uniform(2 * c.ReadNoise) - c.ReadNoise;
+        x.Stats.SharedInfoReads++;
+    }
+    Spend(latency - before);
+
+    auto result = static_cast<PXENIFACE_SHAREDINFO_GET_TIME_OUT>(out);
+    result->Time.dwLowDateTime = static_cast<DWORD>(value);
+    result->Time.dwHighDateTime = static_cast<DWORD>(static_cast<uint64_t>(value) >> 32);
+    result->Local = FALSE;
+    *returned = sizeof(*result);
+    return ERROR_SUCCESS;
+}
+
+// Delivers a notification to every matching registration on the calling thread, as CM does for a single event
+// before moving on to the next. Returns true if a query-remove callback vetoed.
+bool Deliver(const std::shared_ptr<Interface> &iface, CM_NOTIFY_ACTION action) {
+    auto &x = X();
+    bool byInterface =
+        action == CM_NOTIFY_ACTION_DEVICEINTERFACEARRIVAL || action == CM_NOTIFY_ACTION_DEVICEINTERFACEREMOVAL;
+    std::vector<std::shared_ptr<Registration>> targets;
+    {
+        std::lock_guard lock(x.Mutex);
+        for (auto &registration : x.Registrations) {
+            if (registration->Closed || registration->ByInterface != byInterface)
+                continue;
+            if (byInterface ? !(registration->ClassGuid == XenIfaceClass) : registration->Device != iface)
+                continue;
+            registration->InFlight++;
+            targets.push_back(registration);
+        }
+    }
+
+    std::vector<BYTE> buffer(sizeof(CM_NOTIFY_EVENT_DATA) + (iface->Path.size() + 1) * sizeof(WCHAR));
+    auto data = reinterpret_cast<PCM_NOTIFY_EVENT_DATA>(buffer.data());
+    bool vetoed = false;
+    for (auto &registration : targets) {
+        std::fill(buffer.begin(), buffer.end(), 0);
+        DWORD size = sizeof(CM_NOTIFY_EVENT_DATA);
+        if (byInterface) {
+            data->FilterType = CM_NOTIFY_FILTER_TYPE_DEVICEINTERFACE;
+            data->u.DeviceInterface.ClassGuid = XenIfaceClass;
+            wmemcpy(data->u.DeviceInterface.SymbolicLink, iface->Path.c_str(), iface->Path.size() + 1);
+            size = static_cast<DWORD>(buffer.size());
+        } else {
+            data->FilterType = CM_NOTIFY_FILTER_TYPE_DEVICEHANDLE;
+        }
+
+        {
+            std::lock_guard lock(x.Mutex);
+            x.Delivery.Actions[action]++;
+            if ((action == CM_NOTIFY_ACTION_DEVICEREMOVEPENDING || action == CM_NOTIFY_ACTION_DEVICEREMOVECOMPLETE) &&
+                !std::exchange(registration->RemovalSeen, true))
+                x.Delivery.Removals++;
+        }
+        auto previous = std::exchange(t_delivering, registration.get());
+        Touch();
+        try {
+            auto result = registration->Callback(
+                reinterpret_cast<HCMNOTIFICATION>(registration.get()),
+                registration->Context,
+                action,
+                data,
+                size);
+            if (action == CM_NOTIFY_ACTION_DEVICEQUERYREMOVE && result != ERROR_SUCCESS)
+                vetoed = true;
+        } catch (...) {
+            CountCallbackException();
+        }
+        t_delivering = previous;
+
+        std::lock_guard lock(x.Mutex);
+        registration->InFlight--;
+        x.Changed.notify_all();
+    }
+    return vetoed;
+}
+
+void SetFailed(const std::shared_ptr<Interface> &iface) {
+    auto &x = X();
+    std::lock_guard lock(x.Mutex);
+    iface->Failed = true;
+}
+
+void SetAbsent(const std::shared_ptr<Interface> &iface) {
+    auto &x = X();
+    std::lock_guard lock(x.Mutex);
+    iface->Present = false;
+}
+
+std::shared_ptr<Interface> FindLocked(Xen &x, std::wstring_view path) {
+    for (auto &iface : x.Interfaces)
+        if (iface->Present &&
+            CompareStringOrdinal(
+                iface->Path.c_str(),
+                static_cast<int>(iface->Path.size()),
+                path.data(),
+                static_cast<int>(path.size()),
+                TRUE) == CSTR_EQUAL)
+            return iface;
+    return nullptr;
+}
+
+} // namespace
+
+// Simulator control
+
+namespace Sim {
+
+void ConfigureHost(const HostConfig &config) {
+    auto &x = X();
+    std::lock_guard lock(x.Mutex);
+    x.Apply(config);
+}
+
+HostConfig GetHostConfig() {
+    auto &x = X();
+    std::lock_guard lock(x.Mutex);
+    return x.Config;
+}
+
+int64_t HostUtc() {
+    auto &x = X();
+    std::lock_guard lock(x.Mutex);
+    return x.Host.At(Now());
+}
+
+int64_t GuestTime() {
+    auto &x = X();
+    std::lock_guard lock(x.Mutex);
+    return x.Guest.At(Now());
+}
+
+int64_t TruthOffset() {
+    auto &x = X();
+    std::lock_guard lock(x.Mutex);
+    auto now = Now();
+    return x.Host.At(now) - x.Guest.At(now);
+}
+
+void StepHost(int64_t ticks) {
+    auto &x = X();
+    std::lock_guard lock(x.Mutex);
+    x.Host.Base += ticks;
+}
+
+void StepGuest(int64_t ticks) {
+    auto &x = X();
+    std::lock_guard lock(x.Mutex);
+    x.Guest.Base += ticks;
+}
+
+void SetGuestDriftPpb(int64_t ppb) {
+    auto &x = X();
+    std::lock_guard lock(x.Mutex);
+    x.Guest.Rebase(Now());
+    x.Guest.DriftPpb = ppb;
+    x.Config.GuestDriftPpb = ppb;
+}
+
+void SetTimeOffset(int64_t seconds) {
+    auto &x = X();
+    std::lock_guard lock(x.Mutex);
+    x.Config.TimeOffsetSeconds = seconds;
+    x.Store[x.VmPath() + "/rtc/timeoffset"] = std::to_string(seconds);
+}
+
+// The guest clock carries on across the migration; the host clock and the VM's identity follow the new configuration
+void Migrate(const std::optional<HostConfig> &config) {
+    auto &x = X();
+    std::vector<std::shared_ptr<Object>> events;
+    {
+        std::lock_guard lock(x.Mutex);
+        if (config) {
+            auto oldHome = x.Home();
+            auto guest = x.Guest;
+            auto now = Now();
+            x.Config = *config;
+            if (auto newHome = x.Home(); newHome != oldHome) {
+                std::map<std::string, std::string> moved;
+                for (auto &[key, value] : x.Store)
+                    moved[key.starts_with(oldHome) ? newHome + key.substr(oldHome.size()) : key] = value;
+                x.Store = std::move(moved);
+            }
+            x.Apply(*config);
+            x.Host = {.Base = config->UtcStart + now, .Epoch = now, .DriftPpb = config->HostDriftPpb};
+            x.Guest = guest;
+            x.Config.GuestStart = guest.Base;
+            x.Config.GuestDriftPpb = guest.DriftPpb;
+        }
+        x.Stats.SuspendCount++;
+        for (auto &[context, registration] : x.Suspends)
+            events.push_back(registration.Event);
+    }
+    for (auto &event : events)
+        SignalEvent(event);
+}
+
+bool HostNotify() {
+    auto &x = X();
+    std::shared_ptr<Object> event;
+    {
+        std::lock_guard lock(x.Mutex);
+        auto it = x.Store.find(x.Home() + EVENT_CHANNEL_KEY);
+        if (it == x.Store.end())
+            return false;
+        ULONG number = 0;
+        std::from_chars(it->second.data(), it->second.data() + it->second.size(), number);
+        auto port = x.Ports.find(number);
+        if (port == x.Ports.end())
+            return false;
+        if (port->second.Masked) {
+            port->second.Pending = true;
+            x.Stats.NotificationsMasked++;
+            return true;
+        }
+        port->second.Masked = true;
+        event = port->second.Event;
+        x.Stats.NotificationsSent++;
+    }
+    SignalEvent(event);
+    return true;
+}
+
+std::optional<std::string> StoreRead(const std::string &path) {
+    auto &x = X();
+    std::lock_guard lock(x.Mutex);
+    auto it = x.Store.find(path);
+    if (it == x.Store.end())
+        return std::nullopt;
+    return it->second;
+}
+
+void StoreWrite(const std::string &path, const std::string &value) {
+    auto &x = X();
+    std::lock_guard lock(x.Mutex);
+    x.Store[path] = value;
+}
+
+void SetStoreObserver(std::function<void(const StoreOp &)> &&observer) {
+    auto &x = X();
+    std::lock_guard lock(x.Mutex);
+    x.StoreObserver = std::move(observer);
+}
+
+std::wstring AddInterface() {
+    auto &x = X();
+    std::lock_guard pnp(x.Pnp);
+    auto iface = std::make_shared<Interface>();
+    {
+        std::lock_guard lock(x.Mutex);
+        iface->Path = INTERFACE_PREFIX + std::to_wstring(x.NextInterface++) + INTERFACE_SUFFIX;
+        x.Interfaces.push_back(iface);
+    }
+    Deliver(iface, CM_NOTIFY_ACTION_DEVICEINTERFACEARRIVAL);
+    return iface->Path;
+}
+
+bool RemoveInterface(const std::wstring &path, Removal removal) {
+    auto &x = X();
+    std::lock_guard pnp(x.Pnp);
+    std::shared_ptr<Interface> iface;
+    {
+        std::lock_guard lock(x.Mutex);
+        iface = FindLocked(x, path);
+    }
+    if (!iface)
+        return false;
+
+    switch (removal) {
+    case Removal::Orderly: {
+        auto vetoed = Deliver(iface, CM_NOTIFY_ACTION_DEVICEQUERYREMOVE);
+        if (!vetoed) {
+            std::lock_guard lock(x.Mutex);
+            if (iface->OpenHandles) {
+                // Windows vetoes the removal because of the outstanding open
+                CountVeto();
+                vetoed = true;
+            } else {
+                iface->Failed = true;
+            }
+        }
+        if (vetoed) {
+            Deliver(iface, CM_NOTIFY_ACTION_DEVICEQUERYREMOVEFAILED);
+            return false;
+        }
+        Deliver(iface, CM_NOTIFY_ACTION_DEVICEREMOVEPENDING);
+        Deliver(iface, CM_NOTIFY_ACTION_DEVICEREMOVECOMPLETE);
+        break;
+    }
+    case Removal::QueryRemoveFailed:
+        Deliver(iface, CM_NOTIFY_ACTION_DEVICEQUERYREMOVE);
+        Deliver(iface, CM_NOTIFY_ACTION_DEVICEQUERYREMOVEFAILED);
+        return false;
+    case Removal::Surprise:
+        SetFailed(iface);
+        Deliver(iface, CM_NOTIFY_ACTION_DEVICEREMOVECOMPLETE);
+        break;
+    }
+    SetAbsent(iface);
+    Deliver(iface, CM_NOTIFY_ACTION_DEVICEINTERFACEREMOVAL);
+    return true;
+}
+
+std::vector<std::wstring> GetInterfaces() {
+    auto &x = X();
+    std::lock_guard lock(x.Mutex);
+    std::vector<std::wstring> paths;
+    for (auto &iface : x.Interfaces)
+        if (iface->Present)
+            paths.push_back(iface->Path);
+    return paths;
+}
+
+DeliveryStats GetDeliveryStats() {
+    auto &x = X();
+    std::lock_guard lock(x.Mutex);
+    return x.Delivery;
+}
+
+HostStats GetHostStats() {
+    auto &x = X();
+    std::lock_guard lock(x.Mutex);
+    return x.Stats;
+}
+
+} // namespace Sim
+
+// The XENIFACE driver
+
+namespace Sim::Internal {
+
+std::optional<HANDLE> OpenDevice(const std::wstring &path, DWORD &error) {
+    if (!path.starts_with(L"\\\\?\\"))
+        return std::nullopt;
+
+    auto &x = X();
+    std::lock_guard lock(x.Mutex);
+    auto iface = FindLocked(x, path);
+    if (!iface || iface->Failed) {
+        error = iface ? ERROR_DEVICE_NOT_CONNECTED : ERROR_FILE_NOT_FOUND;
+        return HANDLE(nullptr);
+    }
+    iface->OpenHandles++;
+    auto device = std::make_shared<DeviceObject>();
+    device->Iface = std::move(iface);
+    return InsertHandle(std::move(device));
+}
+
+bool IsDeviceHandle(const std::shared_ptr<Object> &object) {
+    return dynamic_cast<DeviceObject *>(object.get()) != nullptr;
+}
+
+BOOL DeviceControl(HANDLE handle, DWORD code, LPVOID in, DWORD inSize, LPVOID out, DWORD outSize, LPDWORD returned) {
+    auto fail = [](DWORD error) {
+        SetLastError(error);
+        return FALSE;
+    };
+
+    auto device = Lookup<DeviceObject>(handle);
+    if (!device)
+        return fail(ERROR_INVALID_HANDLE);
+    *returned = 0;
+
+    auto &x = X();
+    {
+        std::lock_guard lock(x.Mutex);
+        if (device->Iface->Failed)
+            return fail(ERROR_DEVICE_NOT_CONNECTED);
+    }
+
+    DWORD error = ERROR_SUCCESS;
+    switch (code) {
+    case IOCTL_XENIFACE_STORE_READ:
+    case IOCTL_XENIFACE_STORE_WRITE:
+    case IOCTL_XENIFACE_STORE_REMOVE:
+        error = StoreIoctl(code, in, inSize, out, outSize, returned);
+        break;
+
+    case IOCTL_XENIFACE_SHAREDINFO_GET_TIME:
+        error = ReadSharedInfo(out, outSize, returned);
+        break;
+
+    case IOCTL_XENIFACE_SUSPEND_GET_COUNT: {
+        if (outSize < sizeof(ULONG))
+            return fail(ERROR_INSUFFICIENT_BUFFER);
+        std::lock_guard lock(x.Mutex);
+        *static_cast<PULONG>(out) = static_cast<ULONG>(x.Stats.SuspendCount);
+        *returned = sizeof(ULONG);
+        break;
+    }
+
+    case IOCTL_XENIFACE_SUSPEND_REGISTER: {
+        if (inSize < sizeof(XENIFACE_SUSPEND_REGISTER_IN) || outSize < sizeof(XENIFACE_SUSPEND_REGISTER_OUT))
+            return fail(ERROR_INVALID_PARAMETER);
+        auto event = ReferenceEvent(static_cast<PXENIFACE_SUSPEND_REGISTER_IN>(in)->Event);
+        if (!event)
+            return fail(ERROR_INVALID_HANDLE);
+        std::lock_guard lock(x.Mutex);
+        auto context = x.NextSuspend++;
+        x.Suspends.emplace(context, SuspendRegistration{.Event = std::move(event), .Owner = device.get()});
+        static_cast<PXENIFACE_SUSPEND_REGISTER_OUT>(out)->Context = reinterpret_cast<PVOID>(context);
+        *returned = sizeof(XENIFACE_SUSPEND_REGISTER_OUT);
+        break;
+    }
+
+    case IOCTL_XENIFACE_SUSPEND_DEREGISTER: {
+        if (inSize < sizeof(XENIFACE_SUSPEND_REGISTER_OUT))
+            return fail(ERROR_INVALID_PARAMETER);
+        std::lock_guard lock(x.Mutex);
+        auto it = x.Suspends.find(reinterpret_cast<uintptr_t>(static_cast<PXENIFACE_SUSPEND_REGISTER_OUT>(in)->Context));
+        if (it == x.Suspends.end() || it->second.Owner != device.get())
+            error = ERROR_NOT_FOUND;
+        else
+            x.Suspends.erase(it);
+        break;
+    }
+
+    case IOCTL_XENIFACE_EVTCHN_BIND_UNBOUND: {
+        if (inSize < sizeof(XENIFACE_EVTCHN_BIND_UNBOUND_IN) || outSize < sizeof(XENIFACE_EVTCHN_BIND_UNBOUND_OUT))
+            return fail(ERROR_INVALID_PARAMETER);
+        auto bind = static_cast<PXENIFACE_EVTCHN_BIND_UNBOUND_IN>(in);
+        auto event = ReferenceEvent(bind->Event);
+        if (!event)
+            return fail(ERROR_INVALID_HANDLE);
+        std::lock_guard lock(x.Mutex);
+        auto number = x.NextPort++;
+        x.Ports.emplace(number, Port{.Event = std::move(event), .Owner = device.get(), .Masked = !!bind->Mask});
+        x.Stats.PortsBound++;
+        static_cast<PXENIFACE_EVTCHN_BIND_UNBOUND_OUT>(out)->LocalPort = number;
+        *returned = sizeof(XENIFACE_EVTCHN_BIND_UNBOUND_OUT);
+        break;
+    }
+
+    case IOCTL_XENIFACE_EVTCHN_CLOSE:
+    case IOCTL_XENIFACE_EVTCHN_UNMASK:
+    case IOCTL_XENIFACE_EVTCHN_NOTIFY: {
+        if (inSize < sizeof(ULONG))
+            return fail(ERROR_INVALID_PARAMETER);
+        std::shared_ptr<Object> event;
+        {
+            std::lock_guard lock(x.Mutex);
+            auto it = x.Ports.find(*static_cast<PULONG>(in));
+            if (it == x.Ports.end() || it->second.Owner != device.get()) {
+                error = ERROR_NOT_FOUND;
+            } else if (code == IOCTL_XENIFACE_EVTCHN_CLOSE) {
+                x.Ports.erase(it);
+                x.Stats.PortsClosed++;
+            } else if (code == IOCTL_XENIFACE_EVTCHN_UNMASK) {
+                // A notification that arrived while masked is delivered on unmask
+                auto &port = it->second;
+                port.Masked = std::exchange(port.Pending, false);
+                if (port.Masked) {
+                    event = port.Event;
+                    x.Stats.NotificationsSent++;
+                }
+            }
+        }
+        if (event)
+            SignalEvent(event);
+        break;
+    }
+
+    default:
+        error = ERROR_NOT_SUPPORTED;
+        break;
+    }
+
+    if (error != ERROR_SUCCESS)
+        return fail(error);
+    return TRUE;
+}
+
+} // namespace Sim::Internal
+
+// Configuration Manager
+
+extern "C" {
+
+CONFIGRET CM_Register_Notification(
+    PCM_NOTIFY_FILTER pFilter,
+    PVOID pContext,
+    PCM_NOTIFY_CALLBACK pCallback,
+    PHCMNOTIFICATION pNotifyContext) {
+    Touch();
+    if (!pFilter || !pCallback || !pNotifyContext)
+        return CR_INVALID_POINTER;
+
+    auto registration = std::make_shared<Registration>();
+    registration->Callback = pCallback;
+    registration->Context = pContext;
+    switch (pFilter->FilterType) {
+    case CM_NOTIFY_FILTER_TYPE_DEVICEINTERFACE:
+        registration->ByInterface = true;
+        registration->ClassGuid = pFilter->u.DeviceInterface.ClassGuid;
+        break;
+    case CM_NOTIFY_FILTER_TYPE_DEVICEHANDLE: {
+        auto device = Lookup<DeviceObject>(pFilter->u.DeviceHandle.hTarget);
+        if (!device)
+            return CR_INVALID_DATA;
+        registration->ByInterface = false;
+        registration->Device = device->Iface;
+        break;
+    }
+    default:
+        return CR_INVALID_DATA;
+    }
+
+    auto &x = X();
+    std::lock_guard lock(x.Mutex);
+    *pNotifyContext = reinterpret_cast<HCMNOTIFICATION>(registration.get());
+    x.Registrations.push_back(std::move(registration));
+    return CR_SUCCESS;
+}
+
+// Waits for callbacks in flight, as Windows does; from within the registration's own callback that would deadlock
+CONFIGRET CM_Unregister_Notification(HCMNOTIFICATION NotifyContext) {
+    Touch();
+    auto &x = X();
+    std::unique_lock lock(x.Mutex);
+    auto it = std::find_if(x.Registrations.begin(), x.Registrations.end(), [&](auto &registration) {
+        return reinterpret_cast<HCMNOTIFICATION>(registration.get()) == NotifyContext;
+    });
+    if (it == x.Registrations.end()) {
+        lock.unlock();
+        CountUseAfterClose();
+        return CR_INVALID_POINTER;
+    }
+    auto registration = std::move(*it);
+    x.Registrations.erase(it);
+    registration->Closed = true;
+    if (t_delivering == registration.get()) {
+        lock.unlock();
+        CountSelfWait();
+        return CR_SUCCESS;
+    }
+    x.Changed.wait(lock, [&] { return !registration->InFlight; });
+    return CR_SUCCESS;
+}
+
+CONFIGRET CM_Get_Device_Interface_List_Size(
+    PULONG pulLen,
+    LPGUID InterfaceClassGuid,
+    DEVINSTID_W pDeviceID,
+    ULONG ulFlags) {
+    UNREFERENCED_PARAMETER(pDeviceID);
+    UNREFERENCED_PARAMETER(ulFlags);
+    Touch();
+    if (!pulLen || !InterfaceClassGuid)
+        return CR_INVALID_POINTER;
+    auto &x = X();
+    std::lock_guard lock(x.Mutex);
+    ULONG length = 1;
+    if (*InterfaceClassGuid == XenIfaceClass)
+        for (auto &iface : x.Interfaces)
+            if (iface->Present)
+                length += static_cast<ULONG>(iface->Path.size() + 1);
+    *pulLen = length;
+    return CR_SUCCESS;
+}
+
+CONFIGRET CM_Get_Device_Interface_List(
+    LPGUID InterfaceClassGuid,
+    DEVINSTID_W pDeviceID,
+    PWSTR Buffer,
+    ULONG BufferLen,
+    ULONG ulFlags) {
+    UNREFERENCED_PARAMETER(pDeviceID);
+    UNREFERENCED_PARAMETER(ulFlags);
+    Touch();
+    if (!Buffer || !InterfaceClassGuid)
+        return CR_INVALID_POINTER;
+    auto &x = X();
+    std::lock_guard lock(x.Mutex);
+    std::wstring list;
+    if (*InterfaceClassGuid == XenIfaceClass)
+        for (auto &iface : x.Interfaces)
+            if (iface->Present)
+                list.append(iface->Path).push_back(L'\0');
+    list.push_back(L'\0');
+    if (BufferLen < list.size())
+        return CR_BUFFER_SMALL;
+    wmemcpy(Buffer, list.data(), list.size());
+    return CR_SUCCESS;
+}
+
+DWORD CM_MapCrToWin32Err(CONFIGRET CmReturnCode, DWORD DefaultErr) {
+    switch (CmReturnCode) {
+    case CR_SUCCESS:
+        return ERROR_SUCCESS;
+    case CR_OUT_OF_MEMORY:
+        return ERROR_NOT_ENOUGH_MEMORY;
+    case CR_INVALID_POINTER:
+    case CR_INVALID_FLAG:
+        return ERROR_INVALID_PARAMETER;
+    case CR_INVALID_DATA:
+        return ERROR_INVALID_DATA;
+    case CR_BUFFER_SMALL:
+        return ERROR_INSUFFICIENT_BUFFER;
+    case CR_NO_SUCH_DEVICE_INTERFACE:
+        return ERROR_FILE_NOT_FOUND;
+    default:
+        return DefaultErr;
+    }
+}
+}
@@ -0,0 +1,166 @@
+// Prints the samples of an archive written by the provider's ArchiveFile option, as CSV. Builds from the OS-free
+// archive format alone, so archives copied off a VM can be read on any Linux machine.
+//
+// Usage: ArchiveDump [--from TIME] [--to TIME] [--summary] <archive>
+// TIME is UTC, as YYYY-MM-DDTHH:MM:SS, or a FILETIME in 100ns units. --summary prints only the totals.
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "SampleArchiveFormat.hpp"
+
+// Unix epoch as a FILETIME
+#define UNIX_EPOCH 116444736000000000LL
+#define TICKS_PER_SECOND 10000000LL
+#define TICKS_PER_US 10
+
+struct Options {
+    int64_t From = INT64_MIN;
+    int64_t To = INT64_MAX;
+    bool Summary = false;
+    const char *Path = nullptr;
+};
+
+struct Totals {
+    uint64_t Samples;
+    int64_t First;
+    int64_t Last;
+    int64_t OffsetMin;
+    int64_t OffsetMax;
+    int64_t DelayMax;
+};
+
+static bool ParseTime(const char *text, int64_t &time) {
+    char *end;
+    auto value = strtoll(text, &end, 10);
+    if (*text && !*end) {
+        time = value;
+        return true;
+    }
+
+    tm utc{};
+    end = strptime(text, "%Y-%m-%dT%H:%M:%S", &utc);
+    if (!end || *end)
+        return false;
+    time = static_cast<int64_t>(timegm(&utc)) * TICKS_PER_SECOND + UNIX_EPOCH;
+    return true;
+}
+
+static std::string FormatTime(int64_t time) {
+    auto since = time - UNIX_EPOCH;
+    auto seconds = static_cast<time_t>(since / TICKS_PER_SECOND - (since % TICKS_PER_SECOND < 0));
+    auto fraction = since - static_cast<int64_t>(seconds) * TICKS_PER_SECOND;
+    tm utc;
+    gmtime_r(&seconds, &utc);
+    char text[64];
+    auto length = strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%S", &utc);
+    snprintf(text + length, sizeof(text) - length, ".%07" PRId64 "Z", fraction);
+    return text;
+}
+
+static double Us(int64_t ticks) {
+    return static_cast<double>(ticks) / TICKS_PER_US;
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    bool usage = false;
+
+    for (int i = 1; i < argc && !usage; i++) {
+        if (!strcmp(argv[i], "--from") && i + 1 < argc)
+            usage = !ParseTime(argv[++i], options.From);
+        else if (!strcmp(argv[i], "--to") && i + 1 < argc)
+            usage = !ParseTime(argv[++i], options.To);
+        else if (!strcmp(argv[i], "--summary"))
+            options.Summary = true;
+        else if (argv[i][0] != '-' && !options.Path)
+            options.Path = argv[i];
+        else
+            usage = true;
+    }
+    if (usage || !options.Path) {
+        fprintf(stderr, "Usage: %s [--from TIME] [--to TIME] [--summary] <archive>\n", argv[0]);
+        return 2;
+    }
+
+    auto fd = open(options.Path, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) || !info.st_size) {
+        fprintf(stderr, "%s: cannot read: %s\n", options.Path, fd < 0 ? strerror(errno) : "empty file");
+        return 1;
+    }
+    auto size = static_cast<size_t>(info.st_size);
+    auto data = static_cast<const uint8_t *>(mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0));
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "%s: cannot map: %s\n", options.Path, strerror(errno));
+        return 1;
+    }
+
+    if (!options.Summary)
+        printf("time,tick_count,offset_us,delay_us,dispersion_us\n");
+    Totals totals{.Samples = 0, .First = 0, .Last = 0, .OffsetMin = INT64_MAX, .OffsetMax = INT64_MIN, .DelayMax = 0};
+    auto result = DecodeSampleArchive(data, size, options.From, options.To, [&](const ArchivedSample &sample) {
+        if (!totals.Samples++)
+            totals.First = sample.Time;
+        totals.Last = sample.Time;
+        totals.OffsetMin = std::min(totals.OffsetMin, sample.Offset);
+        totals.OffsetMax = std::max(totals.OffsetMax, sample.Offset);
+        totals.DelayMax = std::max(totals.DelayMax, sample.Delay);
+        if (!options.Summary)
+            printf("%s,%" PRIu64 ",%.1f,%.1f,%.1f\n",
+                FormatTime(sample.Time).c_str(),
+                sample.TickCount,
+                Us(sample.Offset),
+                Us(sample.Delay),
+                Us(sample.Dispersion));
+    });
+
+    // Encoded bytes, from the block headers, show how compact the encoding is without the unused ends of blocks
+    uint64_t blocks = 0, encoded = 0;
+    for (auto offset = sizeof(SampleArchiveHeader); offset + sizeof(SampleArchiveBlockHeader) <= size;
+         offset += SAMPLE_ARCHIVE_BLOCK_SIZE) {
+        SampleArchiveBlockHeader block;
+        memcpy(&block, data + offset, sizeof(block));
+        blocks++;
+        encoded += block.Used;
+    }
+    munmap(const_cast<uint8_t *>(data), size);
+
+    switch (result) {
+    case SampleArchiveVersionMismatch:
+        fprintf(stderr, "%s: unsupported archive version or block size\n", options.Path);
+        return 1;
+    case SampleArchiveInvalid:
+        fprintf(stderr, "%s: not a sample archive, or corrupt\n", options.Path);
+        return 1;
+    default:
+        break;
+    }
+
+    fprintf(stderr, "%" PRIu64 " samples", totals.Samples);
+    if (totals.Samples)
+        fprintf(stderr,
+            " from %s to %s, offset %.1f to %.1f us, delay up to %.1f us",
+            FormatTime(totals.First).c_str(),
+            FormatTime(totals.Last).c_str(),
+            Us(totals.OffsetMin),
+            Us(totals.OffsetMax),
+            Us(totals.DelayMax));
+    fprintf(stderr, "\n%" PRIu64 " blocks, %zu bytes", blocks, size);
+    if (options.From == INT64_MIN && options.To == INT64_MAX && totals.Samples)
+        fprintf(stderr, ", %.1f encoded bytes per sample", static_cast<double>(encoded) / totals.Samples);
+    fprintf(stderr, "\n");
+    return 0;
+}
@@ -0,0 +1,355 @@
+// Instantiates the sample pipeline with mock policies and runs the measurement layers the provider stacks on it,
+// window retries, asymmetry calibration, per-vCPU sweeps and time source failover, over scripted clock and Xen readings.
+// Also checks the schedule of background samples against scripted XenStore read latencies. The mocks are plain
+// value types with only the documented members, as a test or benchmark policy would be.
+//
+// Usage: SamplePipelineCheck
+
+#include <cstdio>
+#include <cwchar>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <windows.h>
+
+#include "Sim.hpp"
+#include "Globals.hpp"
+#include "AsymmetryCalibration.hpp"
+#include "CpuSkewSampler.hpp"
+#include "MeasurementWindow.hpp"
+#include "SamplePipeline.hpp"
+#include "SampleTrace.hpp"
+#include "SamplingSchedule.hpp"
+#include "TimeSourceArbiter.hpp"
+
+#define CHECK(_condition)                                                                                              \
+    do {                                                                                                               \
+        g_checks++;                                                                                                    \
+        if (!(_condition)) {                                                                                           \
+            printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #_condition);                                             \
+            g_failures++;                                                                                              \
+        }                                                                                                              \
+    } while (0)
+
+// Store read latencies an idle and a congested xenstored give, and how many reads of each the schedule checks make
+#define SCHEDULE_FAST_READ_US 100
+#define SCHEDULE_SLOW_READ_US 50000
+#define SCHEDULE_READS 64
+
+// Xen time minus local time in the mock host, and the local time between two measurements
+#define MOCK_OFFSET TIME_MS(3)
+#define MOCK_GAP TIME_US(5)
+#define MOCK_DELAY TIME_US(20)
+
+static int g_checks;
+static int g_failures;
+
+// What the mock policies share: a local clock that moves only when read, and the Xen readings it brackets
+struct MockHost {
+    unsigned __int64 Time = 133000000000000000;
+    // Window length of each measurement in turn, repeating
+    std::vector<int64_t> Delays = {MOCK_DELAY};
+    // Where in the window Xen time is read
+    int64_t ReadPointPpm = ASYMMETRY_MIDPOINT_PPM;
+    // Added to Xen time when read on each vCPU
+    std::vector<int64_t> CpuSkew;
+    // Reads of each arbitrated source, and the one that fails, if any
+    size_t SourceReads[2] = {};
+    size_t FailingSource = SIZE_MAX;
+    size_t ClockReads = 0;
+    size_t Measurements = 0;
+    // Clock read that fails, if any
+    size_t FailAt = SIZE_MAX;
+    int64_t TimeOffset = 3600;
+    size_t OffsetReads = 0;
+    size_t Filtered = 0;
+    std::vector<XENTIME_SAMPLE> Published;
+
+    int64_t NextDelay() const {
+        return Delays[Measurements % Delays.size()];
+    }
+};
+
+// Reads alternate between the start of a window and its end
+struct MockClock {
+    MockHost *Host;
+
+    HRESULT Now(_Out_ unsigned __int64 *time) {
+        auto read = Host->ClockReads++;
+        if (read == Host->FailAt)
+            return HRESULT_FROM_WIN32(ERROR_GEN_FAILURE);
+        if (read % 2) {
+            Host->Time += Host->NextDelay();
+            Host->Measurements++;
+        } else {
+            Host->Time += MOCK_GAP;
+        }
+        *time = Host->Time;
+        return S_OK;
+    }
+};
+
+struct MockTimeSource {
+    MockHost *Host;
+
+    HRESULT Read(_Out_ unsigned __int64 *time, _Out_ unsigned __int64 *dispersion) {
+        PROCESSOR_NUMBER cpu;
+        GetCurrentProcessorNumberEx(&cpu);
+        auto skew = cpu.Number < Host->CpuSkew.size() ? Host->CpuSkew[cpu.Number] : 0;
+        *time = Host->Time + Host->NextDelay() * Host->ReadPointPpm / 1000000 + MOCK_OFFSET + skew;
+        *dispersion = 0;
+        return S_OK;
+    }
+};
+
+// One of two sources behind an ArbitratedTimeSource, reading as MockTimeSource does unless the host fails it
+template <size_t Index>
+struct MockArbitratedSource {
+    static constexpr PCWSTR Name = Index ? L"secondary" : L"primary";
+    MockHost *Host;
+
+    HRESULT Read(_Out_ unsigned __int64 *time, _Out_ unsigned __int64 *dispersion) {
+        Host->SourceReads[Index]++;
+        if (Host->FailingSource == Index)
+            return HRESULT_FROM_WIN32(ERROR_GEN_FAILURE);
+        return MockTimeSource{Host}.Read(time, dispersion);
+    }
+};
+
+struct MockOffsetSource {
+    MockHost *Host;
+
+    HRESULT Read(_Out_ int64_t &offset) {
+        Host->OffsetReads++;
+        offset = Host->TimeOffset;
+        return S_OK;
+    }
+};
+
+struct MockFilter {
+    MockHost *Host;
+
+    SampleFilterResult Filter(_Inout_ TimeSample &sample) {
+        Host->Filtered++;
+        sample.tpDispersion = 0;
+        return SampleFilterDownweighted;
+    }
+};
+
+struct MockPublisher {
+    MockHost *Host;
+
+    void Publish(_In_ const XENTIME_SAMPLE &sample) {
+        Host->Published.push_back(sample);
+    }
+};
+
+using MockPipeline = SamplePipeline<MockClock, MockTimeSource, MockOffsetSource, MockFilter, MockPublisher>;
+static_assert(!std::is_polymorphic_v<MockPipeline>, "policies must compose without virtual calls");
+
+static MockPipeline MakePipeline(MockHost &host) {
+    return MockPipeline(
+        MockClock{&host}, MockTimeSource{&host}, MockOffsetSource{&host}, MockFilter{&host}, MockPublisher{&host});
+}
+
+static void CheckPipeline() {
+    MockHost host;
+    auto pipeline = MakePipeline(host);
+
+    TimeMeasurement m{};
+    CHECK(SUCCEEDED(pipeline.Measure(m)));
+    CHECK(host.ClockReads == 2);
+    CHECK(m.Delay() == MOCK_DELAY);
+    CHECK(m.Offset(ASYMMETRY_MIDPOINT_PPM) == MOCK_OFFSET);
+
+    int64_t offset;
+    CHECK(SUCCEEDED(pipeline.ReadOffset(offset)));
+    CHECK(offset == host.TimeOffset && host.OffsetReads == 1);
+
+    TimeSample sample{};
+    sample.tpDispersion = 1;
+    CHECK(pipeline.FilterSample(sample) == SampleFilterDownweighted);
+    CHECK(host.Filtered == 1 && sample.tpDispersion == 0);
+
+    pipeline.Publish(XENTIME_SAMPLE{.LocalTime = 7, .PerfCounter = 0, .Offset = 1, .Delay = 2, .Dispersion = 0});
+    CHECK(host.Published.size() == 1 && host.Published[0].LocalTime == 7);
+
+    // The closing clock read fails, and the measurement with it
+    host.FailAt = host.ClockReads + 1;
+    CHECK(pipeline.Measure(m) == HRESULT_FROM_WIN32(ERROR_GEN_FAILURE));
+}
+
+static void CheckWindow() {
+    MockHost host;
+    auto pipeline = MakePipeline(host);
+    auto measure = [&](_Out_ TimeMeasurement &m) -> HRESULT { return pipeline.Measure(m); };
+    MeasurementWindow window;
+    TimeMeasurement best;
+
+    for (size_t i = 0; i < MeasurementWindow::HistorySize; i++)
+        CHECK(SUCCEEDED(window.Measure(measure, false, best)));
+    CHECK(window.GetStats().Retries == 0);
+
+    // A window stretched by preemption is retried, and the clean retry is used
+    host.Delays = {TIME_US(500), MOCK_DELAY};
+    host.Measurements = 0;
+    CHECK(SUCCEEDED(window.Measure(measure, false, best)));
+    CHECK(window.GetStats().Retries == 1 && window.GetStats().Contaminated == 1);
+    CHECK(best.Delay() == MOCK_DELAY);
+}
+
+static void CheckCalibration() {
+    MockHost host;
+    host.Delays = {TIME_US(10), TIME_US(25), TIME_US(40), TIME_US(60)};
+    host.ReadPointPpm = 300000;
+    auto pipeline = MakePipeline(host);
+    auto measure = [&](_Out_ TimeMeasurement &m) -> HRESULT { return pipeline.Measure(m); };
+
+    int64_t asymmetryPpm;
+    CHECK(CalibrateAsymmetry(measure, asymmetryPpm) == S_OK);
+    CHECK(asymmetryPpm > 299000 && asymmetryPpm < 301000);
+
+    // Windows all the same length say nothing about the read point
+    host.Delays = {MOCK_DELAY};
+    CHECK(CalibrateAsymmetry(measure, asymmetryPpm) == S_FALSE);
+    CHECK(asymmetryPpm == ASYMMETRY_MIDPOINT_PPM);
+}
+
+static void CheckCpuSweep() {
+    MockHost host;
+    host.Delays = {TIME_US(15), TIME_US(30)};
+    host.ReadPointPpm = 250000;
+    host.CpuSkew = {0, TIME_US(10), 0};
+    Sim::SetProcessorCount(3);
+    auto pipeline = MakePipeline(host);
+    auto measure = [&](_Out_ TimeMeasurement &m) -> HRESULT { return pipeline.Measure(m); };
+    MeasurementWindow window;
+    auto windowed = [&](_Out_ TimeMeasurement &m) -> HRESULT { return window.Measure(measure, false, m); };
+    CpuSkewSampler sampler;
+    TimeMeasurement best;
+
+    // Offsets taken at the calibrated read point agree whatever the window length, so only the skew remains
+    CHECK(SUCCEEDED(sampler.Sample(windowed, host.ReadPointPpm, best)));
+    CHECK(sampler.GetCpuCount() == 3);
+    CHECK(sampler.GetMaxSkew() == TIME_US(10));
+    CHECK(sampler.GetSkewMatrix()[1 * 3 + 0] == TIME_US(10));
+    CHECK(sampler.GetPreferredCpu().Number != 1);
+    CHECK(best.Offset(host.ReadPointPpm) == MOCK_OFFSET);
+
+    // A hot-added vCPU joins the next sweep
+    host.CpuSkew.push_back(-TIME_US(5));
+    Sim::SetProcessorCount(4);
+    CHECK(SUCCEEDED(sampler.Sample(windowed, host.ReadPointPpm, best)));
+    CHECK(sampler.GetCpuCount() == 4);
+    CHECK(sampler.GetMaxSkew() == TIME_US(15));
+}
+
+static void CheckFailover() {
+    using MockArbitrated = ArbitratedTimeSource<MockArbitratedSource<0>, MockArbitratedSource<1>>;
+    MockHost host;
+    TimeSourceArbiter arbiter;
+    SamplePipeline<MockClock, MockArbitrated, MockOffsetSource, MockFilter, MockPublisher> pipeline(
+        MockClock{&host},
+        MockArbitrated(arbiter, MockArbitratedSource<0>{&host}, MockArbitratedSource<1>{&host}),
+        MockOffsetSource{&host},
+        MockFilter{&host},
+        MockPublisher{&host});
+    TimeMeasurement m{};
+
+    CHECK(SUCCEEDED(pipeline.Measure(m)));
+    CHECK(host.SourceReads[0] == 1 && host.SourceReads[1] == 0);
+    CHECK(arbiter.GetSwitches() == 0 && !wcscmp(pipeline.GetTimeSource().GetSelectedName(), L"primary"));
+
+    // The first source fails and the same read falls back to the second, without another clock window
+    host.FailingSource = 0;
+    auto clockReads = host.ClockReads;
+    CHECK(SUCCEEDED(pipeline.Measure(m)));
+    CHECK(host.ClockReads == clockReads + 2);
+    CHECK(host.SourceReads[0] == 2 && host.SourceReads[1] == 1);
+    CHECK(m.Offset(ASYMMETRY_MIDPOINT_PPM) == MOCK_OFFSET);
+    CHECK(arbiter.GetSwitches() == 1 && arbiter.GetScore(0).Failures == 1);
+
+    // The sample names the source it came from, as the provider builds it
+    SampleInputs inputs{
+        .TickCount = 0,
+        .PhaseOffset = 0,
+        .Begin = m.Begin,
+        .End = m.End,
+        .XenTime = m.XenTime,
+        .Dispersion = m.Dispersion,
+        .PerfCounter = 0,
+        .TimeOffsetPre = 0,
+        .TimeOffsetPost = 0,
+        .AsymmetryPpm = ASYMMETRY_MIDPOINT_PPM,
+        .SuspendCount = 0,
+        .Flags = 0,
+    };
+    auto name = std::wstring(L"mock (") + pipeline.GetTimeSource().GetSelectedName() + L")";
+    TimeSample sample;
+    int64_t sampleTime;
+    CHECK(MakeTimeSample(inputs, name.c_str(), sample, sampleTime));
+    CHECK(wcsstr(sample.wszUniqueName, L"(secondary)") != nullptr);
+
+    // Reads stay on the working source, so there is no switch back while the first keeps failing
+    CHECK(SUCCEEDED(pipeline.Measure(m)));
+    CHECK(host.SourceReads[1] == 2);
+    CHECK(arbiter.GetSwitches() == 1 && arbiter.GetSelected() == 1);
+}
+
+// Whether every delay the schedule gives in a run lies in its phase plus jitter, shifted by the backoff
+static bool DelaysInRange(SamplingSchedule &schedule, unsigned backoff) {
+    for (int i = 0; i < SCHEDULE_READS; i++) {
+        auto delayUs = schedule.NextDelayUs();
+        if (delayUs < schedule.GetPhaseUs() << backoff ||
+            delayUs > (schedule.GetPhaseUs() + SamplingSchedule::JitterUs) << backoff)
+            return false;
+    }
+    return true;
+}
+
+static void CheckSchedule() {
+    SamplingSchedule schedule(1), sameIdentity(2), otherIdentity(1);
+    schedule.SetIdentity("/local/domain/1/rtc/timeoffset");
+    sameIdentity.SetIdentity("/local/domain/1/rtc/timeoffset");
+    otherIdentity.SetIdentity("/local/domain/2/rtc/timeoffset");
+
+    // The phase depends only on the identity
+    CHECK(schedule.GetPhaseUs() == sameIdentity.GetPhaseUs());
+    CHECK(schedule.GetPhaseUs() != otherIdentity.GetPhaseUs());
+    CHECK(schedule.GetPhaseUs() < SamplingSchedule::PhaseSpreadUs);
+    CHECK(otherIdentity.GetPhaseUs() < SamplingSchedule::PhaseSpreadUs);
+    CHECK(DelaysInRange(schedule, 0));
+
+    for (int i = 0; i < SCHEDULE_READS; i++)
+        schedule.RecordStoreRead(SCHEDULE_FAST_READ_US);
+    CHECK(!schedule.IsCongested());
+
+    // Sustained slow reads back off step by step up to the limit
+    schedule.RecordStoreRead(SCHEDULE_SLOW_READ_US);
+    CHECK(schedule.GetBackoff() == 1);
+    for (int i = 0; i < SCHEDULE_READS; i++)
+        schedule.RecordStoreRead(SCHEDULE_SLOW_READ_US);
+    CHECK(schedule.IsCongested() && schedule.GetBackoff() == SamplingSchedule::MaxBackoff);
+    CHECK(DelaysInRange(schedule, SamplingSchedule::MaxBackoff));
+
+    // One fast read does not end the congestion, but a run of them does
+    schedule.RecordStoreRead(SCHEDULE_FAST_READ_US);
+    CHECK(schedule.GetBackoff() == SamplingSchedule::MaxBackoff);
+    for (int i = 0; i < SCHEDULE_READS; i++)
+        schedule.RecordStoreRead(SCHEDULE_FAST_READ_US);
+    CHECK(!schedule.IsCongested());
+    CHECK(DelaysInRange(schedule, 0));
+}
+
+int main() {
+    Sim::Configure(Sim::ClockMode::Virtual);
+    CheckPipeline();
+    CheckWindow();
+    CheckCalibration();
+    CheckCpuSweep();
+    CheckFailover();
+    CheckSchedule();
+    printf("%d checks, %d failed\n", g_checks, g_failures);
+    return g_failures ? 1 : 0;
+}
@@ -0,0 +1,693 @@
+// Runs a scripted timeline against the provider on a virtual clock, faster than real time and with the same result
+// every run. W32Time is played by polling TPC_GetSamples at a fixed interval, and whenever the provider alerts that a
+// sample is available. Every returned offset is checked against the simulated host, and each disruption is timed
+// until a sample is back within tolerance.
+//
+// Usage: ScenarioRunner [--verbose] <file.scn>
+//
+// A scenario is one command per line; '#' starts a comment. Commands before "start" set the scene:
+//   seed N                        random seed for ioctl jitter and noise
+//   host Field=Value ...          Sim::HostConfig fields; durations take us, ms, s, m or h, bare numbers are 100ns
+//   cpus N                        processor count; also allowed later, to hot-add or remove vCPUs
+//   interfaces N                  XENIFACE interfaces present at start
+//   config Name=Value ...         provider registry values; after start, followed by TPC_UpdateConfig
+//   config-string Name=Value ...  the same for string values, e.g. file paths
+//   poll DURATION                 W32Time poll interval
+//   tolerance DURATION            largest offset error that counts as recovered
+//   start                         open the provider; startup counts as a disruption
+// Commands from then on run at the current time, or at a later time with "at TIME COMMAND":
+//   step-host DURATION            step the host wallclock
+//   step-guest DURATION           step the guest clock, then TPC_TimeJumped as W32Time would
+//   drift-guest PPB               change the guest clock's rate error
+//   timeoffset SECONDS            change the VM's RTC offset in XenStore
+//   migrate [clock=DURATION] [Field=Value ...]
+//                                 suspend and resume onto a host whose clock is off by DURATION
+//   notify                        signal the time change event channel, as the host agent would, if the guest has
+//                                 published one
+//   add                           add an interface
+//   remove orderly|vetoed|surprise
+//                                 remove the interface in use
+//   remove-during-update orderly|vetoed|surprise
+//                                 remove the interface in use from another thread while the next Update() is reading
+//                                 XenStore
+//   end                           stop polling; only expectations may follow
+// Expectations are checked at the end, and fail the run:
+//   expect METRIC OP VALUE        OP is <, <=, >, >= or ==; metrics are listed in Metrics below
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <windows.h>
+#include <TimeProv.h>
+
+#include "Sim.hpp"
+#include "Globals.hpp"
+#include "XenIfaceWorker.hpp"
+#include "XenTimeProvider.hpp"
+
+// Real time a settled simulation must stay idle for, so that the worker thread has caught up
+#define SETTLE_QUIET std::chrono::milliseconds(1)
+#define SETTLE_ROUNDS 2
+#define DEFAULT_POLL TIME_S(64)
+#define DEFAULT_TOLERANCE TIME_MS(1)
+
+struct Expectation {
+    int Line;
+    std::string Metric;
+    std::string Op;
+    // As written, for the report
+    std::string Text;
+    double Value;
+};
+
+struct Results {
+    ULONG64 Polls;
+    ULONG64 Samples;
+    ULONG64 Alerts;
+    ULONG64 Notifications;
+    // Offset error of every sample, and of samples taken while no disruption was outstanding
+    double ErrorSquares;
+    int64_t ErrorMax;
+    ULONG64 SteadySamples;
+    double SteadySquares;
+    int64_t SteadyMax;
+    ULONG64 Disruptions;
+    ULONG64 Recoveries;
+    int64_t RecoverTotal;
+    int64_t RecoverMax;
+    // Simulated time spent in TPC_GetSamples calls that took a fresh sample
+    ULONG64 CostSamples;
+    int64_t CostTotal;
+    int64_t CostMax;
+};
+
+static bool g_verbose;
+static bool g_alerted;
+
+static HRESULT GetTimeSysInfo(TimeSysInfo info, void *value) {
+    switch (info) {
+    case TSI_CurrentTime:
+        *static_cast<unsigned __int64 *>(value) = static_cast<unsigned __int64>(Sim::GuestTime());
+        return S_OK;
+    case TSI_TickCount:
+        *static_cast<unsigned __int64 *>(value) = static_cast<unsigned __int64>(Sim::Now() / TIME_MS(1));
+        return S_OK;
+    case TSI_PhaseOffset:
+        *static_cast<signed __int64 *>(value) = 0;
+        return S_OK;
+    default:
+        return E_NOTIMPL;
+    }
+}
+
+static HRESULT LogTimeProvEvent(WORD type, WCHAR *provider, WCHAR *message) {
+    UNREFERENCED_PARAMETER(type);
+    if (g_verbose)
+        fprintf(stderr, "[%9.3f s] %ls: %ls\n", static_cast<double>(Sim::Now()) / TIME_S(1), provider, message);
+    return S_OK;
+}
+
+static HRESULT AlertSamplesAvail() {
+    g_alerted = true;
+    return S_OK;
+}
+
+static HRESULT SetProviderStatus(void *status) {
+    UNREFERENCED_PARAMETER(status);
+    return S_OK;
+}
+
+static TimeProvSysCallbacks g_callbacks = {
+    .dwSize = sizeof(TimeProvSysCallbacks),
+    .pfnGetTimeSysInfo = &GetTimeSysInfo,
+    .pfnLogTimeProvEvent = &LogTimeProvEvent,
+    .pfnAlertSamplesAvail = &AlertSamplesAvail,
+    .pfnSetProviderStatus = &SetProviderStatus,
+};
+
+// "250ms", "-2s", "1h"; a bare number is in 100ns units
+static bool ParseDuration(const std::string &text, int64_t &ticks) {
+    static const std::pair<const char *, int64_t> Units[] = {
+        {"us", TIME_US(1)},
+        {"ms", TIME_MS(1)},
+        {"s", TIME_S(1)},
+        {"m", TIME_S(60)},
+        {"h", TIME_S(3600LL)},
+    };
+    size_t used;
+    double value;
+    try {
+        value = std::stod(text, &used);
+    } catch (...) {
+        return false;
+    }
+    auto unit = text.substr(used);
+    if (unit.empty()) {
+        ticks = static_cast<int64_t>(value);
+        return true;
+    }
+    for (auto &[name, scale] : Units) {
+        if (unit == name) {
+            ticks = static_cast<int64_t>(std::llround(value * scale));
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool ParseInteger(const std::string &text, int64_t &value) {
+    try {
+        size_t used;
+        value = std::stoll(text, &used, 0);
+        return used == text.size();
+    } catch (...) {
+        return false;
+    }
+}
+
+static bool SetHostField(Sim::HostConfig &config, const std::string &name, const std::string &text) {
+    static const std::map<std::string, int64_t Sim::HostConfig::*> Durations = {
+        {"UtcStart", &Sim::HostConfig::UtcStart},
+        {"GuestStart", &Sim::HostConfig::GuestStart},
+        {"IoctlBase", &Sim::HostConfig::IoctlBase},
+        {"IoctlJitter", &Sim::HostConfig::IoctlJitter},
+        {"SpikeTicks", &Sim::HostConfig::SpikeTicks},
+        {"ReadNoise", &Sim::HostConfig::ReadNoise},
+        {"StoreCost", &Sim::HostConfig::StoreCost},
+    };
+    static const std::map<std::string, int64_t Sim::HostConfig::*> Numbers = {
+        {"HostDriftPpb", &Sim::HostConfig::HostDriftPpb},
+        {"GuestDriftPpb", &Sim::HostConfig::GuestDriftPpb},
+        {"ReadPointPpm", &Sim::HostConfig::ReadPointPpm},
+        {"TimeOffsetSeconds", &Sim::HostConfig::TimeOffsetSeconds},
+    };
+    int64_t value;
+
+    if (auto it = Durations.find(name); it != Durations.end()) {
+        if (!ParseDuration(text, value))
+            return false;
+        config.*it->second = value;
+    } else if (auto it = Numbers.find(name); it != Numbers.end()) {
+        if (!ParseInteger(text, value))
+            return false;
+        config.*it->second = value;
+    } else if (name == "SpikePerMillion" || name == "StoreLoadPermille" || name == "DomainId") {
+        if (!ParseInteger(text, value) || value < 0)
+            return false;
+        if (name == "SpikePerMillion")
+            config.SpikePerMillion = static_cast<uint32_t>(value);
+        else if (name == "StoreLoadPermille")
+            config.StoreLoadPermille = static_cast<uint32_t>(value);
+        else
+            config.DomainId = static_cast<USHORT>(value);
+    } else if (name == "CpuSkew") {
+        // Comma-separated, one per vCPU
+        config.CpuSkew.clear();
+        std::stringstream list(text);
+        std::string item;
+        while (std::getline(list, item, ',')) {
+            if (!ParseDuration(item, value))
+                return false;
+            config.CpuSkew.push_back(value);
+        }
+    } else if (name == "VmUuid") {
+        config.VmUuid = text;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool SplitAssignment(const std::string &word, std::string &name, std::string &value) {
+    auto equals = word.find('=');
+    if (equals == std::string::npos || equals == 0)
+        return false;
+    name = word.substr(0, equals);
+    value = word.substr(equals + 1);
+    return true;
+}
+
+static bool ParseRemoval(const std::string &word, Sim::Removal &removal) {
+    if (word == "orderly")
+        removal = Sim::Removal::Orderly;
+    else if (word == "vetoed")
+        removal = Sim::Removal::QueryRemoveFailed;
+    else if (word == "surprise")
+        removal = Sim::Removal::Surprise;
+    else
+        return false;
+    return true;
+}
+
+class Scenario {
+public:
+    explicit Scenario(const std::string &path) : _path(path) {}
+
+    // Returns the process exit code
+    int Run() {
+        std::ifstream file(_path);
+        if (!file) {
+            fprintf(stderr, "%s: cannot open\n", _path.c_str());
+            return 2;
+        }
+
+        Sim::Configure(Sim::ClockMode::Virtual);
+        Sim::SetClockOwner();
+        if (g_verbose)
+            Sim::SetDebugOutput([](const char *message) { fputs(message, stderr); });
+
+        auto wallStart = std::chrono::steady_clock::now();
+        std::string line;
+        while (std::getline(file, line)) {
+            _line++;
+            auto comment = line.find('#');
+            if (comment != std::string::npos)
+                line.resize(comment);
+            std::stringstream stream(line);
+            std::vector<std::string> words;
+            for (std::string word; stream >> word;)
+                words.push_back(word);
+            if (words.empty())
+                continue;
+            if (!Execute(words)) {
+                fprintf(stderr, "%s:%d: bad command: %s\n", _path.c_str(), _line, line.c_str());
+                Stop();
+                return 2;
+            }
+        }
+        Stop();
+        auto wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+
+        return Report(wall);
+    }
+
+private:
+    bool Execute(std::vector<std::string> words) {
+        // Only expectations may follow the end
+        if (_ended && words[0] != "expect")
+            return false;
+        if (words[0] == "at") {
+            int64_t at;
+            if (words.size() < 3 || !_provider || !ParseDuration(words[1], at) || at < Sim::Now())
+                return false;
+            RunUntil(at);
+            words.erase(words.begin(), words.begin() + 2);
+        }
+
+        auto &command = words[0];
+        auto argument = [&](int64_t &value) { return words.size() == 2 && ParseDuration(words[1], value); };
+        auto integer = [&](int64_t &value) { return words.size() == 2 && ParseInteger(words[1], value); };
+        int64_t value;
+
+        if (command == "seed" && !_provider && integer(value)) {
+            Sim::Configure(Sim::ClockMode::Virtual, static_cast<uint64_t>(value));
+        } else if (command == "host" && !_provider) {
+            std::string name, text;
+            for (size_t i = 1; i < words.size(); i++)
+                if (!SplitAssignment(words[i], name, text) || !SetHostField(_host, name, text))
+                    return false;
+        } else if (command == "cpus" && integer(value) && value > 0) {
+            Sim::SetProcessorCount(static_cast<unsigned>(value));
+        } else if (command == "interfaces" && !_provider && integer(value) && value >= 0) {
+            _interfaces = static_cast<int>(value);
+        } else if (command == "config") {
+            std::string name, text;
+            for (size_t i = 1; i < words.size(); i++) {
+                if (!SplitAssignment(words[i], name, text) || !ParseInteger(text, value))
+                    return false;
+                Sim::SetRegistryDword(XenTimeProviderConfigKey, std::wstring(name.begin(), name.end()),
+                    static_cast<DWORD>(value));
+            }
+            if (_provider) {
+                TimeProvCommand(_provider, TPC_UpdateConfig, nullptr);
+                Settle();
+            }
+        } else if (command == "config-string") {
+            std::string name, text;
+            for (size_t i = 1; i < words.size(); i++) {
+                if (!SplitAssignment(words[i], name, text))
+                    return false;
+                Sim::SetRegistryString(XenTimeProviderConfigKey, std::wstring(name.begin(), name.end()),
+                    std::wstring(text.begin(), text.end()));
+            }
+            if (_provider) {
+                TimeProvCommand(_provider, TPC_UpdateConfig, nullptr);
+                Settle();
+            }
+        } else if (command == "poll" && argument(value) && value > 0) {
+            _poll = value;
+        } else if (command == "tolerance" && argument(value) && value > 0) {
+            _tolerance = value;
+        } else if (command == "start" && !_provider) {
+            return Start();
+        } else if (command == "expect" && words.size() == 4) {
+            // Times take a unit; counts are bare numbers
+            int64_t expected;
+            if (!ParseDuration(words[3], expected))
+                return false;
+            if (!Metrics().contains(words[1]) || !Compare(words[2], 0, 0))
+                return false;
+            _expectations.push_back({_line, words[1], words[2], words[3], static_cast<double>(expected)});
+        } else if (!_provider) {
+            return false;
+        } else if (command == "end") {
+            _ended = true;
+        } else if (command == "step-host" && argument(value)) {
+            Sim::StepHost(value);
+            Disrupt();
+        } else if (command == "step-guest" && argument(value)) {
+            Sim::StepGuest(value);
+            TpcTimeJumpedArgs args = {.tjfFlags = TJF_Default};
+            TimeProvCommand(_provider, TPC_TimeJumped, &args);
+            Disrupt();
+        } else if (command == "drift-guest" && integer(value)) {
+            Sim::SetGuestDriftPpb(value);
+        } else if (command == "timeoffset" && integer(value)) {
+            Sim::SetTimeOffset(value);
+            Disrupt();
+        } else if (command == "migrate") {
+            auto config = Sim::GetHostConfig();
+            int64_t clockError = 0;
+            std::string name, text;
+            for (size_t i = 1; i < words.size(); i++) {
+                if (!SplitAssignment(words[i], name, text))
+                    return false;
+                if (name == "clock") {
+                    if (!ParseDuration(text, clockError))
+                        return false;
+                } else if (!SetHostField(config, name, text)) {
+                    return false;
+                }
+            }
+            // Migrate() starts the new host clock at UtcStart + now
+            config.UtcStart = Sim::HostUtc() + clockError - Sim::Now();
+            Sim::Migrate(config);
+            Disrupt();
+        } else if (command == "notify" && words.size() == 1) {
+            // Only reaches the guest if it has published a port
+            _results.Notifications += Sim::HostNotify();
+        } else if (command == "add" && words.size() == 1) {
+            Sim::AddInterface();
+        } else if (command == "remove" && words.size() == 2) {
+            Sim::Removal removal;
+            if (!ParseRemoval(words[1], removal))
+                return false;
+            if (auto path = ActivePath())
+                Sim::RemoveInterface(*path, removal);
+            Disrupt();
+        } else if (command == "remove-during-update" && words.size() == 2) {
+            Sim::Removal removal;
+            if (!ParseRemoval(words[1], removal))
+                return false;
+            ArmRemoval(removal);
+            Disrupt();
+        } else {
+            return false;
+        }
+        Settle();
+        return true;
+    }
+
+    bool Start() {
+        Sim::ConfigureHost(_host);
+        for (int i = 0; i < _interfaces; i++)
+            Sim::AddInterface();
+        std::wstring name(XenTimeProviderName);
+        if (FAILED(TimeProvOpen(name.data(), &g_callbacks, &_provider)))
+            return false;
+        _worker = XenIfaceWorker::Acquire();
+        _nextPoll = Sim::Now();
+        Disrupt();
+        Settle();
+        return true;
+    }
+
+    void Stop() {
+        Settle();
+        if (!_provider)
+            return;
+        _stats = static_cast<XenTimeProvider *>(_provider)->GetStats();
+        TimeProvCommand(_provider, TPC_Shutdown, nullptr);
+        TimeProvClose(_provider);
+        _provider = nullptr;
+        _worker.reset();
+        Settle();
+    }
+
+    std::optional<std::wstring> ActivePath() {
+        auto [lock, handle, path, cache] = _worker->GetDevice();
+        if (!handle || handle == INVALID_HANDLE_VALUE)
+            return std::nullopt;
+        return std::wstring(path);
+    }
+
+    // CM delivers on its own threads, so a removal during Update() runs on another thread and waits for the XenStore
+    // read Update() holds the worker lock for; a surprise removal fails the device's ioctls straight away
+    void ArmRemoval(Sim::Removal removal) {
+        auto path = ActivePath();
+        if (!path)
+            return;
+        Sim::SetStoreObserver([this, removal, path = *path](const Sim::StoreOp &) {
+            if (_remover.joinable())
+                return;
+            _remover = std::thread([removal, path] { Sim::RemoveInterface(path, removal); });
+            // Let the removal get as far as it can before Update() carries on
+            WaitQuiet();
+        });
+    }
+
+    void Disrupt() {
+        _results.Disruptions++;
+        if (!_disruptedAt)
+            _disruptedAt = Sim::Now();
+    }
+
+    // Waits until no other thread has made a simulated call for a while
+    static void WaitQuiet() {
+        for (int quiet = 0; quiet < SETTLE_ROUNDS;) {
+            auto activity = Sim::Activity();
+            std::this_thread::sleep_for(SETTLE_QUIET);
+            quiet = Sim::Activity() == activity ? quiet + 1 : 0;
+        }
+    }
+
+    // Runs threadpool callbacks that are due and waits until the worker thread has gone quiet
+    void Settle() {
+        int quiet = 0;
+        while (quiet < SETTLE_ROUNDS) {
+            auto activity = Sim::Activity();
+            auto ran = Sim::Pump();
+            if (_remover.joinable()) {
+                Sim::SetStoreObserver(nullptr);
+                _remover.join();
+            }
+            std::this_thread::sleep_for(SETTLE_QUIET);
+            quiet = !ran && Sim::Activity() == activity ? quiet + 1 : 0;
+            if (g_alerted && _provider) {
+                g_alerted = false;
+                _results.Alerts++;
+                Poll();
+                quiet = 0;
+            }
+        }
+    }
+
+    void RunUntil(int64_t until) {
+        while (Sim::Now() < until) {
+            auto next = std::min(until, _nextPoll);
+            if (auto due = Sim::NextTimerDue())
+                next = std::min(next, std::max(*due, Sim::Now()));
+            Sim::Advance(next - Sim::Now());
+            Settle();
+            if (Sim::Now() >= _nextPoll) {
+                Poll();
+                _nextPoll = Sim::Now() + _poll;
+                Settle();
+            }
+        }
+    }
+
+    void Poll() {
+        TimeSample sample;
+        TpcGetSamplesArgs args = {.pbSampleBuf = reinterpret_cast<BYTE *>(&sample), .cbSampleBuf = sizeof(sample)};
+        auto attempts = static_cast<XenTimeProvider *>(_provider)->GetStats().SampleAttempts;
+        auto start = Sim::Now();
+        auto hr = TimeProvCommand(_provider, TPC_GetSamples, &args);
+        auto cost = Sim::Now() - start;
+        _results.Polls++;
+        if (static_cast<XenTimeProvider *>(_provider)->GetStats().SampleAttempts != attempts) {
+            _results.CostSamples++;
+            _results.CostTotal += cost;
+            _results.CostMax = std::max(_results.CostMax, cost);
+        }
+        if (FAILED(hr) || !args.dwSamplesReturned)
+            return;
+
+        int64_t error = sample.toOffset - Sim::TruthOffset();
+        auto magnitude = error < 0 ? -error : error;
+        _results.Samples++;
+        _results.ErrorSquares += static_cast<double>(error) * error;
+        _results.ErrorMax = std::max(_results.ErrorMax, magnitude);
+        if (_disruptedAt && magnitude <= _tolerance) {
+            auto recover = Sim::Now() - *_disruptedAt;
+            _results.Recoveries++;
+            _results.RecoverTotal += recover;
+            _results.RecoverMax = std::max(_results.RecoverMax, recover);
+            _disruptedAt.reset();
+        }
+        if (!_disruptedAt) {
+            _results.SteadySamples++;
+            _results.SteadySquares += static_cast<double>(error) * error;
+            _results.SteadyMax = std::max(_results.SteadyMax, magnitude);
+        }
+        if (g_verbose)
+            fprintf(stderr,
+                "[%9.3f s] sample offset %lld error %lld\n",
+                static_cast<double>(Sim::Now()) / TIME_S(1),
+                sample.toOffset,
+                error);
+    }
+
+    // Values are in 100ns units where they are times
+    static inline const std::set<std::string> TimeMetrics = {
+        "error-max",
+        "error-rms",
+        "steady-error-max",
+        "steady-error-rms",
+        "recover-max",
+        "cost-mean",
+        "cost-max",
+        "cpu-skew-max",
+    };
+    std::map<std::string, double> Metrics() const {
+        auto &r = _results;
+        auto defects = Sim::GetDefects();
+        return {
+            {"samples", static_cast<double>(r.Samples)},
+            {"alerts", static_cast<double>(r.Alerts)},
+            {"notifications", static_cast<double>(r.Notifications)},
+            {"error-max", static_cast<double>(r.ErrorMax)},
+            {"error-rms", r.Samples ? std::sqrt(r.ErrorSquares / r.Samples) : 0},
+            {"steady-error-max", static_cast<double>(r.SteadyMax)},
+            {"steady-error-rms", r.SteadySamples ? std::sqrt(r.SteadySquares / r.SteadySamples) : 0},
+            {"recover-max", static_cast<double>(r.RecoverMax)},
+            {"unrecovered", _disruptedAt ? 1.0 : 0.0},
+            {"cost-mean", r.CostSamples ? static_cast<double>(r.CostTotal) / r.CostSamples : 0},
+            {"cost-max", static_cast<double>(r.CostMax)},
+            {"rejected", static_cast<double>(_stats.SamplesRejected)},
+            {"host-steps", static_cast<double>(_stats.HostSteps)},
+            {"cpu-skew-max", static_cast<double>(_stats.MaxCpuSkew)},
+            {"defects",
+             static_cast<double>(
+                 defects.UseAfterClose + defects.Vetoes + defects.CallbackExceptions + defects.SelfWaits)},
+        };
+    }
+
+    static bool Compare(const std::string &op, double actual, double expected) {
+        if (op == "<")
+            return actual < expected;
+        if (op == "<=")
+            return actual <= expected;
+        if (op == ">")
+            return actual > expected;
+        if (op == ">=")
+            return actual >= expected;
+        if (op == "==")
+            return actual == expected;
+        return false;
+    }
+
+    int Report(double wall) {
+        auto &r = _results;
+        auto simulated = static_cast<double>(Sim::Now()) / TIME_S(1);
+        auto us = [](double ticks) { return ticks / TIME_US(1); };
+        auto metrics = Metrics();
+
+        printf("%s: %.0f s simulated in %.2f s (%.0fx)\n", _path.c_str(), simulated, wall, simulated / wall);
+        printf("  polls %llu, samples %llu, alerts %llu, rejected %llu, host steps %llu\n",
+            r.Polls,
+            r.Samples,
+            r.Alerts,
+            _stats.SamplesRejected,
+            _stats.HostSteps);
+        printf("  offset error: rms %.1f us, max %.1f us; steady state (%llu samples): rms %.1f us, max %.1f us\n",
+            us(metrics["error-rms"]),
+            us(metrics["error-max"]),
+            r.SteadySamples,
+            us(metrics["steady-error-rms"]),
+            us(metrics["steady-error-max"]));
+        printf("  disruptions %llu, recovered %llu%s, time to recover mean %.3f s, max %.3f s\n",
+            r.Disruptions,
+            r.Recoveries,
+            _disruptedAt ? " (last one never)" : "",
+            r.Recoveries ? static_cast<double>(r.RecoverTotal) / r.Recoveries / TIME_S(1) : 0,
+            static_cast<double>(r.RecoverMax) / TIME_S(1));
+        printf("  per-sample cost: mean %.1f us, max %.1f us over %llu samples taken\n",
+            us(metrics["cost-mean"]),
+            us(metrics["cost-max"]),
+            r.CostSamples);
+
+        int failed = 0;
+        for (auto &expectation : _expectations) {
+            auto actual = metrics[expectation.Metric];
+            auto ok = Compare(expectation.Op, actual, expectation.Value);
+            printf("  %s:%d: expect %s %s %s: %.1f%s %s\n",
+                _path.c_str(),
+                expectation.Line,
+                expectation.Metric.c_str(),
+                expectation.Op.c_str(),
+                expectation.Text.c_str(),
+                TimeMetrics.contains(expectation.Metric) ? us(actual) : actual,
+                TimeMetrics.contains(expectation.Metric) ? "us" : "",
+                ok ? "ok" : "FAILED");
+            failed += !ok;
+        }
+        return failed ? 1 : 0;
+    }
+
+    std::string _path;
+    int _line = 0;
+    bool _ended = false;
+    Sim::HostConfig _host;
+    int _interfaces = 1;
+    int64_t _poll = DEFAULT_POLL;
+    int64_t _tolerance = DEFAULT_TOLERANCE;
+    int64_t _nextPoll = 0;
+    TimeProvHandle _provider = nullptr;
+    std::shared_ptr<XenIfaceWorker> _worker;
+    std::thread _remover;
+    std::optional<int64_t> _disruptedAt;
+    std::vector<Expectation> _expectations;
+    Results _results{};
+    XenTimeProviderStats _stats{};
+};
+
+int main(int argc, char **argv) {
+    std::vector<const char *> paths;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--verbose"))
+            g_verbose = true;
+        else
+            paths.push_back(argv[i]);
+    }
+    if (paths.size() != 1) {
+        fprintf(stderr, "Usage: %s [--verbose] <file.scn>\n", argv[0]);
+        return 2;
+    }
+
+    return Scenario(paths[0]).Run();
+}
@@ -0,0 +1,225 @@
+// Checks that the AVX2, SSE4.2 and scalar statistics kernels agree, then times each of them against the others.
+// Every instruction set the CPU supports is run over the same random inputs; min index and absolute deviation must
+// match the scalar results exactly, and the least-squares slope, whose sums are added in a different order, to within
+// a relative 1e-9.
+//
+// Usage: StatKernelBench [--iterations N] [--sizes N[,N...]] [--seed N]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <windows.h>
+
+#include "StatKernels.hpp"
+
+// Every length up to this is checked, to cover each tail the vector loops leave to scalar code
+#define VERIFY_MAX_COUNT 67
+#define VERIFY_ROUNDS 200
+#define SLOPE_TOLERANCE 1e-9
+// Keeps the slope inputs within the +/-2^51 the kernels require
+#define SLOPE_RANGE (1LL << 50)
+
+struct Options {
+    int Iterations = 20000;
+    std::vector<size_t> Sizes = {16, 64, 256, 4096};
+    uint64_t Seed = 1;
+};
+
+struct Inputs {
+    std::vector<int64_t> Values;
+    std::vector<int64_t> X;
+    std::vector<int64_t> Y;
+    int64_t Center;
+};
+
+static const char *IsaName(StatIsa isa) {
+    switch (isa) {
+    case StatIsaAvx2:
+        return "avx2";
+    case StatIsaSse42:
+        return "sse4.2";
+    default:
+        return "scalar";
+    }
+}
+
+static std::vector<StatIsa> SupportedIsas() {
+    std::vector<StatIsa> isas;
+    for (auto isa : {StatIsaScalar, StatIsaSse42, StatIsaAvx2})
+        if (isa <= StatDetectIsa())
+            isas.push_back(isa);
+    return isas;
+}
+
+// Sample histories look like this: increasing timestamps and noisy values, with repeats so that ties are exercised
+static Inputs MakeInputs(std::mt19937_64 &rng, size_t count, bool extreme) {
+    Inputs in;
+    auto range = extreme ? (1LL << 62) : 1000000LL;
+    std::uniform_int_distribution<int64_t> value(-range, range);
+    std::uniform_int_distribution<int64_t> step(1, 100000);
+    std::uniform_int_distribution<int64_t> noise(-SLOPE_RANGE / 1024, SLOPE_RANGE / 1024);
+
+    in.Center = value(rng);
+    auto x = std::uniform_int_distribution<int64_t>(-SLOPE_RANGE, 0)(rng);
+    for (size_t i = 0; i < count; i++) {
+        // Repeat an earlier value now and then
+        if (i > 0 && rng() % 8 == 0)
+            in.Values.push_back(in.Values[rng() % i]);
+        else
+            in.Values.push_back(value(rng));
+        x += step(rng);
+        in.X.push_back(x);
+        in.Y.push_back(x / 3 + noise(rng));
+    }
+    return in;
+}
+
+static bool SameSlope(double expected, double actual) {
+    return std::fabs(expected - actual) <= SLOPE_TOLERANCE * std::max(1.0, std::fabs(expected));
+}
+
+static int Verify(const Options &options) {
+    std::mt19937_64 rng(options.Seed);
+    auto isas = SupportedIsas();
+    int mismatches = 0;
+
+    for (int round = 0; round < VERIFY_ROUNDS; round++) {
+        for (size_t count = 1; count <= VERIFY_MAX_COUNT; count++) {
+            auto in = MakeInputs(rng, count, round % 2);
+
+            StatLimitIsa(StatIsaScalar);
+            auto minIndex = StatMinIndex(in.Values.data(), count);
+            std::vector<int64_t> deviation(count);
+            StatAbsDeviation(in.Values.data(), count, in.Center, deviation.data());
+            double slope = 0;
+            auto haveSlope = StatLeastSquaresSlope(in.X.data(), in.Y.data(), count, slope);
+
+            for (auto isa : isas) {
+                if (isa == StatIsaScalar)
+                    continue;
+                StatLimitIsa(isa);
+                auto name = IsaName(isa);
+
+                auto index = StatMinIndex(in.Values.data(), count);
+                if (index != minIndex) {
+                    printf("MISMATCH %s min index, count %zu: %zu, scalar %zu\n", name, count, index, minIndex);
+                    mismatches++;
+                }
+
+                std::vector<int64_t> out(count);
+                StatAbsDeviation(in.Values.data(), count, in.Center, out.data());
+                if (out != deviation) {
+                    printf("MISMATCH %s absolute deviation, count %zu\n", name, count);
+                    mismatches++;
+                }
+
+                double s = 0;
+                auto have = StatLeastSquaresSlope(in.X.data(), in.Y.data(), count, s);
+                if (have != haveSlope || (have && !SameSlope(slope, s))) {
+                    printf("MISMATCH %s slope, count %zu: %.17g, scalar %.17g\n", name, count, s, slope);
+                    mismatches++;
+                }
+            }
+        }
+    }
+    StatLimitIsa(StatIsaAvx2);
+
+    printf("Checked ");
+    for (auto isa : isas)
+        printf("%s ", IsaName(isa));
+    printf("over %d rounds of 1-%d values: %d mismatches\n", VERIFY_ROUNDS, VERIFY_MAX_COUNT, mismatches);
+    return mismatches;
+}
+
+template <typename Kernel>
+static double TimeKernel(int iterations, Kernel &&kernel) {
+    // Warm up caches and the branch predictor first
+    for (int i = 0; i < iterations / 10 + 1; i++)
+        kernel();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+        kernel();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+}
+
+static void Benchmark(const Options &options) {
+    std::mt19937_64 rng(options.Seed);
+    auto isas = SupportedIsas();
+    // Keeps the results live so that the calls are not optimized away
+    volatile int64_t sink = 0;
+
+    printf("\n%-18s %6s", "kernel", "count");
+    for (auto isa : isas)
+        printf(" %9s ns", IsaName(isa));
+    printf("  best speedup\n");
+
+    for (auto count : options.Sizes) {
+        auto in = MakeInputs(rng, count, false);
+        std::vector<int64_t> out(count);
+
+        auto row = [&](const char *name, auto &&kernel) {
+            std::vector<double> times;
+            for (auto isa : isas) {
+                StatLimitIsa(isa);
+                times.push_back(TimeKernel(options.Iterations, kernel));
+            }
+            printf("%-18s %6zu", name, count);
+            for (auto t : times)
+                printf(" %12.1f", t);
+            printf("  %11.2fx\n", times.front() / *std::min_element(times.begin(), times.end()));
+        };
+
+        row("min index", [&] { sink = sink + static_cast<int64_t>(StatMinIndex(in.Values.data(), count)); });
+        row("abs deviation", [&] {
+            StatAbsDeviation(in.Values.data(), count, in.Center, out.data());
+            sink = sink + out[count - 1];
+        });
+        row("least squares", [&] {
+            double slope = 0;
+            StatLeastSquaresSlope(in.X.data(), in.Y.data(), count, slope);
+            sink = sink + static_cast<int64_t>(slope);
+        });
+    }
+    StatLimitIsa(StatIsaAvx2);
+}
+
+static std::vector<size_t> ParseSizes(const char *list) {
+    std::vector<size_t> sizes;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ','))
+        sizes.push_back(std::max<size_t>(1, std::strtoull(item.c_str(), nullptr, 10)));
+    return sizes;
+}
+
+int main(int argc, char **argv) {
+    Options options;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--iterations") && i + 1 < argc)
+            options.Iterations = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--sizes") && i + 1 < argc)
+            options.Sizes = ParseSizes(argv[++i]);
+        else if (!strcmp(argv[i], "--seed") && i + 1 < argc)
+            options.Seed = std::strtoull(argv[++i], nullptr, 10);
+        else {
+            fprintf(stderr, "Usage: %s [--iterations N] [--sizes N[,N...]] [--seed N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    printf("CPU supports %s\n", IsaName(StatDetectIsa()));
+    if (Verify(options))
+        return 1;
+    Benchmark(options);
+    return 0;
+}
@@ -0,0 +1,464 @@
+// Drives the provider's entry points from several threads while XENIFACE interfaces arrive and leave and the VM is
+// migrated, then reports worker lock contention, entry point throughput and latency, failover latency and any gaps
+// without an active device, and whether every device notification that was delivered was handled exactly once.
+//
+// Usage: StressHarness [--seconds N] [--seed N] [--verbose]
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <windows.h>
+#include <TimeProv.h>
+
+#include "Sim.hpp"
+#include "Globals.hpp"
+#include "Logging.hpp"
+#include "XenIfaceWorker.hpp"
+
+#define ALTERNATE_NAME L"XenTimeProviderAlt"
+#define SAMPLER_THREADS 4
+// Interfaces present at any time during the storm
+#define INTERFACES_MIN 1
+#define INTERFACES_MAX 4
+// Pauses between operations of each thread, in milliseconds
+#define STORM_INTERVAL_MS 3
+#define JUMP_INTERVAL_MS 25
+#define CONFIG_INTERVAL_MS 15
+#define MIGRATE_INTERVAL_MS 60
+// How long the worker gets to drain its queue once the storm stops
+#define QUIESCE_TIMEOUT std::chrono::seconds(10)
+#define HISTOGRAM_BUCKETS LockStats::HistogramBuckets
+
+using Histogram = std::array<ULONG64, HISTOGRAM_BUCKETS>;
+
+struct Options {
+    int Seconds = 10;
+    uint64_t Seed = 1;
+    bool Verbose = false;
+};
+
+// Latency of one entry point, bucketed like LockStats
+struct CallStats {
+    std::mutex Mutex;
+    ULONG64 Calls = 0;
+    ULONG64 Failures = 0;
+    ULONG64 UsTotal = 0;
+    ULONG64 UsMax = 0;
+    Histogram Buckets{};
+
+    void Record(ULONG64 us, bool failed) {
+        std::lock_guard lock(Mutex);
+        Calls++;
+        Failures += failed;
+        UsTotal += us;
+        UsMax = std::max(UsMax, us);
+        Buckets[std::min<size_t>(std::bit_width(us), HISTOGRAM_BUCKETS - 1)]++;
+    }
+};
+
+static Options g_options;
+static std::atomic<bool> g_stop;
+static std::atomic<ULONG64> g_alerts;
+static std::atomic<ULONG64> g_logErrors;
+static CallStats g_getSamples, g_timeJumped, g_updateConfig, g_removals, g_arrivals;
+static std::atomic<ULONG64> g_samplesReturned;
+static std::atomic<ULONG64> g_migrations;
+static std::atomic<ULONG64> g_notifications;
+
+static const Sim::Removal Removals[] = {
+    Sim::Removal::Orderly,
+    Sim::Removal::QueryRemoveFailed,
+    Sim::Removal::Surprise,
+};
+static const char *RemovalNames[] = {"orderly", "vetoed", "surprise"};
+// Index into Removals of the storm thread's latest removal, or -1, so that device outages can be blamed on it
+static std::atomic<int> g_removing = -1;
+// Periods without an active device handle, by the latest removal when they began; the last entry is for outages
+// before any removal
+static CallStats g_outages[ARRAYSIZE(Removals) + 1];
+static std::atomic<ULONG64> g_probes;
+
+static HRESULT GetTimeSysInfo(TimeSysInfo info, void *value) {
+    switch (info) {
+    case TSI_CurrentTime:
+        *static_cast<unsigned __int64 *>(value) = static_cast<unsigned __int64>(Sim::GuestTime());
+        return S_OK;
+    case TSI_TickCount:
+        *static_cast<unsigned __int64 *>(value) = static_cast<unsigned __int64>(Sim::Now() / TIME_MS(1));
+        return S_OK;
+    case TSI_PhaseOffset:
+        *static_cast<signed __int64 *>(value) = 0;
+        return S_OK;
+    default:
+        return E_NOTIMPL;
+    }
+}
+
+static HRESULT LogTimeProvEvent(WORD type, WCHAR *provider, WCHAR *message) {
+    if (type == LogTimeProvEventTypeError)
+        g_logErrors++;
+    if (g_options.Verbose)
+        fprintf(stderr, "%ls: %ls\n", provider, message);
+    return S_OK;
+}
+
+static HRESULT AlertSamplesAvail() {
+    g_alerts++;
+    return S_OK;
+}
+
+static HRESULT SetProviderStatus(void *status) {
+    UNREFERENCED_PARAMETER(status);
+    return S_OK;
+}
+
+static TimeProvSysCallbacks g_callbacks = {
+    .dwSize = sizeof(TimeProvSysCallbacks),
+    .pfnGetTimeSysInfo = &GetTimeSysInfo,
+    .pfnLogTimeProvEvent = &LogTimeProvEvent,
+    .pfnAlertSamplesAvail = &AlertSamplesAvail,
+    .pfnSetProviderStatus = &SetProviderStatus,
+};
+
+// Runs fn and records how long it took on the simulated clock
+template <typename F> static auto Timed(CallStats &stats, F &&fn) {
+    auto start = Sim::Now();
+    auto result = fn();
+    stats.Record(static_cast<ULONG64>(Sim::Now() - start) / TIME_US(1), !result);
+    return result;
+}
+
+static void Pause(std::mt19937_64 &random, int meanMs) {
+    std::uniform_int_distribution<int> jitter(meanMs / 2, meanMs * 3 / 2);
+    std::this_thread::sleep_for(std::chrono::milliseconds(jitter(random)));
+}
+
+static void Sampler(TimeProvHandle provider) {
+    std::vector<BYTE> buffer(sizeof(TimeSample));
+
+    while (!g_stop) {
+        TpcGetSamplesArgs args = {.pbSampleBuf = buffer.data(), .cbSampleBuf = static_cast<DWORD>(buffer.size())};
+        Timed(g_getSamples, [&] { return SUCCEEDED(TimeProvCommand(provider, TPC_GetSamples, &args)); });
+        g_samplesReturned += args.dwSamplesReturned;
+        std::this_thread::yield();
+    }
+}
+
+static void Jumper(std::vector<TimeProvHandle> providers, uint64_t seed) {
+    std::mt19937_64 random(seed);
+
+    while (!g_stop) {
+        Pause(random, JUMP_INTERVAL_MS);
+        Sim::StepGuest(std::uniform_int_distribution<int64_t>(-TIME_S(1), TIME_S(1))(random));
+        auto provider = providers[random() % providers.size()];
+        TpcTimeJumpedArgs args = {.tjfFlags = TJF_Default};
+        Timed(g_timeJumped, [&] { return SUCCEEDED(TimeProvCommand(provider, TPC_TimeJumped, &args)); });
+    }
+}
+
+// Toggles the options that change what the provider holds on the worker: the event channel binding and per-CPU
+// sampling, which pins threads
+static void Configurer(std::vector<TimeProvHandle> providers, uint64_t seed) {
+    static const PCWSTR Values[] = {L"PerCpuSampling", L"BoostMeasurement", L"CalibrateAsymmetry", L"EventChannel"};
+    static const PCWSTR Keys[] = {XenTimeProviderConfigKey, XenTimeProvidersKey ALTERNATE_NAME};
+    std::mt19937_64 random(seed);
+
+    while (!g_stop) {
+        Pause(random, CONFIG_INTERVAL_MS);
+        auto index = random() % providers.size();
+        Sim::SetRegistryDword(Keys[index], Values[random() % ARRAYSIZE(Values)], random() % 2);
+        Timed(g_updateConfig, [&] { return SUCCEEDED(TimeProvCommand(providers[index], TPC_UpdateConfig, nullptr)); });
+    }
+}
+
+static void DeviceStorm(uint64_t seed) {
+    std::mt19937_64 random(seed);
+
+    while (!g_stop) {
+        Pause(random, STORM_INTERVAL_MS);
+        auto interfaces = Sim::GetInterfaces();
+        bool add = interfaces.size() <= INTERFACES_MIN ||
+            (interfaces.size() < INTERFACES_MAX && random() % 2);
+        if (add) {
+            Timed(g_arrivals, [] { return !Sim::AddInterface().empty(); });
+            continue;
+        }
+        auto removal = static_cast<int>(random() % ARRAYSIZE(Removals));
+        auto &path = interfaces[random() % interfaces.size()];
+        g_removing = removal;
+        // Counted as failed when the interface stays, as it always does after a vetoed query-remove
+        Timed(g_removals, [&] { return Sim::RemoveInterface(path, Removals[removal]); });
+    }
+}
+
+static void Host(uint64_t seed) {
+    std::mt19937_64 random(seed);
+
+    while (!g_stop) {
+        Pause(random, MIGRATE_INTERVAL_MS);
+        if (random() % 2) {
+            Sim::Migrate();
+            g_migrations++;
+        } else if (Sim::HostNotify()) {
+            g_notifications++;
+        }
+    }
+}
+
+// Watches for the worker having no active handle, as Update() would find it. With a standby open, query-remove
+// should fail over without any such gap.
+static void DeviceProbe(std::shared_ptr<XenIfaceWorker> worker) {
+    std::optional<int64_t> outageStart;
+    int cause = -1;
+
+    while (!g_stop) {
+        bool present;
+        {
+            auto [lock, handle, path, cache] = worker->GetDevice();
+            present = handle && handle != INVALID_HANDLE_VALUE;
+        }
+        auto now = Sim::Now();
+        g_probes++;
+        if (!present && !outageStart) {
+            outageStart = now;
+            cause = g_removing;
+        } else if (present && outageStart) {
+            auto &stats = g_outages[cause < 0 ? ARRAYSIZE(Removals) : cause];
+            stats.Record(static_cast<ULONG64>(now - *outageStart) / TIME_US(1), false);
+            outageStart.reset();
+        }
+        std::this_thread::yield();
+    }
+}
+
+static void PrintHistogram(const char *name, const Histogram &histogram) {
+    ULONG64 total = 0;
+    for (auto count : histogram)
+        total += count;
+    printf("  %s:", name);
+    if (!total) {
+        printf(" none\n");
+        return;
+    }
+    // Upper bound of the bucket holding each percentile
+    for (auto percentile : {50, 90, 99, 100}) {
+        ULONG64 seen = 0;
+        size_t bucket = 0;
+        for (; bucket < histogram.size(); bucket++) {
+            seen += histogram[bucket];
+            if (seen * 100 >= total * percentile)
+                break;
+        }
+        printf(" p%d<%lluus", percentile, 1ULL << bucket);
+    }
+    printf("\n   ");
+    for (size_t bucket = 0; bucket < histogram.size(); bucket++)
+        if (histogram[bucket])
+            printf(" [<%lluus]=%llu", 1ULL << bucket, histogram[bucket]);
+    printf("\n");
+}
+
+static void PrintCalls(const char *name, CallStats &stats, double seconds) {
+    std::lock_guard lock(stats.Mutex);
+    printf(
+        "%-12s %8llu calls %9.1f/s  failed %llu  mean %llu us  max %llu us\n",
+        name,
+        stats.Calls,
+        stats.Calls / seconds,
+        stats.Failures,
+        stats.Calls ? stats.UsTotal / stats.Calls : 0,
+        stats.UsMax);
+    PrintHistogram("latency", stats.Buckets);
+}
+
+// Pairs of notifications the simulated CM delivered and the worker handled
+struct Transitions {
+    const char *Name;
+    uint64_t Delivered;
+    ULONG64 Handled;
+};
+
+static std::vector<Transitions> CompareTransitions(const XenIfaceWorkerStats &worker) {
+    auto delivery = Sim::GetDeliveryStats();
+    return {
+        {"arrival", delivery.Actions[CM_NOTIFY_ACTION_DEVICEINTERFACEARRIVAL], worker.Arrivals},
+        {"interface removal", delivery.Actions[CM_NOTIFY_ACTION_DEVICEINTERFACEREMOVAL], worker.InterfaceRemovals},
+        {"query remove", delivery.Actions[CM_NOTIFY_ACTION_DEVICEQUERYREMOVE], worker.QueryRemoves},
+        {"query remove failed",
+         delivery.Actions[CM_NOTIFY_ACTION_DEVICEQUERYREMOVEFAILED],
+         worker.QueryRemoveFailures},
+        {"device removal", delivery.Removals, worker.Removals},
+    };
+}
+
+static bool Matches(const std::vector<Transitions> &transitions) {
+    return std::all_of(transitions.begin(), transitions.end(), [](auto &t) { return t.Delivered == t.Handled; });
+}
+
+static bool ParseOptions(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--seconds") && i + 1 < argc)
+            g_options.Seconds = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--seed") && i + 1 < argc)
+            g_options.Seed = strtoull(argv[++i], nullptr, 0);
+        else if (!strcmp(argv[i], "--verbose"))
+            g_options.Verbose = true;
+        else
+            return false;
+    }
+    return g_options.Seconds > 0;
+}
+
+int main(int argc, char **argv) {
+    if (!ParseOptions(argc, argv)) {
+        fprintf(stderr, "Usage: %s [--seconds N] [--seed N] [--verbose]\n", argv[0]);
+        return 2;
+    }
+
+    Sim::Configure(Sim::ClockMode::Real, g_options.Seed);
+    if (g_options.Verbose)
+        Sim::SetDebugOutput([](const char *message) { fputs(message, stderr); });
+    Sim::HostConfig host;
+    host.CpuSkew = {0, 20, -20, 40};
+    host.ReadNoise = 20;
+    Sim::ConfigureHost(host);
+    auto baseHandles = Sim::OpenHandleCount();
+
+    for (int i = 0; i < INTERFACES_MAX - 1; i++)
+        Sim::AddInterface();
+    Sim::SetRegistryString(XenTimeProviderConfigKey, L"AlternateName", ALTERNATE_NAME);
+    Sim::SetRegistryDword(XenTimeProviderConfigKey, L"EventChannel", 1);
+
+    std::vector<TimeProvHandle> providers;
+    for (auto name : {XenTimeProviderName, ALTERNATE_NAME}) {
+        std::wstring buffer(name);
+        TimeProvHandle provider;
+        auto hr = TimeProvOpen(buffer.data(), &g_callbacks, &provider);
+        if (FAILED(hr)) {
+            fprintf(stderr, "TimeProvOpen(%ls) failed %x\n", name, hr);
+            return 1;
+        }
+        providers.push_back(provider);
+    }
+    // Shares the providers' worker, to read its statistics
+    auto worker = XenIfaceWorker::Acquire();
+
+    printf("Stressing for %d s, seed %llu\n", g_options.Seconds, static_cast<unsigned long long>(g_options.Seed));
+    auto start = Sim::Now();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < SAMPLER_THREADS; i++)
+        threads.emplace_back(Sampler, providers[i % providers.size()]);
+    threads.emplace_back(Jumper, providers, g_options.Seed + 1);
+    threads.emplace_back(Configurer, providers, g_options.Seed + 2);
+    threads.emplace_back(DeviceStorm, g_options.Seed + 3);
+    threads.emplace_back(Host, g_options.Seed + 4);
+    threads.emplace_back(DeviceProbe, worker);
+    std::this_thread::sleep_for(std::chrono::seconds(g_options.Seconds));
+    g_stop = true;
+    for (auto &thread : threads)
+        thread.join();
+    auto seconds = static_cast<double>(Sim::Now() - start) / TIME_S(1);
+
+    // The worker handles notifications on its own thread; give it time to catch up
+    auto deadline = std::chrono::steady_clock::now() + QUIESCE_TIMEOUT;
+    auto workerStats = worker->GetStats();
+    while (!Matches(CompareTransitions(workerStats)) && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        workerStats = worker->GetStats();
+    }
+    auto transitions = CompareTransitions(workerStats);
+
+    printf("\nEntry points over %.2f s\n", seconds);
+    PrintCalls("GetSamples", g_getSamples, seconds);
+    PrintCalls("TimeJumped", g_timeJumped, seconds);
+    PrintCalls("UpdateConfig", g_updateConfig, seconds);
+    PrintCalls("Arrival", g_arrivals, seconds);
+    PrintCalls("Removal", g_removals, seconds);
+    printf("Samples returned: %llu, alerts: %llu, migrations: %llu, host notifications: %llu\n",
+        g_samplesReturned.load(),
+        g_alerts.load(),
+        g_migrations.load(),
+        g_notifications.load());
+
+    printf("\nWorker lock: %llu acquisitions, %llu contended, wait mean %llu us max %llu us, hold mean %llu us max %llu "
+           "us\n",
+        workerStats.Lock.Acquisitions,
+        workerStats.Lock.Contended,
+        workerStats.Lock.Contended ? workerStats.Lock.WaitUsTotal / workerStats.Lock.Contended : 0,
+        workerStats.Lock.WaitUsMax,
+        workerStats.Lock.Acquisitions ? workerStats.Lock.HoldUsTotal / workerStats.Lock.Acquisitions : 0,
+        workerStats.Lock.HoldUsMax);
+    PrintHistogram("wait", workerStats.Lock.WaitHistogram);
+    PrintHistogram("hold", workerStats.Lock.HoldHistogram);
+    printf("Worker: %llu enumerations, %llu resyncs, %llu opened, %llu closed, %llu standbys, %llu failovers, %llu "
+           "stale, %llu resumes, %llu time changes\n",
+        workerStats.Enumerations,
+        workerStats.Resyncs,
+        workerStats.DevicesOpened,
+        workerStats.DevicesClosed,
+        workerStats.StandbysOpened,
+        workerStats.Failovers,
+        workerStats.StaleRequests,
+        workerStats.Resumes,
+        workerStats.TimeChanges);
+
+    printf("\nFailovers: %llu, notification to promotion mean %llu us, max %llu us; %llu device probes\n",
+        workerStats.Failovers,
+        workerStats.Failovers ? workerStats.FailoverUsTotal / workerStats.Failovers : 0,
+        workerStats.FailoverUsMax,
+        g_probes.load());
+    for (size_t i = 0; i <= ARRAYSIZE(Removals); i++) {
+        auto name = i < ARRAYSIZE(Removals) ? RemovalNames[i] : "no";
+        std::lock_guard lock(g_outages[i].Mutex);
+        printf("  Outages after %-8s removal: %6llu, mean %llu us, max %llu us\n",
+            name,
+            g_outages[i].Calls,
+            g_outages[i].Calls ? g_outages[i].UsTotal / g_outages[i].Calls : 0,
+            g_outages[i].UsMax);
+    }
+
+    bool failed = false;
+    printf("\nTransitions (delivered / handled)\n");
+    for (auto &t : transitions) {
+        auto verdict = t.Delivered == t.Handled ? "" : t.Delivered > t.Handled ? "  LOST" : "  DUPLICATED";
+        printf("  %-20s %8llu %8llu%s\n",
+            t.Name,
+            static_cast<unsigned long long>(t.Delivered),
+            t.Handled,
+            verdict);
+        failed |= t.Delivered != t.Handled;
+    }
+
+    for (auto provider : providers) {
+        TimeProvCommand(provider, TPC_Shutdown, nullptr);
+        TimeProvClose(provider);
+    }
+    worker.reset();
+
+    auto defects = Sim::GetDefects();
+    auto leakedHandles = Sim::OpenHandleCount() - std::min(Sim::OpenHandleCount(), baseHandles);
+    printf("\nDefects: %llu use after close, %llu vetoed removals, %llu callback exceptions, %llu self waits\n",
+        static_cast<unsigned long long>(defects.UseAfterClose),
+        static_cast<unsigned long long>(defects.Vetoes),
+        static_cast<unsigned long long>(defects.CallbackExceptions),
+        static_cast<unsigned long long>(defects.SelfWaits));
+    printf("Handles left open after close: %zu (%zu device)\n", leakedHandles, Sim::OpenDeviceHandleCount());
+    printf("Provider errors logged: %llu\n", g_logErrors.load());
+    failed |= defects.UseAfterClose || defects.Vetoes || defects.CallbackExceptions || defects.SelfWaits ||
+        leakedHandles || Sim::OpenDeviceHandleCount();
+
+    printf("\n%s\n", failed ? "FAILED" : "PASSED");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,266 @@
+// Checks TimeConvertTable and TimeConvertFileTime against glibc's time zone rules, then times the table against
+// TimeConvertFileTime. Each zone is given to glibc as a POSIX TZ rule and to the converters as the equivalent
+// DYNAMIC_TIME_ZONE_INFORMATION. Universal to local must match localtime_r exactly. Local to universal must give the
+// one universal time glibc maps to it, the standard time one of two when clocks go back, and the standard bias for a
+// time skipped when clocks go forward, as Windows does. The table must match to the tick, and TimeConvertFileTime,
+// which goes through SYSTEMTIME, to the millisecond.
+//
+// Usage: TimeConverterBench [--count N] [--seed N]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <windows.h>
+
+#include "Sim.hpp"
+#include "TimeConverter.hpp"
+
+#define FIRST_YEAR 1990
+#define LAST_YEAR 2060
+#define RANDOM_TIMES 20000
+// Unix epoch as a FILETIME
+#define UNIX_EPOCH 116444736000000000LL
+#define TICKS_PER_MS 10000LL
+#define TICKS_PER_SECOND 10000000LL
+#define TICKS_PER_HOUR (3600 * TICKS_PER_SECOND)
+// Start of the year the benchmark times fall in
+#define BENCH_YEAR_START 133800000000000000LL
+
+struct Options {
+    size_t Count = 200000;
+    uint64_t Seed = 1;
+};
+
+struct Zone {
+    const char *Name;
+    const char *PosixRule;
+    DYNAMIC_TIME_ZONE_INFORMATION Info;
+};
+
+static SYSTEMTIME RuleDate(WORD month, WORD dayOfWeek, WORD week, WORD hour) {
+    return SYSTEMTIME{.wMonth = month, .wDayOfWeek = dayOfWeek, .wDay = week, .wHour = hour};
+}
+
+static std::vector<Zone> MakeZones() {
+    std::vector<Zone> zones;
+    auto add = [&](const char *name, const char *rule, LONG bias, SYSTEMTIME standard, SYSTEMTIME daylight) {
+        Zone zone{.Name = name, .PosixRule = rule, .Info = {}};
+        zone.Info.Bias = bias;
+        zone.Info.StandardDate = standard;
+        zone.Info.DaylightDate = daylight;
+        zone.Info.DaylightBias = standard.wMonth ? -60 : 0;
+        std::wstring key(name, name + strlen(name));
+        wcsncpy(zone.Info.TimeZoneKeyName, key.c_str(), ARRAYSIZE(zone.Info.TimeZoneKeyName) - 1);
+        zones.push_back(zone);
+    };
+
+    add("New York", "EST5EDT,M3.2.0,M11.1.0", 300, RuleDate(11, 0, 1, 2), RuleDate(3, 0, 2, 2));
+    add("London", "GMT0BST,M3.5.0/1,M10.5.0", 0, RuleDate(10, 0, 5, 2), RuleDate(3, 0, 5, 1));
+    add("Sydney", "AEST-10AEDT,M10.1.0,M4.1.0/3", -600, RuleDate(4, 0, 1, 3), RuleDate(10, 0, 1, 2));
+    add("Tokyo", "JST-9", -540, SYSTEMTIME{}, SYSTEMTIME{});
+    return zones;
+}
+
+static LONG64 ToInt64(const FILETIME &time) {
+    return static_cast<LONG64>(static_cast<ULONG64>(time.dwHighDateTime) << 32 | time.dwLowDateTime);
+}
+
+static FILETIME ToFileTime(LONG64 value) {
+    return FILETIME{
+        .dwLowDateTime = static_cast<DWORD>(value),
+        .dwHighDateTime = static_cast<DWORD>(static_cast<ULONG64>(value) >> 32),
+    };
+}
+
+// Local minus universal time at a universal time, from glibc
+static LONG64 ReferenceBias(LONG64 universal) {
+    auto seconds = static_cast<time_t>((universal - UNIX_EPOCH) / TICKS_PER_SECOND -
+        ((universal - UNIX_EPOCH) % TICKS_PER_SECOND < 0));
+    tm local;
+    localtime_r(&seconds, &local);
+    return local.tm_gmtoff * TICKS_PER_SECOND;
+}
+
+static LONG64 ReferenceToLocal(LONG64 universal) {
+    return universal + ReferenceBias(universal);
+}
+
+static LONG64 ReferenceToUniversal(LONG64 local, LONG64 standardBias, LONG64 daylightBias) {
+    auto standard = local - standardBias;
+    auto daylight = local - daylightBias;
+    // A repeated local time maps back to both; Windows takes the standard time one, as it does for skipped times
+    if (ReferenceBias(standard) == standardBias || ReferenceBias(daylight) != daylightBias)
+        return standard;
+    return daylight;
+}
+
+// Random times over the checked years, plus times around each transition glibc reports
+static std::vector<LONG64> MakeCheckTimes(std::mt19937_64 &rng) {
+    std::vector<LONG64> times;
+    SYSTEMTIME first{.wYear = FIRST_YEAR, .wMonth = 1, .wDay = 1}, last{.wYear = LAST_YEAR, .wMonth = 12, .wDay = 31};
+    FILETIME firstTime, lastTime;
+    SystemTimeToFileTime(&first, &firstTime);
+    SystemTimeToFileTime(&last, &lastTime);
+    std::uniform_int_distribution<LONG64> random(ToInt64(firstTime), ToInt64(lastTime));
+
+    for (int i = 0; i < RANDOM_TIMES; i++)
+        times.push_back(random(rng));
+
+    auto day = 24 * TICKS_PER_HOUR;
+    for (auto t = ToInt64(firstTime); t < ToInt64(lastTime); t += day) {
+        if (ReferenceBias(t) == ReferenceBias(t + day))
+            continue;
+        // Narrow the change down to the second
+        LONG64 low = t, high = t + day;
+        while (high - low > TICKS_PER_SECOND) {
+            auto middle = low + (high - low) / 2 / TICKS_PER_SECOND * TICKS_PER_SECOND;
+            (ReferenceBias(middle) == ReferenceBias(low) ? low : high) = middle;
+        }
+        for (auto offset = -2 * TICKS_PER_HOUR; offset <= 2 * TICKS_PER_HOUR; offset += TICKS_PER_HOUR / 6)
+            times.push_back(high + offset);
+        times.push_back(high - 1);
+        times.push_back(high - TICKS_PER_SECOND);
+        times.push_back(high + TICKS_PER_SECOND);
+    }
+    return times;
+}
+
+static int CheckZone(Zone &zone, const std::vector<LONG64> &times) {
+    int mismatches = 0;
+    setenv("TZ", zone.PosixRule, 1);
+    tzset();
+    Sim::SetTimeZone(zone.Info);
+
+    TimeConvertTable table;
+    if (!table.Build(&zone.Info, FIRST_YEAR, LAST_YEAR)) {
+        printf("MISMATCH %s: table build failed\n", zone.Name);
+        return 1;
+    }
+
+    auto standardBias = -zone.Info.Bias * 60 * TICKS_PER_SECOND;
+    auto daylightBias = -(zone.Info.Bias + zone.Info.DaylightBias) * 60 * TICKS_PER_SECOND;
+    std::vector<FILETIME> input, batch(times.size());
+    for (auto t : times)
+        input.push_back(ToFileTime(t));
+
+    for (auto direction : {TimeConvertUniversalToLocal, TimeConvertLocalToUniversal}) {
+        auto toLocal = direction == TimeConvertUniversalToLocal;
+        if (!table.Convert(input.data(), batch.data(), input.size(), direction)) {
+            printf("MISMATCH %s: batch conversion failed\n", zone.Name);
+            return 1;
+        }
+
+        for (size_t i = 0; i < times.size(); i++) {
+            auto expected =
+                toLocal ? ReferenceToLocal(times[i]) : ReferenceToUniversal(times[i], standardBias, daylightBias);
+            FILETIME single, current;
+            auto ok = TimeConvertFileTime(&input[i], &single, direction, &zone.Info) &&
+                TimeConvertFileTime(&input[i], &current, direction, nullptr);
+            // Biases are whole minutes, so truncating the input to the millisecond truncates the output
+            auto expectedSingle = expected - times[i] % TICKS_PER_MS;
+            if (!ok || ToInt64(single) != expectedSingle || ToInt64(current) != expectedSingle ||
+                ToInt64(batch[i]) != expected) {
+                if (mismatches++ < 10) {
+                    SYSTEMTIME at;
+                    FileTimeToSystemTime(&input[i], &at);
+                    printf(
+                        "MISMATCH %s %s %04u-%02u-%02u %02u:%02u:%02u: expected %lld, single %lld, "
+                        "current zone %lld, batch %lld\n",
+                        zone.Name,
+                        toLocal ? "to local" : "to universal",
+                        at.wYear,
+                        at.wMonth,
+                        at.wDay,
+                        at.wHour,
+                        at.wMinute,
+                        at.wSecond,
+                        expected,
+                        ToInt64(single),
+                        ToInt64(current),
+                        ToInt64(batch[i]));
+                }
+            }
+        }
+    }
+    printf(
+        "%-10s %zu times each way, %d-%d: %d mismatches\n",
+        zone.Name,
+        times.size(),
+        FIRST_YEAR,
+        LAST_YEAR,
+        mismatches);
+    return mismatches;
+}
+
+template <typename Convert>
+static double TimeConversions(size_t count, Convert &&convert) {
+    auto start = std::chrono::steady_clock::now();
+    convert();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(count);
+}
+
+static bool Benchmark(const Options &options, std::vector<Zone> &zones) {
+    std::mt19937_64 rng(options.Seed);
+    std::uniform_int_distribution<LONG64> random(BENCH_YEAR_START, BENCH_YEAR_START + 365 * 24 * TICKS_PER_HOUR);
+    std::vector<FILETIME> input, output(options.Count);
+    for (size_t i = 0; i < options.Count; i++)
+        input.push_back(ToFileTime(random(rng)));
+
+    printf("\n%zu conversions to local time, ns each; the simulated system calls are far cheaper than Windows's\n",
+           options.Count);
+    printf("%-10s %12s %12s\n", "zone", "single", "batch");
+    for (auto &zone : zones) {
+        auto single = TimeConversions(options.Count, [&] {
+            for (size_t i = 0; i < options.Count; i++)
+                TimeConvertFileTime(&input[i], &output[i], TimeConvertUniversalToLocal, &zone.Info);
+        });
+        // Including the table build
+        bool built = false;
+        auto batch = TimeConversions(options.Count, [&] {
+            TimeConvertTable table;
+            built = table.Build(&zone.Info, 2024, 2026) &&
+                table.Convert(input.data(), output.data(), options.Count, TimeConvertUniversalToLocal);
+        });
+        if (!built) {
+            printf("%s: batch conversion failed\n", zone.Name);
+            return false;
+        }
+        printf("%-10s %12.1f %12.1f\n", zone.Name, single, batch);
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    Options options;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--count") && i + 1 < argc)
+            options.Count = std::max<size_t>(1, std::strtoull(argv[++i], nullptr, 10));
+        else if (!strcmp(argv[i], "--seed") && i + 1 < argc)
+            options.Seed = std::strtoull(argv[++i], nullptr, 10);
+        else {
+            fprintf(stderr, "Usage: %s [--count N] [--seed N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    Sim::Configure(Sim::ClockMode::Virtual, options.Seed);
+    std::mt19937_64 rng(options.Seed);
+    auto zones = MakeZones();
+    int mismatches = 0;
+    for (auto &zone : zones) {
+        setenv("TZ", zone.PosixRule, 1);
+        tzset();
+        mismatches += CheckZone(zone, MakeCheckTimes(rng));
+    }
+    if (mismatches)
+        return 1;
+    return Benchmark(options, zones) ? 0 : 1;
+}
@@ -0,0 +1,207 @@
+// Replays a trace written by the provider's TraceFile option through MakeTimeSample and the sample filter, at full CPU
+// speed, and reports what the filter made of it. To evaluate a candidate filter, change SampleFilter and replay the
+// same traces: the jitter of the accepted offsets and the rejected count are the figures to compare. Jitter is taken
+// against a line fitted through the neighbouring accepted offsets, so that clock drift over the trace does not count.
+//
+// Usage: TraceReplay [--csv] [--repeat N] <trace>
+// --csv prints every record with its filter result. --repeat replays the trace N times, for timing short traces.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <windows.h>
+
+#include "Sim.hpp"
+#include "Globals.hpp"
+#include "SampleTrace.hpp"
+
+#define TICKS_PER_US 10
+#define MS_PER_HOUR 3600000.0
+// Accepted offsets either side of each one that the line its jitter is measured against is fitted through
+#define JITTER_NEIGHBOURS 8
+
+struct Options {
+    bool Csv = false;
+    unsigned long Repeat = 1;
+    const char *Path = nullptr;
+};
+
+struct AcceptedOffset {
+    ULONG64 TickCount;
+    int64_t Offset;
+};
+
+struct Totals {
+    uint64_t Records;
+    uint64_t OffsetChanged;
+    uint64_t Results[SampleFilterRejected + 1];
+    uint64_t Resumes;
+    uint64_t TimeJumps;
+    ULONG64 FirstTick;
+    ULONG64 LastTick;
+    // Offsets of accepted samples; a resume or time jump starts a new run
+    std::vector<std::vector<AcceptedOffset>> Accepted;
+    std::vector<int64_t> Delays;
+};
+
+static const char *ResultName(SampleFilterResult result) {
+    switch (result) {
+    case SampleFilterAccepted:
+        return "accepted";
+    case SampleFilterDownweighted:
+        return "downweighted";
+    default:
+        return "rejected";
+    }
+}
+
+static double Us(int64_t ticks) {
+    return static_cast<double>(ticks) / TICKS_PER_US;
+}
+
+// Value at a percentile; reorders values
+static int64_t Percentile(std::vector<int64_t> &values, size_t percentile) {
+    auto nth = values.begin() + (values.size() - 1) * percentile / 100;
+    std::nth_element(values.begin(), nth, values.end());
+    return *nth;
+}
+
+// Distance of each offset from the least squares line through its neighbours, leaving it out
+static std::vector<int64_t> Jitter(const std::vector<std::vector<AcceptedOffset>> &runs) {
+    std::vector<int64_t> jitter;
+    for (auto &run : runs) {
+        for (size_t i = 0; i < run.size(); i++) {
+            auto first = i > JITTER_NEIGHBOURS ? i - JITTER_NEIGHBOURS : 0;
+            auto last = std::min(run.size(), i + JITTER_NEIGHBOURS + 1);
+            if (last - first < 3)
+                continue;
+            // Relative to the offset itself, which keeps the sums small
+            double n = 0, sumX = 0, sumY = 0, sumXX = 0, sumXY = 0;
+            for (auto j = first; j < last; j++) {
+                if (j == i)
+                    continue;
+                auto x = static_cast<double>(static_cast<int64_t>(run[j].TickCount - run[i].TickCount));
+                auto y = static_cast<double>(run[j].Offset - run[i].Offset);
+                n++;
+                sumX += x;
+                sumY += y;
+                sumXX += x * x;
+                sumXY += x * y;
+            }
+            auto denominator = n * sumXX - sumX * sumX;
+            auto slope = denominator ? (n * sumXY - sumX * sumY) / denominator : 0;
+            auto fitted = (sumY - slope * sumX) / n;
+            jitter.push_back(std::llabs(std::llround(fitted)));
+        }
+    }
+    return jitter;
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    bool usage = false;
+
+    for (int i = 1; i < argc && !usage; i++) {
+        if (!strcmp(argv[i], "--csv"))
+            options.Csv = true;
+        else if (!strcmp(argv[i], "--repeat") && i + 1 < argc)
+            options.Repeat = std::max(1ul, strtoul(argv[++i], nullptr, 10));
+        else if (argv[i][0] != '-' && !options.Path)
+            options.Path = argv[i];
+        else
+            usage = true;
+    }
+    if (usage || !options.Path) {
+        fprintf(stderr, "Usage: %s [--csv] [--repeat N] <trace>\n", argv[0]);
+        return 2;
+    }
+
+    // The performance counter frequency that host step detection converts with comes from the simulation
+    Sim::Configure(Sim::ClockMode::Virtual);
+
+    if (options.Csv)
+        printf("tick_count,flags,offset_us,delay_us,dispersion_us,result\n");
+    Totals totals{};
+    SampleFilter filter;
+    HRESULT hr = S_OK;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long pass = 0; pass < options.Repeat && SUCCEEDED(hr); pass++) {
+        // Only the first pass is counted; the others are there to be timed
+        auto counted = !pass;
+        hr = ReplaySampleTrace(options.Path, filter, [&](const SampleInputs &inputs, const TimeSample *sample,
+                                                          SampleFilterResult result) {
+            if (!counted)
+                return;
+            if (!totals.Records++)
+                totals.FirstTick = inputs.TickCount;
+            totals.LastTick = inputs.TickCount;
+            totals.Resumes += !!(inputs.Flags & SampleTraceResumed);
+            totals.TimeJumps += !!(inputs.Flags & SampleTraceTimeJumped);
+            if (totals.Accepted.empty() || (inputs.Flags & (SampleTraceResumed | SampleTraceTimeJumped)))
+                totals.Accepted.emplace_back();
+            if (!sample) {
+                totals.OffsetChanged++;
+                if (options.Csv)
+                    printf("%" PRIu64 ",%lu,,,,offset-changed\n", inputs.TickCount, inputs.Flags);
+                return;
+            }
+            totals.Results[result]++;
+            totals.Delays.push_back(sample->toDelay);
+            if (result == SampleFilterAccepted)
+                totals.Accepted.back().push_back({inputs.TickCount, sample->toOffset});
+            if (options.Csv)
+                printf("%" PRIu64 ",%lu,%.1f,%.1f,%.1f,%s\n",
+                    inputs.TickCount,
+                    inputs.Flags,
+                    Us(sample->toOffset),
+                    Us(sample->toDelay),
+                    Us(static_cast<int64_t>(sample->tpDispersion)),
+                    ResultName(result));
+        });
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (FAILED(hr)) {
+        fprintf(stderr, "%s: replay failed: 0x%08x\n", options.Path, static_cast<unsigned>(hr));
+        return 1;
+    }
+
+    auto samples = totals.Records - totals.OffsetChanged;
+    fprintf(stderr,
+        "%" PRIu64 " records over %.1f hours, %" PRIu64 " resumes, %" PRIu64 " time jumps, %" PRIu64
+        " offset changes\n",
+        totals.Records,
+        static_cast<double>(totals.LastTick - totals.FirstTick) / MS_PER_HOUR,
+        totals.Resumes,
+        totals.TimeJumps,
+        totals.OffsetChanged);
+    fprintf(stderr,
+        "%" PRIu64 " samples: %" PRIu64 " accepted, %" PRIu64 " downweighted, %" PRIu64 " rejected\n",
+        samples,
+        totals.Results[SampleFilterAccepted],
+        totals.Results[SampleFilterDownweighted],
+        totals.Results[SampleFilterRejected]);
+    auto jitter = Jitter(totals.Accepted);
+    if (!jitter.empty()) {
+        auto median = Percentile(jitter, 50);
+        auto p99 = Percentile(jitter, 99);
+        fprintf(stderr,
+            "accepted offset jitter: median %.1f us, p99 %.1f us; median delay %.1f us\n",
+            Us(median),
+            Us(p99),
+            Us(Percentile(totals.Delays, 50)));
+    }
+    if (elapsed > 0)
+        fprintf(stderr,
+            "%.0f records/s over %lu passes, %.0f times real time\n",
+            static_cast<double>(totals.Records * options.Repeat) / elapsed,
+            options.Repeat,
+            static_cast<double>(totals.LastTick - totals.FirstTick) / 1000.0 * options.Repeat / elapsed);
+    return 0;
+}
@@ -0,0 +1,421 @@
+// Estimates what a sampling configuration costs xenstored across a fleet. For each configuration, the real provider is
+// first run on a virtual clock against one simulated guest to record the XenStore requests each sample makes and the
+// work between them. Many guests replaying those samples at their poll interval are then simulated against a single
+// xenstored that serves requests one at a time at a fixed cost, which gives the daemon's request rate and utilisation,
+// how long requests queue, and how much longer each guest's samples take as a result.
+//
+// Each guest has its own SamplingSchedule, fed the latency of its requests as the provider's is. With --time-changes,
+// every guest hears of the same host time change that many times over the run and takes a sample after the delay its
+// schedule gives, so the phase spread and the congestion backoff are exercised against the daemon's actual queueing.
+// The same time changes are also simulated with every guest sampling at once, for comparison.
+//
+// Usage: XenStoreLoadSim [--guests N[,N...]] [--poll-seconds N] [--store-cost-us N] [--simulated-seconds N]
+//                        [--time-changes N] [--seed N] [--config Name=Value[,Name=Value...]]...
+// Without --config, a set of representative configurations is compared.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <windows.h>
+#include <TimeProv.h>
+
+#include "Sim.hpp"
+#include "Globals.hpp"
+#include "SamplingSchedule.hpp"
+
+// Samples recorded per configuration, after the warm-up samples that look up paths and calibrate
+#define RECORD_WARMUP 8
+#define RECORD_SAMPLES 64
+#define SETTLE_QUIET std::chrono::milliseconds(1)
+
+struct Options {
+    std::vector<int> Guests = {100, 500, 2000};
+    int64_t Poll = TIME_S(64);
+    int64_t StoreCost = TIME_US(50);
+    int64_t Duration = TIME_S(3600LL);
+    int TimeChanges = 0;
+    uint64_t Seed = 1;
+    std::vector<std::string> Configs;
+};
+
+// One recorded sample: the work before each XenStore request, and after the last one
+struct SamplePattern {
+    std::vector<int64_t> Gaps;
+    int64_t Tail;
+};
+
+struct FleetResults {
+    ULONG64 Ops;
+    ULONG64 Samples;
+    int64_t Busy;
+    // When the last request finished, which an overloaded daemon pushes past the simulated duration
+    int64_t End;
+    std::vector<int64_t> QueueDelays;
+    // Sample duration beyond what it would have taken with xenstored to itself
+    std::vector<int64_t> SampleDelays;
+    ULONG64 TimeChangeSamples;
+    // Time changes heard while the guest's schedule was backing off
+    ULONG64 CongestedDelays;
+    // From hearing of a time change to the end of the sample taken for it
+    std::vector<int64_t> TimeChangeLatencies;
+};
+
+static HRESULT GetTimeSysInfo(TimeSysInfo info, void *value) {
+    switch (info) {
+    case TSI_CurrentTime:
+        *static_cast<unsigned __int64 *>(value) = static_cast<unsigned __int64>(Sim::GuestTime());
+        return S_OK;
+    case TSI_TickCount:
+        *static_cast<unsigned __int64 *>(value) = static_cast<unsigned __int64>(Sim::Now() / TIME_MS(1));
+        return S_OK;
+    case TSI_PhaseOffset:
+        *static_cast<signed __int64 *>(value) = 0;
+        return S_OK;
+    default:
+        return E_NOTIMPL;
+    }
+}
+
+static HRESULT LogTimeProvEvent(WORD type, WCHAR *provider, WCHAR *message) {
+    UNREFERENCED_PARAMETER(type);
+    UNREFERENCED_PARAMETER(provider);
+    UNREFERENCED_PARAMETER(message);
+    return S_OK;
+}
+
+static HRESULT AlertSamplesAvail() {
+    return S_OK;
+}
+
+static HRESULT SetProviderStatus(void *status) {
+    UNREFERENCED_PARAMETER(status);
+    return S_OK;
+}
+
+static TimeProvSysCallbacks g_callbacks = {
+    .dwSize = sizeof(TimeProvSysCallbacks),
+    .pfnGetTimeSysInfo = &GetTimeSysInfo,
+    .pfnLogTimeProvEvent = &LogTimeProvEvent,
+    .pfnAlertSamplesAvail = &AlertSamplesAvail,
+    .pfnSetProviderStatus = &SetProviderStatus,
+};
+
+// Runs due threadpool callbacks and waits for the worker thread to go quiet
+static void Settle() {
+    for (int quiet = 0; quiet < 2;) {
+        auto activity = Sim::Activity();
+        auto ran = Sim::Pump();
+        std::this_thread::sleep_for(SETTLE_QUIET);
+        quiet = !ran && Sim::Activity() == activity ? quiet + 1 : 0;
+    }
+}
+
+static std::vector<std::string> Split(const std::string &text, char separator) {
+    std::vector<std::string> items;
+    std::stringstream stream(text);
+    for (std::string item; std::getline(stream, item, separator);)
+        if (!item.empty())
+            items.push_back(item);
+    return items;
+}
+
+// Runs the provider alone with the given registry values and records the XenStore requests of each sample
+static bool RecordPatterns(const std::string &config, int64_t poll, std::vector<SamplePattern> &patterns) {
+    for (auto &assignment : Split(config, ',')) {
+        auto equals = assignment.find('=');
+        if (equals == std::string::npos)
+            return false;
+        auto name = assignment.substr(0, equals);
+        Sim::SetRegistryDword(
+            XenTimeProviderConfigKey,
+            std::wstring(name.begin(), name.end()),
+            static_cast<DWORD>(strtoul(assignment.c_str() + equals + 1, nullptr, 0)));
+    }
+
+    std::vector<Sim::StoreOp> ops;
+    Sim::SetStoreObserver([&](const Sim::StoreOp &op) { ops.push_back(op); });
+
+    std::wstring name(XenTimeProviderName);
+    TimeProvHandle provider;
+    if (FAILED(TimeProvOpen(name.data(), &g_callbacks, &provider)))
+        return false;
+    Settle();
+    for (int i = 0; i < RECORD_WARMUP + RECORD_SAMPLES; i++) {
+        TimeSample sample;
+        TpcGetSamplesArgs args = {.pbSampleBuf = reinterpret_cast<BYTE *>(&sample), .cbSampleBuf = sizeof(sample)};
+        ops.clear();
+        auto start = Sim::Now();
+        TimeProvCommand(provider, TPC_GetSamples, &args);
+        auto end = Sim::Now();
+        if (i >= RECORD_WARMUP) {
+            SamplePattern pattern{};
+            auto last = start;
+            for (auto &op : ops) {
+                pattern.Gaps.push_back(op.Arrival - last);
+                last = op.Finish;
+            }
+            pattern.Tail = end - last;
+            patterns.push_back(std::move(pattern));
+        }
+        Sim::Advance(poll);
+        Settle();
+    }
+    TimeProvCommand(provider, TPC_Shutdown, nullptr);
+    TimeProvClose(provider);
+    Sim::SetStoreObserver(nullptr);
+    Settle();
+
+    for (auto &assignment : Split(config, ',')) {
+        auto name = assignment.substr(0, assignment.find('='));
+        Sim::DeleteRegistryValue(XenTimeProviderConfigKey, std::wstring(name.begin(), name.end()));
+    }
+    return true;
+}
+
+// Guests poll at the same interval from random phases, each replaying recorded samples. xenstored serves requests in
+// arrival order, one at a time. A guest that hears of a time change takes a sample of its own, alongside its polls,
+// after the delay its schedule gives or at once if scheduled is false.
+static FleetResults SimulateFleet(
+    const std::vector<SamplePattern> &patterns,
+    int guests,
+    bool scheduled,
+    const Options &options,
+    std::mt19937_64 &random) {
+    enum EventKind {
+        PollSample,
+        TimeChangeSample,
+        TimeChangeHeard,
+    };
+    struct Sample {
+        // Null while no sample of this kind is running
+        const SamplePattern *Pattern;
+        int64_t Start;
+        size_t NextOp;
+    };
+    struct Guest {
+        Sample Samples[2];
+        // Set from hearing of a time change until the sample taken for it ends
+        bool TimeChangePending;
+        int64_t HeardAt;
+        SamplingSchedule Schedule;
+    };
+    // Time, guest and kind of the next request arrival, sample start or time change
+    using Event = std::tuple<int64_t, int, EventKind>;
+
+    FleetResults results{};
+    std::vector<Guest> state;
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+    std::uniform_int_distribution<int64_t> phase(0, options.Poll - 1);
+    std::uniform_int_distribution<size_t> pick(0, patterns.size() - 1);
+    int64_t serverFree = 0;
+
+    state.reserve(guests);
+    for (int guest = 0; guest < guests; guest++) {
+        state.push_back(Guest{
+            .Samples = {},
+            .TimeChangePending = false,
+            .HeardAt = 0,
+            .Schedule = SamplingSchedule(random()),
+        });
+        state.back().Schedule.SetIdentity("/local/domain/" + std::to_string(guest + 1) + "/rtc/timeoffset");
+        events.push({phase(random), guest, PollSample});
+    }
+    for (int change = 1; change <= options.TimeChanges; change++)
+        for (int guest = 0; guest < guests; guest++)
+            events.push({options.Duration * change / (options.TimeChanges + 1), guest, TimeChangeHeard});
+
+    auto finishSample = [&](int guest, EventKind kind, int64_t end, int64_t unloaded) {
+        auto &g = state[guest];
+        auto &sample = g.Samples[kind];
+        results.Samples++;
+        results.SampleDelays.push_back(end - sample.Start - unloaded);
+        sample.Pattern = nullptr;
+        if (kind == TimeChangeSample) {
+            results.TimeChangeSamples++;
+            results.TimeChangeLatencies.push_back(end - g.HeardAt);
+            g.TimeChangePending = false;
+        } else {
+            // W32Time waits for a sample before polling again
+            events.push({std::max(sample.Start + options.Poll, end), guest, PollSample});
+        }
+    };
+    auto startSample = [&](int guest, EventKind kind, int64_t at) {
+        auto &sample = state[guest].Samples[kind];
+        sample.Pattern = &patterns[pick(random)];
+        sample.Start = at;
+        sample.NextOp = 0;
+        if (sample.Pattern->Gaps.empty())
+            finishSample(guest, kind, at, 0);
+        else
+            events.push({at + sample.Pattern->Gaps[0], guest, kind});
+    };
+
+    while (!events.empty()) {
+        results.End = std::max(results.End, serverFree);
+        auto [at, guest, kind] = events.top();
+        events.pop();
+        auto &g = state[guest];
+
+        if (kind == TimeChangeHeard) {
+            // As in the provider, a change heard while a sample is already scheduled is covered by it
+            if (g.TimeChangePending)
+                continue;
+            g.TimeChangePending = true;
+            g.HeardAt = at;
+            if (g.Schedule.IsCongested())
+                results.CongestedDelays++;
+            auto delay = scheduled ? TIME_US(static_cast<int64_t>(g.Schedule.NextDelayUs())) : 0;
+            events.push({at + delay, guest, TimeChangeSample});
+            continue;
+        }
+
+        auto &sample = g.Samples[kind];
+        if (!sample.Pattern) {
+            if (kind == TimeChangeSample || at < options.Duration)
+                startSample(guest, kind, at);
+            continue;
+        }
+
+        auto start = std::max(at, serverFree);
+        auto finish = start + options.StoreCost;
+        serverFree = finish;
+        results.Ops++;
+        results.Busy += options.StoreCost;
+        results.QueueDelays.push_back(start - at);
+        g.Schedule.RecordStoreRead(static_cast<ULONG64>((finish - at) / TIME_US(1)));
+
+        auto &pattern = *sample.Pattern;
+        if (++sample.NextOp < pattern.Gaps.size()) {
+            events.push({finish + pattern.Gaps[sample.NextOp], guest, kind});
+            continue;
+        }
+        int64_t unloaded = pattern.Tail;
+        for (auto gap : pattern.Gaps)
+            unloaded += gap + options.StoreCost;
+        finishSample(guest, kind, finish + pattern.Tail, unloaded);
+    }
+    return results;
+}
+
+static void PrintPercentiles(const char *name, std::vector<int64_t> &values) {
+    std::sort(values.begin(), values.end());
+    printf("    %-14s", name);
+    if (values.empty()) {
+        printf(" none\n");
+        return;
+    }
+    for (auto percentile : {50.0, 90.0, 99.0, 99.9}) {
+        auto index = static_cast<size_t>(percentile / 100 * (values.size() - 1));
+        printf(" p%g %8.1f us", percentile, static_cast<double>(values[index]) / TIME_US(1));
+    }
+    printf("  max %8.1f us\n", static_cast<double>(values.back()) / TIME_US(1));
+}
+
+static bool ParseOptions(int argc, char **argv, Options &options) {
+    for (int i = 1; i < argc; i++) {
+        auto next = [&]() -> const char * { return i + 1 < argc ? argv[++i] : nullptr; };
+        const char *value;
+        if (!strcmp(argv[i], "--guests") && (value = next())) {
+            options.Guests.clear();
+            for (auto &item : Split(value, ','))
+                options.Guests.push_back(atoi(item.c_str()));
+        } else if (!strcmp(argv[i], "--poll-seconds") && (value = next())) {
+            options.Poll = TIME_S(atoll(value));
+        } else if (!strcmp(argv[i], "--store-cost-us") && (value = next())) {
+            options.StoreCost = TIME_US(atoll(value));
+        } else if (!strcmp(argv[i], "--simulated-seconds") && (value = next())) {
+            options.Duration = TIME_S(atoll(value));
+        } else if (!strcmp(argv[i], "--time-changes") && (value = next())) {
+            options.TimeChanges = atoi(value);
+        } else if (!strcmp(argv[i], "--seed") && (value = next())) {
+            options.Seed = strtoull(value, nullptr, 0);
+        } else if (!strcmp(argv[i], "--config") && (value = next())) {
+            options.Configs.push_back(value);
+        } else {
+            return false;
+        }
+    }
+    return options.Poll > 0 && options.StoreCost > 0 && options.Duration > 0 && options.TimeChanges >= 0 &&
+        std::all_of(options.Guests.begin(), options.Guests.end(), [](int guests) { return guests > 0; });
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        fprintf(stderr,
+            "Usage: %s [--guests N[,N...]] [--poll-seconds N] [--store-cost-us N] [--simulated-seconds N] "
+            "[--time-changes N] [--seed N] [--config Name=Value[,Name=Value...]]...\n",
+            argv[0]);
+        return 2;
+    }
+    if (options.Configs.empty())
+        options.Configs = {"", "PerCpuSampling=1", "CalibrateAsymmetry=1", "PerCpuSampling=1,BoostMeasurement=1"};
+
+    Sim::Configure(Sim::ClockMode::Virtual, options.Seed);
+    Sim::SetClockOwner();
+    Sim::HostConfig host;
+    host.StoreCost = options.StoreCost;
+    host.IoctlJitter = TIME_US(5);
+    Sim::ConfigureHost(host);
+    Sim::AddInterface();
+    std::mt19937_64 random(options.Seed);
+
+    printf("xenstored at %.1f us per request, guests polling every %.0f s, %.0f s simulated\n",
+        static_cast<double>(options.StoreCost) / TIME_US(1),
+        static_cast<double>(options.Poll) / TIME_S(1),
+        static_cast<double>(options.Duration) / TIME_S(1));
+    for (auto &config : options.Configs) {
+        std::vector<SamplePattern> patterns;
+        if (!RecordPatterns(config, options.Poll, patterns) || patterns.empty()) {
+            fprintf(stderr, "Could not record samples for \"%s\"\n", config.c_str());
+            return 1;
+        }
+        double ops = 0, duration = 0;
+        for (auto &pattern : patterns) {
+            ops += pattern.Gaps.size();
+            duration += pattern.Tail;
+            for (auto gap : pattern.Gaps)
+                duration += gap + options.StoreCost;
+        }
+        printf("\n%s: %.1f requests and %.1f us per sample unloaded\n",
+            config.empty() ? "default" : config.c_str(),
+            ops / patterns.size(),
+            duration / patterns.size() / TIME_US(1));
+
+        for (auto guests : options.Guests) {
+            for (auto scheduled : {true, false}) {
+                // Without time changes the schedule is never consulted
+                if (!scheduled && !options.TimeChanges)
+                    continue;
+                auto results = SimulateFleet(patterns, guests, scheduled, options, random);
+                auto span = std::max(options.Duration, results.End);
+                auto seconds = static_cast<double>(span) / TIME_S(1);
+                printf("  %d guests%s: %.1f requests/s, %.2f%% busy, %llu samples\n",
+                    guests,
+                    !options.TimeChanges ? "" : scheduled ? ", scheduled" : ", all at once",
+                    results.Ops / seconds,
+                    100.0 * static_cast<double>(results.Busy) / static_cast<double>(span),
+                    results.Samples);
+                PrintPercentiles("queueing", results.QueueDelays);
+                PrintPercentiles("sample delay", results.SampleDelays);
+                if (options.TimeChanges) {
+                    printf("    %llu time change samples, %llu heard while backing off\n",
+                        results.TimeChangeSamples,
+                        results.CongestedDelays);
+                    PrintPercentiles("time change", results.TimeChangeLatencies);
+                }
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,246 @@
+// Runs the provider on a virtual clock with time publishing enabled and checks what xentimeapi.h callers see: that
+// XenTimeGetTime tracks the simulated host clock within the uncertainty it reports, also between samples and with the
+// host clock drifting, that XenTimeGetSamples returns the newest samples first, and that subscriptions hear of time
+// offset changes and migrations but never run once XenTimeUnsubscribe has returned.
+//
+// Usage: XenTimeApiCheck
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+#include <windows.h>
+#include <TimeProv.h>
+
+#include "Sim.hpp"
+#include "Globals.hpp"
+#include "xentimeapi.h"
+
+#define CHECK(_condition)                                                                                              \
+    do {                                                                                                               \
+        g_checks++;                                                                                                    \
+        if (!(_condition)) {                                                                                           \
+            printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #_condition);                                             \
+            g_failures++;                                                                                              \
+        }                                                                                                              \
+    } while (0)
+
+#define POLL TIME_S(64)
+// Samples taken before the estimate is checked, enough for the published drift to be fitted
+#define WARMUP_SAMPLES 16
+// Rate error of the host clock against the performance counter, which the estimate has to extrapolate
+#define HOST_DRIFT_PPB 20000
+// Time without a sample over which the estimate is extrapolated
+#define IDLE TIME_S(300LL)
+#define SETTLE_QUIET std::chrono::milliseconds(1)
+// How long the callback that Unsubscribe has to wait for keeps running, and how long to wait for it to start
+#define SLOW_CALLBACK std::chrono::milliseconds(50)
+#define CALLBACK_START_TIMEOUT std::chrono::seconds(5)
+
+static int g_checks;
+static int g_failures;
+
+static HRESULT GetTimeSysInfo(TimeSysInfo info, void *value) {
+    switch (info) {
+    case TSI_CurrentTime:
+        *static_cast<unsigned __int64 *>(value) = static_cast<unsigned __int64>(Sim::GuestTime());
+        return S_OK;
+    case TSI_TickCount:
+        *static_cast<unsigned __int64 *>(value) = static_cast<unsigned __int64>(Sim::Now() / TIME_MS(1));
+        return S_OK;
+    case TSI_PhaseOffset:
+        *static_cast<signed __int64 *>(value) = 0;
+        return S_OK;
+    default:
+        return E_NOTIMPL;
+    }
+}
+
+static HRESULT LogTimeProvEvent(WORD type, WCHAR *provider, WCHAR *message) {
+    UNREFERENCED_PARAMETER(type);
+    UNREFERENCED_PARAMETER(provider);
+    UNREFERENCED_PARAMETER(message);
+    return S_OK;
+}
+
+static HRESULT AlertSamplesAvail() {
+    return S_OK;
+}
+
+static HRESULT SetProviderStatus(void *status) {
+    UNREFERENCED_PARAMETER(status);
+    return S_OK;
+}
+
+static TimeProvSysCallbacks g_callbacks = {
+    .dwSize = sizeof(TimeProvSysCallbacks),
+    .pfnGetTimeSysInfo = &GetTimeSysInfo,
+    .pfnLogTimeProvEvent = &LogTimeProvEvent,
+    .pfnAlertSamplesAvail = &AlertSamplesAvail,
+    .pfnSetProviderStatus = &SetProviderStatus,
+};
+
+// Runs due threadpool callbacks and waits for the worker thread to go quiet
+static void Settle() {
+    for (int quiet = 0; quiet < 2;) {
+        auto activity = Sim::Activity();
+        auto ran = Sim::Pump();
+        std::this_thread::sleep_for(SETTLE_QUIET);
+        quiet = !ran && Sim::Activity() == activity ? quiet + 1 : 0;
+    }
+}
+
+// Plays W32Time for one poll interval
+static void Poll(TimeProvHandle provider) {
+    TimeSample sample;
+    TpcGetSamplesArgs args = {.pbSampleBuf = reinterpret_cast<BYTE *>(&sample), .cbSampleBuf = sizeof(sample)};
+    TimeProvCommand(provider, TPC_GetSamples, &args);
+    Settle();
+    Sim::Advance(POLL);
+    Settle();
+}
+
+// Whether the estimate is within its uncertainty of the host clock, and based on a sample of the given age
+static bool EstimateHolds(int64_t age) {
+    XENTIME_ESTIMATE estimate;
+    if (FAILED(XenTimeGetTime(XENTIME_API_VERSION, &estimate)))
+        return false;
+    auto error = static_cast<int64_t>(estimate.Time) - Sim::HostUtc();
+    auto magnitude = static_cast<ULONG64>(error < 0 ? -error : error);
+    auto ageError = static_cast<int64_t>(estimate.Age) - age;
+    return magnitude <= estimate.Uncertainty && ageError >= 0 && ageError < POLL;
+}
+
+static void CheckGetTime(TimeProvHandle provider) {
+    XENTIME_ESTIMATE estimate;
+    CHECK(XenTimeGetTime(XENTIME_API_VERSION, &estimate) == HRESULT_FROM_WIN32(ERROR_NOT_READY));
+    CHECK(XenTimeGetTime(XENTIME_API_VERSION + 1, &estimate) == HRESULT_FROM_WIN32(ERROR_REVISION_MISMATCH));
+
+    for (int i = 0; i < WARMUP_SAMPLES; i++)
+        Poll(provider);
+    CHECK(EstimateHolds(POLL));
+
+    // Between samples the estimate is extrapolated along the published drift; without it the host clock would have
+    // run further from the estimate than its uncertainty allows
+    Sim::Advance(IDLE);
+    CHECK(EstimateHolds(POLL + IDLE));
+    Poll(provider);
+    CHECK(EstimateHolds(POLL));
+}
+
+static void CheckGetSamples() {
+    XENTIME_SAMPLE samples[XENTIME_MAX_SAMPLES + 4];
+    ULONG returned;
+
+    CHECK(SUCCEEDED(XenTimeGetSamples(XENTIME_API_VERSION, samples, ARRAYSIZE(samples), &returned)));
+    CHECK(returned == XENTIME_MAX_SAMPLES);
+    bool newestFirst = true;
+    for (ULONG i = 1; i < returned; i++)
+        newestFirst = newestFirst && samples[i].LocalTime < samples[i - 1].LocalTime;
+    CHECK(newestFirst);
+
+    XENTIME_SAMPLE newest[2];
+    CHECK(SUCCEEDED(XenTimeGetSamples(XENTIME_API_VERSION, newest, ARRAYSIZE(newest), &returned)));
+    CHECK(returned == 2 && newest[1].LocalTime == samples[1].LocalTime);
+    CHECK(SUCCEEDED(XenTimeGetSamples(XENTIME_API_VERSION, nullptr, 0, &returned)) && returned == 0);
+    CHECK(XenTimeGetSamples(XENTIME_API_VERSION, nullptr, 1, &returned) == E_POINTER);
+}
+
+struct Subscriber {
+    std::atomic<ULONG> Events = 0;
+    std::atomic<ULONG> Calls = 0;
+    std::atomic<bool> Running = false;
+    bool Slow = false;
+};
+
+static VOID CALLBACK OnEvents(_In_ ULONG events, _In_opt_ PVOID context) {
+    auto subscriber = static_cast<Subscriber *>(context);
+    subscriber->Running = true;
+    if (subscriber->Slow)
+        std::this_thread::sleep_for(SLOW_CALLBACK);
+    subscriber->Events |= events;
+    subscriber->Calls++;
+    subscriber->Running = false;
+}
+
+static void CheckSubscribe(TimeProvHandle provider) {
+    Subscriber subscriber;
+    XENTIME_SUBSCRIPTION subscription;
+    CHECK(XenTimeSubscribe(XENTIME_API_VERSION, 0, &OnEvents, &subscriber, &subscription) == E_INVALIDARG);
+    CHECK(SUCCEEDED(XenTimeSubscribe(
+        XENTIME_API_VERSION,
+        XenTimeEventResume | XenTimeEventOffsetChange,
+        &OnEvents,
+        &subscriber,
+        &subscription)));
+
+    // The provider notices the new offset at its next sample
+    Sim::SetTimeOffset(3600);
+    Poll(provider);
+    Poll(provider);
+    CHECK(subscriber.Events == XenTimeEventOffsetChange);
+
+    subscriber.Events = 0;
+    Sim::Migrate();
+    Settle();
+    CHECK(subscriber.Events & XenTimeEventResume);
+    CHECK(SUCCEEDED(XenTimeUnsubscribe(subscription)));
+
+    // A callback still running when Unsubscribe is called is waited for, and none runs afterwards. Callbacks run on
+    // another thread here so that one can be caught mid-call.
+    Subscriber slow;
+    slow.Slow = true;
+    CHECK(SUCCEEDED(XenTimeSubscribe(XENTIME_API_VERSION, XenTimeEventResume, &OnEvents, &slow, &subscription)));
+    std::atomic<bool> stop = false;
+    std::thread pool([&] {
+        while (!stop) {
+            Sim::Pump();
+            std::this_thread::sleep_for(SETTLE_QUIET);
+        }
+    });
+    Sim::Migrate();
+    auto deadline = std::chrono::steady_clock::now() + CALLBACK_START_TIMEOUT;
+    while (!slow.Running && !slow.Calls && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::yield();
+    CHECK(SUCCEEDED(XenTimeUnsubscribe(subscription)));
+    CHECK(!slow.Running && slow.Calls == 1);
+
+    Sim::Migrate();
+    std::this_thread::sleep_for(SLOW_CALLBACK * 2);
+    stop = true;
+    pool.join();
+    Settle();
+    CHECK(slow.Calls == 1);
+}
+
+int main() {
+    Sim::Configure(Sim::ClockMode::Virtual);
+    Sim::SetClockOwner();
+    Sim::HostConfig host;
+    host.HostDriftPpb = HOST_DRIFT_PPB;
+    Sim::ConfigureHost(host);
+    Sim::AddInterface();
+    Sim::SetRegistryDword(XenTimeProviderConfigKey, L"PublishTime", 1);
+
+    std::wstring name(XenTimeProviderName);
+    TimeProvHandle provider;
+    if (FAILED(TimeProvOpen(name.data(), &g_callbacks, &provider))) {
+        printf("Could not open the provider\n");
+        return 1;
+    }
+    Settle();
+
+    CheckGetTime(provider);
+    CheckGetSamples();
+    CheckSubscribe(provider);
+
+    TimeProvCommand(provider, TPC_Shutdown, nullptr);
+    TimeProvClose(provider);
+    Settle();
+    auto defects = Sim::GetDefects();
+    CHECK(defects.CallbackExceptions == 0 && defects.SelfWaits == 0);
+
+    printf("%d checks, %d failed\n", g_checks, g_failures);
+    return g_failures ? 1 : 0;
+}
@@ -0,0 +1,99 @@
+/*! \file xentimeapi.h
+    \brief In-process interface to the Xen time published by the Xen time provider
+
+    The provider running in the W32Time service publishes its latest samples to shared memory. These functions read
+    that state directly, without any device I/O or system clock reads, and can be called from any process that loads
+    xentimeprovider.dll.
+*/
+
+#ifndef _XENTIMEAPI_H_
+#define _XENTIMEAPI_H_
+
+#include <windows.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \brief Interface version implemented by this header; pass it as the Version argument */
+#define XENTIME_API_VERSION 1
+
+/*! \brief Maximum number of samples returned by XenTimeGetSamples */
+#define XENTIME_MAX_SAMPLES 16
+
+/*! \brief Current estimate of Xen time */
+typedef struct _XENTIME_ESTIMATE {
+    ULONG64 Time;        /*!< Xen time, in 100ns units since 1601-01-01 UTC */
+    ULONG64 Uncertainty; /*!< Bound on the error of Time, in 100ns units */
+    ULONG64 Age;         /*!< Time since the sample the estimate is based on, in 100ns units */
+} XENTIME_ESTIMATE, *PXENTIME_ESTIMATE;
+
+/*! \brief One sample taken by the provider */
+typedef struct _XENTIME_SAMPLE {
+    ULONG64 LocalTime;   /*!< System time the sample refers to, in 100ns units since 1601-01-01 UTC */
+    ULONG64 PerfCounter; /*!< QueryPerformanceCounter value at LocalTime */
+    LONG64 Offset;       /*!< Xen time minus LocalTime, in 100ns units */
+    ULONG64 Delay;       /*!< Round-trip delay of the measurement, in 100ns units */
+    ULONG64 Dispersion;  /*!< Dispersion reported by the provider, in 100ns units */
+} XENTIME_SAMPLE, *PXENTIME_SAMPLE;
+
+/*! \brief Notifications that can be subscribed to */
+typedef enum _XENTIME_EVENT {
+    XenTimeEventResume = 1,       /*!< The VM resumed from suspend or migration */
+    XenTimeEventOffsetChange = 2, /*!< The host changed the VM's time offset */
+} XENTIME_EVENT;
+
+/*! \brief Subscription callback
+    \param Events Bitmask of XENTIME_EVENT values that occurred since the previous call
+    \param Context Context passed to XenTimeSubscribe
+
+    Called on a thread pool thread. Bursts of notifications may be merged into one call.
+*/
+typedef VOID(CALLBACK *PXENTIME_CALLBACK)(_In_ ULONG Events, _In_opt_ PVOID Context);
+
+/*! \brief Opaque subscription handle */
+typedef struct _XENTIME_SUBSCRIPTION *XENTIME_SUBSCRIPTION;
+
+/*! \brief Get the current best estimate of Xen time
+    \param Version XENTIME_API_VERSION
+    \param Estimate Receives the estimate
+    \return HRESULT_FROM_WIN32(ERROR_NOT_READY) if the provider has not published a sample yet
+*/
+HRESULT WINAPI XenTimeGetTime(_In_ ULONG Version, _Out_ PXENTIME_ESTIMATE Estimate);
+
+/*! \brief Get the provider's latest samples, newest first
+    \param Version XENTIME_API_VERSION
+    \param Samples Buffer receiving up to Count samples
+    \param Count Number of entries in Samples
+    \param Returned Receives the number of samples written
+*/
+HRESULT WINAPI XenTimeGetSamples(
+    _In_ ULONG Version,
+    _Out_writes_to_(Count, *Returned) PXENTIME_SAMPLE Samples,
+    _In_ ULONG Count,
+    _Out_ PULONG Returned);
+
+/*! \brief Subscribe to provider notifications
+    \param Version XENTIME_API_VERSION
+    \param Events Bitmask of XENTIME_EVENT values to be notified of
+    \param Callback Called when any of Events occurs
+    \param Context Passed to Callback
+    \param Subscription Receives a handle to pass to XenTimeUnsubscribe
+*/
+HRESULT WINAPI XenTimeSubscribe(
+    _In_ ULONG Version,
+    _In_ ULONG Events,
+    _In_ PXENTIME_CALLBACK Callback,
+    _In_opt_ PVOID Context,
+    _Out_ XENTIME_SUBSCRIPTION *Subscription);
+
+/*! \brief End a subscription; waits for a running callback to return
+    \param Subscription Handle returned by XenTimeSubscribe
+*/
+HRESULT WINAPI XenTimeUnsubscribe(_In_ XENTIME_SUBSCRIPTION Subscription);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _XENTIMEAPI_H_ */